@@ -74,4 +74,19 @@ unless have_library 'git2' and have_header 'git2.h'
   abort "ERROR: Failed to build libgit2"
 end
 
+# Ruby 2.0+ lets us drop the GVL around long-running libgit2 calls
+have_header('ruby/thread.h') and have_func('rb_thread_call_without_gvl', 'ruby/thread.h')
+
+# Index#each_entry yields deduplicated, frozen path strings where possible
+have_func('rb_enc_interned_str', 'ruby/encoding.h')
+
+# Commit-graph files are memory-mapped where possible
+have_header('sys/mman.h')
+
+# Diff#each_patch can generate patches on a pool of native threads
+have_header('pthread.h')
+
+# Rugged::FileMonitor::Inotify watches working directories on Linux
+have_header('sys/inotify.h')
+
 create_makefile("rugged/rugged")
@@ -23,6 +23,7 @@
  */
 
 #include "rugged.h"
+#include <ctype.h>
 
 const char *RUGGED_ERROR_NAMES[] = {
 	"None",            /* GITERR_NONE */
@@ -57,6 +58,10 @@ const char *RUGGED_ERROR_NAMES[] = {
 VALUE rb_mRugged;
 VALUE rb_eRuggedError;
 VALUE rb_eRuggedErrors[RUGGED_ERROR_COUNT];
+VALUE rb_cRuggedOid;
+
+/* an empty Rugged::Oid, for rb_str_new_with_class */
+static VALUE rugged_raw_oid_proto;
 
 static VALUE rb_mShutdownHook;
 
@@ -114,7 +119,7 @@ static VALUE rb_git_features(VALUE self)
  *    Rugged.hex_to_raw(oid) -> raw_buffer
  *
  *  Turn a string of 40 hexadecimal characters into the buffer of
- *  20 bytes it represents.
+ *  20 bytes it represents, as a Rugged::Oid.
  *
  *    Rugged.hex_to_raw('d8786bfc97485e8d7b19b21fb88c8ef1f199fc3f')
  *    #=> "\330xk\374\227H^\215{\031\262\037\270\214\216\361\361\231\374?"
@@ -126,7 +131,7 @@ static VALUE rb_git_hex_to_raw(VALUE self, VALUE hex)
 	Check_Type(hex, T_STRING);
 	rugged_exception_check(git_oid_fromstr(&oid, StringValueCStr(hex)));
 
-	return rb_str_new((const char *)oid.id, 20);
+	return rugged_create_raw_oid(&oid);
 }
 
 /*
@@ -155,6 +160,70 @@ static VALUE rb_git_raw_to_hex(VALUE self, VALUE raw)
 	return rb_str_new(out, 40);
 }
 
+/*
+ * A raw OID is a Rugged::Oid: a frozen, 20-byte binary String subclass.
+ * Plain Strings are never taken as raw OIDs, whatever their length or
+ * encoding, so a raw OID is never confused with a revspec.
+ */
+int rugged_oid_is_raw(VALUE rb_oid)
+{
+	return rb_obj_is_kind_of(rb_oid, rb_cRuggedOid) &&
+		RSTRING_LEN(rb_oid) == GIT_OID_RAWSZ;
+}
+
+VALUE rugged_create_raw_oid(const git_oid *oid)
+{
+	VALUE rb_oid = rb_str_new_with_class(rugged_raw_oid_proto, (const char *)oid->id, GIT_OID_RAWSZ);
+	OBJ_FREEZE(rb_oid);
+	return rb_oid;
+}
+
+int rugged_oid_fromstr(git_oid *oid, VALUE rb_oid)
+{
+	if (rugged_oid_is_raw(rb_oid)) {
+		git_oid_fromraw(oid, (const unsigned char *)RSTRING_PTR(rb_oid));
+		return GIT_OK;
+	}
+
+	return git_oid_fromstr(oid, StringValueCStr(rb_oid));
+}
+
+int rugged_oid_fromstrn(git_oid *oid, size_t *len, VALUE rb_oid)
+{
+	if (rugged_oid_is_raw(rb_oid)) {
+		git_oid_fromraw(oid, (const unsigned char *)RSTRING_PTR(rb_oid));
+		*len = GIT_OID_HEXSZ;
+		return GIT_OK;
+	}
+
+	*len = RSTRING_LEN(rb_oid);
+	return git_oid_fromstrn(oid, RSTRING_PTR(rb_oid), *len);
+}
+
+/*
+ * Parses the +:oid_format+ option shared by the iterators that yield OIDs.
+ * Returns non-zero when raw 20-byte OIDs were requested.
+ */
+int rugged_parse_oid_format(VALUE rb_options)
+{
+	VALUE rb_format;
+
+	if (NIL_P(rb_options))
+		return 0;
+
+	Check_Type(rb_options, T_HASH);
+	rb_format = rb_hash_aref(rb_options, CSTR2SYM("oid_format"));
+
+	if (NIL_P(rb_format) || rb_format == CSTR2SYM("hex"))
+		return 0;
+
+	if (rb_format == CSTR2SYM("raw"))
+		return 1;
+
+	rb_raise(rb_eArgError, "Invalid OID format; expected :hex or :raw");
+	return 0; /* never reached */
+}
+
 /*
  *  call-seq:
  *    Rugged.prettify_message(message, strip_comments = '#') -> clean_message
@@ -342,6 +411,106 @@ VALUE rugged__block_yield_splat(VALUE args) {
 	}
 }
 
+#if defined(_MSC_VER)
+#  define RUGGED_THREAD_LOCAL __declspec(thread)
+#else
+#  define RUGGED_THREAD_LOCAL __thread
+#endif
+
+/*
+ * Whether long-running calls should give up the GVL; toggled through
+ * `Rugged::Settings['release_gvl']`.
+ */
+int rugged_release_gvl = 0;
+
+/* Set while the current thread runs libgit2 code without the GVL */
+static RUGGED_THREAD_LOCAL int rugged_gvl_released = 0;
+
+void *rugged_without_gvl(void *(*func)(void *), void *data)
+{
+#ifdef HAVE_RB_THREAD_CALL_WITHOUT_GVL
+	if (rugged_release_gvl && !rugged_gvl_released) {
+		void *result;
+
+		rugged_gvl_released = 1;
+		result = rb_thread_call_without_gvl(func, data, NULL, NULL);
+		rugged_gvl_released = 0;
+
+		return result;
+	}
+#endif
+	return func(data);
+}
+
+struct rugged_io_call {
+	void *(*func)(void *);
+	void *data;
+	int ran;
+};
+
+static void *rugged__io_call(void *data)
+{
+	struct rugged_io_call *call = data;
+
+	call->ran = 1;
+	return call->func(call->data);
+}
+
+static VALUE rugged__check_ints(VALUE unused)
+{
+	rb_thread_check_ints();
+	return Qnil;
+}
+
+int rugged_without_gvl_ubf(void *(*func)(void *), void *data,
+	rb_unblock_function_t *ubf, void *ubf_data, int always)
+{
+#ifdef HAVE_RB_THREAD_CALL_WITHOUT_GVL
+	if ((always || rugged_release_gvl) && !rugged_gvl_released) {
+		struct rugged_io_call call;
+		int state = 0;
+
+		call.func = func;
+		call.data = data;
+		call.ran = 0;
+
+		/* The call is skipped when an interrupt is already pending */
+		do {
+			rugged_gvl_released = 1;
+			rb_thread_call_without_gvl2(rugged__io_call, &call, ubf, ubf_data);
+			rugged_gvl_released = 0;
+
+			rb_protect(rugged__check_ints, Qnil, &state);
+		} while (!call.ran && !state);
+
+		return state;
+	}
+#endif
+	func(data);
+	return 0;
+}
+
+int rugged_without_gvl_io(void *(*func)(void *), void *data, int always)
+{
+	return rugged_without_gvl_ubf(func, data, RUBY_UBF_IO, NULL, always);
+}
+
+void *rugged_with_gvl(void *(*func)(void *), void *data)
+{
+#ifdef HAVE_RB_THREAD_CALL_WITHOUT_GVL
+	if (rugged_gvl_released) {
+		void *result;
+
+		rugged_gvl_released = 0;
+		result = rb_thread_call_with_gvl(func, data);
+		rugged_gvl_released = 1;
+
+		return result;
+	}
+#endif
+	return func(data);
+}
+
 /*
  *  call-seq:
  *    Rugged.__cache_usage__ -> [current, max]
@@ -419,6 +588,16 @@ void Init_rugged(void)
 		}
 	}
 
+	/*
+	 * Document-class: Rugged::Oid
+	 *
+	 * A raw, 20-byte SHA1 OID. Accepted wherever an OID is, and yielded by
+	 * the iterators that take <tt>:oid_format => :raw</tt>.
+	 */
+	rb_cRuggedOid = rb_define_class_under(rb_mRugged, "Oid", rb_cString);
+	rugged_raw_oid_proto = rb_class_new_instance(0, NULL, rb_cRuggedOid);
+	rb_gc_register_mark_object(rugged_raw_oid_proto);
+
 	rb_define_module_function(rb_mRugged, "libgit2_version", rb_git_libgit2_version, 0);
 	rb_define_module_function(rb_mRugged, "features", rb_git_features, 0);
 	rb_define_module_function(rb_mRugged, "hex_to_raw", rb_git_hex_to_raw, 1);
@@ -454,8 +633,15 @@ void Init_rugged(void)
 	Init_rugged_diff_delta();
 	Init_rugged_diff_hunk();
 	Init_rugged_diff_line();
+	Init_rugged_diff_cache();
+	Init_rugged_diff_similarity();
+	Init_rugged_signature_index();
 	Init_rugged_blame();
 	Init_rugged_cred();
+	Init_rugged_commit_graph();
+	Init_rugged_status();
+	Init_rugged_file_monitor();
+	Init_rugged_untracked_cache();
 
 	/*
 	 * Sort the repository contents in no particular ordering;
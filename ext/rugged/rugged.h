@@ -37,6 +37,10 @@
 #include <ruby/encoding.h>
 #endif
 
+#ifdef HAVE_RUBY_THREAD_H
+#include <ruby/thread.h>
+#endif
+
 #include <assert.h>
 #include <git2.h>
 #include <git2/odb_backend.h>
@@ -72,16 +76,25 @@ void Init_rugged_patch(void);
 void Init_rugged_diff_delta(void);
 void Init_rugged_diff_hunk(void);
 void Init_rugged_diff_line(void);
+void Init_rugged_diff_cache(void);
+void Init_rugged_diff_similarity(void);
+void Init_rugged_signature_index(void);
 void Init_rugged_blame(void);
 void Init_rugged_cred(void);
+void Init_rugged_commit_graph(void);
+void Init_rugged_status(void);
+void Init_rugged_file_monitor(void);
+void Init_rugged_untracked_cache(void);
 
 VALUE rb_git_object_init(git_otype type, int argc, VALUE *argv, VALUE self);
 
 VALUE rugged_raw_read(git_repository *repo, const git_oid *oid);
 
 VALUE rugged_signature_new(const git_signature *sig, const char *encoding_name);
+VALUE rugged_signature_new_enc(const git_signature *sig, rb_encoding *encoding);
 
 VALUE rugged_repo_new(VALUE klass, git_repository *repo);
+int rugged_repository_reopen(git_repository **out, git_repository *repo);
 VALUE rugged_index_new(VALUE klass, VALUE owner, git_index *index);
 VALUE rugged_config_new(VALUE klass, VALUE owner, git_config *cfg);
 VALUE rugged_object_new(VALUE owner, git_object *object);
@@ -90,12 +103,109 @@ VALUE rugged_ref_new(VALUE klass, VALUE owner, git_reference *ref);
 VALUE rugged_diff_new(VALUE klass, VALUE owner, git_diff *diff);
 VALUE rugged_patch_new(VALUE owner, git_patch *patch);
 VALUE rugged_diff_delta_new(VALUE owner, const git_diff_delta *delta);
-VALUE rugged_diff_hunk_new(VALUE owner, size_t hunk_idx, const git_diff_hunk *hunk, size_t lines_in_hunk);
+VALUE rugged_diff_hunk_new(VALUE owner, size_t hunk_idx, size_t lines_in_hunk);
 VALUE rugged_diff_line_new(const git_diff_line *line);
+VALUE rugged_diff_line_table_new(git_patch *patch, size_t hunk_start, size_t hunk_end);
 VALUE rugged_remote_new(VALUE owner, git_remote *remote);
 VALUE rb_git_delta_file_fromC(const git_diff_file *file);
 
 void rugged_parse_diff_options(git_diff_options *opts, VALUE rb_options);
+
+struct rugged_diff_budget {
+	size_t max_files;
+	size_t max_total_lines;
+	size_t timeout_ms;
+	uint64_t deadline;
+	size_t files;
+	int truncated;
+
+	/* copies of the deltas left out of the diff, paths included */
+	git_diff_delta *skipped;
+	size_t skipped_count, skipped_alloc;
+};
+
+void rugged_parse_diff_budget(struct rugged_diff_budget *budget, git_diff_options *opts, VALUE rb_options);
+void rugged_diff_set_budget(VALUE rb_diff, struct rugged_diff_budget *budget);
+void rugged_diff_budget_free(struct rugged_diff_budget *budget);
+void rugged_diff_set_options(VALUE rb_diff, VALUE rb_options);
+
+/*
+ * File monitors (see rugged_file_monitor.c): `rugged_file_monitor_changes`
+ * returns the paths changed since `rb_consumer` last synced, or Qnil when
+ * the consumer must scan everything. Changes inside the repository
+ * directory only force a full scan with RUGGED_FILE_MONITOR_GITDIR.
+ *
+ * libgit2 bounds a scan only by the common prefix of its pathspec, so
+ * consumers scan each path of `rugged_file_monitor_outermost` (the sorted
+ * paths, without those below another one) on its own.
+ */
+#define RUGGED_FILE_MONITOR_GITDIR (1 << 0)
+
+VALUE rugged_file_monitor_get(VALUE rb_owner);
+VALUE rugged_file_monitor_changes(VALUE rb_monitor, VALUE rb_consumer, int flags, VALUE *rb_token);
+void rugged_file_monitor_sync(VALUE rb_consumer, VALUE rb_monitor, VALUE rb_token);
+VALUE rugged_file_monitor_outermost(VALUE rb_paths);
+
+/*
+ * Untracked cache (see rugged_untracked_cache.c): `rugged_untracked_cache_scan`
+ * lists the untracked and ignored paths of the working directory into
+ * `list`, and may run without the GVL between acquire and release.
+ */
+struct rugged_untracked_cache;
+
+struct rugged_untracked_list {
+	char *paths;
+	size_t paths_len, paths_alloc;
+	size_t *offsets;
+	unsigned int *flags;
+	size_t count, alloc;
+};
+
+struct rugged_untracked_cache *rugged_untracked_cache_acquire(VALUE rb_repo, git_repository *repo);
+void rugged_untracked_cache_release(struct rugged_untracked_cache *cache);
+int rugged_untracked_cache_scan(struct rugged_untracked_list *list, struct rugged_untracked_cache *cache, git_repository *repo);
+void rugged_untracked_cache_write(VALUE rb_repo);
+void rugged_untracked_list_free(struct rugged_untracked_list *list);
+
+#define RUGGED_SIMILARITY_BINS 64
+
+enum {
+	RUGGED_SIMILARITY_SMART_WHITESPACE = 0,
+	RUGGED_SIMILARITY_IGNORE_WHITESPACE = 1,
+	RUGGED_SIMILARITY_EXACT_WHITESPACE = 2
+};
+
+struct rugged_similarity_sig {
+	uint32_t bins[RUGGED_SIMILARITY_BINS];
+};
+
+size_t rugged_similarity_sig_init(struct rugged_similarity_sig *sig, const char *buf, size_t len, int mode);
+int rugged_similarity_sig_compare(const struct rugged_similarity_sig *a, const struct rugged_similarity_sig *b);
+
+struct rugged_signature_cache;
+
+struct rugged_similarity_metric {
+	git_diff_similarity_metric metric;
+	struct rugged_signature_cache *cache;
+	int mode;
+	int rows;
+};
+
+void rugged_similarity_metric_init(struct rugged_similarity_metric *metric, VALUE rb_cache, const git_diff_find_options *opts);
+void rugged_similarity_metric_done(struct rugged_similarity_metric *metric);
+
+struct rugged_diff_numstat {
+	size_t adds, dels;
+	int binary;
+	size_t counted;
+};
+
+int rugged_diff_numstat(
+	struct rugged_diff_numstat *numstats,
+	struct rugged_diff_numstat *total,
+	git_diff *diff,
+	git_repository *repo,
+	git_off_t max_size);
 void rugged_parse_merge_options(git_merge_options *opts, VALUE rb_options);
 
 void rugged_cred_extract(git_cred **cred, int allowed_types, VALUE rb_credential);
@@ -107,6 +217,11 @@ git_signature *rugged_signature_get(VALUE rb_person, git_repository *repo);
 git_object *rugged_object_get(git_repository *repo, VALUE object_value, git_otype type);
 int rugged_oid_get(git_oid *oid, git_repository *repo, VALUE p);
 
+int rugged_oid_is_raw(VALUE rb_oid);
+int rugged_oid_fromstr(git_oid *oid, VALUE rb_oid);
+int rugged_oid_fromstrn(git_oid *oid, size_t *len, VALUE rb_oid);
+int rugged_parse_oid_format(VALUE rb_options);
+
 void rugged_rb_ary_to_strarray(VALUE rb_array, git_strarray *str_array);
 VALUE rugged_strarray_to_rb_ary(git_strarray *str_array);
 
@@ -138,6 +253,35 @@ static inline int rugged_parse_bool(VALUE boolean)
 
 extern VALUE rb_cRuggedRepo;
 
+/*
+ * GVL handling: long-running libgit2 calls are run through
+ * `rugged_without_gvl`; any callback that may fire from inside such a
+ * call must touch the Ruby VM only from inside `rugged_with_gvl`.
+ * Neither `func` may raise.
+ */
+extern int rugged_release_gvl;
+
+void *rugged_without_gvl(void *(*func)(void *), void *data);
+void *rugged_with_gvl(void *(*func)(void *), void *data);
+
+/*
+ * For calls that block on I/O (network transfers, writes to pipes and
+ * sockets): the GVL is released with an unblocking function, so that
+ * Thread#kill, Timeout and signals interrupt the blocking system call.
+ * With `always`, the GVL is released even if `release_gvl` is off.
+ * Returns the state of the exception raised by a pending interrupt, if
+ * any; the caller must then release its resources and `rb_jump_tag` it.
+ */
+int rugged_without_gvl_io(void *(*func)(void *), void *data, int always);
+
+/*
+ * Like `rugged_without_gvl_io`, for calls that wait on something other
+ * than a file descriptor: `ubf` is called with `ubf_data` to make `func`
+ * return early when the thread is interrupted.
+ */
+int rugged_without_gvl_ubf(void *(*func)(void *), void *data,
+	rb_unblock_function_t *ubf, void *ubf_data, int always);
+
 VALUE rugged__block_yield_splat(VALUE args);
 
 struct rugged_cb_payload
@@ -174,4 +318,35 @@ static inline VALUE rugged_create_oid(const git_oid *oid)
 	return rb_str_new(out, 40);
 }
 
+VALUE rugged_create_raw_oid(const git_oid *oid);
+
+/*
+ * Commit-graph files let the ancestry queries run on a compact, mapped
+ * index instead of parsing commits from the ODB. The queries below take
+ * graph positions, may run without the GVL and only ever allocate
+ * with malloc().
+ */
+typedef struct rugged_commit_graph rugged_commit_graph;
+
+VALUE rugged_commit_graph_open(VALUE owner, const char *path);
+rugged_commit_graph *rugged_commit_graph_get(VALUE rb_graph);
+
+int rugged_commit_graph_lookup(uint32_t *pos, const rugged_commit_graph *graph, const git_oid *oid);
+void rugged_commit_graph_oid(git_oid *out, const rugged_commit_graph *graph, uint32_t pos);
+int rugged_commit_graph_ahead_behind(size_t *ahead, size_t *behind, const rugged_commit_graph *graph, uint32_t local, uint32_t upstream);
+int rugged_commit_graph_ahead_behind_many(size_t *ahead, size_t *behind, const rugged_commit_graph *graph, uint32_t base, const uint32_t *targets, size_t count);
+int rugged_commit_graph_merge_bases(git_oid **bases, size_t *count, const rugged_commit_graph *graph, uint32_t one, uint32_t two);
+int rugged_commit_graph_descendant_of(const rugged_commit_graph *graph, uint32_t commit, uint32_t ancestor);
+
+/*
+ * The shared walk of rugged_commit_graph_ahead_behind_many, over commits
+ * read from the object database in date order instead.
+ */
+int rugged_commit_walk_ahead_behind_many(size_t *ahead, size_t *behind, git_repository *repo, const git_oid *base, const git_oid *targets, size_t count);
+
+static inline VALUE rugged_create_oid_as(const git_oid *oid, int raw)
+{
+	return raw ? rugged_create_raw_oid(oid) : rugged_create_oid(oid);
+}
+
 #endif
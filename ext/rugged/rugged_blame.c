@@ -99,6 +99,21 @@ static void rugged_parse_blame_options(git_blame_options *opts, git_repository *
 	}
 }
 
+struct rugged_blame_file_args {
+	git_blame *blame;
+	git_repository *repo;
+	const char *path;
+	git_blame_options *opts;
+	int error;
+};
+
+static void *rugged__blame_file_nogvl(void *data)
+{
+	struct rugged_blame_file_args *args = data;
+	args->error = git_blame_file(&args->blame, args->repo, args->path, args->opts);
+	return NULL;
+}
+
 /*
  *  call-seq:
  *    Blame.new(repo, path, options = {}) -> blame
@@ -146,8 +161,8 @@ static VALUE rb_git_blame_new(int argc, VALUE *argv, VALUE klass)
 {
 	VALUE rb_repo, rb_path, rb_options;
 	git_repository *repo;
-	git_blame *blame;
 	git_blame_options opts = GIT_BLAME_OPTIONS_INIT;
+	struct rugged_blame_file_args args;
 
 	rb_scan_args(argc, argv, "20:", &rb_repo, &rb_path, &rb_options);
 
@@ -158,11 +173,14 @@ static VALUE rb_git_blame_new(int argc, VALUE *argv, VALUE klass)
 
 	rugged_parse_blame_options(&opts, repo, rb_options);
 
-	rugged_exception_check(git_blame_file(
-		&blame, repo, StringValueCStr(rb_path), &opts
-	));
+	args.repo = repo;
+	args.path = StringValueCStr(rb_path);
+	args.opts = &opts;
+
+	rugged_without_gvl(rugged__blame_file_nogvl, &args);
+	rugged_exception_check(args.error);
 
-	return Data_Wrap_Struct(klass, NULL, &git_blame_free, blame);
+	return Data_Wrap_Struct(klass, NULL, &git_blame_free, args.blame);
 }
 
 /*
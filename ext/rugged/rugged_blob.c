@@ -23,13 +23,22 @@
  */
 
 #include "rugged.h"
-#include <ctype.h>
+#include <errno.h>
 #include <git2/sys/hashsig.h>
 
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#if defined(__SSE2__) && defined(__GNUC__)
+#include <emmintrin.h>
+#define RUGGED_LINE_STATS_SSE2
+#endif
+
 extern VALUE rb_mRugged;
 extern VALUE rb_cRuggedObject;
 extern VALUE rb_cRuggedRepo;
-static ID id_read;
+static ID id_read, id_write;
 
 VALUE rb_cRuggedBlob;
 VALUE rb_cRuggedBlobSig;
@@ -125,6 +134,256 @@ static VALUE rb_git_blob_content_GET(int argc, VALUE *argv, VALUE self)
 	return rb_str_new(content, size);
 }
 
+#define RUGGED_BLOB_CHUNK_SIZE (64 * 1024)
+
+struct rugged_blob_range {
+	const char *data;
+	size_t size;
+	size_t chunk_size;
+};
+
+static size_t rugged__blob_size_option(VALUE rb_options, const char *name, size_t default_value)
+{
+	VALUE rb_value = rb_hash_aref(rb_options, CSTR2SYM(name));
+	long value;
+
+	if (NIL_P(rb_value))
+		return default_value;
+
+	value = NUM2LONG(rb_value);
+	if (value < 0)
+		rb_raise(rb_eArgError, "Expected :%s to be a non-negative Integer", name);
+
+	return (size_t)value;
+}
+
+/*
+ * Parse the +:offset+, +:length+ and +:chunk_size+ options shared by
+ * the streaming readers into a slice of the blob's raw content.
+ */
+static void rugged__blob_range_parse(struct rugged_blob_range *range, git_blob *blob, VALUE rb_options)
+{
+	size_t size = (size_t)git_blob_rawsize(blob), offset = 0, length = SIZE_MAX;
+
+	range->chunk_size = RUGGED_BLOB_CHUNK_SIZE;
+
+	if (!NIL_P(rb_options)) {
+		Check_Type(rb_options, T_HASH);
+
+		offset = rugged__blob_size_option(rb_options, "offset", 0);
+		length = rugged__blob_size_option(rb_options, "length", SIZE_MAX);
+		range->chunk_size = rugged__blob_size_option(rb_options, "chunk_size", RUGGED_BLOB_CHUNK_SIZE);
+
+		if (range->chunk_size == 0)
+			rb_raise(rb_eArgError, "Expected :chunk_size to be positive");
+	}
+
+	if (offset > size)
+		offset = size;
+
+	range->data = (const char *)git_blob_rawcontent(blob) + offset;
+	range->size = length < size - offset ? length : size - offset;
+}
+
+/*
+ *  call-seq:
+ *    blob.read(offset, length = nil) -> string or nil
+ *
+ *  Return up to +length+ bytes of the blob's content, starting at byte
+ *  +offset+, as an ASCII-8BIT +String+. If +length+ is +nil+, everything
+ *  from +offset+ to the end of the blob is returned.
+ *
+ *  Only the requested range is copied, which makes this suitable for
+ *  serving range requests on large blobs. Returns +nil+ if +offset+ is
+ *  past the end of the blob.
+ *
+ *    blob.read(0, 10) #=> "# Rugged\n*"
+ */
+static VALUE rb_git_blob_read(int argc, VALUE *argv, VALUE self)
+{
+	git_blob *blob;
+	size_t size;
+	long offset, length;
+	VALUE rb_offset, rb_length;
+
+	Data_Get_Struct(self, git_blob, blob);
+	rb_scan_args(argc, argv, "11", &rb_offset, &rb_length);
+
+	size = (size_t)git_blob_rawsize(blob);
+	offset = NUM2LONG(rb_offset);
+
+	if (offset < 0)
+		rb_raise(rb_eArgError, "Expected offset to be a non-negative Integer");
+
+	if ((size_t)offset > size)
+		return Qnil;
+
+	length = (long)(size - offset);
+
+	if (!NIL_P(rb_length)) {
+		long max_length = NUM2LONG(rb_length);
+
+		if (max_length < 0)
+			rb_raise(rb_eArgError, "Expected length to be a non-negative Integer");
+
+		if (max_length < length)
+			length = max_length;
+	}
+
+	return rb_str_new((const char *)git_blob_rawcontent(blob) + offset, length);
+}
+
+/*
+ *  call-seq:
+ *    blob.each_chunk(options = {}) { |chunk| block }
+ *    blob.each_chunk(options = {}) -> enumerator
+ *
+ *  Yield the content of the blob as a series of ASCII-8BIT +String+
+ *  slices, so that large blobs can be processed without ever building
+ *  a single +String+ with all of their content.
+ *
+ *  The following options can be passed in the +options+ Hash:
+ *
+ *  :chunk_size ::
+ *    The maximum size in bytes of each yielded chunk. Defaults to 64KB.
+ *
+ *  :offset ::
+ *    The byte offset to start reading from. Defaults to 0.
+ *
+ *  :length ::
+ *    The maximum number of bytes to read. Defaults to reading until
+ *    the end of the blob.
+ *
+ *    blob.each_chunk(:chunk_size => 4096) { |chunk| socket.write(chunk) }
+ */
+static VALUE rb_git_blob_each_chunk(int argc, VALUE *argv, VALUE self)
+{
+	git_blob *blob;
+	struct rugged_blob_range range;
+	VALUE rb_options;
+	size_t done = 0;
+
+	rb_scan_args(argc, argv, "01", &rb_options);
+
+	if (!rb_block_given_p())
+		return rb_funcall(self, rb_intern("to_enum"), 2, CSTR2SYM("each_chunk"), NIL_P(rb_options) ? rb_hash_new() : rb_options);
+
+	Data_Get_Struct(self, git_blob, blob);
+	rugged__blob_range_parse(&range, blob, rb_options);
+
+	while (done < range.size) {
+		size_t length = range.size - done < range.chunk_size ? range.size - done : range.chunk_size;
+
+		rb_yield(rb_str_new(range.data + done, length));
+		done += length;
+	}
+
+	return Qnil;
+}
+
+#ifndef _WIN32
+struct rugged_blob_write_fd_args {
+	int fd;
+	const char *data;
+	size_t size;
+	size_t written;
+	int error;
+};
+
+/* A single write(2); the loop runs with the GVL, between interrupts */
+static void *rugged__blob_write_fd_nogvl(void *data)
+{
+	struct rugged_blob_write_fd_args *args = data;
+	ssize_t ret = write(args->fd, args->data + args->written, args->size - args->written);
+
+	if (ret < 0)
+		args->error = errno;
+	else
+		args->written += (size_t)ret;
+
+	return NULL;
+}
+#endif
+
+/*
+ *  call-seq:
+ *    blob.write_to(io, options = {}) -> int
+ *
+ *  Write the content of the blob to +io+ and return the number of
+ *  bytes written. Accepts the same +options+ as #each_chunk.
+ *
+ *  When +io+ is an +IO+ in binary mode (or wraps one, like +Tempfile+), the
+ *  content is written straight from the blob to the underlying file
+ *  descriptor without being copied into any Ruby +String+, and without
+ *  holding the GVL; the write can be interrupted like IO#write. Any other
+ *  object only needs to respond to <code>write(string)</code>, and is given
+ *  the content in chunks.
+ *
+ *    File.open("asset.png", "wb") { |file| blob.write_to(file) }
+ */
+static VALUE rb_git_blob_write_to(int argc, VALUE *argv, VALUE self)
+{
+	git_blob *blob;
+	struct rugged_blob_range range;
+	VALUE rb_io, rb_file, rb_options;
+	size_t done = 0;
+
+	rb_scan_args(argc, argv, "11", &rb_io, &rb_options);
+
+	Data_Get_Struct(self, git_blob, blob);
+	rugged__blob_range_parse(&range, blob, rb_options);
+
+#ifndef _WIN32
+	/* Tempfile and other IO wrappers are unwrapped through #to_io */
+	rb_file = rb_io_check_io(rb_io);
+
+	if (!NIL_P(rb_file) && RTEST(rb_funcall(rb_file, rb_intern("binmode?"), 0))) {
+		struct rugged_blob_write_fd_args args;
+
+		rb_io_flush(rb_file);
+
+		args.fd = NUM2INT(rb_funcall(rb_file, rb_intern("fileno"), 0));
+		args.data = range.data;
+		args.size = range.size;
+		args.written = 0;
+
+		while (args.written < args.size) {
+			int interrupt;
+
+			args.error = 0;
+
+			/* Blocks without the GVL; Thread#kill and Timeout interrupt it */
+			if ((interrupt = rugged_without_gvl_io(rugged__blob_write_fd_nogvl, &args, 1)))
+				rb_jump_tag(interrupt);
+
+			if (args.error == EINTR)
+				continue;
+
+			if (args.error) {
+				errno = args.error;
+
+				/* Waits on non-blocking descriptors, returns false otherwise */
+				if (rb_io_wait_writable(args.fd))
+					continue;
+
+				rb_sys_fail("write");
+			}
+		}
+
+		done = args.written;
+	}
+#endif
+
+	while (done < range.size) {
+		size_t length = range.size - done < range.chunk_size ? range.size - done : range.chunk_size;
+
+		rb_funcall(rb_io, id_write, 1, rb_str_new(range.data + done, length));
+		done += length;
+	}
+
+	return ULONG2NUM(range.size);
+}
+
 /*
  *  call-seq:
  *    blob.rawsize -> int
@@ -318,43 +577,278 @@ static VALUE rb_git_blob_from_io(int argc, VALUE *argv, VALUE klass)
 }
 
 
+struct rugged_line_stats {
+	size_t lines;
+	size_t sloc;
+	size_t blank;
+	size_t longest_line;
+	size_t crlf;
+	int binary;
+};
+
+struct rugged_line_state {
+	const unsigned char *data;
+	size_t line_start;
+	int line_nonspace;
+	int first_line;
+};
+
+static inline int rugged__is_space(unsigned char c)
+{
+	return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+static inline void rugged__line_stats_newline(
+	struct rugged_line_stats *stats, struct rugged_line_state *state, size_t pos)
+{
+	size_t length = pos - state->line_start;
+
+	if (length > 0 && state->data[pos - 1] == '\r') {
+		stats->crlf++;
+		length--;
+	}
+
+	if (length > stats->longest_line)
+		stats->longest_line = length;
+
+	if (!state->line_nonspace)
+		stats->blank++;
+
+	/* Matches the historical behavior of Blob#sloc, which always counts the first line */
+	if (state->line_nonspace || state->first_line)
+		stats->sloc++;
+
+	stats->lines++;
+	state->line_start = pos + 1;
+	state->line_nonspace = 0;
+	state->first_line = 0;
+}
+
+/*
+ * Count lines, source lines, blank lines, CRLF line endings and the
+ * length of the longest line in a single pass over +data+. Lines are
+ * found 16 bytes at a time with SSE2 where available.
+ */
+static void rugged__line_stats(struct rugged_line_stats *stats, const unsigned char *data, size_t size)
+{
+	struct rugged_line_state state;
+	size_t i = 0;
+
+	memset(stats, 0, sizeof(*stats));
+
+	state.data = data;
+	state.line_start = 0;
+	state.line_nonspace = 0;
+	state.first_line = 1;
+
+#ifdef RUGGED_LINE_STATS_SSE2
+	{
+		const __m128i newline = _mm_set1_epi8('\n'), space = _mm_set1_epi8(' ');
+		const __m128i below_tab = _mm_set1_epi8('\t' - 1), above_cr = _mm_set1_epi8('\r' + 1);
+
+		for (; i + 16 <= size; i += 16) {
+			__m128i block = _mm_loadu_si128((const __m128i *)(data + i));
+			__m128i is_space = _mm_or_si128(_mm_cmpeq_epi8(block, space),
+				_mm_and_si128(_mm_cmpgt_epi8(block, below_tab), _mm_cmplt_epi8(block, above_cr)));
+			unsigned int newlines = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(block, newline));
+			unsigned int nonspace = ~(unsigned int)_mm_movemask_epi8(is_space) & 0xffff;
+			unsigned int from = 0;
+
+			while (newlines) {
+				unsigned int bit = (unsigned int)__builtin_ctz(newlines);
+
+				if (nonspace & ((1u << bit) - 1) & ~((1u << from) - 1))
+					state.line_nonspace = 1;
+
+				rugged__line_stats_newline(stats, &state, i + bit);
+				from = bit + 1;
+				newlines &= newlines - 1;
+			}
+
+			if (nonspace >> from)
+				state.line_nonspace = 1;
+		}
+	}
+#endif
+
+	for (; i < size; ++i) {
+		if (data[i] == '\n')
+			rugged__line_stats_newline(stats, &state, i);
+		else if (!rugged__is_space(data[i]))
+			state.line_nonspace = 1;
+	}
+
+	/* last line without trailing '\n'? */
+	if (size > 0 && data[size - 1] != '\n') {
+		if (size - state.line_start > stats->longest_line)
+			stats->longest_line = size - state.line_start;
+
+		if (!state.line_nonspace)
+			stats->blank++;
+
+		stats->lines++;
+		stats->sloc++;
+	}
+}
+
+static VALUE rugged_line_stats_new(const struct rugged_line_stats *stats)
+{
+	VALUE rb_stats = rb_hash_new();
+
+	rb_hash_aset(rb_stats, CSTR2SYM("lines"), ULONG2NUM(stats->lines));
+	rb_hash_aset(rb_stats, CSTR2SYM("sloc"), ULONG2NUM(stats->sloc));
+	rb_hash_aset(rb_stats, CSTR2SYM("blank"), ULONG2NUM(stats->blank));
+	rb_hash_aset(rb_stats, CSTR2SYM("longest_line"), ULONG2NUM(stats->longest_line));
+	rb_hash_aset(rb_stats, CSTR2SYM("crlf"), ULONG2NUM(stats->crlf));
+	rb_hash_aset(rb_stats, CSTR2SYM("binary"), stats->binary ? Qtrue : Qfalse);
+
+	return rb_stats;
+}
+
+static void rugged__blob_line_stats(struct rugged_line_stats *stats, git_blob *blob)
+{
+	rugged__line_stats(stats, git_blob_rawcontent(blob), (size_t)git_blob_rawsize(blob));
+	stats->binary = git_blob_is_binary(blob);
+}
+
 /*
  *  call-seq:
  *    blob.sloc -> int
  *
- *  Return the number of non-empty code lines for the blob,
- *  assuming the blob is plaintext (i.e. not binary)
+ *  Return the number of code lines for the blob, assuming the blob is
+ *  plaintext (i.e. not binary). These are the lines with something other
+ *  than whitespace in them, plus the first line and a last line without a
+ *  trailing newline, which are always counted even when blank.
  */
 static VALUE rb_git_blob_sloc(VALUE self)
 {
 	git_blob *blob;
-	const char *data, *data_end;
-	size_t sloc = 0;
+	struct rugged_line_stats stats;
 
 	Data_Get_Struct(self, git_blob, blob);
+	rugged__line_stats(&stats, git_blob_rawcontent(blob), (size_t)git_blob_rawsize(blob));
 
-	data = git_blob_rawcontent(blob);
-	data_end = data + git_blob_rawsize(blob);
+	return INT2FIX(stats.sloc);
+}
+
+/*
+ *  call-seq:
+ *    blob.line_stats -> hash
+ *
+ *  Return a Hash with statistics about the lines of the blob, all
+ *  computed in a single pass over its content:
+ *
+ *  :lines ::
+ *    The number of lines, counting a last line without a trailing newline.
+ *
+ *  :sloc ::
+ *    The number of code lines, as returned by #sloc: lines with something
+ *    other than whitespace in them, plus the first and unterminated last
+ *    lines.
+ *
+ *  :blank ::
+ *    The number of lines with only whitespace in them.
+ *
+ *  :longest_line ::
+ *    The length in bytes of the longest line, without its line ending.
+ *
+ *  :crlf ::
+ *    The number of lines ending in "\r\n".
+ *
+ *  :binary ::
+ *    Whether the blob is binary, as returned by #binary?.
+ *
+ *  See Blob.line_stats to compute these for many blobs at once.
+ */
+static VALUE rb_git_blob_line_stats(VALUE self)
+{
+	git_blob *blob;
+	struct rugged_line_stats stats;
 
-	if (data == data_end)
-		return INT2FIX(0);
+	Data_Get_Struct(self, git_blob, blob);
+	rugged__blob_line_stats(&stats, blob);
 
-	/* go through the whole blob, counting lines
-	 * that are not empty */
-	while (data < data_end) {
-		if (*data++ == '\n') {
-			while (data < data_end && isspace(*data))
-				data++;
+	return rugged_line_stats_new(&stats);
+}
 
-			sloc++;
-		}
+struct rugged_blob_line_stats_args {
+	git_repository *repo;
+	git_oid *oids;
+	struct rugged_line_stats *stats;
+	size_t count;
+	int error;
+};
+
+static void *rugged__blob_line_stats_nogvl(void *data)
+{
+	struct rugged_blob_line_stats_args *args = data;
+	git_blob *blob;
+	size_t i;
+
+	for (i = 0; i < args->count; ++i) {
+		if ((args->error = git_blob_lookup(&blob, args->repo, &args->oids[i])) < 0)
+			break;
+
+		rugged__blob_line_stats(&args->stats[i], blob);
+		git_blob_free(blob);
 	}
 
-	/* last line without trailing '\n'? */
-	if (data[-1] != '\n')
-		sloc++;
+	return NULL;
+}
+
+/*
+ *  call-seq:
+ *    Blob.line_stats(repository, oids) -> Array
+ *
+ *  Return the Blob#line_stats of each one of the blobs identified by
+ *  the Array of +oids+, in the same order.
+ *
+ *  The blobs are read and scanned without creating any Rugged::Blob
+ *  objects and, if enabled, without holding the GVL.
+ */
+static VALUE rb_git_blob_line_stats_many(VALUE self, VALUE rb_repo, VALUE rb_oids)
+{
+	struct rugged_blob_line_stats_args args = { NULL };
+	VALUE rb_result;
+	size_t i;
+
+	rugged_check_repo(rb_repo);
+	Check_Type(rb_oids, T_ARRAY);
+	Data_Get_Struct(rb_repo, git_repository, args.repo);
+
+	args.count = RARRAY_LEN(rb_oids);
+
+	/*
+	 * Parse every OID before allocating anything: parsing raises on
+	 * invalid input, and nothing would free the arrays if it did.
+	 */
+	for (i = 0; i < args.count; ++i) {
+		VALUE rb_oid = rb_ary_entry(rb_oids, i);
+		git_oid oid;
+
+		Check_Type(rb_oid, T_STRING);
+		rugged_exception_check(rugged_oid_fromstr(&oid, rb_oid));
+	}
+
+	args.oids = xcalloc(args.count ? args.count : 1, sizeof(git_oid));
+
+	for (i = 0; i < args.count; ++i)
+		rugged_oid_fromstr(&args.oids[i], rb_ary_entry(rb_oids, i));
+
+	args.stats = xcalloc(args.count ? args.count : 1, sizeof(struct rugged_line_stats));
+
+	rugged_without_gvl(rugged__blob_line_stats_nogvl, &args);
+
+	rb_result = rb_ary_new2(args.count);
+	for (i = 0; !args.error && i < args.count; ++i)
+		rb_ary_push(rb_result, rugged_line_stats_new(&args.stats[i]));
+
+	xfree(args.oids);
+	xfree(args.stats);
+	rugged_exception_check(args.error);
 
-	return INT2FIX(sloc);
+	RB_GC_GUARD(rb_repo);
+	return rb_result;
 }
 
 /*
@@ -576,13 +1070,18 @@ static VALUE rb_git_blob_sig_compare(VALUE self, VALUE rb_sig_a, VALUE rb_sig_b)
 void Init_rugged_blob(void)
 {
 	id_read = rb_intern("read");
+	id_write = rb_intern("write");
 
 	rb_cRuggedBlob = rb_define_class_under(rb_mRugged, "Blob", rb_cRuggedObject);
 
 	rb_define_method(rb_cRuggedBlob, "size", rb_git_blob_rawsize, 0);
 	rb_define_method(rb_cRuggedBlob, "content", rb_git_blob_content_GET, -1);
 	rb_define_method(rb_cRuggedBlob, "text", rb_git_blob_text_GET, -1);
+	rb_define_method(rb_cRuggedBlob, "read", rb_git_blob_read, -1);
+	rb_define_method(rb_cRuggedBlob, "each_chunk", rb_git_blob_each_chunk, -1);
+	rb_define_method(rb_cRuggedBlob, "write_to", rb_git_blob_write_to, -1);
 	rb_define_method(rb_cRuggedBlob, "sloc", rb_git_blob_sloc, 0);
+	rb_define_method(rb_cRuggedBlob, "line_stats", rb_git_blob_line_stats, 0);
 	rb_define_method(rb_cRuggedBlob, "binary?", rb_git_blob_is_binary, 0);
 	rb_define_method(rb_cRuggedBlob, "diff", rb_git_blob_diff, -1);
 
@@ -590,6 +1089,7 @@ void Init_rugged_blob(void)
 	rb_define_singleton_method(rb_cRuggedBlob, "from_workdir", rb_git_blob_from_workdir, 2);
 	rb_define_singleton_method(rb_cRuggedBlob, "from_disk", rb_git_blob_from_disk, 2);
 	rb_define_singleton_method(rb_cRuggedBlob, "from_io", rb_git_blob_from_io, -1);
+	rb_define_singleton_method(rb_cRuggedBlob, "line_stats", rb_git_blob_line_stats_many, 2);
 
 	rb_define_singleton_method(rb_cRuggedBlob, "to_buffer", rb_git_blob_to_buffer, -1);
 
@@ -424,7 +424,7 @@ static VALUE rb_git_commit_create(VALUE self, VALUE rb_repo, VALUE rb_data)
 		if (TYPE(p) == T_STRING) {
 			git_oid oid;
 
-			error = git_oid_fromstr(&oid, StringValueCStr(p));
+			error = rugged_oid_fromstr(&oid, p);
 			if (error < GIT_OK)
 				goto cleanup;
 
@@ -0,0 +1,1611 @@
+/*
+ * The MIT License
+ *
+ * Copyright (c) 2014 GitHub, Inc
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "rugged.h"
+
+#include <stdio.h>
+
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+extern VALUE rb_mRugged;
+VALUE rb_cRuggedCommitGraph;
+
+/*
+ * The on-disk format is the one written by `git commit-graph write`
+ * (version 1, SHA1), so graphs can be shared between Git and Rugged.
+ */
+#define GRAPH_SIGNATURE "CGPH"
+#define GRAPH_VERSION 1
+#define GRAPH_HASH_VERSION 1
+#define GRAPH_HEADER_SIZE 8
+#define GRAPH_CHUNK_ENTRY_SIZE 12
+#define GRAPH_FANOUT_SIZE (256 * 4)
+#define GRAPH_DATA_SIZE (GIT_OID_RAWSZ + 16)
+
+#define GRAPH_CHUNK_OID_FANOUT 0x4f494446 /* "OIDF" */
+#define GRAPH_CHUNK_OID_LOOKUP 0x4f49444c /* "OIDL" */
+#define GRAPH_CHUNK_DATA 0x43444154 /* "CDAT" */
+#define GRAPH_CHUNK_EXTRA_EDGES 0x45444745 /* "EDGE" */
+
+#define GRAPH_PARENT_NONE 0x70000000
+#define GRAPH_EXTRA_EDGES_NEEDED 0x80000000
+#define GRAPH_EDGE_LAST_MASK 0x7fffffff
+#define GRAPH_GENERATION_MAX 0x3fffffff
+
+#define GRAPH_FLAG_ONE (1 << 0)
+#define GRAPH_FLAG_TWO (1 << 1)
+#define GRAPH_FLAG_STALE (1 << 2)
+#define GRAPH_FLAG_RESULT (1 << 3)
+#define GRAPH_FLAG_QUEUED (1 << 4)
+
+struct rugged_commit_graph {
+	const unsigned char *data;
+	size_t size;
+	int mapped;
+
+	uint32_t num_commits;
+	const unsigned char *fanout;
+	const unsigned char *oids;
+	const unsigned char *commit_data;
+	const unsigned char *extra_edges;
+	size_t num_extra_edges;
+};
+
+static inline uint32_t graph_get_be32(const unsigned char *p)
+{
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+		((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+static inline uint64_t graph_get_be64(const unsigned char *p)
+{
+	return ((uint64_t)graph_get_be32(p) << 32) | graph_get_be32(p + 4);
+}
+
+static inline const unsigned char *graph_commit_data(const rugged_commit_graph *graph, uint32_t pos)
+{
+	return graph->commit_data + (size_t)pos * GRAPH_DATA_SIZE;
+}
+
+static inline uint32_t graph_generation(const rugged_commit_graph *graph, uint32_t pos)
+{
+	return graph_get_be32(graph_commit_data(graph, pos) + GIT_OID_RAWSZ + 8) >> 2;
+}
+
+static inline uint64_t graph_commit_time(const rugged_commit_graph *graph, uint32_t pos)
+{
+	const unsigned char *p = graph_commit_data(graph, pos) + GIT_OID_RAWSZ + 8;
+	return ((uint64_t)(graph_get_be32(p) & 0x3) << 32) | graph_get_be32(p + 4);
+}
+
+static void graph_free(rugged_commit_graph *graph)
+{
+	if (!graph)
+		return;
+
+#ifdef HAVE_SYS_MMAN_H
+	if (graph->mapped)
+		munmap((void *)graph->data, graph->size);
+	else
+#endif
+		xfree((void *)graph->data);
+
+	xfree(graph);
+}
+
+static int graph_parse(rugged_commit_graph *graph)
+{
+	const unsigned char *data = graph->data;
+	size_t i, chunk_count, oids_size = 0, commit_data_size = 0;
+	size_t end = graph->size - GIT_OID_RAWSZ;
+
+	if (graph->size < GRAPH_HEADER_SIZE + GRAPH_CHUNK_ENTRY_SIZE + GIT_OID_RAWSZ)
+		return -1;
+
+	/* Unknown versions and split graph chains are simply not used */
+	if (memcmp(data, GRAPH_SIGNATURE, 4) != 0 ||
+		data[4] != GRAPH_VERSION || data[5] != GRAPH_HASH_VERSION || data[7] != 0)
+		return GIT_ENOTFOUND;
+
+	chunk_count = data[6];
+	if (GRAPH_HEADER_SIZE + (chunk_count + 1) * GRAPH_CHUNK_ENTRY_SIZE > end)
+		return -1;
+
+	for (i = 0; i < chunk_count; ++i) {
+		const unsigned char *entry = data + GRAPH_HEADER_SIZE + i * GRAPH_CHUNK_ENTRY_SIZE;
+		uint64_t offset = graph_get_be64(entry + 4);
+		uint64_t next_offset = graph_get_be64(entry + GRAPH_CHUNK_ENTRY_SIZE + 4);
+		size_t length;
+
+		if (offset > end || next_offset > end || next_offset < offset)
+			return -1;
+
+		length = (size_t)(next_offset - offset);
+
+		switch (graph_get_be32(entry)) {
+		case GRAPH_CHUNK_OID_FANOUT:
+			if (length != GRAPH_FANOUT_SIZE)
+				return -1;
+			graph->fanout = data + offset;
+			break;
+
+		case GRAPH_CHUNK_OID_LOOKUP:
+			graph->oids = data + offset;
+			oids_size = length;
+			break;
+
+		case GRAPH_CHUNK_DATA:
+			graph->commit_data = data + offset;
+			commit_data_size = length;
+			break;
+
+		case GRAPH_CHUNK_EXTRA_EDGES:
+			graph->extra_edges = data + offset;
+			graph->num_extra_edges = length / 4;
+			break;
+		}
+	}
+
+	if (!graph->fanout || !graph->oids || !graph->commit_data)
+		return -1;
+
+	for (i = 1; i < 256; ++i) {
+		if (graph_get_be32(graph->fanout + i * 4) < graph_get_be32(graph->fanout + (i - 1) * 4))
+			return -1;
+	}
+
+	graph->num_commits = graph_get_be32(graph->fanout + 255 * 4);
+
+	if (oids_size != (size_t)graph->num_commits * GIT_OID_RAWSZ ||
+		commit_data_size != (size_t)graph->num_commits * GRAPH_DATA_SIZE)
+		return -1;
+
+	/* Graphs written before generation numbers existed cannot prune walks */
+	if (graph->num_commits > 0 && graph_generation(graph, 0) == 0)
+		return GIT_ENOTFOUND;
+
+	return 0;
+}
+
+static int graph_load(rugged_commit_graph *graph, const char *path)
+{
+#ifdef HAVE_SYS_MMAN_H
+	struct stat st;
+	void *map;
+	int fd = open(path, O_RDONLY);
+
+	if (fd < 0)
+		return GIT_ENOTFOUND;
+
+	if (fstat(fd, &st) < 0 || st.st_size <= 0) {
+		close(fd);
+		return GIT_ENOTFOUND;
+	}
+
+	map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if (map == MAP_FAILED)
+		return GIT_ENOTFOUND;
+
+	graph->data = map;
+	graph->size = (size_t)st.st_size;
+	graph->mapped = 1;
+#else
+	unsigned char *data;
+	long size;
+	FILE *fp = fopen(path, "rb");
+
+	if (!fp)
+		return GIT_ENOTFOUND;
+
+	if (fseek(fp, 0, SEEK_END) < 0 || (size = ftell(fp)) <= 0 || fseek(fp, 0, SEEK_SET) < 0) {
+		fclose(fp);
+		return GIT_ENOTFOUND;
+	}
+
+	data = xmalloc((size_t)size);
+	if (fread(data, 1, (size_t)size, fp) != (size_t)size) {
+		fclose(fp);
+		xfree(data);
+		return GIT_ENOTFOUND;
+	}
+
+	fclose(fp);
+
+	graph->data = data;
+	graph->size = (size_t)size;
+#endif
+
+	return graph_parse(graph);
+}
+
+/*
+ * Open the commit-graph file at +path+, returning a new
+ * Rugged::CommitGraph owned by +owner+, or nil if there is
+ * no usable graph there. Like Git, a corrupt graph is ignored.
+ */
+VALUE rugged_commit_graph_open(VALUE owner, const char *path)
+{
+	rugged_commit_graph *graph = xcalloc(1, sizeof(rugged_commit_graph));
+	VALUE rb_graph;
+
+	if (graph_load(graph, path) < 0) {
+		graph_free(graph);
+		return Qnil;
+	}
+
+	rb_graph = Data_Wrap_Struct(rb_cRuggedCommitGraph, NULL, &graph_free, graph);
+	rugged_set_owner(rb_graph, owner);
+	return rb_graph;
+}
+
+rugged_commit_graph *rugged_commit_graph_get(VALUE rb_graph)
+{
+	rugged_commit_graph *graph;
+
+	if (NIL_P(rb_graph))
+		return NULL;
+
+	Data_Get_Struct(rb_graph, rugged_commit_graph, graph);
+	return graph;
+}
+
+int rugged_commit_graph_lookup(uint32_t *pos, const rugged_commit_graph *graph, const git_oid *oid)
+{
+	uint32_t lo, hi;
+
+	lo = oid->id[0] ? graph_get_be32(graph->fanout + (oid->id[0] - 1) * 4) : 0;
+	hi = graph_get_be32(graph->fanout + oid->id[0] * 4);
+
+	while (lo < hi) {
+		uint32_t mid = lo + (hi - lo) / 2;
+		int cmp = memcmp(oid->id, graph->oids + (size_t)mid * GIT_OID_RAWSZ, GIT_OID_RAWSZ);
+
+		if (!cmp) {
+			*pos = mid;
+			return 0;
+		}
+
+		if (cmp < 0)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+
+	return GIT_ENOTFOUND;
+}
+
+void rugged_commit_graph_oid(git_oid *out, const rugged_commit_graph *graph, uint32_t pos)
+{
+	git_oid_fromraw(out, graph->oids + (size_t)pos * GIT_OID_RAWSZ);
+}
+
+/*
+ * Parent iteration. Octopus merges store their second and later
+ * parents in the extra edges chunk.
+ */
+struct graph_parents {
+	const rugged_commit_graph *graph;
+	const unsigned char *entry;
+	uint32_t edge;
+	int state;
+};
+
+static void graph_parents_init(struct graph_parents *iter, const rugged_commit_graph *graph, uint32_t pos)
+{
+	iter->graph = graph;
+	iter->entry = graph_commit_data(graph, pos) + GIT_OID_RAWSZ;
+	iter->edge = 0;
+	iter->state = 0;
+}
+
+static int graph_corrupt(void)
+{
+	giterr_set_str(GITERR_ODB, "The commit-graph file is corrupted");
+	return -1;
+}
+
+/* Returns 1 and sets +parent+, 0 when done, or -1 on corruption */
+static int graph_parents_next(uint32_t *parent, struct graph_parents *iter)
+{
+	uint32_t value;
+
+	switch (iter->state) {
+	case 0:
+		value = graph_get_be32(iter->entry);
+		iter->state = 1;
+		if (value == GRAPH_PARENT_NONE)
+			return 0;
+		break;
+
+	case 1:
+		value = graph_get_be32(iter->entry + 4);
+		iter->state = 3;
+		if (value == GRAPH_PARENT_NONE)
+			return 0;
+
+		if (!(value & GRAPH_EXTRA_EDGES_NEEDED))
+			break;
+
+		iter->edge = value & GRAPH_EDGE_LAST_MASK;
+		iter->state = 2;
+		/* fall through */
+
+	case 2:
+		if (iter->edge >= iter->graph->num_extra_edges)
+			return graph_corrupt();
+
+		value = graph_get_be32(iter->graph->extra_edges + (size_t)iter->edge * 4);
+		iter->edge++;
+
+		if (value & GRAPH_EXTRA_EDGES_NEEDED)
+			iter->state = 3;
+
+		value &= GRAPH_EDGE_LAST_MASK;
+		break;
+
+	default:
+		return 0;
+	}
+
+	if (value >= iter->graph->num_commits)
+		return graph_corrupt();
+
+	*parent = value;
+	return 1;
+}
+
+/*
+ * A max-heap of graph positions, ordered by generation number and
+ * then by commit time, so a commit is never popped before any of
+ * its descendants in the queue.
+ */
+struct graph_queue {
+	const rugged_commit_graph *graph;
+	uint32_t *items;
+	size_t length, alloc;
+};
+
+static int graph_queue_before(const rugged_commit_graph *graph, uint32_t a, uint32_t b)
+{
+	uint32_t gen_a = graph_generation(graph, a), gen_b = graph_generation(graph, b);
+	uint64_t time_a, time_b;
+
+	if (gen_a != gen_b)
+		return gen_a > gen_b;
+
+	time_a = graph_commit_time(graph, a);
+	time_b = graph_commit_time(graph, b);
+
+	if (time_a != time_b)
+		return time_a > time_b;
+
+	return a < b;
+}
+
+static int graph_queue_push(struct graph_queue *queue, uint32_t pos)
+{
+	size_t i;
+
+	if (queue->length == queue->alloc) {
+		size_t alloc = queue->alloc ? queue->alloc * 2 : 64;
+		uint32_t *items = realloc(queue->items, alloc * sizeof(uint32_t));
+
+		if (!items) {
+			giterr_set_oom();
+			return -1;
+		}
+
+		queue->items = items;
+		queue->alloc = alloc;
+	}
+
+	i = queue->length++;
+	while (i > 0) {
+		size_t parent = (i - 1) / 2;
+
+		if (!graph_queue_before(queue->graph, pos, queue->items[parent]))
+			break;
+
+		queue->items[i] = queue->items[parent];
+		i = parent;
+	}
+
+	queue->items[i] = pos;
+	return 0;
+}
+
+static uint32_t graph_queue_pop(struct graph_queue *queue)
+{
+	uint32_t top = queue->items[0], last = queue->items[--queue->length];
+	size_t i = 0;
+
+	for (;;) {
+		size_t child = i * 2 + 1;
+
+		if (child >= queue->length)
+			break;
+
+		if (child + 1 < queue->length &&
+			graph_queue_before(queue->graph, queue->items[child + 1], queue->items[child]))
+			child++;
+
+		if (!graph_queue_before(queue->graph, queue->items[child], last))
+			break;
+
+		queue->items[i] = queue->items[child];
+		i = child;
+	}
+
+	if (queue->length > 0)
+		queue->items[i] = last;
+
+	return top;
+}
+
+/*
+ * Paint +one+ and +two+ down towards their common history in generation
+ * order. Every commit is final by the time it is popped, and the walk
+ * stops as soon as only stale (common) commits are left in the queue.
+ *
+ * Counts the commits reachable from only one side into +ahead+ and
+ * +behind+ if given, and collects the best common ancestors into
+ * +bases+ if given.
+ */
+static int graph_paint_down(
+	size_t *ahead, size_t *behind, struct graph_queue *bases,
+	const rugged_commit_graph *graph, uint32_t one, uint32_t two)
+{
+	struct graph_queue queue = { graph, NULL, 0, 0 };
+	struct graph_parents parents;
+	unsigned char *flags;
+	size_t nonstale = 0;
+	uint32_t parent;
+	int error = 0;
+
+	if (!(flags = calloc(graph->num_commits, 1))) {
+		giterr_set_oom();
+		return -1;
+	}
+
+	flags[one] |= GRAPH_FLAG_ONE | GRAPH_FLAG_QUEUED;
+	flags[two] |= GRAPH_FLAG_TWO;
+
+	if ((error = graph_queue_push(&queue, one)) < 0)
+		goto done;
+	nonstale++;
+
+	if (!(flags[two] & GRAPH_FLAG_QUEUED)) {
+		flags[two] |= GRAPH_FLAG_QUEUED;
+		if ((error = graph_queue_push(&queue, two)) < 0)
+			goto done;
+		nonstale++;
+	}
+
+	while (nonstale > 0 && queue.length > 0) {
+		uint32_t pos = graph_queue_pop(&queue);
+		unsigned char paint = flags[pos] & (GRAPH_FLAG_ONE | GRAPH_FLAG_TWO | GRAPH_FLAG_STALE);
+		int ret;
+
+		if (!(paint & GRAPH_FLAG_STALE))
+			nonstale--;
+
+		if (paint == GRAPH_FLAG_ONE && ahead)
+			(*ahead)++;
+		else if (paint == GRAPH_FLAG_TWO && behind)
+			(*behind)++;
+		else if (paint == (GRAPH_FLAG_ONE | GRAPH_FLAG_TWO)) {
+			if (bases && (error = graph_queue_push(bases, pos)) < 0)
+				goto done;
+
+			flags[pos] |= GRAPH_FLAG_RESULT;
+			paint |= GRAPH_FLAG_STALE;
+		}
+
+		graph_parents_init(&parents, graph, pos);
+
+		while ((ret = graph_parents_next(&parent, &parents)) > 0) {
+			unsigned char old = flags[parent];
+
+			if ((old & paint) == paint)
+				continue;
+
+			flags[parent] |= paint;
+
+			if (!(old & GRAPH_FLAG_QUEUED)) {
+				flags[parent] |= GRAPH_FLAG_QUEUED;
+				if ((error = graph_queue_push(&queue, parent)) < 0)
+					goto done;
+
+				if (!(paint & GRAPH_FLAG_STALE))
+					nonstale++;
+			} else if (!(old & GRAPH_FLAG_STALE) && (paint & GRAPH_FLAG_STALE)) {
+				nonstale--;
+			}
+		}
+
+		if (ret < 0) {
+			error = -1;
+			goto done;
+		}
+	}
+
+done:
+	free(queue.items);
+	free(flags);
+	return error;
+}
+
+int rugged_commit_graph_ahead_behind(
+	size_t *ahead, size_t *behind,
+	const rugged_commit_graph *graph, uint32_t local, uint32_t upstream)
+{
+	*ahead = *behind = 0;
+
+	if (local == upstream)
+		return 0;
+
+	return graph_paint_down(ahead, behind, NULL, graph, local, upstream);
+}
+
+/*
+ * Compute ahead/behind counts of every commit in +targets+ against
+ * +base+ in a single walk. Each visited commit carries a bitset of the
+ * tips it is reachable from (bit 0 for +base+), and is counted once for
+ * every target it sets apart from +base+. Bitsets are only allocated
+ * for the commits that are actually visited.
+ */
+int rugged_commit_graph_ahead_behind_many(
+	size_t *ahead, size_t *behind, const rugged_commit_graph *graph,
+	uint32_t base, const uint32_t *targets, size_t count)
+{
+	struct graph_queue queue = { graph, NULL, 0, 0 };
+	struct graph_parents parents;
+	size_t words = (count + 1 + 63) / 64, slots = 0, slots_alloc = 0, nonstale = 0, i, w;
+	uint64_t *bits = NULL, last_mask;
+	uint32_t *slot_of, parent;
+	int error = 0, ret;
+
+	last_mask = ((count + 1) % 64) ? (((uint64_t)1 << ((count + 1) % 64)) - 1) : ~(uint64_t)0;
+
+	memset(ahead, 0, count * sizeof(size_t));
+	memset(behind, 0, count * sizeof(size_t));
+
+	/* slot 0 is never used, so that a zero entry means "not visited" */
+	if (!(slot_of = calloc(graph->num_commits, sizeof(uint32_t)))) {
+		giterr_set_oom();
+		return -1;
+	}
+
+#define GRAPH_BITS(slot) (bits + (size_t)(slot) * words)
+
+	for (i = 0; i <= count; ++i) {
+		uint32_t pos = i ? targets[i - 1] : base;
+
+		if (!slot_of[pos]) {
+			if (slots + 2 > slots_alloc) {
+				size_t alloc = slots_alloc ? slots_alloc * 2 : 64;
+				uint64_t *grown;
+
+				while (alloc < slots + 2)
+					alloc *= 2;
+
+				if (!(grown = realloc(bits, alloc * words * sizeof(uint64_t)))) {
+					giterr_set_oom();
+					error = -1;
+					goto done;
+				}
+
+				bits = grown;
+				slots_alloc = alloc;
+			}
+
+			slot_of[pos] = (uint32_t)++slots;
+			memset(GRAPH_BITS(slots), 0, words * sizeof(uint64_t));
+
+			if ((error = graph_queue_push(&queue, pos)) < 0)
+				goto done;
+		}
+
+		GRAPH_BITS(slot_of[pos])[i / 64] |= (uint64_t)1 << (i % 64);
+	}
+
+	/* Everything queued so far is non-stale unless all tips are the same commit */
+	for (i = 0; i < queue.length; ++i) {
+		uint64_t *set = GRAPH_BITS(slot_of[queue.items[i]]);
+
+		for (w = 0; w < words; ++w) {
+			if (set[w] != (w + 1 == words ? last_mask : ~(uint64_t)0)) {
+				nonstale++;
+				break;
+			}
+		}
+	}
+
+	while (nonstale > 0 && queue.length > 0) {
+		uint32_t pos = graph_queue_pop(&queue);
+		size_t slot = slot_of[pos];
+		int from_base = (int)(GRAPH_BITS(slot)[0] & 1), stale = 1;
+
+		for (w = 0; w < words; ++w) {
+			uint64_t set = GRAPH_BITS(slot)[w], mask = (w + 1 == words) ? last_mask : ~(uint64_t)0;
+			uint64_t counted = from_base ? (~set & mask) : set;
+
+			if (set != mask)
+				stale = 0;
+
+			if (w == 0)
+				counted &= ~(uint64_t)1;
+
+			for (i = w * 64; counted; ++i, counted >>= 1) {
+				if (!(counted & 1))
+					continue;
+
+				if (from_base)
+					behind[i - 1]++;
+				else
+					ahead[i - 1]++;
+			}
+		}
+
+		if (!stale)
+			nonstale--;
+
+		graph_parents_init(&parents, graph, pos);
+
+		while ((ret = graph_parents_next(&parent, &parents)) > 0) {
+			uint64_t *set, *parent_set;
+			int changed = 0, was_stale = 1, is_stale = 1;
+
+			if (!slot_of[parent]) {
+				if (slots + 1 >= slots_alloc) {
+					uint64_t *grown = realloc(bits, slots_alloc * 2 * words * sizeof(uint64_t));
+
+					if (!grown) {
+						giterr_set_oom();
+						error = -1;
+						goto done;
+					}
+
+					bits = grown;
+					slots_alloc *= 2;
+				}
+
+				slot_of[parent] = (uint32_t)++slots;
+				memset(GRAPH_BITS(slots), 0, words * sizeof(uint64_t));
+
+				if ((error = graph_queue_push(&queue, parent)) < 0)
+					goto done;
+
+				was_stale = 0;
+				nonstale++;
+			}
+
+			set = GRAPH_BITS(slot);
+			parent_set = GRAPH_BITS(slot_of[parent]);
+
+			for (w = 0; w < words; ++w) {
+				uint64_t mask = (w + 1 == words) ? last_mask : ~(uint64_t)0;
+
+				if (parent_set[w] != mask)
+					was_stale = 0;
+
+				if ((parent_set[w] | set[w]) != parent_set[w]) {
+					parent_set[w] |= set[w];
+					changed = 1;
+				}
+
+				if (parent_set[w] != mask)
+					is_stale = 0;
+			}
+
+			if (changed && !was_stale && is_stale)
+				nonstale--;
+		}
+
+		if (ret < 0) {
+			error = -1;
+			goto done;
+		}
+	}
+
+#undef GRAPH_BITS
+
+done:
+	free(queue.items);
+	free(slot_of);
+	free(bits);
+	return error;
+}
+
+/*
+ * Collect the best common ancestors of +one+ and +two+ into a new
+ * array in +bases+, which must be released with free(). Like libgit2,
+ * the most recently committed merge base comes first.
+ */
+int rugged_commit_graph_merge_bases(
+	git_oid **bases, size_t *count,
+	const rugged_commit_graph *graph, uint32_t one, uint32_t two)
+{
+	struct graph_queue found = { graph, NULL, 0, 0 };
+	size_t i, j;
+	int error;
+
+	*bases = NULL;
+	*count = 0;
+
+	if ((error = graph_paint_down(NULL, NULL, &found, graph, one, two)) < 0)
+		goto done;
+
+	if (found.length == 0)
+		goto done;
+
+	if (!(*bases = malloc(found.length * sizeof(git_oid)))) {
+		giterr_set_oom();
+		error = -1;
+		goto done;
+	}
+
+	/* There are rarely more than a couple of merge bases */
+	for (i = 1; i < found.length; ++i) {
+		uint32_t pos = found.items[i];
+
+		for (j = i; j > 0 && graph_commit_time(graph, found.items[j - 1]) < graph_commit_time(graph, pos); --j)
+			found.items[j] = found.items[j - 1];
+
+		found.items[j] = pos;
+	}
+
+	for (i = 0; i < found.length; ++i)
+		rugged_commit_graph_oid(&(*bases)[i], graph, found.items[i]);
+
+	*count = found.length;
+
+done:
+	free(found.items);
+	return error;
+}
+
+/*
+ * Returns 1 if +ancestor+ is reachable from +commit+, 0 if not, and
+ * -1 on error. Only commits with a higher generation number than
+ * +ancestor+ can reach it, which bounds the walk.
+ */
+int rugged_commit_graph_descendant_of(
+	const rugged_commit_graph *graph, uint32_t commit, uint32_t ancestor)
+{
+	struct graph_parents parents;
+	uint32_t *stack, parent, min_generation;
+	unsigned char *seen;
+	size_t length = 0, alloc = 64;
+	int result = 0, ret;
+
+	if (commit == ancestor)
+		return 0;
+
+	min_generation = graph_generation(graph, ancestor);
+	if (graph_generation(graph, commit) <= min_generation)
+		return 0;
+
+	seen = calloc(graph->num_commits, 1);
+	stack = malloc(alloc * sizeof(uint32_t));
+
+	if (!seen || !stack) {
+		giterr_set_oom();
+		result = -1;
+		goto done;
+	}
+
+	stack[length++] = commit;
+	seen[commit] = 1;
+
+	while (length > 0 && !result) {
+		graph_parents_init(&parents, graph, stack[--length]);
+
+		while ((ret = graph_parents_next(&parent, &parents)) > 0) {
+			if (parent == ancestor) {
+				result = 1;
+				break;
+			}
+
+			if (seen[parent] || graph_generation(graph, parent) <= min_generation)
+				continue;
+
+			seen[parent] = 1;
+
+			if (length == alloc) {
+				uint32_t *grown = realloc(stack, alloc * 2 * sizeof(uint32_t));
+
+				if (!grown) {
+					giterr_set_oom();
+					result = -1;
+					goto done;
+				}
+
+				stack = grown;
+				alloc *= 2;
+			}
+
+			stack[length++] = parent;
+		}
+
+		if (ret < 0)
+			result = -1;
+	}
+
+done:
+	free(stack);
+	free(seen);
+	return result;
+}
+
+/*
+ * Without a commit-graph, rugged_commit_walk_ahead_behind_many runs the
+ * same shared bitset walk over commits read from the object database,
+ * in commit date order like git_graph_ahead_behind. A commit whose
+ * bitset grows after it was counted, because of clock skew, has its
+ * counts taken back and is queued again; to give such commits a chance,
+ * the walk goes on for WALK_SLOP commits after only the history common
+ * to all tips is left, like the slop of git's revision walk.
+ */
+struct walk_commit {
+	git_oid oid;
+	git_time_t time;
+	size_t parents, parent_count;
+	int queued, counted;
+};
+
+struct walk_state {
+	git_repository *repo;
+	struct walk_commit *commits;
+	size_t count, alloc;
+
+	/* the parents of every commit, back to back */
+	git_oid *parent_ids;
+	size_t parent_ids_count, parent_ids_alloc;
+
+	/* open addressing table of commit index + 1 */
+	uint32_t *table;
+	size_t table_size;
+
+	uint64_t *bits;
+	size_t bits_alloc, words;
+	uint64_t last_mask;
+
+	uint32_t *queue;
+	size_t queue_length, queue_alloc;
+};
+
+#define WALK_SLOP 5
+#define WALK_BITS(state, i) ((state)->bits + (size_t)(i) * (state)->words)
+
+static size_t walk_hash(const git_oid *oid)
+{
+	size_t hash;
+	memcpy(&hash, oid->id, sizeof(hash));
+	return hash;
+}
+
+static int walk_table_grow(struct walk_state *state)
+{
+	size_t size = state->table_size ? state->table_size * 2 : 1024, i;
+	uint32_t *table = calloc(size, sizeof(uint32_t));
+
+	if (!table) {
+		giterr_set_oom();
+		return -1;
+	}
+
+	for (i = 0; i < state->count; ++i) {
+		size_t slot = walk_hash(&state->commits[i].oid) & (size - 1);
+
+		while (table[slot])
+			slot = (slot + 1) & (size - 1);
+
+		table[slot] = (uint32_t)i + 1;
+	}
+
+	free(state->table);
+	state->table = table;
+	state->table_size = size;
+	return 0;
+}
+
+static int walk_grow(void **items, size_t *alloc, size_t needed, size_t item_size)
+{
+	size_t grown_alloc = *alloc ? *alloc : 64;
+	void *grown;
+
+	if (needed <= *alloc)
+		return 0;
+
+	while (grown_alloc < needed)
+		grown_alloc *= 2;
+
+	if (!(grown = realloc(*items, grown_alloc * item_size))) {
+		giterr_set_oom();
+		return -1;
+	}
+
+	*items = grown;
+	*alloc = grown_alloc;
+	return 0;
+}
+
+/*
+ * Find the index of the commit +oid+, reading it from the object database
+ * the first time it is seen.
+ */
+static int walk_commit_get(size_t *out, struct walk_state *state, const git_oid *oid)
+{
+	struct walk_commit *commit;
+	git_commit *object;
+	size_t slot, i;
+	int error;
+
+	if (state->count * 2 >= state->table_size && walk_table_grow(state) < 0)
+		return -1;
+
+	slot = walk_hash(oid) & (state->table_size - 1);
+
+	for (; state->table[slot]; slot = (slot + 1) & (state->table_size - 1)) {
+		if (git_oid_equal(&state->commits[state->table[slot] - 1].oid, oid)) {
+			*out = state->table[slot] - 1;
+			return 0;
+		}
+	}
+
+	if ((error = git_commit_lookup(&object, state->repo, oid)) < 0)
+		return error;
+
+	if (walk_grow((void **)&state->commits, &state->alloc, state->count + 1, sizeof(struct walk_commit)) < 0 ||
+		walk_grow((void **)&state->bits, &state->bits_alloc, state->count + 1, state->words * sizeof(uint64_t)) < 0 ||
+		walk_grow((void **)&state->parent_ids, &state->parent_ids_alloc,
+			state->parent_ids_count + git_commit_parentcount(object), sizeof(git_oid)) < 0) {
+		git_commit_free(object);
+		return -1;
+	}
+
+	commit = &state->commits[state->count];
+	git_oid_cpy(&commit->oid, oid);
+	commit->time = git_commit_time(object);
+	commit->parents = state->parent_ids_count;
+	commit->parent_count = git_commit_parentcount(object);
+	commit->queued = commit->counted = 0;
+
+	for (i = 0; i < commit->parent_count; ++i)
+		git_oid_cpy(&state->parent_ids[state->parent_ids_count++], git_commit_parent_id(object, (unsigned int)i));
+
+	git_commit_free(object);
+
+	memset(WALK_BITS(state, state->count), 0, state->words * sizeof(uint64_t));
+	state->table[slot] = (uint32_t)(state->count + 1);
+
+	*out = state->count++;
+	return 0;
+}
+
+/* The newest commit first; ties go to the commit that was seen first */
+static int walk_queue_before(const struct walk_state *state, uint32_t a, uint32_t b)
+{
+	if (state->commits[a].time != state->commits[b].time)
+		return state->commits[a].time > state->commits[b].time;
+
+	return a < b;
+}
+
+static int walk_queue_push(struct walk_state *state, uint32_t commit)
+{
+	size_t i;
+
+	if (walk_grow((void **)&state->queue, &state->queue_alloc, state->queue_length + 1, sizeof(uint32_t)) < 0)
+		return -1;
+
+	i = state->queue_length++;
+	while (i > 0) {
+		size_t parent = (i - 1) / 2;
+
+		if (!walk_queue_before(state, commit, state->queue[parent]))
+			break;
+
+		state->queue[i] = state->queue[parent];
+		i = parent;
+	}
+
+	state->queue[i] = commit;
+	state->commits[commit].queued = 1;
+	return 0;
+}
+
+static uint32_t walk_queue_pop(struct walk_state *state)
+{
+	uint32_t top = state->queue[0], last = state->queue[--state->queue_length];
+	size_t i = 0;
+
+	for (;;) {
+		size_t child = i * 2 + 1;
+
+		if (child >= state->queue_length)
+			break;
+
+		if (child + 1 < state->queue_length &&
+			walk_queue_before(state, state->queue[child + 1], state->queue[child]))
+			child++;
+
+		if (!walk_queue_before(state, state->queue[child], last))
+			break;
+
+		state->queue[i] = state->queue[child];
+		i = child;
+	}
+
+	if (state->queue_length > 0)
+		state->queue[i] = last;
+
+	state->commits[top].queued = 0;
+	return top;
+}
+
+/* Whether every tip reaches +commit+, which then tells no tips apart */
+static int walk_is_stale(const struct walk_state *state, size_t commit)
+{
+	const uint64_t *set = WALK_BITS(state, commit);
+	size_t w;
+
+	for (w = 0; w < state->words; ++w) {
+		if (set[w] != (w + 1 == state->words ? state->last_mask : ~(uint64_t)0))
+			return 0;
+	}
+
+	return 1;
+}
+
+/* Add (+delta+ 1) or take back (+delta+ -1) what +commit+ counts for */
+static void walk_count(size_t *ahead, size_t *behind, const struct walk_state *state, size_t commit, size_t delta)
+{
+	const uint64_t *set = WALK_BITS(state, commit);
+	int from_base = (int)(set[0] & 1);
+	size_t w, i;
+
+	for (w = 0; w < state->words; ++w) {
+		uint64_t mask = (w + 1 == state->words) ? state->last_mask : ~(uint64_t)0;
+		uint64_t counted = from_base ? (~set[w] & mask) : set[w];
+
+		if (w == 0)
+			counted &= ~(uint64_t)1;
+
+		for (i = w * 64; counted; ++i, counted >>= 1) {
+			if (!(counted & 1))
+				continue;
+
+			if (from_base)
+				behind[i - 1] += delta;
+			else
+				ahead[i - 1] += delta;
+		}
+	}
+}
+
+int rugged_commit_walk_ahead_behind_many(
+	size_t *ahead, size_t *behind, git_repository *repo,
+	const git_oid *base, const git_oid *targets, size_t count)
+{
+	struct walk_state state;
+	size_t nonstale = 0, slop = WALK_SLOP, i, w;
+	int error = 0;
+
+	memset(&state, 0, sizeof(state));
+	state.repo = repo;
+	state.words = (count + 1 + 63) / 64;
+	state.last_mask = ((count + 1) % 64) ? (((uint64_t)1 << ((count + 1) % 64)) - 1) : ~(uint64_t)0;
+
+	memset(ahead, 0, count * sizeof(size_t));
+	memset(behind, 0, count * sizeof(size_t));
+
+	for (i = 0; i <= count; ++i) {
+		size_t commit;
+
+		if ((error = walk_commit_get(&commit, &state, i ? &targets[i - 1] : base)) < 0)
+			goto done;
+
+		WALK_BITS(&state, commit)[i / 64] |= (uint64_t)1 << (i % 64);
+
+		if (!state.commits[commit].queued && (error = walk_queue_push(&state, (uint32_t)commit)) < 0)
+			goto done;
+	}
+
+	for (i = 0; i < state.queue_length; ++i) {
+		if (!walk_is_stale(&state, state.queue[i]))
+			nonstale++;
+	}
+
+	while ((nonstale > 0 || slop > 0) && state.queue_length > 0) {
+		uint32_t commit = walk_queue_pop(&state);
+		size_t parents, p;
+
+		if (!walk_is_stale(&state, commit))
+			nonstale--;
+
+		if (nonstale > 0)
+			slop = WALK_SLOP;
+		else if (slop > 0)
+			slop--;
+
+		walk_count(ahead, behind, &state, commit, 1);
+		state.commits[commit].counted = 1;
+
+		parents = state.commits[commit].parents;
+
+		for (p = 0; p < state.commits[commit].parent_count; ++p) {
+			git_oid parent_id;
+			size_t parent;
+			uint64_t *set, *parent_set;
+			int changed = 0, was_stale;
+
+			/* reading the parent may move the arrays around */
+			git_oid_cpy(&parent_id, &state.parent_ids[parents + p]);
+
+			if ((error = walk_commit_get(&parent, &state, &parent_id)) < 0)
+				goto done;
+
+			set = WALK_BITS(&state, commit);
+			parent_set = WALK_BITS(&state, parent);
+			was_stale = walk_is_stale(&state, parent);
+
+			for (w = 0; w < state.words; ++w) {
+				if ((parent_set[w] | set[w]) != parent_set[w])
+					changed = 1;
+			}
+
+			if (!changed)
+				continue;
+
+			if (state.commits[parent].counted) {
+				walk_count(ahead, behind, &state, parent, (size_t)-1);
+				state.commits[parent].counted = 0;
+			}
+
+			for (w = 0; w < state.words; ++w)
+				parent_set[w] |= set[w];
+
+			if (state.commits[parent].queued) {
+				if (!was_stale && walk_is_stale(&state, parent))
+					nonstale--;
+			} else {
+				if ((error = walk_queue_push(&state, (uint32_t)parent)) < 0)
+					goto done;
+
+				if (!walk_is_stale(&state, parent))
+					nonstale++;
+			}
+		}
+	}
+
+done:
+	free(state.commits);
+	free(state.parent_ids);
+	free(state.table);
+	free(state.bits);
+	free(state.queue);
+	return error;
+}
+
+#undef WALK_BITS
+#undef WALK_SLOP
+
+/*
+ * Writing
+ */
+struct graph_entry {
+	git_oid tree;
+	uint32_t parents[2];
+	uint32_t generation;
+	uint64_t time;
+};
+
+struct graph_write_args {
+	git_repository *repo;
+	unsigned char *out;
+	size_t out_size;
+	int error;
+};
+
+static int graph_oid_cmp(const void *a, const void *b)
+{
+	return git_oid_cmp((const git_oid *)a, (const git_oid *)b);
+}
+
+static int graph_find(uint32_t *pos, const git_oid *sorted, size_t count, const git_oid *oid)
+{
+	const git_oid *found = bsearch(oid, sorted, count, sizeof(git_oid), graph_oid_cmp);
+
+	if (!found) {
+		giterr_set_str(GITERR_ODB, "Commit history is incomplete");
+		return -1;
+	}
+
+	*pos = (uint32_t)(found - sorted);
+	return 0;
+}
+
+static int graph_push_refs(git_revwalk *walk, git_repository *repo)
+{
+	git_reference_iterator *iter;
+	git_reference *ref;
+	git_object *target;
+	int error;
+
+	if ((error = git_reference_iterator_new(&iter, repo)) < 0)
+		return error;
+
+	while ((error = git_reference_next(&ref, iter)) == 0) {
+		/* Refs that do not point to commits are not part of the graph */
+		if (git_reference_peel(&target, ref, GIT_OBJ_COMMIT) == 0) {
+			error = git_revwalk_push(walk, git_object_id(target));
+			git_object_free(target);
+		} else {
+			giterr_clear();
+		}
+
+		git_reference_free(ref);
+
+		if (error < 0)
+			break;
+	}
+
+	git_reference_iterator_free(iter);
+
+	if (error != GIT_ITEROVER)
+		return error;
+
+	/* A detached HEAD is reachable too; an unborn one is fine */
+	if (git_repository_head_detached(repo) == 1)
+		return git_revwalk_push_head(walk);
+
+	return 0;
+}
+
+static void graph_put_be32(unsigned char *p, uint32_t value)
+{
+	p[0] = (unsigned char)(value >> 24);
+	p[1] = (unsigned char)(value >> 16);
+	p[2] = (unsigned char)(value >> 8);
+	p[3] = (unsigned char)value;
+}
+
+static void graph_put_chunk(unsigned char *p, uint32_t id, uint64_t offset)
+{
+	graph_put_be32(p, id);
+	graph_put_be32(p + 4, (uint32_t)(offset >> 32));
+	graph_put_be32(p + 8, (uint32_t)offset);
+}
+
+static int graph_serialize(
+	struct graph_write_args *args, const git_oid *sorted, size_t count,
+	const struct graph_entry *entries, const uint32_t *edges, size_t edge_count)
+{
+	size_t chunk_count = edge_count ? 4 : 3, i;
+	size_t offset = GRAPH_HEADER_SIZE + (chunk_count + 1) * GRAPH_CHUNK_ENTRY_SIZE;
+	unsigned char *p;
+	uint32_t fanout = 0;
+	int byte;
+
+	args->out_size = offset + GRAPH_FANOUT_SIZE +
+		count * (GIT_OID_RAWSZ + GRAPH_DATA_SIZE) + edge_count * 4;
+
+	if (!(args->out = p = malloc(args->out_size))) {
+		giterr_set_oom();
+		return -1;
+	}
+
+	memcpy(p, GRAPH_SIGNATURE, 4);
+	p[4] = GRAPH_VERSION;
+	p[5] = GRAPH_HASH_VERSION;
+	p[6] = (unsigned char)chunk_count;
+	p[7] = 0;
+	p += GRAPH_HEADER_SIZE;
+
+	graph_put_chunk(p, GRAPH_CHUNK_OID_FANOUT, offset);
+	offset += GRAPH_FANOUT_SIZE;
+	graph_put_chunk(p + 12, GRAPH_CHUNK_OID_LOOKUP, offset);
+	offset += count * GIT_OID_RAWSZ;
+	graph_put_chunk(p + 24, GRAPH_CHUNK_DATA, offset);
+	offset += count * GRAPH_DATA_SIZE;
+	p += 36;
+
+	if (edge_count) {
+		graph_put_chunk(p, GRAPH_CHUNK_EXTRA_EDGES, offset);
+		offset += edge_count * 4;
+		p += 12;
+	}
+
+	graph_put_chunk(p, 0, offset);
+	p += 12;
+
+	for (byte = 0, i = 0; byte < 256; ++byte) {
+		while (i < count && sorted[i].id[0] == byte)
+			i++, fanout++;
+
+		graph_put_be32(p, fanout);
+		p += 4;
+	}
+
+	for (i = 0; i < count; ++i) {
+		memcpy(p, sorted[i].id, GIT_OID_RAWSZ);
+		p += GIT_OID_RAWSZ;
+	}
+
+	for (i = 0; i < count; ++i) {
+		const struct graph_entry *entry = &entries[i];
+
+		memcpy(p, entry->tree.id, GIT_OID_RAWSZ);
+		graph_put_be32(p + 20, entry->parents[0]);
+		graph_put_be32(p + 24, entry->parents[1]);
+		graph_put_be32(p + 28, (entry->generation << 2) | (uint32_t)((entry->time >> 32) & 0x3));
+		graph_put_be32(p + 32, (uint32_t)entry->time);
+		p += GRAPH_DATA_SIZE;
+	}
+
+	for (i = 0; i < edge_count; ++i) {
+		graph_put_be32(p, edges[i]);
+		p += 4;
+	}
+
+	return 0;
+}
+
+static void *rugged__commit_graph_write_nogvl(void *data)
+{
+	struct graph_write_args *args = data;
+	git_revwalk *walk = NULL;
+	git_commit *commit;
+	git_oid oid, *order = NULL, *sorted = NULL;
+	struct graph_entry *entries = NULL;
+	uint32_t *edges = NULL;
+	size_t count = 0, alloc = 0, edge_count = 0, edge_alloc = 0, i;
+	int error;
+
+	if ((error = git_revwalk_new(&walk, args->repo)) < 0)
+		goto done;
+
+	/* Parents come before their children, so generations can be computed in one pass */
+	git_revwalk_sorting(walk, GIT_SORT_TOPOLOGICAL | GIT_SORT_REVERSE);
+
+	if ((error = graph_push_refs(walk, args->repo)) < 0)
+		goto done;
+
+	while ((error = git_revwalk_next(&oid, walk)) == 0) {
+		if (count == alloc) {
+			git_oid *grown;
+
+			alloc = alloc ? alloc * 2 : 1024;
+			if (!(grown = realloc(order, alloc * sizeof(git_oid)))) {
+				giterr_set_oom();
+				error = -1;
+				goto done;
+			}
+
+			order = grown;
+		}
+
+		git_oid_cpy(&order[count++], &oid);
+	}
+
+	if (error != GIT_ITEROVER)
+		goto done;
+
+	error = 0;
+
+	if (count > GRAPH_EDGE_LAST_MASK) {
+		giterr_set_str(GITERR_INVALID, "Too many commits for a commit-graph");
+		error = -1;
+		goto done;
+	}
+
+	sorted = malloc((count ? count : 1) * sizeof(git_oid));
+	entries = calloc(count ? count : 1, sizeof(struct graph_entry));
+
+	if (!sorted || !entries) {
+		giterr_set_oom();
+		error = -1;
+		goto done;
+	}
+
+	memcpy(sorted, order, count * sizeof(git_oid));
+	qsort(sorted, count, sizeof(git_oid), graph_oid_cmp);
+
+	for (i = 0; i < count; ++i) {
+		struct graph_entry *entry;
+		unsigned int n, parent_count;
+		uint32_t pos, parent, generation = 0;
+		git_time_t time;
+
+		if ((error = git_commit_lookup(&commit, args->repo, &order[i])) < 0)
+			goto done;
+
+		if ((error = graph_find(&pos, sorted, count, &order[i])) < 0) {
+			git_commit_free(commit);
+			goto done;
+		}
+
+		entry = &entries[pos];
+		git_oid_cpy(&entry->tree, git_commit_tree_id(commit));
+
+		time = git_commit_time(commit);
+		entry->time = time > 0 ? (uint64_t)time & 0x3ffffffffULL : 0;
+
+		entry->parents[0] = entry->parents[1] = GRAPH_PARENT_NONE;
+		parent_count = git_commit_parentcount(commit);
+
+		for (n = 0; n < parent_count; ++n) {
+			if ((error = graph_find(&parent, sorted, count, git_commit_parent_id(commit, n))) < 0) {
+				git_commit_free(commit);
+				goto done;
+			}
+
+			if (entries[parent].generation > generation)
+				generation = entries[parent].generation;
+
+			if (n == 0 || (n == 1 && parent_count == 2)) {
+				entry->parents[n] = parent;
+				continue;
+			}
+
+			if (n == 1)
+				entry->parents[1] = GRAPH_EXTRA_EDGES_NEEDED | (uint32_t)edge_count;
+
+			if (edge_count == edge_alloc) {
+				uint32_t *grown;
+
+				edge_alloc = edge_alloc ? edge_alloc * 2 : 16;
+				if (!(grown = realloc(edges, edge_alloc * sizeof(uint32_t)))) {
+					git_commit_free(commit);
+					giterr_set_oom();
+					error = -1;
+					goto done;
+				}
+
+				edges = grown;
+			}
+
+			edges[edge_count++] = parent | (n + 1 == parent_count ? GRAPH_EXTRA_EDGES_NEEDED : 0);
+		}
+
+		entry->generation = generation < GRAPH_GENERATION_MAX ? generation + 1 : GRAPH_GENERATION_MAX;
+		git_commit_free(commit);
+	}
+
+	error = graph_serialize(args, sorted, count, entries, edges, edge_count);
+
+done:
+	free(order);
+	free(sorted);
+	free(entries);
+	free(edges);
+	git_revwalk_free(walk);
+
+	args->error = error;
+	return NULL;
+}
+
+/*
+ *  call-seq:
+ *    CommitGraph.serialize(repository) -> String
+ *
+ *  Build the commit-graph of every commit reachable from the references
+ *  (and a detached HEAD) of +repository+, and return it as a binary String
+ *  in the format of Git's <tt>objects/info/commit-graph</tt> file, minus the
+ *  trailing checksum.
+ *
+ *  Most callers want Rugged::Repository#write_commit_graph instead.
+ */
+static VALUE rb_git_commit_graph_serialize(VALUE self, VALUE rb_repo)
+{
+	struct graph_write_args args = { NULL };
+	VALUE rb_result;
+
+	rugged_check_repo(rb_repo);
+	Data_Get_Struct(rb_repo, git_repository, args.repo);
+
+	rugged_without_gvl(rugged__commit_graph_write_nogvl, &args);
+	rugged_exception_check(args.error);
+
+	rb_result = rb_str_new((const char *)args.out, args.out_size);
+	free(args.out);
+
+	return rb_result;
+}
+
+/*
+ *  call-seq:
+ *    graph.size -> Integer
+ *
+ *  Return the number of commits in the commit-graph.
+ */
+static VALUE rb_git_commit_graph_size(VALUE self)
+{
+	rugged_commit_graph *graph;
+	Data_Get_Struct(self, rugged_commit_graph, graph);
+
+	return UINT2NUM(graph->num_commits);
+}
+
+/*
+ *  call-seq:
+ *    graph.include?(oid) -> true or false
+ *
+ *  Return whether the commit with the given +oid+ is part of the
+ *  commit-graph. Commits created after the graph was written are not.
+ */
+static VALUE rb_git_commit_graph_include_p(VALUE self, VALUE rb_oid)
+{
+	rugged_commit_graph *graph;
+	git_oid oid;
+	uint32_t pos;
+
+	Data_Get_Struct(self, rugged_commit_graph, graph);
+	rugged_exception_check(rugged_oid_fromstr(&oid, rb_oid));
+
+	return rugged_commit_graph_lookup(&pos, graph, &oid) == 0 ? Qtrue : Qfalse;
+}
+
+/*
+ *  call-seq:
+ *    graph.generation(oid) -> Integer or nil
+ *
+ *  Return the generation number of the commit with the given +oid+:
+ *  1 for root commits, and one more than the highest generation of its
+ *  parents otherwise. Returns +nil+ if the commit is not in the graph.
+ */
+static VALUE rb_git_commit_graph_generation(VALUE self, VALUE rb_oid)
+{
+	rugged_commit_graph *graph;
+	git_oid oid;
+	uint32_t pos;
+
+	Data_Get_Struct(self, rugged_commit_graph, graph);
+	rugged_exception_check(rugged_oid_fromstr(&oid, rb_oid));
+
+	if (rugged_commit_graph_lookup(&pos, graph, &oid) < 0)
+		return Qnil;
+
+	return UINT2NUM(graph_generation(graph, pos));
+}
+
+void Init_rugged_commit_graph(void)
+{
+	rb_cRuggedCommitGraph = rb_define_class_under(rb_mRugged, "CommitGraph", rb_cObject);
+
+	rb_define_singleton_method(rb_cRuggedCommitGraph, "serialize", rb_git_commit_graph_serialize, 1);
+
+	rb_define_method(rb_cRuggedCommitGraph, "size", rb_git_commit_graph_size, 0);
+	rb_define_method(rb_cRuggedCommitGraph, "include?", rb_git_commit_graph_include_p, 1);
+	rb_define_method(rb_cRuggedCommitGraph, "generation", rb_git_commit_graph_generation, 1);
+}
@@ -23,10 +23,25 @@
  */
 
 #include "rugged.h"
+#include <errno.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#include <time.h>
+#endif
+
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
 
 extern VALUE rb_mRugged;
 VALUE rb_cRuggedDiff;
 
+static ID id_max_total_lines, id_timeout_ms, id_truncated, id_skipped_deltas, id_truncated_deltas;
+static ID id_patch_options, id_patch_blobs;
+
 VALUE rugged_diff_new(VALUE klass, VALUE owner, git_diff *diff)
 {
 	VALUE rb_diff = Data_Wrap_Struct(klass, NULL, git_diff_free, diff);
@@ -190,293 +205,1468 @@ void rugged_parse_diff_options(git_diff_options *opts, VALUE rb_options)
 	}
 }
 
-static int diff_print_cb(
-	const git_diff_delta *delta,
-	const git_diff_hunk *hunk,
-	const git_diff_line *line,
+static uint64_t rugged__diff_budget_now(void)
+{
+#ifdef _WIN32
+	return GetTickCount64();
+#else
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+#endif
+}
+
+static int rugged__diff_budget_within_deadline(uint64_t deadline)
+{
+	return !deadline || rugged__diff_budget_now() < deadline;
+}
+
+/*
+ * Keep a copy of +delta+, which is left out of the diff, so that it can
+ * be reported by Diff#skipped_deltas. Runs without the GVL.
+ */
+static int rugged__diff_budget_skip(struct rugged_diff_budget *budget, const git_diff_delta *delta)
+{
+	git_diff_delta *skipped;
+
+	if (budget->skipped_count == budget->skipped_alloc) {
+		size_t alloc = budget->skipped_alloc ? budget->skipped_alloc * 2 : 16;
+
+		skipped = realloc(budget->skipped, alloc * sizeof(git_diff_delta));
+		if (!skipped)
+			goto on_oom;
+
+		budget->skipped = skipped;
+		budget->skipped_alloc = alloc;
+	}
+
+	skipped = &budget->skipped[budget->skipped_count];
+	memcpy(skipped, delta, sizeof(git_diff_delta));
+	skipped->old_file.path = delta->old_file.path ? strdup(delta->old_file.path) : NULL;
+	skipped->new_file.path = delta->new_file.path ? strdup(delta->new_file.path) : NULL;
+
+	if ((delta->old_file.path && !skipped->old_file.path) ||
+		(delta->new_file.path && !skipped->new_file.path)) {
+		free((char *)skipped->old_file.path);
+		free((char *)skipped->new_file.path);
+		goto on_oom;
+	}
+
+	budget->skipped_count++;
+	return 1;
+
+on_oom:
+	giterr_set_oom();
+	return -1;
+}
+
+/*
+ * Called by libgit2 for every delta about to be added to the diff. Once
+ * the file or time budget is spent, every remaining delta is skipped,
+ * and recorded as such.
+ */
+static int rugged__diff_budget_notify_cb(
+	const git_diff *diff_so_far,
+	const git_diff_delta *delta_to_add,
+	const char *matched_pathspec,
 	void *payload)
 {
-	VALUE rb_str = (VALUE)payload;
+	struct rugged_diff_budget *budget = payload;
 
-	switch (line->origin) {
-		case GIT_DIFF_LINE_CONTEXT:
-		case GIT_DIFF_LINE_ADDITION:
-		case GIT_DIFF_LINE_DELETION:
-			rb_str_cat(rb_str, &line->origin, 1);
+	if (!budget->truncated) {
+		if (budget->max_files && budget->files >= budget->max_files)
+			budget->truncated = 1;
+		else if (!rugged__diff_budget_within_deadline(budget->deadline))
+			budget->truncated = 1;
 	}
 
-	rb_str_cat(rb_str, line->content, line->content_len);
+	if (budget->truncated)
+		return rugged__diff_budget_skip(budget, delta_to_add);
 
-	return GIT_OK;
+	budget->files++;
+	return 0;
+}
+
+static size_t rugged__diff_budget_value(VALUE rb_options, const char *key)
+{
+	VALUE rb_value = rb_hash_aref(rb_options, CSTR2SYM(key));
+
+	if (NIL_P(rb_value))
+		return 0;
+
+	Check_Type(rb_value, T_FIXNUM);
+	if (FIX2LONG(rb_value) <= 0)
+		rb_raise(rb_eArgError, "%s must be positive", key);
+
+	return FIX2ULONG(rb_value);
 }
 
 /*
- *  call-seq:
- *    diff.patch -> patch
- *    diff.patch(:compact => true) -> compact_patch
- *
- *  Return a string containing the diff in patch form.
+ * Parse the size guardrails of a diff out of +rb_options+. The budget
+ * becomes the payload of +opts+, so it has to outlive the diff call;
+ * pass it to `rugged_diff_set_budget` once the Rugged::Diff is created,
+ * or to `rugged_diff_budget_free` if the diff failed.
  */
-static VALUE rb_git_diff_patch(int argc, VALUE *argv, VALUE self)
+void rugged_parse_diff_budget(struct rugged_diff_budget *budget, git_diff_options *opts, VALUE rb_options)
 {
-	git_diff *diff;
-	VALUE rb_str = rb_str_new(NULL, 0);
-	VALUE rb_opts;
+	size_t max_file_bytes;
 
-	rb_scan_args(argc, argv, "00:", &rb_opts);
+	memset(budget, 0, sizeof(*budget));
 
-	Data_Get_Struct(self, git_diff, diff);
+	if (NIL_P(rb_options))
+		return;
 
-	if (!NIL_P(rb_opts)) {
-		if (rb_hash_aref(rb_opts, CSTR2SYM("compact")) == Qtrue)
-			git_diff_print(diff, GIT_DIFF_FORMAT_NAME_STATUS, diff_print_cb, (void*)rb_str);
-		else
-			git_diff_print(diff, GIT_DIFF_FORMAT_PATCH, diff_print_cb, (void*)rb_str);
-	} else {
-		git_diff_print(diff, GIT_DIFF_FORMAT_PATCH, diff_print_cb, (void*)rb_str);
+	Check_Type(rb_options, T_HASH);
+
+	budget->max_files = rugged__diff_budget_value(rb_options, "max_files");
+	budget->max_total_lines = rugged__diff_budget_value(rb_options, "max_total_lines");
+
+	/* libgit2 treats files over `max_size` as binary and never loads them */
+	max_file_bytes = rugged__diff_budget_value(rb_options, "max_file_bytes");
+	if (max_file_bytes) {
+		if (!NIL_P(rb_hash_aref(rb_options, CSTR2SYM("max_size"))))
+			rb_raise(rb_eArgError, "max_size and max_file_bytes can't be given together");
+
+		opts->max_size = (git_off_t)max_file_bytes;
 	}
 
-	return rb_str;
+	budget->timeout_ms = rugged__diff_budget_value(rb_options, "timeout_ms");
+	if (budget->timeout_ms)
+		budget->deadline = rugged__diff_budget_now() + budget->timeout_ms;
+
+	if (budget->max_files || budget->deadline) {
+		opts->notify_cb = rugged__diff_budget_notify_cb;
+		opts->notify_payload = budget;
+	}
 }
 
-static int diff_write_cb(
-	const git_diff_delta *delta,
-	const git_diff_hunk *hunk,
-	const git_diff_line *line,
-	void *payload)
+void rugged_diff_budget_free(struct rugged_diff_budget *budget)
 {
-	VALUE rb_io = (VALUE)payload, str = rb_str_new(line->content, line->content_len);
+	size_t i;
 
-	rb_io_write(rb_io, str);
+	for (i = 0; i < budget->skipped_count; ++i) {
+		free((char *)budget->skipped[i].old_file.path);
+		free((char *)budget->skipped[i].new_file.path);
+	}
 
-	return GIT_OK;
+	free(budget->skipped);
+	budget->skipped = NULL;
+	budget->skipped_count = budget->skipped_alloc = 0;
 }
 
-/*
- *  call-seq:
- *    diff.write_patch(io) -> nil
- *    diff.write_patch(io, :compact => true) -> nil
- *
- *  Write a patch directly to an object which responds to "write".
- */
-static VALUE rb_git_diff_write_patch(int argc, VALUE *argv, VALUE self)
+struct rugged_diff_set_budget_args {
+	VALUE rb_diff;
+	struct rugged_diff_budget *budget;
+};
+
+static VALUE rugged__diff_set_budget_body(VALUE payload)
 {
-	git_diff *diff;
-	VALUE rb_io, rb_opts;
+	struct rugged_diff_set_budget_args *args = (struct rugged_diff_set_budget_args *)payload;
+	struct rugged_diff_budget *budget = args->budget;
+	VALUE rb_skipped;
+	size_t i;
 
-	rb_scan_args(argc, argv, "10:", &rb_io, &rb_opts);
+	if (budget->max_total_lines)
+		rb_ivar_set(args->rb_diff, id_max_total_lines, ULONG2NUM(budget->max_total_lines));
 
-	if (!rb_respond_to(rb_io, rb_intern("write")))
-		rb_raise(rb_eArgError, "Expected io to respond to \"write\"");
+	if (budget->timeout_ms)
+		rb_ivar_set(args->rb_diff, id_timeout_ms, ULONG2NUM(budget->timeout_ms));
 
-	Data_Get_Struct(self, git_diff, diff);
+	if (budget->skipped_count) {
+		rb_skipped = rb_ary_new2(budget->skipped_count);
+		for (i = 0; i < budget->skipped_count; ++i)
+			rb_ary_push(rb_skipped, rugged_diff_delta_new(args->rb_diff, &budget->skipped[i]));
 
-	if (!NIL_P(rb_opts)) {
-		if (rb_hash_aref(rb_opts, CSTR2SYM("compact")) == Qtrue)
-			git_diff_print(diff, GIT_DIFF_FORMAT_NAME_STATUS, diff_write_cb, (void*)rb_io);
-		else
-			git_diff_print(diff, GIT_DIFF_FORMAT_PATCH, diff_write_cb, (void*)rb_io);
-	} else {
-		git_diff_print(diff, GIT_DIFF_FORMAT_PATCH, diff_write_cb, (void*)rb_io);
+		rb_ivar_set(args->rb_diff, id_skipped_deltas, rb_skipped);
 	}
 
+	if (budget->truncated)
+		rb_ivar_set(args->rb_diff, id_truncated, Qtrue);
+
+	return Qnil;
+}
+
+static VALUE rugged__diff_set_budget_ensure(VALUE payload)
+{
+	rugged_diff_budget_free(((struct rugged_diff_set_budget_args *)payload)->budget);
 	return Qnil;
 }
 
 /*
- *  call-seq:
- *    diff.merge!(other_diff) -> self
- *
- *  Merges all diff information from +other_diff+.
+ * Record the budget of a freshly created Rugged::Diff, and the deltas it
+ * left out, then free the budget.
  */
-static VALUE rb_git_diff_merge(VALUE self, VALUE rb_other)
+void rugged_diff_set_budget(VALUE rb_diff, struct rugged_diff_budget *budget)
 {
-	git_diff *diff;
-	git_diff *other;
-	int error;
+	struct rugged_diff_set_budget_args args;
 
-	if (!rb_obj_is_kind_of(rb_other, rb_cRuggedDiff))
-		rb_raise(rb_eTypeError, "A Rugged::Diff instance is required");
+	args.rb_diff = rb_diff;
+	args.budget = budget;
 
-	Data_Get_Struct(self, git_diff, diff);
-	Data_Get_Struct(rb_other, git_diff, other);
+	rb_ensure(rugged__diff_set_budget_body, (VALUE)&args, rugged__diff_set_budget_ensure, (VALUE)&args);
+}
 
-	error = git_diff_merge(diff, other);
-	rugged_exception_check(error);
+/*
+ * Remember the options +rb_diff+ was created with, so that its patches
+ * can be generated outside of the git_diff (see Diff#each_patch).
+ */
+void rugged_diff_set_options(VALUE rb_diff, VALUE rb_options)
+{
+	rb_ivar_set(rb_diff, id_patch_options,
+		NIL_P(rb_options) ? rb_hash_new() : rb_obj_freeze(rb_hash_dup(rb_options)));
+}
 
-	return self;
+static size_t rugged__diff_max_total_lines(VALUE rb_diff)
+{
+	VALUE rb_value = rb_attr_get(rb_diff, id_max_total_lines);
+	return NIL_P(rb_value) ? 0 : NUM2ULONG(rb_value);
+}
+
+/*
+ * The deadline of a call to #each_patch, #patch or #write_patch starting
+ * now, or 0 if the diff has no +:timeout_ms+ budget. Each call gets the
+ * whole budget to itself.
+ */
+static uint64_t rugged__diff_deadline(VALUE rb_diff)
+{
+	VALUE rb_value = rb_attr_get(rb_diff, id_timeout_ms);
+	return NIL_P(rb_value) ? 0 : rugged__diff_budget_now() + NUM2ULONG(rb_value);
+}
+
+/*
+ * Record the deltas from the +from+-th on as the ones the current call
+ * to #each_patch, #patch or #write_patch left out or cut short. No delta
+ * is recorded when +from+ is past the last one.
+ */
+static void rugged__diff_set_truncated_deltas(VALUE rb_diff, git_diff *diff, size_t from)
+{
+	size_t d, delta_count = git_diff_num_deltas(diff);
+	VALUE rb_deltas = rb_ary_new2(from < delta_count ? delta_count - from : 0);
+
+	for (d = from; d < delta_count; ++d)
+		rb_ary_push(rb_deltas, rugged_diff_delta_new(rb_diff, git_diff_get_delta(diff, d)));
+
+	rb_ivar_set(rb_diff, id_truncated_deltas, rb_deltas);
 }
 
 /*
  *  call-seq:
- *    diff.find_similar!([options]) -> self
- *
- *  Detects entries in the diff that look like renames or copies (based on the
- *  given options) and replaces them with actual rename or copy entries.
- *
- *  Additionally, modified files can be broken into add/delete pairs if the
- *  amount of changes are above a specific threshold (see +:break_rewrite_threshold+).
- *
- *  By default, similarity will be measured without leading whitespace. You
- *  you can use the +:dont_ignore_whitespace+ to disable this.
- *
- *  The following options can be passed in the +options+ Hash:
+ *    diff.truncated? -> true or false
  *
- *  :rename_threshold ::
- *    An integer specifying the similarity to consider a file renamed (default 50).
- *
- *  :rename_from_rewrite_threshold ::
- *    An integer specifying the similarity of modified to be eligible
- *    rename source (default 50).
- *
- *  :copy_threshold ::
- *    An integer specifying the similarity to consider a file a copy (default 50).
- *
- *  :break_rewrite_threshold ::
- *    An integer specifying the similarity to split modify into delete/add pair (default 60).
- *
- *  :rename_limit ::
- *    An integer specifying the maximum amount of similarity sources to examine
- *    (a la diff's +-l+ option or the +diff.renameLimit+ config) (default 200).
- *
- *  :renames ::
- *    If true, looking for renames will be enabled (+--find-renames+).
- *
- *  :renames_from_rewrites ::
- *    If true, the "old side" of modified files will be considered for renames (+--break-rewrites=N+).
- *
- *  :copies ::
- *    If true, looking for copies will be enabled (+--find-copies+).
- *
- *  :copies_from_unmodified ::
- *    If true, unmodified files will be considered as copy sources (+--find-copies-harder+).
- *
- *  :break_rewrites ::
- *    If true, larger rewrites will be split into delete/add pairs (+--break-rewrites=/M+).
- *
- *  :all ::
- *    If true, enables all finding features.
- *
- *  :ignore_whitespace ::
- *    If true, similarity will be measured with all whitespace ignored.
+ *  Returns +true+ if a +:max_files+, +:timeout_ms+ or +:max_total_lines+
+ *  budget given when creating this diff has been exceeded, which means
+ *  that some deltas or patches were left out. See #skipped_deltas and
+ *  #truncated_deltas for which ones.
+ */
+static VALUE rb_git_diff_truncated_p(VALUE self)
+{
+	return RTEST(rb_attr_get(self, id_truncated)) ? Qtrue : Qfalse;
+}
+
+/*
+ *  call-seq:
+ *    diff.skipped_deltas -> array
  *
- *  :dont_ignore_whitespace ::
- *    If true, similarity will be measured without ignoring any whitespace.
+ *  Returns the deltas that the +:max_files+ or +:timeout_ms+ budget of
+ *  this diff kept out of it, in the order they were found. They aren't
+ *  yielded by #each_delta and have no patch.
+ */
+static VALUE rb_git_diff_skipped_deltas(VALUE self)
+{
+	VALUE rb_deltas = rb_attr_get(self, id_skipped_deltas);
+	return NIL_P(rb_deltas) ? rb_ary_new() : rb_ary_dup(rb_deltas);
+}
+
+/*
+ *  call-seq:
+ *    diff.truncated_deltas -> array
  *
+ *  Returns the deltas whose patches the last call to #each_patch, #patch
+ *  or #write_patch left out or cut short, because of a +:max_total_lines+
+ *  or +:timeout_ms+ budget, or of the +:max_bytes+ of a preview. The
+ *  first one may have been yielded, or written in part.
  */
-static VALUE rb_git_diff_find_similar(int argc, VALUE *argv, VALUE self)
+static VALUE rb_git_diff_truncated_deltas(VALUE self)
 {
+	VALUE rb_deltas = rb_attr_get(self, id_truncated_deltas);
+	return NIL_P(rb_deltas) ? rb_ary_new() : rb_ary_dup(rb_deltas);
+}
+
+#define RUGGED_DIFF_WRITER_BUFSIZE (64 * 1024)
+
+/*
+ * Formats the output of `git_diff_print` into a single native buffer,
+ * so that printing can run without the GVL. The buffer is either grown
+ * to hold the whole patch (`collect`), flushed straight to a file
+ * descriptor with write(2), or handed to `IO#write` one chunk at a time.
+ * Flushing always happens with the GVL, and writes to a descriptor
+ * release it again around each write(2), interruptibly.
+ */
+struct rugged_diff_writer {
+	VALUE rb_diff;
 	git_diff *diff;
-	git_diff_find_options opts = GIT_DIFF_FIND_OPTIONS_INIT;
-	VALUE rb_options;
-	int error;
+	git_diff_format_t format;
 
-	Data_Get_Struct(self, git_diff, diff);
+	char *buf;
+	size_t len, cap, flushed;
 
-	rb_scan_args(argc, argv, "00:", &rb_options);
+	int collect;
+	int fd;
+	VALUE rb_io;
 
-	if (!NIL_P(rb_options)) {
-		VALUE rb_value = rb_hash_aref(rb_options, CSTR2SYM("rename_threshold"));
-		if (!NIL_P(rb_value)) {
-			Check_Type(rb_value, T_FIXNUM);
-			opts.rename_threshold = FIX2INT(rb_value);
-		}
+	size_t written;
+	size_t max_bytes;
+	size_t lines;
+	size_t max_lines;
+	uint64_t deadline;
+	int truncated;
+	int over_budget;
 
-		rb_value = rb_hash_aref(rb_options, CSTR2SYM("rename_from_rewrite_threshold"));
-		if (!NIL_P(rb_value)) {
-			Check_Type(rb_value, T_FIXNUM);
-			opts.rename_from_rewrite_threshold = FIX2INT(rb_value);
-		}
+	/* the delta being printed, and its index in the diff */
+	const git_diff_delta *delta;
+	size_t delta_idx;
 
-		rb_value = rb_hash_aref(rb_options, CSTR2SYM("copy_threshold"));
-		if (!NIL_P(rb_value)) {
-			Check_Type(rb_value, T_FIXNUM);
-			opts.copy_threshold = FIX2INT(rb_value);
-		}
+	int result;
+	int error;
+	int exception;
+};
 
-		rb_value = rb_hash_aref(rb_options, CSTR2SYM("break_rewrite_threshold"));
-		if (!NIL_P(rb_value)) {
-			Check_Type(rb_value, T_FIXNUM);
-			opts.break_rewrite_threshold = FIX2INT(rb_value);
-		}
+#ifndef _WIN32
+/* A single write(2); the loop runs with the GVL, between interrupts */
+static void *rugged__diff_writer_write_fd_nogvl(void *data)
+{
+	struct rugged_diff_writer *w = data;
+	ssize_t ret = write(w->fd, w->buf + w->flushed, w->len - w->flushed);
 
-		rb_value = rb_hash_aref(rb_options, CSTR2SYM("rename_limit"));
-		if (!NIL_P(rb_value)) {
-			Check_Type(rb_value, T_FIXNUM);
-			opts.rename_limit = FIX2INT(rb_value);
-		}
+	if (ret < 0)
+		w->error = errno;
+	else
+		w->flushed += (size_t)ret;
 
-		if (RTEST(rb_hash_aref(rb_options, CSTR2SYM("renames")))) {
-			opts.flags |= GIT_DIFF_FIND_RENAMES;
-		}
+	return NULL;
+}
+#endif
 
-		if (RTEST(rb_hash_aref(rb_options, CSTR2SYM("renames_from_rewrites")))) {
-			opts.flags |= GIT_DIFF_FIND_RENAMES_FROM_REWRITES;
-		}
+static VALUE rugged__diff_writer_flush_body(VALUE payload)
+{
+	struct rugged_diff_writer *w = (struct rugged_diff_writer *)payload;
 
-		if (RTEST(rb_hash_aref(rb_options, CSTR2SYM("copies")))) {
-			opts.flags |= GIT_DIFF_FIND_COPIES;
-		}
+#ifndef _WIN32
+	while (w->fd >= 0 && w->flushed < w->len) {
+		int interrupt;
 
-		if (RTEST(rb_hash_aref(rb_options, CSTR2SYM("copies_from_unmodified")))) {
-			opts.flags |= GIT_DIFF_FIND_COPIES_FROM_UNMODIFIED;
-		}
+		w->error = 0;
 
-		if (RTEST(rb_hash_aref(rb_options, CSTR2SYM("break_rewrites")))) {
-			opts.flags |= GIT_DIFF_FIND_AND_BREAK_REWRITES;
-		}
+		/* Blocks without the GVL; Thread#kill and Timeout interrupt it */
+		if ((interrupt = rugged_without_gvl_io(rugged__diff_writer_write_fd_nogvl, w, 1)))
+			rb_jump_tag(interrupt);
 
-		if (RTEST(rb_hash_aref(rb_options, CSTR2SYM("all")))) {
-			opts.flags |= GIT_DIFF_FIND_ALL;
-		}
+		if (w->error == EINTR)
+			continue;
 
-		if (RTEST(rb_hash_aref(rb_options, CSTR2SYM("ignore_whitespace")))) {
-			opts.flags |= GIT_DIFF_FIND_IGNORE_WHITESPACE;
-		}
+		if (w->error) {
+			errno = w->error;
 
-		if (RTEST(rb_hash_aref(rb_options, CSTR2SYM("dont_ignore_whitespace")))) {
-			opts.flags |= GIT_DIFF_FIND_DONT_IGNORE_WHITESPACE;
+			/* Waits on non-blocking descriptors, returns false otherwise */
+			if (rb_io_wait_writable(w->fd))
+				continue;
+
+			rb_sys_fail("write");
 		}
 	}
+#endif
 
-	error = git_diff_find_similar(diff, &opts);
-	rugged_exception_check(error);
+	if (w->flushed < w->len)
+		rb_io_write(w->rb_io, rb_str_new(w->buf + w->flushed, w->len - w->flushed));
 
-	return self;
+	return Qnil;
 }
 
 /*
- *  call-seq:
- *    diff.each_patch { |patch| } -> self
- *    diff.each_patch -> enumerator
- *
- *  If given a block, yields each patch that is part of the diff.
- *  If no block is given, an enumerator will be returned.
+ * Runs with the GVL, from inside `git_diff_print`: anything raised is
+ * kept in `exception` and re-raised once printing has stopped.
  */
-static VALUE rb_git_diff_each_patch(VALUE self)
+static void *rugged__diff_writer_flush_gvl(void *data)
 {
-	git_diff *diff;
-	git_patch *patch;
-	int error = 0;
-	size_t d, delta_count;
+	struct rugged_diff_writer *w = data;
+	rb_protect(rugged__diff_writer_flush_body, (VALUE)w, &w->exception);
+	return NULL;
+}
+
+static int rugged__diff_writer_flush(struct rugged_diff_writer *w)
+{
+	w->flushed = 0;
+
+	rugged_with_gvl(rugged__diff_writer_flush_gvl, w);
+	if (w->exception)
+		return -1;
+
+	w->len = 0;
+	return 0;
+}
+
+static int rugged__diff_writer_put(struct rugged_diff_writer *w, const char *data, size_t size)
+{
+	while (size > 0) {
+		size_t length;
+
+		if (w->len == w->cap) {
+			if (w->collect) {
+				char *buf = realloc(w->buf, w->cap * 2);
+
+				if (!buf) {
+					giterr_set_oom();
+					return -1;
+				}
+
+				w->buf = buf;
+				w->cap *= 2;
+			} else if (rugged__diff_writer_flush(w) < 0) {
+				return -1;
+			}
+		}
+
+		length = w->cap - w->len < size ? w->cap - w->len : size;
+		memcpy(w->buf + w->len, data, length);
+
+		w->len += length;
+		data += length;
+		size -= length;
+	}
+
+	return 0;
+}
+
+static int rugged__diff_writer_cb(
+	const git_diff_delta *delta,
+	const git_diff_hunk *hunk,
+	const git_diff_line *line,
+	void *payload)
+{
+	struct rugged_diff_writer *w = payload;
+	size_t origin = 0, changed = 0, delta_count;
+
+	/* deltas are printed in order, with the pointers stored in the diff */
+	if (delta != w->delta) {
+		delta_count = git_diff_num_deltas(w->diff);
+		while (w->delta_idx < delta_count && git_diff_get_delta(w->diff, w->delta_idx) != delta)
+			w->delta_idx++;
+
+		w->delta = delta;
+	}
+
+	switch (line->origin) {
+		case GIT_DIFF_LINE_ADDITION:
+		case GIT_DIFF_LINE_DELETION:
+			changed = 1;
+			/* fall through */
+		case GIT_DIFF_LINE_CONTEXT:
+			origin = 1;
+	}
+
+	/* The deadline is checked on every file and hunk header */
+	if (!origin && !rugged__diff_budget_within_deadline(w->deadline)) {
+		w->truncated = w->over_budget = 1;
+		return GIT_EUSER;
+	}
+
+	/* Previews stop at the last whole line that fits */
+	if (w->max_bytes && w->written + origin + line->content_len > w->max_bytes) {
+		w->truncated = 1;
+		return GIT_EUSER;
+	}
+
+	if (changed && w->max_lines && w->lines >= w->max_lines) {
+		w->truncated = w->over_budget = 1;
+		return GIT_EUSER;
+	}
+
+	if (origin && rugged__diff_writer_put(w, &line->origin, 1) < 0)
+		return -1;
+
+	if (rugged__diff_writer_put(w, line->content, line->content_len) < 0)
+		return -1;
+
+	w->written += origin + line->content_len;
+	w->lines += changed;
+	return GIT_OK;
+}
+
+static void *rugged__diff_writer_print_nogvl(void *data)
+{
+	struct rugged_diff_writer *w = data;
+	int error = git_diff_print(w->diff, w->format, rugged__diff_writer_cb, w);
+
+	if (w->truncated) {
+		giterr_clear();
+		error = GIT_OK;
+	}
+
+	if (!error && !w->collect && w->len)
+		error = rugged__diff_writer_flush(w);
+
+	w->result = error;
+	return NULL;
+}
+
+static void rugged__diff_writer_init(struct rugged_diff_writer *w, VALUE self, VALUE rb_opts)
+{
+	memset(w, 0, sizeof(*w));
+
+	Data_Get_Struct(self, git_diff, w->diff);
+	w->rb_diff = self;
+	w->max_lines = rugged__diff_max_total_lines(self);
+	w->deadline = rugged__diff_deadline(self);
+	w->format = GIT_DIFF_FORMAT_PATCH;
+	w->fd = -1;
+	w->rb_io = Qnil;
+
+	if (!NIL_P(rb_opts)) {
+		VALUE rb_value;
+
+		if (rb_hash_aref(rb_opts, CSTR2SYM("compact")) == Qtrue)
+			w->format = GIT_DIFF_FORMAT_NAME_STATUS;
+
+		rb_value = rb_hash_aref(rb_opts, CSTR2SYM("max_bytes"));
+		if (!NIL_P(rb_value)) {
+			Check_Type(rb_value, T_FIXNUM);
+			if (FIX2LONG(rb_value) <= 0)
+				rb_raise(rb_eArgError, "max_bytes must be positive");
+
+			w->max_bytes = FIX2ULONG(rb_value);
+		}
+	}
+
+	w->cap = RUGGED_DIFF_WRITER_BUFSIZE;
+	w->buf = malloc(w->cap);
+	if (!w->buf)
+		rb_memerror();
+}
+
+static void rugged__diff_writer_print(struct rugged_diff_writer *w)
+{
+	rugged_without_gvl(rugged__diff_writer_print_nogvl, w);
+
+	if (w->over_budget)
+		rb_ivar_set(w->rb_diff, id_truncated, Qtrue);
+
+	if (w->exception) {
+		free(w->buf);
+		rb_jump_tag(w->exception);
+	}
+
+	if (w->result) {
+		free(w->buf);
+		rugged_exception_check(w->result);
+	}
+
+	rugged__diff_set_truncated_deltas(w->rb_diff, w->diff,
+		w->truncated ? w->delta_idx : git_diff_num_deltas(w->diff));
+}
+
+/*
+ *  call-seq:
+ *    diff.patch(options = {}) -> patch
+ *
+ *  Return a string containing the diff in patch form.
+ *
+ *  The following options can be passed in the +options+ Hash:
+ *
+ *  :compact ::
+ *    If +true+, only the name and status of each changed file is
+ *    returned, like <tt>git diff --name-status</tt>.
+ *
+ *  :max_bytes ::
+ *    Stop the patch at the last whole line that fits into this many
+ *    bytes. Useful to render a preview of a huge diff.
+ *
+ *  When the diff was created with a +:max_total_lines+ budget, the patch
+ *  stops at the changed line that spends it. With a +:timeout_ms+ budget,
+ *  it stops at the first file or hunk that starts once that much time
+ *  has passed since this call started. Either way, the diff is marked as
+ *  #truncated?. #truncated_deltas returns the deltas that were left out
+ *  or cut short, including by +:max_bytes+.
+ */
+static VALUE rb_git_diff_patch(int argc, VALUE *argv, VALUE self)
+{
+	struct rugged_diff_writer w;
+	VALUE rb_opts, rb_str;
+
+	rb_scan_args(argc, argv, "00:", &rb_opts);
+
+	rugged__diff_writer_init(&w, self, rb_opts);
+	w.collect = 1;
+
+	rugged__diff_writer_print(&w);
+
+	rb_str = rb_str_new(w.buf, w.len);
+	free(w.buf);
+
+	return rb_str;
+}
+
+/*
+ *  call-seq:
+ *    diff.write_patch(io, options = {}) -> int
+ *
+ *  Write a patch directly to an object which responds to "write", and
+ *  return the number of bytes written. Accepts the same +options+ as
+ *  #patch.
+ *
+ *  The patch is formatted into a native buffer which is handed to +io+
+ *  in large chunks. When +io+ is an +IO+ in binary mode (or wraps one, like
+ *  +Tempfile+), the buffer is written straight to the underlying file
+ *  descriptor instead, without holding the GVL; the write can be
+ *  interrupted like IO#write.
+ *
+ *    File.open("preview.diff", "wb") do |file|
+ *      diff.write_patch(file, :max_bytes => 64 * 1024)
+ *    end
+ */
+static VALUE rb_git_diff_write_patch(int argc, VALUE *argv, VALUE self)
+{
+	struct rugged_diff_writer w;
+	VALUE rb_io, rb_file, rb_opts;
+	int fd = -1;
+
+	rb_scan_args(argc, argv, "10:", &rb_io, &rb_opts);
+
+	if (!rb_respond_to(rb_io, rb_intern("write")))
+		rb_raise(rb_eArgError, "Expected io to respond to \"write\"");
+
+#ifndef _WIN32
+	/* Tempfile and other IO wrappers are unwrapped through #to_io */
+	rb_file = rb_io_check_io(rb_io);
+
+	if (!NIL_P(rb_file) && RTEST(rb_funcall(rb_file, rb_intern("binmode?"), 0))) {
+		rb_io_flush(rb_file);
+		fd = NUM2INT(rb_funcall(rb_file, rb_intern("fileno"), 0));
+	}
+#endif
+
+	rugged__diff_writer_init(&w, self, rb_opts);
+	w.rb_io = rb_io;
+	w.fd = fd;
+
+	rugged__diff_writer_print(&w);
+	free(w.buf);
+
+	return ULONG2NUM(w.written);
+}
+
+/*
+ *  call-seq:
+ *    diff.merge!(other_diff) -> self
+ *
+ *  Merges all diff information from +other_diff+.
+ */
+static VALUE rb_git_diff_merge(VALUE self, VALUE rb_other)
+{
+	git_diff *diff;
+	git_diff *other;
+	int error;
+
+	if (!rb_obj_is_kind_of(rb_other, rb_cRuggedDiff))
+		rb_raise(rb_eTypeError, "A Rugged::Diff instance is required");
+
+	Data_Get_Struct(self, git_diff, diff);
+	Data_Get_Struct(rb_other, git_diff, other);
+
+	error = git_diff_merge(diff, other);
+
+	if (!error && RTEST(rb_attr_get(rb_other, id_truncated))) {
+		rb_ivar_set(self, id_truncated, Qtrue);
+
+		if (!NIL_P(rb_attr_get(rb_other, id_skipped_deltas)))
+			rb_ivar_set(self, id_skipped_deltas, rb_ary_plus(
+				rb_git_diff_skipped_deltas(self), rb_attr_get(rb_other, id_skipped_deltas)));
+	}
+	rugged_exception_check(error);
+
+	return self;
+}
+
+struct rugged_diff_find_similar_args {
+	git_diff *diff;
+	const git_diff_find_options *opts;
+	int error;
+};
+
+static void *rugged__diff_find_similar_nogvl(void *data)
+{
+	struct rugged_diff_find_similar_args *args = data;
+	args->error = git_diff_find_similar(args->diff, args->opts);
+	return NULL;
+}
+
+#define RUGGED_DIFF_MINHASH_RENAME_LIMIT 1000
+
+/*
+ * Comparing two sketches is cheap, so MinHash searches default to git's
+ * own rename limit rather than libgit2's 200, unless the repository
+ * configures a higher one.
+ */
+static int rugged__diff_minhash_rename_limit(VALUE self)
+{
+	VALUE owner = rugged_owner(self);
+	git_repository *repo;
+	git_config *config;
+	int32_t limit = RUGGED_DIFF_MINHASH_RENAME_LIMIT, configured;
+
+	if (!rb_obj_is_kind_of(owner, rb_cRuggedRepo))
+		return limit;
+
+	Data_Get_Struct(owner, git_repository, repo);
+
+	if (git_repository_config(&config, repo) == 0) {
+		if (git_config_get_int32(&configured, config, "diff.renamelimit") == 0 && configured > limit)
+			limit = configured;
+
+		git_config_free(config);
+	}
+
+	giterr_clear();
+	return limit;
+}
+
+/*
+ *  call-seq:
+ *    diff.find_similar!([options]) -> self
+ *
+ *  Detects entries in the diff that look like renames or copies (based on the
+ *  given options) and replaces them with actual rename or copy entries.
+ *
+ *  Additionally, modified files can be broken into add/delete pairs if the
+ *  amount of changes are above a specific threshold (see +:break_rewrite_threshold+).
+ *
+ *  By default, similarity will be measured without leading whitespace. You
+ *  you can use the +:dont_ignore_whitespace+ to disable this.
+ *
+ *  The following options can be passed in the +options+ Hash:
+ *
+ *  :rename_threshold ::
+ *    An integer specifying the similarity to consider a file renamed (default 50).
+ *
+ *  :rename_from_rewrite_threshold ::
+ *    An integer specifying the similarity of modified to be eligible
+ *    rename source (default 50).
+ *
+ *  :copy_threshold ::
+ *    An integer specifying the similarity to consider a file a copy (default 50).
+ *
+ *  :break_rewrite_threshold ::
+ *    An integer specifying the similarity to split modify into delete/add pair (default 60).
+ *
+ *  :rename_limit ::
+ *    An integer specifying the maximum amount of similarity sources to examine
+ *    (a la diff's +-l+ option or the +diff.renameLimit+ config) (default 200).
+ *
+ *  :renames ::
+ *    If true, looking for renames will be enabled (+--find-renames+).
+ *
+ *  :renames_from_rewrites ::
+ *    If true, the "old side" of modified files will be considered for renames (+--break-rewrites=N+).
+ *
+ *  :copies ::
+ *    If true, looking for copies will be enabled (+--find-copies+).
+ *
+ *  :copies_from_unmodified ::
+ *    If true, unmodified files will be considered as copy sources (+--find-copies-harder+).
+ *
+ *  :break_rewrites ::
+ *    If true, larger rewrites will be split into delete/add pairs (+--break-rewrites=/M+).
+ *
+ *  :all ::
+ *    If true, enables all finding features.
+ *
+ *  :ignore_whitespace ::
+ *    If true, similarity will be measured with all whitespace ignored.
+ *
+ *  :dont_ignore_whitespace ::
+ *    If true, similarity will be measured without ignoring any whitespace.
+ *
+ *  :minhash ::
+ *    If true, files are compared through fixed-size MinHash sketches of
+ *    their lines instead of libgit2's hash signatures. Every comparison
+ *    then takes constant time, so +:rename_limit+ defaults to 1000, git's
+ *    own default for +diff.renameLimit+, or to the +diff.renameLimit+ of
+ *    the repository when that is higher. When every threshold is over 50,
+ *    pairs of files that share no band of their sketches are not compared
+ *    any further.
+ *
+ *    Scores are estimates of the share of lines two files have in common,
+ *    and can differ from git's: lines repeated in a file count once, and
+ *    64-bin sketches leave a noise of about 6 points, so files close to a
+ *    threshold may be paired differently.
+ *
+ *  :signature_cache ::
+ *    A Rugged::Diff::SignatureCache keeping the sketches of blobs across
+ *    calls, so blobs seen by an earlier diff aren't hashed again. Implies
+ *    +:minhash+.
+ *
+ *    cache = Rugged::Diff::SignatureCache.new
+ *    diff.find_similar!(:renames => true, :signature_cache => cache)
+ */
+static VALUE rb_git_diff_find_similar(int argc, VALUE *argv, VALUE self)
+{
+	git_diff *diff;
+	git_diff_find_options opts = GIT_DIFF_FIND_OPTIONS_INIT;
+	struct rugged_diff_find_similar_args args;
+	struct rugged_similarity_metric metric;
+	VALUE rb_options, rb_cache = Qnil;
+	int minhash = 0;
+
+	Data_Get_Struct(self, git_diff, diff);
+
+	rb_scan_args(argc, argv, "00:", &rb_options);
+
+	if (!NIL_P(rb_options)) {
+		VALUE rb_value = rb_hash_aref(rb_options, CSTR2SYM("rename_threshold"));
+		if (!NIL_P(rb_value)) {
+			Check_Type(rb_value, T_FIXNUM);
+			opts.rename_threshold = FIX2INT(rb_value);
+		}
+
+		rb_value = rb_hash_aref(rb_options, CSTR2SYM("rename_from_rewrite_threshold"));
+		if (!NIL_P(rb_value)) {
+			Check_Type(rb_value, T_FIXNUM);
+			opts.rename_from_rewrite_threshold = FIX2INT(rb_value);
+		}
+
+		rb_value = rb_hash_aref(rb_options, CSTR2SYM("copy_threshold"));
+		if (!NIL_P(rb_value)) {
+			Check_Type(rb_value, T_FIXNUM);
+			opts.copy_threshold = FIX2INT(rb_value);
+		}
+
+		rb_value = rb_hash_aref(rb_options, CSTR2SYM("break_rewrite_threshold"));
+		if (!NIL_P(rb_value)) {
+			Check_Type(rb_value, T_FIXNUM);
+			opts.break_rewrite_threshold = FIX2INT(rb_value);
+		}
+
+		rb_value = rb_hash_aref(rb_options, CSTR2SYM("rename_limit"));
+		if (!NIL_P(rb_value)) {
+			Check_Type(rb_value, T_FIXNUM);
+			opts.rename_limit = FIX2INT(rb_value);
+		}
+
+		if (RTEST(rb_hash_aref(rb_options, CSTR2SYM("renames")))) {
+			opts.flags |= GIT_DIFF_FIND_RENAMES;
+		}
+
+		if (RTEST(rb_hash_aref(rb_options, CSTR2SYM("renames_from_rewrites")))) {
+			opts.flags |= GIT_DIFF_FIND_RENAMES_FROM_REWRITES;
+		}
+
+		if (RTEST(rb_hash_aref(rb_options, CSTR2SYM("copies")))) {
+			opts.flags |= GIT_DIFF_FIND_COPIES;
+		}
+
+		if (RTEST(rb_hash_aref(rb_options, CSTR2SYM("copies_from_unmodified")))) {
+			opts.flags |= GIT_DIFF_FIND_COPIES_FROM_UNMODIFIED;
+		}
+
+		if (RTEST(rb_hash_aref(rb_options, CSTR2SYM("break_rewrites")))) {
+			opts.flags |= GIT_DIFF_FIND_AND_BREAK_REWRITES;
+		}
+
+		if (RTEST(rb_hash_aref(rb_options, CSTR2SYM("all")))) {
+			opts.flags |= GIT_DIFF_FIND_ALL;
+		}
+
+		if (RTEST(rb_hash_aref(rb_options, CSTR2SYM("ignore_whitespace")))) {
+			opts.flags |= GIT_DIFF_FIND_IGNORE_WHITESPACE;
+		}
+
+		if (RTEST(rb_hash_aref(rb_options, CSTR2SYM("dont_ignore_whitespace")))) {
+			opts.flags |= GIT_DIFF_FIND_DONT_IGNORE_WHITESPACE;
+		}
+
+		rb_cache = rb_hash_aref(rb_options, CSTR2SYM("signature_cache"));
+		minhash = RTEST(rb_hash_aref(rb_options, CSTR2SYM("minhash"))) || !NIL_P(rb_cache);
+	}
+
+	if (minhash) {
+		rugged_similarity_metric_init(&metric, rb_cache, &opts);
+		opts.metric = &metric.metric;
+
+		if (!opts.rename_limit)
+			opts.rename_limit = rugged__diff_minhash_rename_limit(self);
+	}
+
+	args.diff = diff;
+	args.opts = &opts;
+	rugged_without_gvl(rugged__diff_find_similar_nogvl, &args);
+
+	if (minhash)
+		rugged_similarity_metric_done(&metric);
+
+	rugged_exception_check(args.error);
+
+	return self;
+}
+
+/*
+ * Count the changed lines of +patch+ against the +:max_total_lines+
+ * budget of the diff. Returns 0 once the budget is spent; the budget is
+ * checked before building each patch, so that no further content is
+ * loaded. libgit2 can't build part of a patch, so the patch that reaches
+ * the budget is still built and yielded whole.
+ */
+static int rugged__diff_budget_consume(size_t *lines, size_t max_lines, git_patch *patch)
+{
+	size_t adds, dels;
+
+	if (!max_lines)
+		return 1;
+
+	if (patch && git_patch_line_stats(NULL, &adds, &dels, patch) == 0)
+		*lines += adds + dels;
+
+	return *lines < max_lines;
+}
+
+static VALUE rugged__diff_each_patch_serial(VALUE self, git_diff *diff)
+{
+	git_patch *patch;
+	int error = 0, within_budget = 1;
+	size_t d, delta_count, lines = 0, max_lines;
+	uint64_t deadline;
+
+	max_lines = rugged__diff_max_total_lines(self);
+	deadline = rugged__diff_deadline(self);
+
+	delta_count = git_diff_num_deltas(diff);
+	rugged__diff_set_truncated_deltas(self, diff, delta_count);
+
+	for (d = 0; d < delta_count; ++d) {
+		if (!within_budget || !rugged__diff_budget_within_deadline(deadline)) {
+			rb_ivar_set(self, id_truncated, Qtrue);
+			rugged__diff_set_truncated_deltas(self, diff, d);
+			break;
+		}
+
+		error = git_patch_from_diff(&patch, diff, d);
+		if (error) break;
+
+		within_budget = rugged__diff_budget_consume(&lines, max_lines, patch);
+		rb_yield(rugged_patch_new(self, patch));
+	}
+
+	rugged_exception_check(error);
+
+	return self;
+}
+
+#ifdef HAVE_PTHREAD_H
+/*
+ * How the patch of each delta is built. Deltas between regular,
+ * non-executable blobs (one of them missing for additions and deletions)
+ * are built by the workers with `git_patch_from_blobs`. Everything else
+ * (renames and copies, type and mode changes, submodules, files only
+ * found in the working directory) goes through `git_patch_from_diff` in
+ * the Ruby thread, since a git_diff can only be used by one thread.
+ */
+struct rugged_patch_plan {
+	git_oid old_id, new_id;
+	const char *old_path, *new_path;
+	int from_blobs;
+};
+
+struct rugged_patch_slot {
+	git_patch *patch;
+	git_blob *old_blob, *new_blob;
+	int from_diff;
+	int error;
+	int error_class;
+	char *error_message;
+	int ready;
+};
+
+struct rugged_patch_pool;
+
+struct rugged_patch_worker {
+	struct rugged_patch_pool *pool;
+	git_repository *repo;
+	pthread_t thread;
+	int started;
+};
+
+/*
+ * Native threads generating the patches of a diff ahead of the Ruby
+ * thread consuming them, each reading blobs through a repository handle
+ * of its own. Delta `d` is stored in slot `d % window` and no worker
+ * takes a delta more than `window` ahead of the consumer, so at most
+ * `window` patches are held at once.
+ */
+struct rugged_patch_pool {
+	git_diff *diff;
+	git_repository *repo;
+	git_diff_options opts;
+	struct rugged_patch_plan *plan;
+	size_t delta_count;
+	size_t next, consumed, window;
+	size_t lines, max_lines;
+	uint64_t deadline;
+	int stop, interrupted, slot_ready;
+
+	struct rugged_patch_slot *slots;
+	struct rugged_patch_worker *workers;
+	size_t threads, started;
+
+	pthread_mutex_t lock;
+	pthread_cond_t ready_cond;
+	pthread_cond_t space_cond;
+
+	VALUE rb_diff;
+};
 
-	if (!rb_block_given_p()) {
-		return rb_funcall(self, rb_intern("to_enum"), 1, CSTR2SYM("each_patch"), self);
+static int rugged__patch_plan_side(const git_diff_file *file)
+{
+	return file->mode == GIT_FILEMODE_BLOB && (file->flags & GIT_DIFF_FLAG_VALID_ID);
+}
+
+static void rugged__patch_plan_init(struct rugged_patch_plan *plan, const git_diff_delta *delta)
+{
+	memset(plan, 0, sizeof(*plan));
+
+	switch (delta->status) {
+	case GIT_DELTA_ADDED:
+		plan->from_blobs = rugged__patch_plan_side(&delta->new_file);
+		break;
+	case GIT_DELTA_DELETED:
+		plan->from_blobs = rugged__patch_plan_side(&delta->old_file);
+		break;
+	case GIT_DELTA_MODIFIED:
+		plan->from_blobs = rugged__patch_plan_side(&delta->old_file) &&
+			rugged__patch_plan_side(&delta->new_file);
+		break;
+	default:
+		break;
 	}
 
-	Data_Get_Struct(self, git_diff, diff);
+	if (!plan->from_blobs)
+		return;
 
-	delta_count = git_diff_num_deltas(diff);
-	for (d = 0; d < delta_count; ++d) {
-		error = git_patch_from_diff(&patch, diff, d);
-		if (error) break;
+	if (delta->status != GIT_DELTA_ADDED)
+		git_oid_cpy(&plan->old_id, &delta->old_file.id);
 
-		rb_yield(rugged_patch_new(self, patch));
+	if (delta->status != GIT_DELTA_DELETED)
+		git_oid_cpy(&plan->new_id, &delta->new_file.id);
+
+	plan->old_path = delta->old_file.path;
+	plan->new_path = delta->new_file.path;
+}
+
+static int rugged__patch_pool_build(struct rugged_patch_worker *worker,
+	const struct rugged_patch_plan *plan, struct rugged_patch_slot *slot)
+{
+	int error = 0;
+
+	if (!git_oid_iszero(&plan->old_id))
+		error = git_blob_lookup(&slot->old_blob, worker->repo, &plan->old_id);
+
+	if (!error && !git_oid_iszero(&plan->new_id))
+		error = git_blob_lookup(&slot->new_blob, worker->repo, &plan->new_id);
+
+	/* the lines of the patch point into the blobs, which must outlive it */
+	if (!error)
+		error = git_patch_from_blobs(&slot->patch,
+			slot->old_blob, plan->old_path, slot->new_blob, plan->new_path,
+			&worker->pool->opts);
+
+	return error;
+}
+
+static void *rugged__patch_pool_worker(void *data)
+{
+	struct rugged_patch_worker *worker = data;
+	struct rugged_patch_pool *pool = worker->pool;
+
+	for (;;) {
+		struct rugged_patch_slot result;
+		const git_error *last_error;
+		size_t d;
+
+		pthread_mutex_lock(&pool->lock);
+
+		while (!pool->stop && pool->next < pool->delta_count &&
+			pool->next >= pool->consumed + pool->window)
+			pthread_cond_wait(&pool->space_cond, &pool->lock);
+
+		if (pool->stop || pool->next >= pool->delta_count) {
+			pthread_mutex_unlock(&pool->lock);
+			break;
+		}
+
+		d = pool->next++;
+		pthread_mutex_unlock(&pool->lock);
+
+		memset(&result, 0, sizeof(result));
+		result.from_diff = !pool->plan[d].from_blobs;
+
+		if (!result.from_diff)
+			result.error = rugged__patch_pool_build(worker, &pool->plan[d], &result);
+
+		/* a blob hashed from the working directory may not be in the ODB */
+		if (result.error == GIT_ENOTFOUND) {
+			giterr_clear();
+			git_blob_free(result.old_blob);
+			git_blob_free(result.new_blob);
+			memset(&result, 0, sizeof(result));
+			result.from_diff = 1;
+		}
+
+		/* libgit2 errors are thread-local, so hand them over to the consumer */
+		if (result.error < 0 && (last_error = giterr_last()) != NULL) {
+			result.error_class = last_error->klass;
+			result.error_message = strdup(last_error->message);
+		}
+
+		result.ready = 1;
+
+		pthread_mutex_lock(&pool->lock);
+		pool->slots[d % pool->window] = result;
+		pthread_cond_broadcast(&pool->ready_cond);
+		pthread_mutex_unlock(&pool->lock);
+
+		if (result.error < 0)
+			break;
 	}
 
-	rugged_exception_check(error);
+	return NULL;
+}
 
-	return self;
+static void *rugged__patch_pool_start_nogvl(void *data)
+{
+	struct rugged_patch_pool *pool = data;
+	size_t t;
+
+	for (t = 0; t < pool->threads; ++t) {
+		pool->workers[t].pool = pool;
+
+		/* without handles that see the same objects, nothing is built in parallel */
+		if (rugged_repository_reopen(&pool->workers[t].repo, pool->repo) < 0) {
+			giterr_clear();
+			return NULL;
+		}
+	}
+
+	for (t = 0; t < pool->threads; ++t) {
+		struct rugged_patch_worker *worker = &pool->workers[t];
+
+		worker->started = pthread_create(&worker->thread, NULL, rugged__patch_pool_worker, worker) == 0;
+		if (worker->started)
+			pool->started++;
+	}
+
+	return NULL;
+}
+
+static void *rugged__patch_pool_wait_nogvl(void *data)
+{
+	struct rugged_patch_pool *pool = data;
+	struct rugged_patch_slot *slot = &pool->slots[pool->consumed % pool->window];
+
+	pthread_mutex_lock(&pool->lock);
+	while (!slot->ready && !pool->interrupted)
+		pthread_cond_wait(&pool->ready_cond, &pool->lock);
+
+	pool->slot_ready = slot->ready;
+	pool->interrupted = 0;
+	pthread_mutex_unlock(&pool->lock);
+
+	return NULL;
+}
+
+static void rugged__patch_pool_interrupt(void *data)
+{
+	struct rugged_patch_pool *pool = data;
+
+	pthread_mutex_lock(&pool->lock);
+	pool->interrupted = 1;
+	pthread_cond_broadcast(&pool->ready_cond);
+	pthread_mutex_unlock(&pool->lock);
+}
+
+static void *rugged__patch_pool_stop_nogvl(void *data)
+{
+	struct rugged_patch_pool *pool = data;
+	size_t t;
+
+	pthread_mutex_lock(&pool->lock);
+	pool->stop = 1;
+	pthread_cond_broadcast(&pool->space_cond);
+	pthread_mutex_unlock(&pool->lock);
+
+	for (t = 0; t < pool->threads; ++t) {
+		if (pool->workers[t].started)
+			pthread_join(pool->workers[t].thread, NULL);
+	}
+
+	return NULL;
+}
+
+static VALUE rugged__patch_blob_new(git_blob *blob)
+{
+	return Data_Wrap_Struct(rb_cObject, NULL, &git_blob_free, blob);
+}
+
+static VALUE rugged__patch_pool_consume(VALUE data)
+{
+	struct rugged_patch_pool *pool = (struct rugged_patch_pool *)data;
+	int within_budget = 1;
+
+	while (pool->consumed < pool->delta_count) {
+		struct rugged_patch_slot *slot = &pool->slots[pool->consumed % pool->window];
+		git_blob *old_blob, *new_blob;
+		git_patch *patch;
+		VALUE rb_patch;
+		int state;
+
+		if (!within_budget || !rugged__diff_budget_within_deadline(pool->deadline)) {
+			rb_ivar_set(pool->rb_diff, id_truncated, Qtrue);
+			rugged__diff_set_truncated_deltas(pool->rb_diff, pool->diff, pool->consumed);
+			break;
+		}
+
+		do {
+			state = rugged_without_gvl_ubf(rugged__patch_pool_wait_nogvl, pool,
+				rugged__patch_pool_interrupt, pool, 1);
+			if (state)
+				rb_jump_tag(state);
+		} while (!pool->slot_ready);
+
+		/* the workers are done with this slot; it stays untouched until `consumed` moves */
+		if (slot->error) {
+			if (slot->error_message)
+				giterr_set_str(slot->error_class, slot->error_message);
+			rugged_exception_check(slot->error);
+		}
+
+		if (slot->from_diff)
+			rugged_exception_check(git_patch_from_diff(&slot->patch, pool->diff, pool->consumed));
+
+		patch = slot->patch;
+		old_blob = slot->old_blob;
+		new_blob = slot->new_blob;
+
+		pthread_mutex_lock(&pool->lock);
+		memset(slot, 0, sizeof(*slot));
+		pool->consumed++;
+		pthread_cond_broadcast(&pool->space_cond);
+		pthread_mutex_unlock(&pool->lock);
+
+		within_budget = rugged__diff_budget_consume(&pool->lines, pool->max_lines, patch);
+
+		/* once wrapped, the patch and its blobs are owned by Ruby objects */
+		rb_patch = rugged_patch_new(pool->rb_diff, patch);
+		if (old_blob || new_blob)
+			rb_ivar_set(rb_patch, id_patch_blobs, rb_ary_new3(2,
+				old_blob ? rugged__patch_blob_new(old_blob) : Qnil,
+				new_blob ? rugged__patch_blob_new(new_blob) : Qnil));
+
+		rb_yield(rb_patch);
+	}
+
+	return pool->rb_diff;
+}
+
+static void rugged__patch_pool_free(struct rugged_patch_pool *pool)
+{
+	size_t i;
+
+	for (i = 0; i < pool->window; ++i) {
+		git_patch_free(pool->slots[i].patch);
+		git_blob_free(pool->slots[i].old_blob);
+		git_blob_free(pool->slots[i].new_blob);
+		free(pool->slots[i].error_message);
+	}
+
+	for (i = 0; i < pool->threads; ++i)
+		git_repository_free(pool->workers[i].repo);
+
+	pthread_cond_destroy(&pool->space_cond);
+	pthread_cond_destroy(&pool->ready_cond);
+	pthread_mutex_destroy(&pool->lock);
+
+	xfree(pool->plan);
+	xfree(pool->slots);
+	xfree(pool->workers);
+}
+
+static VALUE rugged__patch_pool_cleanup(VALUE data)
+{
+	struct rugged_patch_pool *pool = (struct rugged_patch_pool *)data;
+
+	/* the workers finish the patches they're working on, at most */
+	rugged_without_gvl(rugged__patch_pool_stop_nogvl, pool);
+	rugged__patch_pool_free(pool);
+
+	return Qnil;
+}
+
+/*
+ * Fill +opts+ with the options the diff was created with. Returns 0 if
+ * they're unknown, or if they change how patches are printed, which
+ * patches built outside of the diff wouldn't follow.
+ */
+static int rugged__diff_patch_options(git_diff_options *opts, VALUE self)
+{
+	struct rugged_diff_budget budget;
+	VALUE rb_options = rb_attr_get(self, id_patch_options);
+
+	if (NIL_P(rb_options))
+		return 0;
+
+	rugged_parse_diff_budget(&budget, opts, rb_options);
+	rugged_parse_diff_options(opts, rb_options);
+	xfree(opts->pathspec.strings);
+
+	memset(&opts->pathspec, 0, sizeof(opts->pathspec));
+	opts->notify_cb = NULL;
+	opts->notify_payload = NULL;
+
+	/* the deltas already have their final orientation */
+	opts->flags &= ~GIT_DIFF_REVERSE;
+
+	return !opts->old_prefix && !opts->new_prefix && !opts->id_abbrev;
+}
+
+static VALUE rugged__diff_each_patch_background(VALUE self, git_diff *diff, size_t threads, size_t window)
+{
+	git_diff_options opts = GIT_DIFF_OPTIONS_INIT;
+	struct rugged_patch_pool pool;
+	size_t d, from_blobs = 0;
+
+	if (!rugged__diff_patch_options(&opts, self))
+		return rugged__diff_each_patch_serial(self, diff);
+
+	memset(&pool, 0, sizeof(pool));
+	pool.opts = opts;
+
+	pool.rb_diff = self;
+	pool.diff = diff;
+	pool.delta_count = git_diff_num_deltas(diff);
+	pool.window = window;
+	pool.max_lines = rugged__diff_max_total_lines(self);
+	pool.deadline = rugged__diff_deadline(self);
+	Data_Get_Struct(rugged_owner(self), git_repository, pool.repo);
+
+	pool.plan = xcalloc(pool.delta_count ? pool.delta_count : 1, sizeof(struct rugged_patch_plan));
+
+	for (d = 0; d < pool.delta_count; ++d) {
+		rugged__patch_plan_init(&pool.plan[d], git_diff_get_delta(diff, d));
+		from_blobs += pool.plan[d].from_blobs;
+	}
+
+	if (from_blobs < 2) {
+		xfree(pool.plan);
+		return rugged__diff_each_patch_serial(self, diff);
+	}
+
+	pool.threads = threads < from_blobs ? threads : from_blobs;
+	pool.slots = xcalloc(window, sizeof(struct rugged_patch_slot));
+	pool.workers = xcalloc(pool.threads, sizeof(struct rugged_patch_worker));
+
+	pthread_mutex_init(&pool.lock, NULL);
+	pthread_cond_init(&pool.ready_cond, NULL);
+	pthread_cond_init(&pool.space_cond, NULL);
+
+	rugged__diff_set_truncated_deltas(self, diff, pool.delta_count);
+	rugged_without_gvl(rugged__patch_pool_start_nogvl, &pool);
+
+	if (!pool.started) {
+		rugged__patch_pool_free(&pool);
+		return rugged__diff_each_patch_serial(self, diff);
+	}
+
+	return rb_ensure(rugged__patch_pool_consume, (VALUE)&pool,
+		rugged__patch_pool_cleanup, (VALUE)&pool);
+}
+#endif
+
+/*
+ *  call-seq:
+ *    diff.each_patch(options = {}) { |patch| } -> self
+ *    diff.each_patch(options = {}) -> enumerator
+ *
+ *  If given a block, yields each patch that is part of the diff.
+ *  If no block is given, an enumerator will be returned.
+ *
+ *  The following options can be passed in the +options+ Hash:
+ *
+ *  :threads ::
+ *    With 2 or more, up to that many native threads generate patches
+ *    concurrently while the block runs, each reading blobs through a
+ *    repository handle of its own; patches are still yielded in the order
+ *    of the deltas of the diff. Only changes between regular files stored
+ *    in the object database are built this way: renames and copies, type
+ *    and mode changes, executables, submodules and files only found in
+ *    the working directory are generated in the calling thread as they
+ *    come up. Everything is generated in the calling thread for diffs
+ *    created with +:old_prefix+, +:new_prefix+ or +:id_abbrev+, and for
+ *    repositories given object database alternates at runtime. Defaults
+ *    to 1. Ignored when libgit2 was built without thread support.
+ *
+ *  :window ::
+ *    The maximum number of patches generated ahead of the one being yielded,
+ *    which bounds how many patches are held in memory at once. Defaults to
+ *    four times +:threads+.
+ *
+ *  When the diff was created with a +:max_total_lines+ budget, no further
+ *  patches are yielded once the patches yielded so far add up to that
+ *  many changed lines. With a +:timeout_ms+ budget, none are yielded once
+ *  that much time has passed since this call started. Either way, the
+ *  diff is marked as #truncated?, and #truncated_deltas returns the
+ *  deltas that were left out. With +:threads+, up to +:window+ patches
+ *  past that point may already have been generated, and are dropped.
+ *
+ *  The diff must not be modified (with #merge! or #find_similar!) from another
+ *  thread while its patches are being generated.
+ */
+static VALUE rb_git_diff_each_patch(int argc, VALUE *argv, VALUE self)
+{
+	git_diff *diff;
+	VALUE rb_options, rb_value;
+	size_t threads = 1, window = 0;
+
+	rb_scan_args(argc, argv, "00:", &rb_options);
+
+	if (!rb_block_given_p()) {
+		if (NIL_P(rb_options))
+			return rb_funcall(self, rb_intern("to_enum"), 1, CSTR2SYM("each_patch"));
+
+		return rb_funcall(self, rb_intern("to_enum"), 2, CSTR2SYM("each_patch"), rb_options);
+	}
+
+	if (!NIL_P(rb_options)) {
+		rb_value = rb_hash_aref(rb_options, CSTR2SYM("threads"));
+		if (!NIL_P(rb_value)) {
+			Check_Type(rb_value, T_FIXNUM);
+			if (FIX2INT(rb_value) < 1)
+				rb_raise(rb_eArgError, "The number of threads must be positive");
+			threads = FIX2INT(rb_value);
+		}
+
+		rb_value = rb_hash_aref(rb_options, CSTR2SYM("window"));
+		if (!NIL_P(rb_value)) {
+			Check_Type(rb_value, T_FIXNUM);
+			if (FIX2INT(rb_value) < 1)
+				rb_raise(rb_eArgError, "The window size must be positive");
+			window = FIX2INT(rb_value);
+		}
+	}
+
+	Data_Get_Struct(self, git_diff, diff);
+
+#ifdef HAVE_PTHREAD_H
+	if (threads > 1 && (git_libgit2_features() & GIT_FEATURE_THREADS))
+		return rugged__diff_each_patch_background(self, diff, threads, window ? window : threads * 4);
+#endif
+
+	return rugged__diff_each_patch_serial(self, diff);
 }
 
 /*
@@ -489,11 +1679,13 @@ static VALUE rb_git_diff_each_patch(VALUE self)
  *
  *  This method should be preferred over #each_patch if you're not interested
  *  in the actual line-by-line changes of the diff.
+ *
+ *  Deltas decode their fields from the diff on first access, and can't be
+ *  used anymore once the diff is modified by #merge! or #find_similar!.
  */
 static VALUE rb_git_diff_each_delta(VALUE self)
 {
 	git_diff *diff;
-	const git_diff_delta *delta;
 	int error = 0;
 	size_t d, delta_count;
 
@@ -505,8 +1697,7 @@ static VALUE rb_git_diff_each_delta(VALUE self)
 
 	delta_count = git_diff_num_deltas(diff);
 	for (d = 0; d < delta_count; ++d) {
-		delta = git_diff_get_delta(diff, d);
-		rb_yield(rugged_diff_delta_new(self, delta));
+		rb_yield(rugged_diff_delta_new(self, git_diff_get_delta(diff, d)));
 	}
 
 	rugged_exception_check(error);
@@ -586,17 +1777,11 @@ static VALUE rb_git_diff_size(VALUE self)
 	return INT2FIX(git_diff_num_deltas(diff));
 }
 
-struct diff_stats {
-	size_t files, adds, dels;
-};
+/* libgit2's default `max_size` for diffs, used when none is given */
+#define RUGGED_DIFF_NUMSTAT_MAX_SIZE (512 * 1024 * 1024)
 
-static int diff_file_stats_cb(
-	const git_diff_delta *delta,
-	float progress,
-	void *payload)
+static int rugged__diff_delta_counts(const git_diff_delta *delta)
 {
-	struct diff_stats *stats = payload;
-
 	switch (delta->status) {
 	case GIT_DELTA_ADDED:
 	case GIT_DELTA_DELETED:
@@ -604,30 +1789,163 @@ static int diff_file_stats_cb(
 	case GIT_DELTA_RENAMED:
 	case GIT_DELTA_COPIED:
 	case GIT_DELTA_TYPECHANGE:
-		stats->files++;
-		break;
+		return 1;
 	default:
 		/* unmodified, ignored, and untracked files don't count */
-		break;
+		return 0;
 	}
-	return GIT_OK;
 }
 
-static int diff_line_stats_cb(
+static size_t rugged__count_lines(const char *data, size_t size)
+{
+	const char *end = data + size, *nl;
+	size_t lines = 0;
+
+	while (data < end && (nl = memchr(data, '\n', end - data)) != NULL) {
+		lines++;
+		data = nl + 1;
+	}
+
+	/* last line without trailing '\n'? */
+	if (data < end)
+		lines++;
+
+	return lines;
+}
+
+/*
+ * Files that were added or deleted are all additions or all deletions,
+ * so their line counts can be taken straight from the blob without
+ * running a diff, as long as nothing but the content decides whether
+ * they are binary.
+ */
+static int rugged__diff_numstat_blob(
+	struct rugged_diff_numstat *numstat,
+	git_repository *repo,
 	const git_diff_delta *delta,
-	const git_diff_hunk *hunk,
-	const git_diff_line *line,
-	void *payload)
+	git_off_t max_size)
 {
-	struct diff_stats *stats = payload;
+	const git_diff_file *file;
+	const char *value;
+	git_blob *blob;
+	int error;
 
-	switch (line->origin) {
-	case GIT_DIFF_LINE_ADDITION: stats->adds++; break;
-	case GIT_DIFF_LINE_DELETION: stats->dels++; break;
-	default: break;
+	if (delta->status == GIT_DELTA_ADDED)
+		file = &delta->new_file;
+	else if (delta->status == GIT_DELTA_DELETED)
+		file = &delta->old_file;
+	else
+		return GIT_ENOTFOUND;
+
+	if (!(file->flags & GIT_DIFF_FLAG_VALID_ID) ||
+		(file->mode != GIT_FILEMODE_BLOB && file->mode != GIT_FILEMODE_BLOB_EXECUTABLE) ||
+		(delta->flags & (GIT_DIFF_FLAG_BINARY | GIT_DIFF_FLAG_NOT_BINARY)))
+		return GIT_ENOTFOUND;
+
+	/* a `diff` attribute may force the file to be text or binary */
+	if ((error = git_attr_get(&value, repo, 0, file->path, "diff")) < 0)
+		return error;
+
+	if (git_attr_value(value) != GIT_ATTR_UNSPECIFIED_T)
+		return GIT_ENOTFOUND;
+
+	if ((error = git_blob_lookup(&blob, repo, &file->id)) < 0)
+		return error;
+
+	/* libgit2 treats files over `max_size` as binary; a negative one is no limit */
+	if (!max_size)
+		max_size = RUGGED_DIFF_NUMSTAT_MAX_SIZE;
+
+	if (max_size > 0 && git_blob_rawsize(blob) > max_size) {
+		git_blob_free(blob);
+		return GIT_ENOTFOUND;
 	}
 
-	return GIT_OK;
+	if (git_blob_is_binary(blob)) {
+		numstat->binary = 1;
+	} else {
+		size_t lines = rugged__count_lines(git_blob_rawcontent(blob), (size_t)git_blob_rawsize(blob));
+
+		if (delta->status == GIT_DELTA_ADDED)
+			numstat->adds = lines;
+		else
+			numstat->dels = lines;
+	}
+
+	git_blob_free(blob);
+	return 0;
+}
+
+/*
+ * Count the files, additions and deletions in +diff+ and optionally,
+ * when +numstats+ is not NULL, the additions and deletions of each delta.
+ *
+ * No lines are handed out to any callback: deltas are turned into
+ * patches one at a time and only their line counts are kept. When
+ * +repo+ is given, added and deleted files are counted from their blobs
+ * without diffing them at all; this is only valid if the diff was not
+ * generated with the `force_text` or `force_binary` options, and
+ * +max_size+ must be the `max_size` it was generated with.
+ *
+ * This function doesn't need the GVL.
+ */
+int rugged_diff_numstat(
+	struct rugged_diff_numstat *numstats,
+	struct rugged_diff_numstat *total,
+	git_diff *diff,
+	git_repository *repo,
+	git_off_t max_size)
+{
+	size_t i, deltas = git_diff_num_deltas(diff);
+	int error = 0;
+
+	memset(total, 0, sizeof(*total));
+
+	for (i = 0; !error && i < deltas; ++i) {
+		const git_diff_delta *delta = git_diff_get_delta(diff, i);
+		struct rugged_diff_numstat numstat = { 0, 0, 0, 0 };
+		git_patch *patch;
+
+		numstat.counted = rugged__diff_delta_counts(delta);
+
+		if (delta->flags & GIT_DIFF_FLAG_BINARY) {
+			numstat.binary = 1;
+		} else if (!repo || (error = rugged__diff_numstat_blob(&numstat, repo, delta, max_size)) == GIT_ENOTFOUND) {
+			if ((error = git_patch_from_diff(&patch, diff, i)) < 0)
+				break;
+
+			/* no patch is created for binary or unchanged files */
+			if (patch) {
+				error = git_patch_line_stats(NULL, &numstat.adds, &numstat.dels, patch);
+				git_patch_free(patch);
+			}
+
+			numstat.binary = (delta->flags & GIT_DIFF_FLAG_BINARY) != 0;
+		}
+
+		if (numstats)
+			numstats[i] = numstat;
+
+		total->counted += numstat.counted;
+		total->adds += numstat.adds;
+		total->dels += numstat.dels;
+	}
+
+	return error;
+}
+
+struct rugged_diff_numstat_args {
+	git_diff *diff;
+	struct rugged_diff_numstat *numstats;
+	struct rugged_diff_numstat total;
+	int error;
+};
+
+static void *rugged__diff_numstat_nogvl(void *data)
+{
+	struct rugged_diff_numstat_args *args = data;
+	args->error = rugged_diff_numstat(args->numstats, &args->total, args->diff, NULL, 0);
+	return NULL;
 }
 
 /*
@@ -637,16 +1955,63 @@ static int diff_line_stats_cb(
  */
 static VALUE rb_git_diff_stat(VALUE self)
 {
-	git_diff *diff;
-	struct diff_stats stats = { 0, 0, 0 };
+	struct rugged_diff_numstat_args args = { NULL };
 
-	Data_Get_Struct(self, git_diff, diff);
+	Data_Get_Struct(self, git_diff, args.diff);
+
+	rugged_without_gvl(rugged__diff_numstat_nogvl, &args);
+	rugged_exception_check(args.error);
+
+	return rb_ary_new3(3,
+		INT2FIX(args.total.counted), INT2FIX(args.total.adds), INT2FIX(args.total.dels));
+}
+
+/*
+ *  call-seq: diff.numstat -> array
+ *
+ *  Returns an Array with a <tt>[path, additions, deletions]</tt> triple for
+ *  each added, deleted, modified, renamed, copied or type changed file in
+ *  this diff, like <tt>git diff --numstat</tt>.
+ *
+ *  The number of additions and deletions of binary files is +nil+.
+ *
+ *    diff.numstat #=> [["README", 2, 1], ["logo.png", nil, nil]]
+ */
+static VALUE rb_git_diff_numstat(VALUE self)
+{
+	struct rugged_diff_numstat_args args = { NULL };
+	VALUE rb_result;
+	size_t i, deltas;
+
+	Data_Get_Struct(self, git_diff, args.diff);
+
+	deltas = git_diff_num_deltas(args.diff);
+	args.numstats = xcalloc(deltas ? deltas : 1, sizeof(struct rugged_diff_numstat));
 
-	git_diff_foreach(
-		diff, diff_file_stats_cb, NULL, diff_line_stats_cb, &stats);
+	rugged_without_gvl(rugged__diff_numstat_nogvl, &args);
 
-	return rb_ary_new3(
-		3, INT2FIX(stats.files), INT2FIX(stats.adds), INT2FIX(stats.dels));
+	if (args.error) {
+		xfree(args.numstats);
+		rugged_exception_check(args.error);
+	}
+
+	rb_result = rb_ary_new();
+	for (i = 0; i < deltas; ++i) {
+		const git_diff_delta *delta;
+
+		if (!args.numstats[i].counted)
+			continue;
+
+		delta = git_diff_get_delta(args.diff, i);
+
+		rb_ary_push(rb_result, rb_ary_new3(3,
+			rb_str_new_utf8(delta->new_file.path),
+			args.numstats[i].binary ? Qnil : INT2FIX(args.numstats[i].adds),
+			args.numstats[i].binary ? Qnil : INT2FIX(args.numstats[i].dels)));
+	}
+
+	xfree(args.numstats);
+	return rb_result;
 }
 
 /*
@@ -665,6 +2030,14 @@ void Init_rugged_diff(void)
 {
 	rb_cRuggedDiff = rb_define_class_under(rb_mRugged, "Diff", rb_cObject);
 
+	id_max_total_lines = rb_intern("max_total_lines");
+	id_timeout_ms = rb_intern("timeout_ms");
+	id_truncated = rb_intern("truncated");
+	id_skipped_deltas = rb_intern("skipped_deltas");
+	id_truncated_deltas = rb_intern("truncated_deltas");
+	id_patch_options = rb_intern("patch_options");
+	id_patch_blobs = rb_intern("patch_blobs");
+
 	rb_define_method(rb_cRuggedDiff, "patch", rb_git_diff_patch, -1);
 	rb_define_method(rb_cRuggedDiff, "write_patch", rb_git_diff_write_patch, -1);
 
@@ -672,11 +2045,15 @@ void Init_rugged_diff(void)
 	rb_define_method(rb_cRuggedDiff, "merge!", rb_git_diff_merge, 1);
 
 	rb_define_method(rb_cRuggedDiff, "size", rb_git_diff_size, 0);
+	rb_define_method(rb_cRuggedDiff, "truncated?", rb_git_diff_truncated_p, 0);
+	rb_define_method(rb_cRuggedDiff, "skipped_deltas", rb_git_diff_skipped_deltas, 0);
+	rb_define_method(rb_cRuggedDiff, "truncated_deltas", rb_git_diff_truncated_deltas, 0);
 	rb_define_method(rb_cRuggedDiff, "stat", rb_git_diff_stat, 0);
+	rb_define_method(rb_cRuggedDiff, "numstat", rb_git_diff_numstat, 0);
 
 	rb_define_method(rb_cRuggedDiff, "sorted_icase?", rb_git_diff_sorted_icase_p, 0);
 
-	rb_define_method(rb_cRuggedDiff, "each_patch", rb_git_diff_each_patch, 0);
+	rb_define_method(rb_cRuggedDiff, "each_patch", rb_git_diff_each_patch, -1);
 	rb_define_method(rb_cRuggedDiff, "each_delta", rb_git_diff_each_delta, 0);
 	rb_define_method(rb_cRuggedDiff, "each_line", rb_git_diff_each_line, -1);
 }
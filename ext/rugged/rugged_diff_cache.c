@@ -0,0 +1,782 @@
+/*
+ * The MIT License
+ *
+ * Copyright (c) 2014 GitHub, Inc
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "rugged.h"
+
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
+extern VALUE rb_mRugged;
+VALUE rb_cRuggedDiffCache;
+
+/*
+ * The cache file is a fixed-size ring buffer of entries behind a small
+ * header. New entries are written at `head`, evicting the oldest entries
+ * from `tail` as needed. Entries are found through an in-memory index
+ * that is rebuilt by scanning the ring.
+ *
+ * Entries that are read while in the older half of the ring are written
+ * again at the head, so frequently used entries survive eviction.
+ *
+ * Any number of caches, in any number of processes, can have the file
+ * open at once: every read takes a shared lock on the file, and every
+ * write an exclusive one. Each write bumps the `generation` in the header,
+ * and a cache that finds a generation other than the one its index was
+ * built from rebuilds the index before using it.
+ */
+#define DIFF_CACHE_MAGIC 0x52444331 /* "RDC1" */
+#define DIFF_CACHE_VERSION 2
+#define DIFF_CACHE_ENTRY_MAGIC 0x52444345 /* "RDCE" */
+#define DIFF_CACHE_WRAP_MAGIC 0x52444357 /* "RDCW" */
+
+#define DIFF_CACHE_HEADER_SIZE 64
+#define DIFF_CACHE_ENTRY_HEADER_SIZE 32
+#define DIFF_CACHE_MIN_SIZE 4096
+#define DIFF_CACHE_DEFAULT_SIZE (64 * 1024 * 1024)
+
+#define DIFF_CACHE_ALIGN(n) (((n) + 7) & ~(uint64_t)7)
+
+struct diff_cache_header {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t capacity;
+	uint64_t head;
+	uint64_t tail;
+	uint64_t count;
+	uint64_t generation;
+};
+
+struct diff_cache_entry {
+	uint32_t magic;
+	uint32_t length;
+	unsigned char key[GIT_OID_RAWSZ];
+	uint32_t reserved;
+};
+
+typedef struct {
+	int fd;
+	unsigned char *map;
+	size_t map_size;
+	uint64_t capacity;
+	struct diff_cache_header *header;
+	unsigned char *data;
+
+	/* binary key => Integer offset of its latest entry */
+	VALUE index;
+
+	/* the generation of the file the index was built from */
+	uint64_t generation;
+	int synced;
+} rugged_diff_cache;
+
+static void diff_cache_mark(rugged_diff_cache *cache)
+{
+	rb_gc_mark(cache->index);
+}
+
+static void diff_cache_close(rugged_diff_cache *cache)
+{
+#ifdef HAVE_SYS_MMAN_H
+	if (cache->map) {
+		munmap(cache->map, cache->map_size);
+		cache->map = NULL;
+	}
+
+	if (cache->fd >= 0) {
+		close(cache->fd);
+		cache->fd = -1;
+	}
+#endif
+	cache->synced = 0;
+}
+
+static void diff_cache_free(rugged_diff_cache *cache)
+{
+	diff_cache_close(cache);
+	xfree(cache);
+}
+
+static rugged_diff_cache *diff_cache_get(VALUE self)
+{
+	rugged_diff_cache *cache;
+	Data_Get_Struct(self, rugged_diff_cache, cache);
+
+	if (!cache->map)
+		rb_raise(rb_eIOError, "closed diff cache");
+
+	return cache;
+}
+
+#ifdef HAVE_SYS_MMAN_H
+struct diff_cache_flock {
+	int fd;
+	int operation;
+	int result;
+	int error;
+};
+
+static void *diff_cache_flock_nogvl(void *data)
+{
+	struct diff_cache_flock *args = data;
+
+	args->result = flock(args->fd, args->operation);
+	args->error = errno;
+
+	return NULL;
+}
+
+/*
+ * Take a LOCK_SH or LOCK_EX lock on the cache file, waiting for it
+ * without the GVL if another cache holds a conflicting lock.
+ */
+static void diff_cache_lock(rugged_diff_cache *cache, int operation)
+{
+	struct diff_cache_flock args;
+	int interrupt;
+
+	args.fd = cache->fd;
+	args.operation = operation | LOCK_NB;
+	diff_cache_flock_nogvl(&args);
+
+	args.operation = operation;
+	while (args.result < 0 && (args.error == EWOULDBLOCK || args.error == EINTR)) {
+		args.result = -1;
+		args.error = EINTR;
+
+		if ((interrupt = rugged_without_gvl_io(diff_cache_flock_nogvl, &args, 1))) {
+			if (args.result == 0)
+				flock(cache->fd, LOCK_UN);
+			rb_jump_tag(interrupt);
+		}
+	}
+
+	if (args.result < 0) {
+		errno = args.error;
+		rb_sys_fail("flock");
+	}
+}
+
+static VALUE diff_cache_unlock(VALUE arg)
+{
+	rugged_diff_cache *cache = (rugged_diff_cache *)arg;
+
+	if (cache->fd >= 0)
+		flock(cache->fd, LOCK_UN);
+
+	return Qnil;
+}
+
+static inline struct diff_cache_entry *diff_cache_entry_at(rugged_diff_cache *cache, uint64_t offset)
+{
+	struct diff_cache_entry *entry;
+
+	/* too close to the end of the ring for an entry: it wraps around */
+	if (cache->header->capacity - offset < DIFF_CACHE_ENTRY_HEADER_SIZE)
+		return NULL;
+
+	entry = (struct diff_cache_entry *)(cache->data + offset);
+	return entry->magic == DIFF_CACHE_ENTRY_MAGIC ? entry : NULL;
+}
+
+static inline uint64_t diff_cache_entry_size(const struct diff_cache_entry *entry)
+{
+	return DIFF_CACHE_ALIGN(DIFF_CACHE_ENTRY_HEADER_SIZE + (uint64_t)entry->length);
+}
+
+static void diff_cache_reset(rugged_diff_cache *cache)
+{
+	cache->header->generation++;
+	cache->header->head = 0;
+	cache->header->tail = 0;
+	cache->header->count = 0;
+	rb_funcall(cache->index, rb_intern("clear"), 0);
+
+	cache->generation = cache->header->generation;
+	cache->synced = 1;
+}
+
+/* Drop the oldest entry in the ring, or skip over the wrap at the tail */
+static void diff_cache_evict(rugged_diff_cache *cache)
+{
+	struct diff_cache_header *header = cache->header;
+	struct diff_cache_entry *entry = diff_cache_entry_at(cache, header->tail);
+	VALUE rb_key, rb_offset;
+
+	if (!entry) {
+		header->tail = 0;
+		return;
+	}
+
+	rb_key = rb_str_new((const char *)entry->key, GIT_OID_RAWSZ);
+	rb_offset = rb_hash_aref(cache->index, rb_key);
+
+	if (!NIL_P(rb_offset) && NUM2ULL(rb_offset) == header->tail)
+		rb_hash_delete(cache->index, rb_key);
+
+	header->tail += diff_cache_entry_size(entry);
+	header->count--;
+}
+
+/* Make room for +size+ bytes at the head of the ring, returning their offset */
+static uint64_t diff_cache_reserve(rugged_diff_cache *cache, uint64_t size)
+{
+	struct diff_cache_header *header = cache->header;
+
+	if (header->head + size > header->capacity) {
+		/* everything between the head and the end of the ring goes away */
+		while (header->count > 0 && header->tail >= header->head)
+			diff_cache_evict(cache);
+
+		if (header->capacity - header->head >= DIFF_CACHE_ENTRY_HEADER_SIZE)
+			((struct diff_cache_entry *)(cache->data + header->head))->magic = DIFF_CACHE_WRAP_MAGIC;
+
+		header->head = 0;
+	}
+
+	while (header->count > 0 && header->tail >= header->head && header->tail < header->head + size)
+		diff_cache_evict(cache);
+
+	if (header->count == 0)
+		header->tail = header->head;
+
+	return header->head;
+}
+
+/* Must be called with the exclusive lock held and the index in sync */
+static void diff_cache_put(rugged_diff_cache *cache, const unsigned char *key, const char *data, size_t length)
+{
+	struct diff_cache_entry *entry;
+	uint64_t offset, size = DIFF_CACHE_ALIGN(DIFF_CACHE_ENTRY_HEADER_SIZE + (uint64_t)length);
+
+	if (size > cache->header->capacity || length > UINT32_MAX)
+		return;
+
+	/* bumped first, so that a write cut short still invalidates other indexes */
+	cache->header->generation++;
+
+	offset = diff_cache_reserve(cache, size);
+	entry = (struct diff_cache_entry *)(cache->data + offset);
+
+	memcpy(entry->key, key, GIT_OID_RAWSZ);
+	entry->length = (uint32_t)length;
+	entry->reserved = 0;
+	memcpy(cache->data + offset + DIFF_CACHE_ENTRY_HEADER_SIZE, data, length);
+	entry->magic = DIFF_CACHE_ENTRY_MAGIC;
+
+	cache->header->head = offset + size;
+	cache->header->count++;
+
+	rb_hash_aset(cache->index, rb_str_new((const char *)key, GIT_OID_RAWSZ), ULL2NUM(offset));
+	cache->generation = cache->header->generation;
+}
+
+/*
+ * Rebuild the index from the entries in the ring. Returns -1 if anything
+ * doesn't add up, like a write that was cut short.
+ */
+static int diff_cache_load(rugged_diff_cache *cache)
+{
+	struct diff_cache_header *header = cache->header;
+	uint64_t offset = header->tail, i;
+	int wrapped = 0;
+
+	rb_funcall(cache->index, rb_intern("clear"), 0);
+
+	if (header->head > header->capacity || header->tail > header->capacity)
+		return -1;
+
+	for (i = 0; i < header->count; ) {
+		struct diff_cache_entry *entry = diff_cache_entry_at(cache, offset);
+
+		if (!entry) {
+			if (wrapped++ || (header->capacity - offset >= DIFF_CACHE_ENTRY_HEADER_SIZE &&
+				((struct diff_cache_entry *)(cache->data + offset))->magic != DIFF_CACHE_WRAP_MAGIC))
+				return -1;
+
+			offset = 0;
+			continue;
+		}
+
+		if (offset + diff_cache_entry_size(entry) > header->capacity)
+			return -1;
+
+		rb_hash_aset(cache->index, rb_str_new((const char *)entry->key, GIT_OID_RAWSZ), ULL2NUM(offset));
+		offset += diff_cache_entry_size(entry);
+		i++;
+	}
+
+	if (header->count > 0 && offset != header->head)
+		return -1;
+
+	return 0;
+}
+
+/*
+ * Bring the index up to date with the file, with its lock held. A broken
+ * file reads as empty, and is emptied by the next writer.
+ */
+static void diff_cache_sync(rugged_diff_cache *cache, int exclusive)
+{
+	struct diff_cache_header *header = cache->header;
+
+	/* closed by another thread while this one waited for the lock */
+	if (!cache->map)
+		rb_raise(rb_eIOError, "closed diff cache");
+
+	if (header->magic != DIFF_CACHE_MAGIC || header->version != DIFF_CACHE_VERSION ||
+		header->capacity != cache->capacity)
+		rb_raise(rb_eIOError, "The diff cache file was recreated with a different size");
+
+	if (cache->synced && cache->generation == header->generation)
+		return;
+
+	cache->synced = 0;
+
+	if (diff_cache_load(cache) < 0) {
+		rb_funcall(cache->index, rb_intern("clear"), 0);
+
+		if (exclusive)
+			diff_cache_reset(cache);
+		return;
+	}
+
+	cache->generation = header->generation;
+	cache->synced = 1;
+}
+#endif
+
+static void diff_cache_key(unsigned char *out, VALUE rb_key)
+{
+	git_oid oid;
+
+	Check_Type(rb_key, T_STRING);
+	rugged_exception_check(
+		git_odb_hash(&oid, RSTRING_PTR(rb_key), RSTRING_LEN(rb_key), GIT_OBJ_BLOB)
+	);
+
+	memcpy(out, oid.id, GIT_OID_RAWSZ);
+}
+
+#ifdef HAVE_SYS_MMAN_H
+struct diff_cache_open {
+	rugged_diff_cache *cache;
+	VALUE rb_path;
+};
+
+static VALUE diff_cache_open_body(VALUE arg)
+{
+	struct diff_cache_open *args = (struct diff_cache_open *)arg;
+	rugged_diff_cache *cache = args->cache;
+	struct diff_cache_header *header;
+	struct stat st;
+	void *map;
+	int error;
+
+	if (fstat(cache->fd, &st) < 0)
+		goto fail;
+
+	cache->map_size = (size_t)(DIFF_CACHE_HEADER_SIZE + cache->capacity);
+
+	if ((uint64_t)st.st_size != DIFF_CACHE_HEADER_SIZE + cache->capacity &&
+		ftruncate(cache->fd, (off_t)cache->map_size) < 0)
+		goto fail;
+
+	map = mmap(NULL, cache->map_size, PROT_READ | PROT_WRITE, MAP_SHARED, cache->fd, 0);
+	if (map == MAP_FAILED)
+		goto fail;
+
+	cache->map = map;
+	cache->header = header = map;
+	cache->data = cache->map + DIFF_CACHE_HEADER_SIZE;
+
+	if (header->magic != DIFF_CACHE_MAGIC || header->version != DIFF_CACHE_VERSION ||
+		header->capacity != cache->capacity) {
+		header->magic = DIFF_CACHE_MAGIC;
+		header->version = DIFF_CACHE_VERSION;
+		header->capacity = cache->capacity;
+		diff_cache_reset(cache);
+	} else {
+		diff_cache_sync(cache, 1);
+	}
+
+	return Qnil;
+
+fail:
+	error = errno;
+	diff_cache_close(cache);
+	errno = error;
+	rb_sys_fail(StringValueCStr(args->rb_path));
+	return Qnil;
+}
+#endif
+
+/*
+ *  call-seq:
+ *    DiffCache.new(path, max_size = 64 * 1024 * 1024) -> cache
+ *
+ *  Open the cache file at +path+, creating it if needed, and map it into
+ *  memory. The cache stores at most +max_size+ bytes, evicting the least
+ *  recently used entries first. If the file was created with a different
+ *  +max_size+, its contents are discarded, and caches that still have it
+ *  open with the old size raise IOError from then on.
+ *
+ *  The same file can be open in several caches, in this or other processes,
+ *  at once: each read or write locks the file only while it runs, and sees
+ *  the values stored through every other cache. A cache must not be used
+ *  from both sides of a fork; open it after forking.
+ */
+static VALUE rb_git_diff_cache_new(int argc, VALUE *argv, VALUE klass)
+{
+#ifdef HAVE_SYS_MMAN_H
+	rugged_diff_cache *cache;
+	struct diff_cache_open args;
+	VALUE rb_path, rb_max_size, rb_cache;
+	uint64_t capacity = DIFF_CACHE_DEFAULT_SIZE;
+
+	rb_scan_args(argc, argv, "11", &rb_path, &rb_max_size);
+	FilePathValue(rb_path);
+
+	if (!NIL_P(rb_max_size)) {
+		capacity = NUM2ULL(rb_max_size);
+
+		if (capacity < DIFF_CACHE_MIN_SIZE)
+			rb_raise(rb_eArgError, "The diff cache must be at least %d bytes", DIFF_CACHE_MIN_SIZE);
+	}
+
+	rb_cache = Data_Make_Struct(klass, rugged_diff_cache, diff_cache_mark, diff_cache_free, cache);
+	cache->fd = -1;
+	cache->index = rb_hash_new();
+	cache->capacity = DIFF_CACHE_ALIGN(capacity);
+
+	cache->fd = open(StringValueCStr(rb_path), O_RDWR | O_CREAT, 0644);
+	if (cache->fd < 0)
+		rb_sys_fail(StringValueCStr(rb_path));
+
+	args.cache = cache;
+	args.rb_path = rb_path;
+
+	diff_cache_lock(cache, LOCK_EX);
+	rb_ensure(diff_cache_open_body, (VALUE)&args, diff_cache_unlock, (VALUE)cache);
+
+	return rb_cache;
+#else
+	rb_raise(rb_eNotImpError, "Rugged::DiffCache is not supported on this platform");
+	return Qnil;
+#endif
+}
+
+#ifdef HAVE_SYS_MMAN_H
+struct diff_cache_op {
+	rugged_diff_cache *cache;
+	const unsigned char *key;
+	VALUE rb_value;
+	int promote;
+};
+
+static VALUE diff_cache_lookup(rugged_diff_cache *cache, const unsigned char *key)
+{
+	return rb_hash_aref(cache->index, rb_str_new((const char *)key, GIT_OID_RAWSZ));
+}
+
+/* Whether the entry at +offset+ is in the older half of the ring in use */
+static int diff_cache_is_old(rugged_diff_cache *cache, uint64_t offset)
+{
+	struct diff_cache_header *header = cache->header;
+	uint64_t age, live;
+
+	/* how far the entry is from being evicted, relative to the size of the ring in use */
+	age = offset >= header->tail ? offset - header->tail : header->capacity - header->tail + offset;
+	live = header->head > header->tail ? header->head - header->tail : header->capacity - header->tail + header->head;
+
+	return age < live / 2;
+}
+
+static VALUE diff_cache_get_body(VALUE arg)
+{
+	struct diff_cache_op *op = (struct diff_cache_op *)arg;
+	struct diff_cache_entry *entry;
+	uint64_t offset;
+	VALUE rb_offset;
+
+	diff_cache_sync(op->cache, 0);
+
+	rb_offset = diff_cache_lookup(op->cache, op->key);
+	if (NIL_P(rb_offset))
+		return Qnil;
+
+	offset = NUM2ULL(rb_offset);
+	entry = (struct diff_cache_entry *)(op->cache->data + offset);
+
+	op->promote = diff_cache_is_old(op->cache, offset);
+	return rb_str_new((const char *)entry + DIFF_CACHE_ENTRY_HEADER_SIZE, entry->length);
+}
+
+static VALUE diff_cache_promote_body(VALUE arg)
+{
+	struct diff_cache_op *op = (struct diff_cache_op *)arg;
+	VALUE rb_offset;
+
+	diff_cache_sync(op->cache, 1);
+
+	/* unless another cache has moved or evicted it in the meantime */
+	rb_offset = diff_cache_lookup(op->cache, op->key);
+	if (!NIL_P(rb_offset) && diff_cache_is_old(op->cache, NUM2ULL(rb_offset)))
+		diff_cache_put(op->cache, op->key, RSTRING_PTR(op->rb_value), RSTRING_LEN(op->rb_value));
+
+	return Qnil;
+}
+
+static VALUE diff_cache_set_body(VALUE arg)
+{
+	struct diff_cache_op *op = (struct diff_cache_op *)arg;
+
+	diff_cache_sync(op->cache, 1);
+	diff_cache_put(op->cache, op->key, RSTRING_PTR(op->rb_value), RSTRING_LEN(op->rb_value));
+
+	return Qnil;
+}
+
+static VALUE diff_cache_size_body(VALUE arg)
+{
+	rugged_diff_cache *cache = (rugged_diff_cache *)arg;
+
+	diff_cache_sync(cache, 0);
+	return rb_funcall(cache->index, rb_intern("size"), 0);
+}
+
+static VALUE diff_cache_clear_body(VALUE arg)
+{
+	rugged_diff_cache *cache = (rugged_diff_cache *)arg;
+
+	diff_cache_sync(cache, 1);
+	diff_cache_reset(cache);
+
+	return Qnil;
+}
+#endif
+
+/*
+ *  call-seq:
+ *    cache[key] -> string or nil
+ *
+ *  Return the value stored under +key+, or +nil+ if it's not in the cache.
+ */
+static VALUE rb_git_diff_cache_get(VALUE self, VALUE rb_key)
+{
+#ifdef HAVE_SYS_MMAN_H
+	struct diff_cache_op op;
+	unsigned char key[GIT_OID_RAWSZ];
+
+	op.cache = diff_cache_get(self);
+	op.key = key;
+	op.promote = 0;
+
+	diff_cache_key(key, rb_key);
+
+	diff_cache_lock(op.cache, LOCK_SH);
+	op.rb_value = rb_ensure(diff_cache_get_body, (VALUE)&op, diff_cache_unlock, (VALUE)op.cache);
+
+	if (op.promote) {
+		diff_cache_lock(op.cache, LOCK_EX);
+		rb_ensure(diff_cache_promote_body, (VALUE)&op, diff_cache_unlock, (VALUE)op.cache);
+	}
+
+	return op.rb_value;
+#else
+	return Qnil;
+#endif
+}
+
+/*
+ *  call-seq:
+ *    cache[key] = value
+ *
+ *  Store the String +value+ under +key+, evicting the least recently used
+ *  entries to make room for it. Values that don't fit in the cache at all
+ *  are not stored.
+ */
+static VALUE rb_git_diff_cache_set(VALUE self, VALUE rb_key, VALUE rb_value)
+{
+#ifdef HAVE_SYS_MMAN_H
+	struct diff_cache_op op;
+	unsigned char key[GIT_OID_RAWSZ];
+
+	op.cache = diff_cache_get(self);
+	op.key = key;
+	op.rb_value = rb_value;
+
+	Check_Type(rb_value, T_STRING);
+	diff_cache_key(key, rb_key);
+
+	diff_cache_lock(op.cache, LOCK_EX);
+	rb_ensure(diff_cache_set_body, (VALUE)&op, diff_cache_unlock, (VALUE)op.cache);
+#endif
+	return rb_value;
+}
+
+/*
+ *  call-seq:
+ *    cache.size -> int
+ *
+ *  Return the number of values in the cache.
+ */
+static VALUE rb_git_diff_cache_size(VALUE self)
+{
+	rugged_diff_cache *cache = diff_cache_get(self);
+#ifdef HAVE_SYS_MMAN_H
+	diff_cache_lock(cache, LOCK_SH);
+	return rb_ensure(diff_cache_size_body, (VALUE)cache, diff_cache_unlock, (VALUE)cache);
+#else
+	return rb_funcall(cache->index, rb_intern("size"), 0);
+#endif
+}
+
+/*
+ *  call-seq:
+ *    cache.max_size -> int
+ *
+ *  Return the maximum number of bytes stored in the cache.
+ */
+static VALUE rb_git_diff_cache_max_size(VALUE self)
+{
+	rugged_diff_cache *cache = diff_cache_get(self);
+	return ULL2NUM(cache->capacity);
+}
+
+/*
+ *  call-seq:
+ *    cache.clear -> cache
+ *
+ *  Remove all the values from the cache.
+ */
+static VALUE rb_git_diff_cache_clear(VALUE self)
+{
+#ifdef HAVE_SYS_MMAN_H
+	rugged_diff_cache *cache = diff_cache_get(self);
+
+	diff_cache_lock(cache, LOCK_EX);
+	rb_ensure(diff_cache_clear_body, (VALUE)cache, diff_cache_unlock, (VALUE)cache);
+#endif
+	return self;
+}
+
+/*
+ *  call-seq:
+ *    cache.close -> nil
+ *
+ *  Unmap and close the cache file. Any further use of the cache raises IOError.
+ */
+static VALUE rb_git_diff_cache_close(VALUE self)
+{
+	rugged_diff_cache *cache;
+	Data_Get_Struct(self, rugged_diff_cache, cache);
+
+	diff_cache_close(cache);
+	rb_funcall(cache->index, rb_intern("clear"), 0);
+
+	return Qnil;
+}
+
+static void diff_cache_key_cat_str(VALUE rb_buffer, const char *str)
+{
+	if (str)
+		rb_str_cat(rb_buffer, str, strlen(str));
+	rb_str_cat(rb_buffer, "", 1);
+}
+
+static int diff_cache_strcmp(const void *a, const void *b)
+{
+	return strcmp(*(const char **)a, *(const char **)b);
+}
+
+/*
+ *  call-seq:
+ *    DiffCache.options_key(options = {}) -> string
+ *
+ *  Return a canonical binary representation of the diff +options+, as
+ *  accepted by Rugged::Tree.diff. Two option hashes that produce the same
+ *  diff have the same key, regardless of how they were spelled. The
+ *  +:max_files+, +:max_file_bytes+, +:max_total_lines+ and +:timeout_ms+
+ *  budgets are part of the key.
+ */
+static VALUE rb_git_diff_cache_options_key(int argc, VALUE *argv, VALUE self)
+{
+	git_diff_options opts = GIT_DIFF_OPTIONS_INIT;
+	struct rugged_diff_budget budget;
+	VALUE rb_options, rb_buffer;
+	uint64_t fields[9];
+	size_t i;
+
+	rb_scan_args(argc, argv, "01", &rb_options);
+	rugged_parse_diff_budget(&budget, &opts, rb_options);
+	rugged_parse_diff_options(&opts, rb_options);
+
+	fields[0] = opts.flags;
+	fields[1] = (uint64_t)opts.ignore_submodules;
+	fields[2] = opts.context_lines;
+	fields[3] = opts.interhunk_lines;
+	fields[4] = opts.id_abbrev;
+	fields[5] = (uint64_t)opts.max_size;
+	fields[6] = budget.max_files;
+	fields[7] = budget.max_total_lines;
+	fields[8] = budget.timeout_ms;
+
+	rb_buffer = rb_str_buf_new(sizeof(fields) + 64);
+	rb_str_cat(rb_buffer, (const char *)fields, sizeof(fields));
+
+	diff_cache_key_cat_str(rb_buffer, opts.old_prefix);
+	diff_cache_key_cat_str(rb_buffer, opts.new_prefix);
+
+	/* the order of the paths doesn't change the diff */
+	if (opts.pathspec.count > 1)
+		qsort(opts.pathspec.strings, opts.pathspec.count, sizeof(char *), diff_cache_strcmp);
+
+	for (i = 0; i < opts.pathspec.count; ++i)
+		diff_cache_key_cat_str(rb_buffer, opts.pathspec.strings[i]);
+
+	xfree(opts.pathspec.strings);
+
+	return rb_buffer;
+}
+
+void Init_rugged_diff_cache(void)
+{
+	rb_cRuggedDiffCache = rb_define_class_under(rb_mRugged, "DiffCache", rb_cObject);
+
+	rb_define_singleton_method(rb_cRuggedDiffCache, "new", rb_git_diff_cache_new, -1);
+	rb_define_singleton_method(rb_cRuggedDiffCache, "options_key", rb_git_diff_cache_options_key, -1);
+
+	rb_define_method(rb_cRuggedDiffCache, "[]", rb_git_diff_cache_get, 1);
+	rb_define_method(rb_cRuggedDiffCache, "[]=", rb_git_diff_cache_set, 2);
+	rb_define_method(rb_cRuggedDiffCache, "size", rb_git_diff_cache_size, 0);
+	rb_define_method(rb_cRuggedDiffCache, "max_size", rb_git_diff_cache_max_size, 0);
+	rb_define_method(rb_cRuggedDiffCache, "clear", rb_git_diff_cache_clear, 0);
+	rb_define_method(rb_cRuggedDiffCache, "close", rb_git_diff_cache_close, 0);
+}
@@ -81,25 +81,152 @@ static VALUE rb_git_delta_status_char_fromC(git_delta_t status)
 	return CSTR2SYM(status_char);
 }
 
+/*
+ * Deltas are snapshots: each one copies its git_diff_delta, and the paths
+ * it points to, when it is created, so it stays valid after #merge! or
+ * #find_similar! rebuild the deltas of its diff. The Ruby values of its
+ * fields are still only built on first access.
+ */
+struct rugged_diff_delta {
+	git_diff_delta delta;
+	/* followed by the NUL terminated old and new paths */
+};
+
+/*
+ * Create a delta owned by +owner+, which is kept alive for as long as
+ * the delta, from a copy of +delta+.
+ */
 VALUE rugged_diff_delta_new(VALUE owner, const git_diff_delta *delta)
 {
-	VALUE rb_delta = rb_class_new_instance(0, NULL, rb_cRuggedDiffDelta);
+	struct rugged_diff_delta *snapshot;
+	char *paths;
+	size_t old_len = delta->old_file.path ? strlen(delta->old_file.path) + 1 : 0;
+	size_t new_len = delta->new_file.path ? strlen(delta->new_file.path) + 1 : 0;
+	VALUE rb_delta;
+
+	snapshot = xmalloc(sizeof(struct rugged_diff_delta) + old_len + new_len);
+	memcpy(&snapshot->delta, delta, sizeof(git_diff_delta));
+	paths = (char *)(snapshot + 1);
+
+	if (old_len) {
+		memcpy(paths, delta->old_file.path, old_len);
+		snapshot->delta.old_file.path = paths;
+	}
 
+	if (new_len) {
+		memcpy(paths + old_len, delta->new_file.path, new_len);
+		snapshot->delta.new_file.path = paths + old_len;
+	}
+
+	rb_delta = Data_Wrap_Struct(rb_cRuggedDiffDelta, NULL, xfree, snapshot);
 	rugged_set_owner(rb_delta, owner);
-	rb_iv_set(rb_delta, "@old_file", rb_git_delta_file_fromC(&delta->old_file));
-	rb_iv_set(rb_delta, "@new_file", rb_git_delta_file_fromC(&delta->new_file));
-	rb_iv_set(rb_delta, "@similarity", INT2FIX(delta->similarity));
-	rb_iv_set(rb_delta, "@status", rb_git_delta_status_fromC(delta->status));
-	rb_iv_set(rb_delta, "@status_char", rb_git_delta_status_char_fromC(delta->status));
-	rb_iv_set(rb_delta, "@binary",
-		(!(delta->flags & GIT_DIFF_FLAG_NOT_BINARY) &&
-		 (delta->flags & GIT_DIFF_FLAG_BINARY)) ? Qtrue : Qfalse
-	);
 
 	return rb_delta;
 }
 
+static const git_diff_delta *rugged_diff_delta_get(VALUE self)
+{
+	struct rugged_diff_delta *snapshot;
+
+	Data_Get_Struct(self, struct rugged_diff_delta, snapshot);
+	return &snapshot->delta;
+}
+
+/*
+ *  call-seq:
+ *    delta.old_file -> hash
+ *
+ *  Returns a Hash with the +:oid+, +:path+, +:size+, +:flags+ and +:mode+
+ *  of the old side of the delta.
+ */
+static VALUE rb_git_delta_old_file_GET(VALUE self)
+{
+	VALUE rb_file = rb_attr_get(self, rb_intern("@old_file"));
+
+	if (NIL_P(rb_file)) {
+		rb_file = rb_git_delta_file_fromC(&rugged_diff_delta_get(self)->old_file);
+		rb_iv_set(self, "@old_file", rb_file);
+	}
+
+	return rb_file;
+}
+
+/*
+ *  call-seq:
+ *    delta.new_file -> hash
+ *
+ *  Returns a Hash with the +:oid+, +:path+, +:size+, +:flags+ and +:mode+
+ *  of the new side of the delta.
+ */
+static VALUE rb_git_delta_new_file_GET(VALUE self)
+{
+	VALUE rb_file = rb_attr_get(self, rb_intern("@new_file"));
+
+	if (NIL_P(rb_file)) {
+		rb_file = rb_git_delta_file_fromC(&rugged_diff_delta_get(self)->new_file);
+		rb_iv_set(self, "@new_file", rb_file);
+	}
+
+	return rb_file;
+}
+
+/*
+ *  call-seq:
+ *    delta.similarity -> int
+ *
+ *  Returns the similarity score, from 0 to 100, of a renamed or copied file.
+ */
+static VALUE rb_git_delta_similarity_GET(VALUE self)
+{
+	return INT2FIX(rugged_diff_delta_get(self)->similarity);
+}
+
+/*
+ *  call-seq:
+ *    delta.status -> symbol
+ *
+ *  Returns the status of the delta, like +:added+, +:deleted+ or +:modified+.
+ */
+static VALUE rb_git_delta_status_GET(VALUE self)
+{
+	return rb_git_delta_status_fromC(rugged_diff_delta_get(self)->status);
+}
+
+/*
+ *  call-seq:
+ *    delta.status_char -> symbol
+ *
+ *  Returns the status of the delta as a single character Symbol, as used by
+ *  <tt>git diff --name-status</tt>.
+ */
+static VALUE rb_git_delta_status_char_GET(VALUE self)
+{
+	return rb_git_delta_status_char_fromC(rugged_diff_delta_get(self)->status);
+}
+
+/*
+ *  call-seq:
+ *    delta.binary -> true or false
+ *
+ *  Returns true if the delta is known to be binary.
+ */
+static VALUE rb_git_delta_binary_GET(VALUE self)
+{
+	const git_diff_delta *delta = rugged_diff_delta_get(self);
+
+	return (!(delta->flags & GIT_DIFF_FLAG_NOT_BINARY) &&
+		(delta->flags & GIT_DIFF_FLAG_BINARY)) ? Qtrue : Qfalse;
+}
+
 void Init_rugged_diff_delta(void)
 {
 	rb_cRuggedDiffDelta = rb_define_class_under(rb_cRuggedDiff, "Delta", rb_cObject);
+	rb_undef_alloc_func(rb_cRuggedDiffDelta);
+
+	rb_define_method(rb_cRuggedDiffDelta, "old_file", rb_git_delta_old_file_GET, 0);
+	rb_define_method(rb_cRuggedDiffDelta, "new_file", rb_git_delta_new_file_GET, 0);
+	rb_define_method(rb_cRuggedDiffDelta, "similarity", rb_git_delta_similarity_GET, 0);
+	rb_define_method(rb_cRuggedDiffDelta, "status", rb_git_delta_status_GET, 0);
+	rb_define_method(rb_cRuggedDiffDelta, "status_char", rb_git_delta_status_char_GET, 0);
+	rb_define_method(rb_cRuggedDiffDelta, "binary", rb_git_delta_binary_GET, 0);
 }
@@ -28,23 +28,100 @@ extern VALUE rb_cRuggedDiff;
 VALUE rb_cRuggedDiffHunk;
 
 
-VALUE rugged_diff_hunk_new(VALUE owner, size_t hunk_idx, const git_diff_hunk *hunk, size_t lines_in_hunk)
+/*
+ * Hunks only keep their index in the patch that owns them, and read
+ * their header and line ranges from the native git_diff_hunk on access.
+ */
+VALUE rugged_diff_hunk_new(VALUE owner, size_t hunk_idx, size_t lines_in_hunk)
 {
 	VALUE rb_hunk = rb_class_new_instance(0, NULL, rb_cRuggedDiffHunk);
 	rugged_set_owner(rb_hunk, owner);
 
-	rb_iv_set(rb_hunk, "@header", rb_str_new(hunk->header, hunk->header_len));
 	rb_iv_set(rb_hunk, "@line_count", INT2FIX(lines_in_hunk));
 	rb_iv_set(rb_hunk, "@hunk_index", INT2FIX(hunk_idx));
 
-	rb_iv_set(rb_hunk, "@old_start", INT2FIX(hunk->old_start));
-	rb_iv_set(rb_hunk, "@old_lines", INT2FIX(hunk->old_lines));
-	rb_iv_set(rb_hunk, "@new_start", INT2FIX(hunk->new_start));
-	rb_iv_set(rb_hunk, "@new_lines", INT2FIX(hunk->new_lines));
-
 	return rb_hunk;
 }
 
+static const git_diff_hunk *rugged_diff_hunk_get(VALUE self)
+{
+	const git_diff_hunk *hunk;
+	git_patch *patch;
+
+	Data_Get_Struct(rugged_owner(self), git_patch, patch);
+
+	rugged_exception_check(
+		git_patch_get_hunk(&hunk, NULL, patch, FIX2INT(rb_iv_get(self, "@hunk_index")))
+	);
+
+	return hunk;
+}
+
+/*
+ *  call-seq:
+ *    hunk.header -> string
+ *
+ *  Returns the header line of the hunk, like
+ *  <tt>"@@ -1,3 +1,4 @@ def foo\n"</tt>.
+ */
+static VALUE rb_git_diff_hunk_header_GET(VALUE self)
+{
+	VALUE rb_header = rb_attr_get(self, rb_intern("@header"));
+
+	if (NIL_P(rb_header)) {
+		const git_diff_hunk *hunk = rugged_diff_hunk_get(self);
+
+		rb_header = rb_str_new(hunk->header, hunk->header_len);
+		rb_iv_set(self, "@header", rb_header);
+	}
+
+	return rb_header;
+}
+
+/*
+ *  call-seq:
+ *    hunk.old_start -> int
+ *
+ *  Returns the first line of the hunk in the old file.
+ */
+static VALUE rb_git_diff_hunk_old_start_GET(VALUE self)
+{
+	return INT2FIX(rugged_diff_hunk_get(self)->old_start);
+}
+
+/*
+ *  call-seq:
+ *    hunk.old_lines -> int
+ *
+ *  Returns the number of lines of the hunk in the old file.
+ */
+static VALUE rb_git_diff_hunk_old_lines_GET(VALUE self)
+{
+	return INT2FIX(rugged_diff_hunk_get(self)->old_lines);
+}
+
+/*
+ *  call-seq:
+ *    hunk.new_start -> int
+ *
+ *  Returns the first line of the hunk in the new file.
+ */
+static VALUE rb_git_diff_hunk_new_start_GET(VALUE self)
+{
+	return INT2FIX(rugged_diff_hunk_get(self)->new_start);
+}
+
+/*
+ *  call-seq:
+ *    hunk.new_lines -> int
+ *
+ *  Returns the number of lines of the hunk in the new file.
+ */
+static VALUE rb_git_diff_hunk_new_lines_GET(VALUE self)
+{
+	return INT2FIX(rugged_diff_hunk_get(self)->new_lines);
+}
+
 /*
  *  call-seq:
  *    hunk.each_line { |line| } -> self
@@ -80,6 +157,367 @@ static VALUE rb_git_diff_hunk_each_line(VALUE self)
 	return self;
 }
 
+/*
+ *  call-seq:
+ *    hunk.line_table -> line_table
+ *
+ *  Returns a Rugged::Diff::LineTable with all the lines that are part of
+ *  the current hunk, without creating a Rugged::Diff::Line for each of them.
+ */
+static VALUE rb_git_diff_hunk_line_table(VALUE self)
+{
+	git_patch *patch;
+	size_t hunk_idx;
+
+	Data_Get_Struct(rugged_owner(self), git_patch, patch);
+	hunk_idx = FIX2INT(rb_iv_get(self, "@hunk_index"));
+
+	return rugged_diff_line_table_new(patch, hunk_idx, hunk_idx + 1);
+}
+
+/*
+ * Intraline (word) diff of the paired deletion/addition lines in a hunk.
+ *
+ * Each run of deleted lines that is directly followed by a run of added
+ * lines is paired up line by line. Both sides of a pair are split into
+ * word, whitespace and punctuation tokens, and the tokens are diffed with
+ * an LCS after trimming their common prefix and suffix. Pairs where the
+ * LCS table would grow beyond RUGGED_INTRALINE_MAX_CELLS fall back to
+ * marking everything between the common prefix and suffix as changed.
+ */
+#define RUGGED_INTRALINE_MAX_CELLS (1 << 20)
+
+struct rugged_intraline_token {
+	size_t offset;
+	size_t len;
+	uint32_t hash;
+};
+
+struct rugged_intraline {
+	git_patch *patch;
+	int hunk_idx;
+	int lines_count;
+
+	int *dels, *adds;
+
+	struct rugged_intraline_token *old_tokens, *new_tokens;
+	char *old_changed, *new_changed;
+	size_t old_alloc, new_alloc;
+
+	uint32_t *table;
+	size_t table_alloc;
+
+	VALUE rb_result;
+};
+
+static int rugged__intraline_is_word(unsigned char c)
+{
+	return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+		(c >= '0' && c <= '9') || c == '_' || c >= 0x80;
+}
+
+static int rugged__intraline_is_space(unsigned char c)
+{
+	return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+static size_t rugged__intraline_tokenize(
+	struct rugged_intraline_token *tokens, const char *content, size_t len)
+{
+	size_t i = 0, count = 0;
+
+	while (i < len) {
+		struct rugged_intraline_token *token = &tokens[count++];
+		size_t start = i;
+		uint32_t hash = 2166136261u;
+
+		if (rugged__intraline_is_word(content[i])) {
+			while (i < len && rugged__intraline_is_word(content[i]))
+				i++;
+		} else if (rugged__intraline_is_space(content[i])) {
+			while (i < len && rugged__intraline_is_space(content[i]))
+				i++;
+		} else {
+			i++;
+		}
+
+		token->offset = start;
+		token->len = i - start;
+
+		for (; start < i; ++start) {
+			hash ^= (unsigned char)content[start];
+			hash *= 16777619u;
+		}
+		token->hash = hash;
+	}
+
+	return count;
+}
+
+static int rugged__intraline_token_eq(
+	const char *old_content, const struct rugged_intraline_token *a,
+	const char *new_content, const struct rugged_intraline_token *b)
+{
+	return a->hash == b->hash && a->len == b->len &&
+		!memcmp(old_content + a->offset, new_content + b->offset, a->len);
+}
+
+static void rugged__intraline_diff(
+	struct rugged_intraline *il,
+	const char *old_content, size_t old_count,
+	const char *new_content, size_t new_count)
+{
+	const struct rugged_intraline_token *a = il->old_tokens, *b = il->new_tokens;
+	size_t prefix = 0, suffix = 0, n, m, i, j;
+
+	memset(il->old_changed, 0, old_count);
+	memset(il->new_changed, 0, new_count);
+
+	while (prefix < old_count && prefix < new_count &&
+		rugged__intraline_token_eq(old_content, &a[prefix], new_content, &b[prefix]))
+		prefix++;
+
+	while (suffix < old_count - prefix && suffix < new_count - prefix &&
+		rugged__intraline_token_eq(
+			old_content, &a[old_count - suffix - 1],
+			new_content, &b[new_count - suffix - 1]))
+		suffix++;
+
+	n = old_count - prefix - suffix;
+	m = new_count - prefix - suffix;
+
+	if (n == 0 || m == 0 ||
+		(n + 1) > RUGGED_INTRALINE_MAX_CELLS / (m + 1)) {
+		memset(il->old_changed + prefix, 1, n);
+		memset(il->new_changed + prefix, 1, m);
+		return;
+	}
+
+	a += prefix;
+	b += prefix;
+
+	if ((n + 1) * (m + 1) > il->table_alloc) {
+		il->table_alloc = (n + 1) * (m + 1);
+		REALLOC_N(il->table, uint32_t, il->table_alloc);
+	}
+
+#define LCS(i, j) il->table[(i) * (m + 1) + (j)]
+	for (i = n + 1; i-- > 0; ) {
+		for (j = m + 1; j-- > 0; ) {
+			if (i == n || j == m)
+				LCS(i, j) = 0;
+			else if (rugged__intraline_token_eq(old_content, &a[i], new_content, &b[j]))
+				LCS(i, j) = LCS(i + 1, j + 1) + 1;
+			else
+				LCS(i, j) = LCS(i + 1, j) >= LCS(i, j + 1) ? LCS(i + 1, j) : LCS(i, j + 1);
+		}
+	}
+
+	i = j = 0;
+	while (i < n && j < m) {
+		if (rugged__intraline_token_eq(old_content, &a[i], new_content, &b[j])) {
+			i++; j++;
+		} else if (LCS(i + 1, j) >= LCS(i, j + 1)) {
+			il->old_changed[prefix + i++] = 1;
+		} else {
+			il->new_changed[prefix + j++] = 1;
+		}
+	}
+#undef LCS
+
+	for (; i < n; ++i)
+		il->old_changed[prefix + i] = 1;
+	for (; j < m; ++j)
+		il->new_changed[prefix + j] = 1;
+}
+
+static VALUE rugged__intraline_ranges(
+	const struct rugged_intraline_token *tokens, const char *changed, size_t count)
+{
+	VALUE rb_ranges = rb_ary_new();
+	size_t i = 0;
+
+	while (i < count) {
+		size_t start;
+
+		if (!changed[i]) {
+			i++;
+			continue;
+		}
+
+		start = tokens[i].offset;
+		while (i < count && changed[i])
+			i++;
+
+		rb_ary_push(rb_ranges, rb_range_new(
+			LONG2NUM(start), LONG2NUM(tokens[i - 1].offset + tokens[i - 1].len), 1));
+	}
+
+	return rb_ranges;
+}
+
+static const git_diff_line *rugged__intraline_line(
+	struct rugged_intraline *il, int line_idx, size_t *len)
+{
+	const git_diff_line *line;
+
+	rugged_exception_check(
+		git_patch_get_line_in_hunk(&line, il->patch, il->hunk_idx, line_idx)
+	);
+
+	*len = line->content_len;
+	if (*len > 0 && line->content[*len - 1] == '\n')
+		(*len)--;
+
+	return line;
+}
+
+static void rugged__intraline_flush(struct rugged_intraline *il, int dels, int adds)
+{
+	int k;
+
+	for (k = 0; k < dels && k < adds; ++k) {
+		const git_diff_line *old_line, *new_line;
+		size_t old_len, new_len, old_count, new_count;
+		VALUE rb_change;
+
+		old_line = rugged__intraline_line(il, il->dels[k], &old_len);
+		new_line = rugged__intraline_line(il, il->adds[k], &new_len);
+
+		if (old_len > il->old_alloc) {
+			il->old_alloc = old_len;
+			REALLOC_N(il->old_tokens, struct rugged_intraline_token, il->old_alloc);
+			REALLOC_N(il->old_changed, char, il->old_alloc);
+		}
+
+		if (new_len > il->new_alloc) {
+			il->new_alloc = new_len;
+			REALLOC_N(il->new_tokens, struct rugged_intraline_token, il->new_alloc);
+			REALLOC_N(il->new_changed, char, il->new_alloc);
+		}
+
+		old_count = rugged__intraline_tokenize(il->old_tokens, old_line->content, old_len);
+		new_count = rugged__intraline_tokenize(il->new_tokens, new_line->content, new_len);
+
+		rugged__intraline_diff(il,
+			old_line->content, old_count, new_line->content, new_count);
+
+		rb_change = rb_hash_new();
+		rb_hash_aset(rb_change, CSTR2SYM("old_line"), INT2FIX(il->dels[k]));
+		rb_hash_aset(rb_change, CSTR2SYM("new_line"), INT2FIX(il->adds[k]));
+		rb_hash_aset(rb_change, CSTR2SYM("old_ranges"),
+			rugged__intraline_ranges(il->old_tokens, il->old_changed, old_count));
+		rb_hash_aset(rb_change, CSTR2SYM("new_ranges"),
+			rugged__intraline_ranges(il->new_tokens, il->new_changed, new_count));
+
+		rb_ary_push(il->rb_result, rb_change);
+	}
+}
+
+static VALUE rugged__intraline_run(VALUE _il)
+{
+	struct rugged_intraline *il = (struct rugged_intraline *)_il;
+	int l, dels = 0, adds = 0;
+
+	il->dels = ALLOC_N(int, il->lines_count);
+	il->adds = ALLOC_N(int, il->lines_count);
+
+	for (l = 0; l < il->lines_count; ++l) {
+		const git_diff_line *line;
+
+		rugged_exception_check(
+			git_patch_get_line_in_hunk(&line, il->patch, il->hunk_idx, l)
+		);
+
+		switch (line->origin) {
+		case GIT_DIFF_LINE_DELETION:
+			if (adds) {
+				rugged__intraline_flush(il, dels, adds);
+				dels = adds = 0;
+			}
+			il->dels[dels++] = l;
+			break;
+
+		case GIT_DIFF_LINE_ADDITION:
+			il->adds[adds++] = l;
+			break;
+
+		case GIT_DIFF_LINE_CONTEXT_EOFNL:
+		case GIT_DIFF_LINE_ADD_EOFNL:
+		case GIT_DIFF_LINE_DEL_EOFNL:
+			break;
+
+		default:
+			rugged__intraline_flush(il, dels, adds);
+			dels = adds = 0;
+		}
+	}
+
+	rugged__intraline_flush(il, dels, adds);
+
+	return il->rb_result;
+}
+
+static VALUE rugged__intraline_cleanup(VALUE _il)
+{
+	struct rugged_intraline *il = (struct rugged_intraline *)_il;
+
+	xfree(il->dels);
+	xfree(il->adds);
+	xfree(il->old_tokens);
+	xfree(il->new_tokens);
+	xfree(il->old_changed);
+	xfree(il->new_changed);
+	xfree(il->table);
+
+	return Qnil;
+}
+
+/*
+ *  call-seq:
+ *    hunk.intraline_changes -> array
+ *
+ *  Returns the words that changed inside the modified lines of the hunk.
+ *
+ *  Every run of deleted lines that is directly followed by a run of added
+ *  lines is paired up line by line, and each pair is diffed word by word.
+ *  Lines without a partner are left out, since they changed as a whole.
+ *
+ *  Each pair is returned as a Hash with the following keys:
+ *
+ *  :old_line ::
+ *    The index of the deleted line in the hunk, as yielded by #each_line.
+ *
+ *  :new_line ::
+ *    The index of the added line in the hunk.
+ *
+ *  :old_ranges ::
+ *    An Array of byte ranges into the content of the deleted line that
+ *    were removed or replaced.
+ *
+ *  :new_ranges ::
+ *    An Array of byte ranges into the content of the added line that
+ *    were inserted or replaced.
+ *
+ *  The ranges can be passed to String#byteslice directly, and never cover
+ *  the trailing newline of a line.
+ *
+ *    hunk.intraline_changes #=> [{:old_line=>0, :new_line=>1, :old_ranges=>[3...4], :new_ranges=>[3...5]}]
+ */
+static VALUE rb_git_diff_hunk_intraline_changes(VALUE self)
+{
+	struct rugged_intraline il;
+
+	memset(&il, 0, sizeof(il));
+
+	Data_Get_Struct(rugged_owner(self), git_patch, il.patch);
+	il.hunk_idx = FIX2INT(rb_iv_get(self, "@hunk_index"));
+	il.lines_count = FIX2INT(rb_iv_get(self, "@line_count"));
+	il.rb_result = rb_ary_new();
+
+	return rb_ensure(rugged__intraline_run, (VALUE)&il, rugged__intraline_cleanup, (VALUE)&il);
+}
+
 void Init_rugged_diff_hunk(void)
 {
 	rb_cRuggedDiffHunk = rb_define_class_under(rb_cRuggedDiff, "Hunk", rb_cObject);
@@ -88,15 +526,17 @@ void Init_rugged_diff_hunk(void)
 
 	rb_define_method(rb_cRuggedDiffHunk, "each", rb_git_diff_hunk_each_line, 0);
 	rb_define_method(rb_cRuggedDiffHunk, "each_line", rb_git_diff_hunk_each_line, 0);
+	rb_define_method(rb_cRuggedDiffHunk, "line_table", rb_git_diff_hunk_line_table, 0);
+	rb_define_method(rb_cRuggedDiffHunk, "intraline_changes", rb_git_diff_hunk_intraline_changes, 0);
 
-	rb_define_attr(rb_cRuggedDiffHunk, "header", 1, 0);
+	rb_define_method(rb_cRuggedDiffHunk, "header", rb_git_diff_hunk_header_GET, 0);
 	rb_define_attr(rb_cRuggedDiffHunk, "line_count", 1, 0);
 	rb_define_attr(rb_cRuggedDiffHunk, "hunk_index", 1, 0);
 
-	rb_define_attr(rb_cRuggedDiffHunk, "old_start", 1, 0);
-	rb_define_attr(rb_cRuggedDiffHunk, "old_lines", 1, 0);
-	rb_define_attr(rb_cRuggedDiffHunk, "new_start", 1, 0);
-	rb_define_attr(rb_cRuggedDiffHunk, "new_lines", 1, 0);
+	rb_define_method(rb_cRuggedDiffHunk, "old_start", rb_git_diff_hunk_old_start_GET, 0);
+	rb_define_method(rb_cRuggedDiffHunk, "old_lines", rb_git_diff_hunk_old_lines_GET, 0);
+	rb_define_method(rb_cRuggedDiffHunk, "new_start", rb_git_diff_hunk_new_start_GET, 0);
+	rb_define_method(rb_cRuggedDiffHunk, "new_lines", rb_git_diff_hunk_new_lines_GET, 0);
 
 	rb_define_alias(rb_cRuggedDiffHunk, "count", "line_count");
 	rb_define_alias(rb_cRuggedDiffHunk, "size", "line_count");
@@ -26,6 +26,7 @@
 
 extern VALUE rb_cRuggedDiff;
 VALUE rb_cRuggedDiffLine;
+VALUE rb_cRuggedDiffLineTable;
 
 VALUE rugged_diff_line_new(const git_diff_line *line)
 {
@@ -77,7 +78,106 @@ VALUE rugged_diff_line_new(const git_diff_line *line)
 	return rb_line;
 }
 
+/*
+ * Build a Rugged::Diff::LineTable with all the lines of the hunks
+ * +hunk_start+ to +hunk_end+ (exclusive) of +patch+.
+ *
+ * Each column is stored as a single String: one origin byte per line,
+ * native-endian 32-bit integers for line numbers and offsets, 64-bit
+ * integers for the offsets of the lines in their files, and the contents
+ * of all lines concatenated in one buffer.
+ */
+VALUE rugged_diff_line_table_new(git_patch *patch, size_t hunk_start, size_t hunk_end)
+{
+	VALUE rb_table, rb_origins, rb_old_linenos, rb_new_linenos;
+	VALUE rb_content, rb_content_offsets, rb_file_offsets, rb_hunk_offsets;
+	const git_diff_hunk *hunk;
+	size_t h, l, lines_in_hunk, lines_count = 0;
+	uint32_t offset;
+	int32_t lineno;
+	int64_t file_offset;
+	int error = 0;
+
+	for (h = hunk_start; h < hunk_end; ++h) {
+		error = git_patch_get_hunk(&hunk, &lines_in_hunk, patch, h);
+		rugged_exception_check(error);
+		lines_count += lines_in_hunk;
+	}
+
+	rb_origins = rb_str_buf_new(lines_count);
+	rb_old_linenos = rb_str_buf_new(lines_count * sizeof(int32_t));
+	rb_new_linenos = rb_str_buf_new(lines_count * sizeof(int32_t));
+	rb_content_offsets = rb_str_buf_new((lines_count + 1) * sizeof(uint32_t));
+	rb_file_offsets = rb_str_buf_new(lines_count * sizeof(int64_t));
+	rb_hunk_offsets = rb_str_buf_new((hunk_end - hunk_start + 1) * sizeof(uint32_t));
+	rb_content = rb_str_buf_new(0);
+
+	lines_count = 0;
+
+	for (h = hunk_start; !error && h < hunk_end; ++h) {
+		lines_in_hunk = (size_t)git_patch_num_lines_in_hunk(patch, h);
+
+		offset = (uint32_t)lines_count;
+		rb_str_cat(rb_hunk_offsets, (const char *)&offset, sizeof(offset));
+
+		for (l = 0; l < lines_in_hunk; ++l) {
+			const git_diff_line *line;
+
+			if ((error = git_patch_get_line_in_hunk(&line, patch, h, l)) < 0)
+				break;
+
+			if ((size_t)RSTRING_LEN(rb_content) + line->content_len > UINT32_MAX)
+				rb_raise(rb_eRangeError, "diff content is too large for a line table");
+
+			offset = (uint32_t)RSTRING_LEN(rb_content);
+			rb_str_cat(rb_content_offsets, (const char *)&offset, sizeof(offset));
+			rb_str_cat(rb_content, line->content, line->content_len);
+
+			rb_str_cat(rb_origins, &line->origin, 1);
+
+			lineno = (int32_t)line->old_lineno;
+			rb_str_cat(rb_old_linenos, (const char *)&lineno, sizeof(lineno));
+
+			lineno = (int32_t)line->new_lineno;
+			rb_str_cat(rb_new_linenos, (const char *)&lineno, sizeof(lineno));
+
+			file_offset = (int64_t)line->content_offset;
+			rb_str_cat(rb_file_offsets, (const char *)&file_offset, sizeof(file_offset));
+		}
+
+		lines_count += lines_in_hunk;
+	}
+	rugged_exception_check(error);
+
+	offset = (uint32_t)RSTRING_LEN(rb_content);
+	rb_str_cat(rb_content_offsets, (const char *)&offset, sizeof(offset));
+
+	offset = (uint32_t)lines_count;
+	rb_str_cat(rb_hunk_offsets, (const char *)&offset, sizeof(offset));
+
+	rb_table = rb_class_new_instance(0, NULL, rb_cRuggedDiffLineTable);
+	rb_iv_set(rb_table, "@origins", rb_origins);
+	rb_iv_set(rb_table, "@old_linenos", rb_old_linenos);
+	rb_iv_set(rb_table, "@new_linenos", rb_new_linenos);
+	rb_iv_set(rb_table, "@content", rb_content);
+	rb_iv_set(rb_table, "@content_offsets", rb_content_offsets);
+	rb_iv_set(rb_table, "@file_offsets", rb_file_offsets);
+	rb_iv_set(rb_table, "@hunk_offsets", rb_hunk_offsets);
+
+	return rb_table;
+}
+
 void Init_rugged_diff_line(void)
 {
 	rb_cRuggedDiffLine = rb_define_class_under(rb_cRuggedDiff, "Line", rb_cObject);
+
+	rb_cRuggedDiffLineTable = rb_define_class_under(rb_cRuggedDiff, "LineTable", rb_cObject);
+
+	rb_define_attr(rb_cRuggedDiffLineTable, "origins", 1, 0);
+	rb_define_attr(rb_cRuggedDiffLineTable, "old_linenos", 1, 0);
+	rb_define_attr(rb_cRuggedDiffLineTable, "new_linenos", 1, 0);
+	rb_define_attr(rb_cRuggedDiffLineTable, "content", 1, 0);
+	rb_define_attr(rb_cRuggedDiffLineTable, "content_offsets", 1, 0);
+	rb_define_attr(rb_cRuggedDiffLineTable, "file_offsets", 1, 0);
+	rb_define_attr(rb_cRuggedDiffLineTable, "hunk_offsets", 1, 0);
 }
@@ -0,0 +1,669 @@
+/*
+ * The MIT License
+ *
+ * Copyright (c) 2014 GitHub, Inc
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "rugged.h"
+#include <stdio.h>
+#include <math.h>
+
+extern VALUE rb_cRuggedDiff;
+VALUE rb_cRuggedDiffSignatureCache;
+
+/*
+ * Similarity signatures are one-permutation MinHash sketches of the set
+ * of lines of a file: every line is hashed once, the top bits of the
+ * hash pick one of RUGGED_SIMILARITY_BINS bins and each bin keeps the
+ * smallest hash it has seen. Two sketches are compared bin by bin in
+ * constant time, however large the files are.
+ *
+ * Scores can differ from git's. Sketches stand for sets, so a line that
+ * repeats counts once, where git counts every copy; and the share of
+ * matching bins out of 64 estimates the Jaccard index of both sets with
+ * a standard error of up to sqrt(1/4 / 64), about 6 points. Pairs near
+ * a threshold can land on either side of it.
+ *
+ * libgit2 drives the search and compares each target to every source up
+ * to the rename limit, so candidates can't be looked up by bucket. The
+ * bins are instead split into bands of `rows` bins, each summed up by a
+ * hash: pairs that share no band are scored 0 without comparing their
+ * bins. The chance that a pair shares a band, 1 - (1 - J^rows)^bands for
+ * a Jaccard index J, only depends on the sketches, so `rows` is the
+ * largest that still keeps SIMILARITY_BAND_RECALL of the pairs right at
+ * the lowest threshold of the search, and 1 (no banding) for low ones.
+ */
+#define SIMILARITY_BIN_BITS 6
+#define SIMILARITY_EMPTY UINT32_MAX
+#define SIMILARITY_BAND_RECALL 0.99
+
+#define SIGNATURE_CACHE_MAGIC "RSIGCACH"
+#define SIGNATURE_CACHE_VERSION 1
+#define SIGNATURE_CACHE_MIN_CAPACITY 64
+
+struct rugged_signature_cache_entry {
+	git_oid oid;
+	unsigned char mode;
+	unsigned char used;
+	struct rugged_similarity_sig sig;
+};
+
+struct rugged_signature_cache {
+	struct rugged_signature_cache_entry *entries;
+	size_t count, capacity;
+	int busy;
+};
+
+/* The signatures handed to libgit2 */
+struct similarity_signature {
+	struct rugged_similarity_sig sketch;
+	uint32_t bands[RUGGED_SIMILARITY_BINS / 2];
+};
+
+static int similarity_is_space(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+static uint64_t similarity_mix(uint64_t h)
+{
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+	return h;
+}
+
+/*
+ * Fill +sig+ with the sketch of +buf+ and return the number of lines that
+ * went into it. Blank lines are skipped; +mode+ decides how whitespace
+ * inside the other lines is treated.
+ */
+size_t rugged_similarity_sig_init(struct rugged_similarity_sig *sig, const char *buf, size_t len, int mode)
+{
+	const char *end = buf + len;
+	size_t lines = 0;
+	size_t i;
+
+	for (i = 0; i < RUGGED_SIMILARITY_BINS; ++i)
+		sig->bins[i] = SIMILARITY_EMPTY;
+
+	while (buf < end) {
+		const char *eol = memchr(buf, '\n', end - buf);
+		const char *start = buf, *stop;
+		uint64_t h = 0xcbf29ce484222325ULL;
+		uint32_t value;
+		int empty = 1;
+
+		stop = eol ? eol : end;
+		buf = stop + 1;
+
+		if (mode != RUGGED_SIMILARITY_EXACT_WHITESPACE) {
+			while (start < stop && similarity_is_space(*start))
+				start++;
+			while (stop > start && similarity_is_space(stop[-1]))
+				stop--;
+		}
+
+		for (; start < stop; ++start) {
+			if (mode == RUGGED_SIMILARITY_IGNORE_WHITESPACE && similarity_is_space(*start))
+				continue;
+
+			h = (h ^ (unsigned char)*start) * 0x100000001b3ULL;
+			empty = 0;
+		}
+
+		if (empty)
+			continue;
+
+		h = similarity_mix(h);
+		value = (uint32_t)h;
+
+		if (value < sig->bins[h >> (64 - SIMILARITY_BIN_BITS)])
+			sig->bins[h >> (64 - SIMILARITY_BIN_BITS)] = value;
+
+		lines++;
+	}
+
+	return lines;
+}
+
+/*
+ * Return the similarity of two sketches as a score from 0 to 100. The
+ * share of matching bins estimates the Jaccard index of both sets of
+ * lines, which is turned into the Dice coefficient: like git's own
+ * score, that's the share of lines the files have in common.
+ */
+int rugged_similarity_sig_compare(const struct rugged_similarity_sig *a, const struct rugged_similarity_sig *b)
+{
+	unsigned int bins = 0, matches = 0;
+	size_t i;
+
+	for (i = 0; i < RUGGED_SIMILARITY_BINS; ++i) {
+		if (a->bins[i] == SIMILARITY_EMPTY && b->bins[i] == SIMILARITY_EMPTY)
+			continue;
+
+		bins++;
+		matches += (a->bins[i] == b->bins[i]);
+	}
+
+	if (!bins)
+		return 0;
+
+	return (int)((200 * matches + (bins + matches) / 2) / (bins + matches));
+}
+
+static size_t signature_cache_slot(const git_oid *oid, unsigned char mode, size_t capacity)
+{
+	uint32_t h;
+	memcpy(&h, oid->id, sizeof(h));
+	return (h ^ (mode * 0x9e3779b9U)) & (capacity - 1);
+}
+
+static struct rugged_signature_cache_entry *signature_cache_find(
+	struct rugged_signature_cache *cache, const git_oid *oid, unsigned char mode)
+{
+	size_t i;
+
+	if (!cache->capacity)
+		return NULL;
+
+	for (i = signature_cache_slot(oid, mode, cache->capacity);
+		cache->entries[i].used;
+		i = (i + 1) & (cache->capacity - 1)) {
+		if (cache->entries[i].mode == mode && git_oid_equal(&cache->entries[i].oid, oid))
+			return &cache->entries[i];
+	}
+
+	return NULL;
+}
+
+/* Called without the GVL, so it may only fail by returning -1 */
+static int signature_cache_insert(
+	struct rugged_signature_cache *cache, const git_oid *oid, unsigned char mode,
+	const struct rugged_similarity_sig *sig)
+{
+	struct rugged_signature_cache_entry *entry;
+	size_t i;
+
+	if ((cache->count + 1) * 2 > cache->capacity) {
+		size_t capacity = cache->capacity ? cache->capacity * 2 : SIGNATURE_CACHE_MIN_CAPACITY;
+		struct rugged_signature_cache_entry *entries = calloc(capacity, sizeof(*entries));
+
+		if (!entries)
+			return -1;
+
+		for (i = 0; i < cache->capacity; ++i) {
+			size_t j;
+
+			if (!cache->entries[i].used)
+				continue;
+
+			j = signature_cache_slot(&cache->entries[i].oid, cache->entries[i].mode, capacity);
+			while (entries[j].used)
+				j = (j + 1) & (capacity - 1);
+
+			entries[j] = cache->entries[i];
+		}
+
+		free(cache->entries);
+		cache->entries = entries;
+		cache->capacity = capacity;
+	}
+
+	i = signature_cache_slot(oid, mode, cache->capacity);
+	while (cache->entries[i].used) {
+		if (cache->entries[i].mode == mode && git_oid_equal(&cache->entries[i].oid, oid))
+			return 0;
+
+		i = (i + 1) & (cache->capacity - 1);
+	}
+
+	entry = &cache->entries[i];
+	git_oid_cpy(&entry->oid, oid);
+	entry->mode = mode;
+	entry->used = 1;
+	entry->sig = *sig;
+	cache->count++;
+
+	return 0;
+}
+
+static void similarity_signature_bands(struct similarity_signature *sig, int rows)
+{
+	size_t band, row;
+
+	if (rows < 2)
+		return;
+
+	for (band = 0; band < RUGGED_SIMILARITY_BINS / rows; ++band) {
+		uint64_t h = 0;
+
+		for (row = 0; row < (size_t)rows; ++row)
+			h = similarity_mix(h ^ sig->sketch.bins[band * rows + row]);
+
+		sig->bands[band] = (uint32_t)h;
+	}
+}
+
+static int similarity_sig_new(void **out, struct rugged_similarity_metric *metric, const char *buf, size_t len)
+{
+	struct similarity_signature *sig = malloc(sizeof(*sig));
+
+	if (!sig) {
+		giterr_set_oom();
+		return -1;
+	}
+
+	/* Like libgit2's own metric, files without content can't be scored */
+	if (!rugged_similarity_sig_init(&sig->sketch, buf, len, metric->mode)) {
+		free(sig);
+		sig = NULL;
+	} else {
+		similarity_signature_bands(sig, metric->rows);
+	}
+
+	*out = sig;
+	return 0;
+}
+
+static int similarity_cache_usable(struct rugged_similarity_metric *metric, const git_diff_file *file)
+{
+	return metric->cache && (file->flags & GIT_DIFF_FLAG_VALID_ID) && !git_oid_iszero(&file->id);
+}
+
+/*
+ * Copy the cached signature of +file+ into +out+, if there is one.
+ * Returns 1 on a hit, 0 on a miss and -1 on allocation failures.
+ */
+static int similarity_cache_lookup(void **out, struct rugged_similarity_metric *metric, const git_diff_file *file)
+{
+	struct rugged_signature_cache_entry *entry;
+	struct similarity_signature *sig;
+
+	if (!similarity_cache_usable(metric, file) ||
+		(entry = signature_cache_find(metric->cache, &file->id, (unsigned char)metric->mode)) == NULL)
+		return 0;
+
+	if ((sig = malloc(sizeof(*sig))) == NULL) {
+		giterr_set_oom();
+		return -1;
+	}
+
+	sig->sketch = entry->sig;
+	similarity_signature_bands(sig, metric->rows);
+
+	*out = sig;
+	return 1;
+}
+
+static void similarity_cache_store(struct rugged_similarity_metric *metric, const git_diff_file *file, void *sig)
+{
+	/* A full cache only means the next diff hashes this blob again */
+	if (sig && similarity_cache_usable(metric, file))
+		signature_cache_insert(metric->cache, &file->id, (unsigned char)metric->mode,
+			&((struct similarity_signature *)sig)->sketch);
+}
+
+static int similarity_file_signature(
+	void **out, const git_diff_file *file, const char *fullpath, void *payload)
+{
+	struct rugged_similarity_metric *metric = payload;
+	FILE *fp;
+	char *buf;
+	long len;
+	int error;
+
+	*out = NULL;
+
+	/* Working directory files with a known OID aren't read at all on a hit */
+	if ((error = similarity_cache_lookup(out, metric, file)) != 0)
+		return error < 0 ? error : 0;
+
+	if ((fp = fopen(fullpath, "rb")) == NULL)
+		return 0;
+
+	if (fseek(fp, 0, SEEK_END) < 0 || (len = ftell(fp)) < 0 || fseek(fp, 0, SEEK_SET) < 0) {
+		fclose(fp);
+		return 0;
+	}
+
+	if ((buf = malloc(len ? len : 1)) == NULL) {
+		fclose(fp);
+		giterr_set_oom();
+		return -1;
+	}
+
+	if (fread(buf, 1, len, fp) != (size_t)len) {
+		free(buf);
+		fclose(fp);
+		return 0;
+	}
+
+	fclose(fp);
+
+	error = similarity_sig_new(out, metric, buf, (size_t)len);
+	free(buf);
+
+	if (!error)
+		similarity_cache_store(metric, file, *out);
+
+	return error;
+}
+
+/*
+ * libgit2 loads blobs itself before asking for their signature, so a hit
+ * only saves hashing them.
+ */
+static int similarity_buffer_signature(
+	void **out, const git_diff_file *file, const char *buf, size_t buflen, void *payload)
+{
+	struct rugged_similarity_metric *metric = payload;
+	int error;
+
+	*out = NULL;
+
+	if ((error = similarity_cache_lookup(out, metric, file)) != 0)
+		return error < 0 ? error : 0;
+
+	error = similarity_sig_new(out, metric, buf, buflen);
+
+	if (!error)
+		similarity_cache_store(metric, file, *out);
+
+	return error;
+}
+
+static void similarity_free_signature(void *sig, void *payload)
+{
+	free(sig);
+}
+
+static int similarity_compare(int *score, void *siga, void *sigb, void *payload)
+{
+	struct rugged_similarity_metric *metric = payload;
+	struct similarity_signature *a = siga, *b = sigb;
+	size_t band;
+
+	if (metric->rows > 1) {
+		for (band = 0; band < RUGGED_SIMILARITY_BINS / (size_t)metric->rows; ++band) {
+			if (a->bands[band] == b->bands[band])
+				break;
+		}
+
+		if (band == RUGGED_SIMILARITY_BINS / (size_t)metric->rows) {
+			*score = 0;
+			return 0;
+		}
+	}
+
+	*score = rugged_similarity_sig_compare(&a->sketch, &b->sketch);
+	return 0;
+}
+
+static int similarity_threshold(uint16_t threshold, uint16_t fallback)
+{
+	return threshold ? threshold : fallback;
+}
+
+/*
+ * The number of bins per band for a search whose lowest threshold is
+ * +threshold+, a Dice coefficient from 0 to 100 (see the top of the file).
+ */
+static int similarity_rows(int threshold)
+{
+	double dice = threshold / 100.0, jaccard = dice / (2 - dice);
+	int rows;
+
+	for (rows = 4; rows > 1; rows /= 2) {
+		if (1 - pow(1 - pow(jaccard, rows), RUGGED_SIMILARITY_BINS / rows) >= SIMILARITY_BAND_RECALL)
+			return rows;
+	}
+
+	return 1;
+}
+
+/*
+ * Set up +metric+ for `git_diff_find_similar` with +opts+. A
+ * Rugged::Diff::SignatureCache given as +rb_cache+ is used exclusively
+ * until `rugged_similarity_metric_done`; if another thread is using it
+ * already, signatures are not cached.
+ */
+void rugged_similarity_metric_init(struct rugged_similarity_metric *metric, VALUE rb_cache, const git_diff_find_options *opts)
+{
+	int threshold;
+
+	memset(metric, 0, sizeof(*metric));
+
+	if (opts->flags & GIT_DIFF_FIND_DONT_IGNORE_WHITESPACE)
+		metric->mode = RUGGED_SIMILARITY_EXACT_WHITESPACE;
+	else if (opts->flags & GIT_DIFF_FIND_IGNORE_WHITESPACE)
+		metric->mode = RUGGED_SIMILARITY_IGNORE_WHITESPACE;
+	else
+		metric->mode = RUGGED_SIMILARITY_SMART_WHITESPACE;
+
+	/* Any score may decide the outcome, with libgit2's defaults for unset thresholds */
+	threshold = similarity_threshold(opts->rename_threshold, 50);
+	if (similarity_threshold(opts->rename_from_rewrite_threshold, 50) < threshold)
+		threshold = similarity_threshold(opts->rename_from_rewrite_threshold, 50);
+	if (similarity_threshold(opts->copy_threshold, 50) < threshold)
+		threshold = similarity_threshold(opts->copy_threshold, 50);
+	if (similarity_threshold(opts->break_rewrite_threshold, 60) < threshold)
+		threshold = similarity_threshold(opts->break_rewrite_threshold, 60);
+
+	metric->rows = similarity_rows(threshold);
+
+	if (!NIL_P(rb_cache)) {
+		struct rugged_signature_cache *cache;
+
+		if (!rb_obj_is_kind_of(rb_cache, rb_cRuggedDiffSignatureCache))
+			rb_raise(rb_eTypeError, "Expected a Rugged::Diff::SignatureCache");
+
+		Data_Get_Struct(rb_cache, struct rugged_signature_cache, cache);
+
+		if (!cache->busy) {
+			cache->busy = 1;
+			metric->cache = cache;
+		}
+	}
+
+	metric->metric.file_signature = similarity_file_signature;
+	metric->metric.buffer_signature = similarity_buffer_signature;
+	metric->metric.free_signature = similarity_free_signature;
+	metric->metric.similarity = similarity_compare;
+	metric->metric.payload = metric;
+}
+
+void rugged_similarity_metric_done(struct rugged_similarity_metric *metric)
+{
+	if (metric->cache)
+		metric->cache->busy = 0;
+}
+
+static void rb_git_signature_cache__free(struct rugged_signature_cache *cache)
+{
+	free(cache->entries);
+	xfree(cache);
+}
+
+static VALUE rb_git_signature_cache_allocate(VALUE klass)
+{
+	struct rugged_signature_cache *cache;
+	return Data_Make_Struct(klass, struct rugged_signature_cache, NULL, rb_git_signature_cache__free, cache);
+}
+
+static struct rugged_signature_cache *signature_cache_get(VALUE self)
+{
+	struct rugged_signature_cache *cache;
+	Data_Get_Struct(self, struct rugged_signature_cache, cache);
+
+	if (cache->busy)
+		rb_raise(rb_eRuntimeError, "The signature cache is being used by Rugged::Diff#find_similar!");
+
+	return cache;
+}
+
+/*
+ *  call-seq:
+ *    cache.size -> int
+ *
+ *  Returns the number of signatures in the cache.
+ */
+static VALUE rb_git_signature_cache_size(VALUE self)
+{
+	struct rugged_signature_cache *cache;
+	Data_Get_Struct(self, struct rugged_signature_cache, cache);
+	return ULONG2NUM(cache->count);
+}
+
+/*
+ *  call-seq:
+ *    cache.clear -> self
+ *
+ *  Removes all signatures from the cache.
+ */
+static VALUE rb_git_signature_cache_clear(VALUE self)
+{
+	struct rugged_signature_cache *cache = signature_cache_get(self);
+
+	free(cache->entries);
+	cache->entries = NULL;
+	cache->count = cache->capacity = 0;
+
+	return self;
+}
+
+/*
+ *  call-seq:
+ *    cache.save(path) -> self
+ *
+ *  Writes the signatures in the cache to the file at +path+, so they can
+ *  be read back with Rugged::Diff::SignatureCache.load. The file uses the
+ *  byte order of the machine it was written on.
+ */
+static VALUE rb_git_signature_cache_save(VALUE self, VALUE rb_path)
+{
+	struct rugged_signature_cache *cache = signature_cache_get(self);
+	uint32_t version = SIGNATURE_CACHE_VERSION, bins = RUGGED_SIMILARITY_BINS;
+	uint64_t count = cache->count;
+	static const char padding[3];
+	FILE *fp;
+	size_t i;
+	int ok;
+
+	FilePathValue(rb_path);
+
+	if ((fp = fopen(StringValueCStr(rb_path), "wb")) == NULL)
+		rb_sys_fail(StringValueCStr(rb_path));
+
+	ok = fwrite(SIGNATURE_CACHE_MAGIC, 8, 1, fp) == 1 &&
+		fwrite(&version, sizeof(version), 1, fp) == 1 &&
+		fwrite(&bins, sizeof(bins), 1, fp) == 1 &&
+		fwrite(&count, sizeof(count), 1, fp) == 1;
+
+	for (i = 0; ok && i < cache->capacity; ++i) {
+		struct rugged_signature_cache_entry *entry = &cache->entries[i];
+
+		if (!entry->used)
+			continue;
+
+		ok = fwrite(entry->oid.id, GIT_OID_RAWSZ, 1, fp) == 1 &&
+			fwrite(&entry->mode, 1, 1, fp) == 1 &&
+			fwrite(padding, sizeof(padding), 1, fp) == 1 &&
+			fwrite(entry->sig.bins, sizeof(entry->sig.bins), 1, fp) == 1;
+	}
+
+	if (fclose(fp) != 0)
+		ok = 0;
+
+	if (!ok)
+		rb_sys_fail(StringValueCStr(rb_path));
+
+	return self;
+}
+
+/*
+ *  call-seq:
+ *    SignatureCache.load(path) -> cache
+ *
+ *  Returns a new cache holding the signatures saved to +path+ with
+ *  Rugged::Diff::SignatureCache#save.
+ */
+static VALUE rb_git_signature_cache_load(VALUE klass, VALUE rb_path)
+{
+	VALUE rb_cache = rb_class_new_instance(0, NULL, klass);
+	struct rugged_signature_cache *cache = signature_cache_get(rb_cache);
+	char magic[8];
+	uint32_t version, bins;
+	uint64_t count, i;
+	FILE *fp;
+	int ok, oom = 0;
+
+	FilePathValue(rb_path);
+
+	if ((fp = fopen(StringValueCStr(rb_path), "rb")) == NULL)
+		rb_sys_fail(StringValueCStr(rb_path));
+
+	ok = fread(magic, sizeof(magic), 1, fp) == 1 &&
+		fread(&version, sizeof(version), 1, fp) == 1 &&
+		fread(&bins, sizeof(bins), 1, fp) == 1 &&
+		fread(&count, sizeof(count), 1, fp) == 1 &&
+		memcmp(magic, SIGNATURE_CACHE_MAGIC, sizeof(magic)) == 0 &&
+		version == SIGNATURE_CACHE_VERSION &&
+		bins == RUGGED_SIMILARITY_BINS;
+
+	for (i = 0; ok && i < count; ++i) {
+		struct rugged_similarity_sig sig;
+		unsigned char mode, padding[3];
+		git_oid oid;
+
+		ok = fread(oid.id, GIT_OID_RAWSZ, 1, fp) == 1 &&
+			fread(&mode, 1, 1, fp) == 1 &&
+			fread(padding, sizeof(padding), 1, fp) == 1 &&
+			fread(sig.bins, sizeof(sig.bins), 1, fp) == 1;
+
+		if (ok && signature_cache_insert(cache, &oid, mode, &sig) < 0)
+			ok = 0, oom = 1;
+	}
+
+	fclose(fp);
+
+	if (oom)
+		rb_memerror();
+
+	if (!ok)
+		rb_raise(rb_eIOError, "Invalid signature cache file '%s'", StringValueCStr(rb_path));
+
+	return rb_cache;
+}
+
+void Init_rugged_diff_similarity(void)
+{
+	rb_cRuggedDiffSignatureCache = rb_define_class_under(rb_cRuggedDiff, "SignatureCache", rb_cObject);
+	rb_define_alloc_func(rb_cRuggedDiffSignatureCache, rb_git_signature_cache_allocate);
+
+	rb_define_singleton_method(rb_cRuggedDiffSignatureCache, "load", rb_git_signature_cache_load, 1);
+
+	rb_define_method(rb_cRuggedDiffSignatureCache, "size", rb_git_signature_cache_size, 0);
+	rb_define_method(rb_cRuggedDiffSignatureCache, "clear", rb_git_signature_cache_clear, 0);
+	rb_define_method(rb_cRuggedDiffSignatureCache, "save", rb_git_signature_cache_save, 1);
+}
@@ -0,0 +1,527 @@
+/*
+ * The MIT License
+ *
+ * Copyright (c) 2014 GitHub, Inc
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "rugged.h"
+
+#ifdef HAVE_SYS_INOTIFY_H
+#include <ruby/util.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <errno.h>
+#include <unistd.h>
+#endif
+
+extern VALUE rb_mRugged;
+VALUE rb_cRuggedFileMonitor;
+
+static ID id_file_monitor, id_file_monitor_token, id_changed_paths;
+
+/*
+ * A file monitor is any object answering
+ *
+ *   monitor.changed_paths(token) -> [new_token, paths]
+ *
+ * where +paths+ are the paths relative to the working directory changed
+ * since +token+ was handed out, or nil when the monitor can't tell (no
+ * token yet, or events were lost) and everything must be looked at.
+ *
+ * Every consumer (the repository for #status, each index for #add_all
+ * and #update_all) keeps its own token, along with the monitor it came
+ * from, and only moves it forward once its scan has succeeded.
+ */
+VALUE rugged_file_monitor_get(VALUE rb_owner)
+{
+	if (!rb_obj_is_kind_of(rb_owner, rb_cRuggedRepo))
+		return Qnil;
+
+	return rb_attr_get(rb_owner, id_file_monitor);
+}
+
+static int rugged__file_monitor_is_lock(const char *path, long len)
+{
+	return len >= 5 && !memcmp(path + len - 5, ".lock", 5);
+}
+
+static int rugged__file_monitor_basename_is(const char *path, long len, const char *name)
+{
+	long name_len = (long)strlen(name);
+
+	return len >= name_len && !memcmp(path + len - name_len, name, name_len) &&
+		(len == name_len || path[len - name_len - 1] == '/');
+}
+
+VALUE rugged_file_monitor_changes(VALUE rb_monitor, VALUE rb_consumer, int flags, VALUE *rb_token)
+{
+	VALUE rb_state, rb_result, rb_paths, rb_changed;
+	long i;
+
+	*rb_token = Qnil;
+
+	if (NIL_P(rb_monitor))
+		return Qnil;
+
+	rb_state = rb_attr_get(rb_consumer, id_file_monitor_token);
+
+	rb_result = rb_funcall(rb_monitor, id_changed_paths, 1,
+		(!NIL_P(rb_state) && rb_ary_entry(rb_state, 0) == rb_monitor) ?
+			rb_ary_entry(rb_state, 1) : Qnil);
+
+	Check_Type(rb_result, T_ARRAY);
+
+	*rb_token = rb_ary_entry(rb_result, 0);
+	rb_paths = rb_ary_entry(rb_result, 1);
+
+	if (NIL_P(rb_state) || rb_ary_entry(rb_state, 0) != rb_monitor || NIL_P(rb_paths))
+		return Qnil;
+
+	Check_Type(rb_paths, T_ARRAY);
+	rb_changed = rb_ary_new();
+
+	for (i = 0; i < RARRAY_LEN(rb_paths); ++i) {
+		VALUE rb_path = rb_ary_entry(rb_paths, i);
+		const char *path;
+		long len;
+
+		Check_Type(rb_path, T_STRING);
+		path = RSTRING_PTR(rb_path);
+		len = RSTRING_LEN(rb_path);
+
+		/* ignore rules and attributes can change the status of any file */
+		if (rugged__file_monitor_basename_is(path, len, ".gitignore") ||
+			rugged__file_monitor_basename_is(path, len, ".gitattributes"))
+			return Qnil;
+
+		if ((len == 4 || (len > 4 && path[4] == '/')) && !memcmp(path, ".git", 4)) {
+			if (len > 9 && !memcmp(path, ".git/info/", 10))
+				return Qnil;
+
+			if ((flags & RUGGED_FILE_MONITOR_GITDIR) && !rugged__file_monitor_is_lock(path, len))
+				return Qnil;
+
+			continue;
+		}
+
+		rb_ary_push(rb_changed, rb_path);
+	}
+
+	return rb_changed;
+}
+
+VALUE rugged_file_monitor_outermost(VALUE rb_paths)
+{
+	VALUE rb_sorted = rb_ary_sort(rb_ary_dup(rb_paths));
+	VALUE rb_outermost = rb_ary_new(), rb_kept = rb_hash_new();
+	long i;
+
+	/* a path sorts after all of its parent directories */
+	for (i = 0; i < RARRAY_LEN(rb_sorted); ++i) {
+		VALUE rb_path = rb_ary_entry(rb_sorted, i);
+		const char *path = RSTRING_PTR(rb_path), *slash = path;
+		long len = RSTRING_LEN(rb_path);
+		int covered = RTEST(rb_hash_aref(rb_kept, rb_path));
+
+		while (!covered && (slash = memchr(slash, '/', len - (slash - path))) != NULL)
+			covered = RTEST(rb_hash_aref(rb_kept, rb_str_new(path, slash++ - path)));
+
+		if (covered)
+			continue;
+
+		rb_hash_aset(rb_kept, rb_path, Qtrue);
+		rb_ary_push(rb_outermost, rb_path);
+	}
+
+	return rb_outermost;
+}
+
+void rugged_file_monitor_sync(VALUE rb_consumer, VALUE rb_monitor, VALUE rb_token)
+{
+	if (NIL_P(rb_monitor))
+		rb_ivar_set(rb_consumer, id_file_monitor_token, Qnil);
+	else
+		rb_ivar_set(rb_consumer, id_file_monitor_token, rb_ary_new3(2, rb_monitor, rb_token));
+}
+
+/*
+ *  call-seq:
+ *    repo.file_monitor = monitor
+ *
+ *  Use +monitor+ to find the files changed in the working directory, so
+ *  that #status, Index#add_all and Index#update_all only need to look at
+ *  those instead of the whole tree. Pass +nil+ to go back to full scans.
+ *
+ *  +monitor+ can be a Rugged::FileMonitor, like the inotify-based
+ *  Rugged::FileMonitor::Inotify, or any object answering
+ *  <tt>changed_paths(token)</tt> with a new token and the paths changed
+ *  since +token+, or +nil+ for the paths if they're unknown.
+ *
+ *  The first call of each of these methods after setting a monitor still
+ *  scans the whole tree. So does any change to a +.gitignore+ or
+ *  +.gitattributes+ file, to <tt>.git/info</tt> and, for #status, to
+ *  anything else in the repository directory, like the index or HEAD.
+ *
+ *  Index entries changed by hand, through Index#add or Index#remove, are
+ *  only synchronized again by #add_all and #update_all once the file
+ *  changes on disk.
+ */
+static VALUE rb_git_repo_set_file_monitor(VALUE self, VALUE rb_monitor)
+{
+	if (!NIL_P(rb_monitor) && !rb_respond_to(rb_monitor, id_changed_paths))
+		rb_raise(rb_eTypeError, "Expecting an object responding to changed_paths");
+
+	rb_ivar_set(self, id_file_monitor, rb_monitor);
+	rugged_file_monitor_sync(self, Qnil, Qnil);
+
+	return rb_monitor;
+}
+
+/*
+ *  call-seq:
+ *    repo.file_monitor -> monitor or nil
+ *
+ *  Returns the file monitor set with #file_monitor=, if any.
+ */
+static VALUE rb_git_repo_get_file_monitor(VALUE self)
+{
+	return rb_attr_get(self, id_file_monitor);
+}
+
+#ifdef HAVE_SYS_INOTIFY_H
+VALUE rb_cRuggedFileMonitorInotify;
+
+#define RUGGED_INOTIFY_MASK (IN_CREATE | IN_DELETE | IN_MODIFY | IN_ATTRIB | \
+	IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF)
+
+/*
+ * The directories being watched, indexed by watch descriptor. Paths are
+ * kept relative to the working directory, "" being its root.
+ */
+struct rugged_inotify {
+	int fd;
+	char *root;
+	char **dirs;
+	size_t dirs_alloc;
+	int overflow;
+};
+
+static void rb_git_inotify__free(struct rugged_inotify *inotify)
+{
+	size_t i;
+
+	if (inotify->fd >= 0)
+		close(inotify->fd);
+
+	for (i = 0; i < inotify->dirs_alloc; ++i)
+		xfree(inotify->dirs[i]);
+
+	xfree(inotify->dirs);
+	xfree(inotify->root);
+	xfree(inotify);
+}
+
+static VALUE rb_git_inotify_allocate(VALUE klass)
+{
+	struct rugged_inotify *inotify = ALLOC(struct rugged_inotify);
+
+	memset(inotify, 0, sizeof(*inotify));
+	inotify->fd = -1;
+
+	return Data_Wrap_Struct(klass, NULL, rb_git_inotify__free, inotify);
+}
+
+static char *rugged__inotify_join(const char *dir, const char *name)
+{
+	size_t dir_len = strlen(dir), name_len = strlen(name);
+	char *path = xmalloc(dir_len + name_len + 2);
+
+	if (dir_len) {
+		memcpy(path, dir, dir_len);
+		path[dir_len++] = '/';
+	}
+
+	memcpy(path + dir_len, name, name_len + 1);
+	return path;
+}
+
+/*
+ * Watch +relpath+ and, unless +recurse+ is 0, every directory below it.
+ * Watching a directory again (after it was moved) returns its existing
+ * descriptor, whose path is then updated. Returns -1 with errno set if
+ * the directory could not be watched.
+ */
+static int rugged__inotify_watch(struct rugged_inotify *inotify, const char *relpath, int recurse)
+{
+	char *fullpath = rugged__inotify_join(inotify->root, relpath);
+	struct dirent *de;
+	DIR *dir;
+	int wd;
+
+	wd = inotify_add_watch(inotify->fd, fullpath, RUGGED_INOTIFY_MASK | IN_ONLYDIR | IN_DONT_FOLLOW);
+
+	if (wd < 0) {
+		int watch_errno = errno;
+		xfree(fullpath);
+
+		/* the directory went away before we got to it */
+		if (watch_errno == ENOENT || watch_errno == ENOTDIR)
+			return 0;
+
+		errno = watch_errno;
+		return -1;
+	}
+
+	if ((size_t)wd >= inotify->dirs_alloc) {
+		size_t alloc = inotify->dirs_alloc ? inotify->dirs_alloc : 64;
+
+		while (alloc <= (size_t)wd)
+			alloc *= 2;
+
+		REALLOC_N(inotify->dirs, char *, alloc);
+		memset(inotify->dirs + inotify->dirs_alloc, 0, (alloc - inotify->dirs_alloc) * sizeof(char *));
+		inotify->dirs_alloc = alloc;
+	}
+
+	xfree(inotify->dirs[wd]);
+	inotify->dirs[wd] = ruby_strdup(relpath);
+
+	if (!recurse || (dir = opendir(fullpath)) == NULL) {
+		xfree(fullpath);
+		return 0;
+	}
+
+	while ((de = readdir(dir)) != NULL) {
+		char *child;
+		int is_dir;
+
+		if (!strcmp(de->d_name, ".") || !strcmp(de->d_name, ".."))
+			continue;
+
+		/* nested repositories are somebody else's business */
+		if (*relpath && !strcmp(de->d_name, ".git"))
+			continue;
+
+#ifdef _DIRENT_HAVE_D_TYPE
+		if (de->d_type != DT_UNKNOWN) {
+			is_dir = de->d_type == DT_DIR;
+		} else
+#endif
+		{
+			struct stat st;
+			char *childpath = rugged__inotify_join(fullpath, de->d_name);
+
+			is_dir = !lstat(childpath, &st) && S_ISDIR(st.st_mode);
+			xfree(childpath);
+		}
+
+		if (!is_dir)
+			continue;
+
+		child = rugged__inotify_join(relpath, de->d_name);
+
+		/*
+		 * Only the top of the repository directory and its references
+		 * matter: they tell when the index or HEAD moved.
+		 */
+		if (!strcmp(child, ".git")) {
+			if (rugged__inotify_watch(inotify, child, 0) == 0) {
+				xfree(child);
+				child = ruby_strdup(".git/refs");
+			} else {
+				goto failed;
+			}
+		}
+
+		if (rugged__inotify_watch(inotify, child, 1) < 0)
+			goto failed;
+
+		xfree(child);
+		continue;
+
+failed:
+		{
+			int watch_errno = errno;
+			xfree(child);
+			closedir(dir);
+			xfree(fullpath);
+			errno = watch_errno;
+			return -1;
+		}
+	}
+
+	closedir(dir);
+	xfree(fullpath);
+	return 0;
+}
+
+/*
+ *  call-seq:
+ *    FileMonitor::Inotify.new(workdir) -> monitor
+ *
+ *  Start watching every directory below +workdir+ with inotify. Only
+ *  available on Linux.
+ *
+ *  Each directory takes one inotify watch, so the system-wide limit in
+ *  <tt>/proc/sys/fs/inotify/max_user_watches</tt> may need to be raised
+ *  for very large trees.
+ */
+static VALUE rb_git_inotify_initialize(VALUE self, VALUE rb_workdir)
+{
+	struct rugged_inotify *inotify;
+	size_t len;
+
+	Check_Type(rb_workdir, T_STRING);
+	Data_Get_Struct(self, struct rugged_inotify, inotify);
+
+	if (inotify->fd >= 0)
+		rb_raise(rb_eRuntimeError, "the monitor is already initialized");
+
+	inotify->root = ruby_strdup(StringValueCStr(rb_workdir));
+
+	/* paths are joined with a slash of their own */
+	len = strlen(inotify->root);
+	while (len > 1 && inotify->root[len - 1] == '/')
+		inotify->root[--len] = '\0';
+
+	if ((inotify->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) < 0)
+		rb_sys_fail("inotify_init1");
+
+	if (rugged__inotify_watch(inotify, "", 1) < 0)
+		rb_sys_fail(inotify->root);
+
+	return Qnil;
+}
+
+/*
+ *  call-seq:
+ *    monitor.poll -> array or nil
+ *
+ *  Returns the paths changed since the previous call, without waiting for
+ *  new events, or +nil+ if the kernel dropped events and any path may have
+ *  changed. Paths can repeat.
+ */
+static VALUE rb_git_inotify_poll(VALUE self)
+{
+	struct rugged_inotify *inotify;
+	char buf[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+	VALUE rb_paths = rb_ary_new();
+	ssize_t len;
+
+	Data_Get_Struct(self, struct rugged_inotify, inotify);
+
+	if (inotify->fd < 0)
+		rb_raise(rb_eRuntimeError, "the monitor is closed");
+
+	while ((len = read(inotify->fd, buf, sizeof(buf))) > 0) {
+		char *ptr = buf;
+
+		while (ptr < buf + len) {
+			const struct inotify_event *event = (const struct inotify_event *)ptr;
+			const char *dir;
+			char *path;
+
+			ptr += sizeof(struct inotify_event) + event->len;
+
+			if (event->mask & IN_Q_OVERFLOW) {
+				inotify->overflow = 1;
+				continue;
+			}
+
+			if (event->wd < 0 || (size_t)event->wd >= inotify->dirs_alloc ||
+				(dir = inotify->dirs[event->wd]) == NULL)
+				continue;
+
+			path = event->len ? rugged__inotify_join(dir, event->name) : ruby_strdup(dir);
+
+			if (event->mask & IN_IGNORED) {
+				xfree(inotify->dirs[event->wd]);
+				inotify->dirs[event->wd] = NULL;
+			}
+
+			/*
+			 * New directories are reported as a whole, since files
+			 * created in them before the watch was set up are missed.
+			 */
+			if ((event->mask & IN_ISDIR) && (event->mask & (IN_CREATE | IN_MOVED_TO)) &&
+				strcmp(path, ".git") && (strncmp(path, ".git/", 5) || !strncmp(path, ".git/refs/", 10))) {
+				if (rugged__inotify_watch(inotify, path, 1) < 0)
+					inotify->overflow = 1;
+			}
+
+			if (*path)
+				rb_ary_push(rb_paths, rb_str_new_utf8(path));
+
+			xfree(path);
+		}
+	}
+
+	if (len < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+		rb_sys_fail("read");
+
+	if (inotify->overflow) {
+		inotify->overflow = 0;
+		return Qnil;
+	}
+
+	return rb_paths;
+}
+
+/*
+ *  call-seq:
+ *    monitor.close -> nil
+ *
+ *  Stop watching the working directory.
+ */
+static VALUE rb_git_inotify_close(VALUE self)
+{
+	struct rugged_inotify *inotify;
+	Data_Get_Struct(self, struct rugged_inotify, inotify);
+
+	if (inotify->fd >= 0) {
+		close(inotify->fd);
+		inotify->fd = -1;
+	}
+
+	return Qnil;
+}
+#endif
+
+void Init_rugged_file_monitor(void)
+{
+	id_file_monitor = rb_intern("file_monitor");
+	id_file_monitor_token = rb_intern("file_monitor_token");
+	id_changed_paths = rb_intern("changed_paths");
+
+	rb_cRuggedFileMonitor = rb_define_class_under(rb_mRugged, "FileMonitor", rb_cObject);
+
+#ifdef HAVE_SYS_INOTIFY_H
+	rb_cRuggedFileMonitorInotify = rb_define_class_under(rb_cRuggedFileMonitor, "Inotify", rb_cRuggedFileMonitor);
+	rb_define_alloc_func(rb_cRuggedFileMonitorInotify, rb_git_inotify_allocate);
+	rb_define_method(rb_cRuggedFileMonitorInotify, "initialize", rb_git_inotify_initialize, 1);
+	rb_define_method(rb_cRuggedFileMonitorInotify, "poll", rb_git_inotify_poll, 0);
+	rb_define_method(rb_cRuggedFileMonitorInotify, "close", rb_git_inotify_close, 0);
+#endif
+
+	rb_define_method(rb_cRuggedRepo, "file_monitor=", rb_git_repo_set_file_monitor, 1);
+	rb_define_method(rb_cRuggedRepo, "file_monitor", rb_git_repo_get_file_monitor, 0);
+}
@@ -24,14 +24,56 @@
 
 #include "rugged.h"
 
+#ifndef _WIN32
+# include <sys/stat.h>
+#endif
+
 VALUE rb_cRuggedIndex;
+VALUE rb_cRuggedIndexEntry;
 extern VALUE rb_mRugged;
 extern VALUE rb_cRuggedCommit;
 extern VALUE rb_cRuggedDiff;
 extern VALUE rb_cRuggedTree;
 
 static void rb_git_indexentry_toC(git_index_entry *entry, VALUE rb_entry);
-static VALUE rb_git_indexentry_fromC(const git_index_entry *entry);
+static VALUE rb_git_indexentry_fromC(const git_index_entry *entry, int raw_oid);
+
+/* Keys of the entry hashes, interned once in Init_rugged_index */
+static VALUE id_entry_path, id_entry_oid, id_entry_dev, id_entry_ino, id_entry_mode, id_entry_gid;
+static VALUE id_entry_uid, id_entry_file_size, id_entry_valid, id_entry_stage, id_entry_ctime, id_entry_mtime;
+
+/* The fields of an entry that Index#each_entry can project */
+enum rugged_index_entry_field {
+	RUGGED_ENTRY_PATH,
+	RUGGED_ENTRY_OID,
+	RUGGED_ENTRY_DEV,
+	RUGGED_ENTRY_INO,
+	RUGGED_ENTRY_MODE,
+	RUGGED_ENTRY_GID,
+	RUGGED_ENTRY_UID,
+	RUGGED_ENTRY_FILE_SIZE,
+	RUGGED_ENTRY_VALID,
+	RUGGED_ENTRY_STAGE,
+	RUGGED_ENTRY_CTIME,
+	RUGGED_ENTRY_MTIME,
+	RUGGED_ENTRY_FIELDS
+};
+
+static VALUE *rugged_index_entry_keys[RUGGED_ENTRY_FIELDS] = {
+	&id_entry_path, &id_entry_oid, &id_entry_dev, &id_entry_ino, &id_entry_mode, &id_entry_gid,
+	&id_entry_uid, &id_entry_file_size, &id_entry_valid, &id_entry_stage, &id_entry_ctime, &id_entry_mtime
+};
+
+/*
+ * An entry yielded by Index#each_entry: a copy of the libgit2 entry, with
+ * the path kept as a frozen Ruby string. Everything else is converted to
+ * Ruby objects only when it is read.
+ */
+struct rugged_index_entry {
+	git_index_entry entry;
+	VALUE rb_path;
+	int raw_oid;
+};
 
 /*
  * Index
@@ -89,6 +131,7 @@ static VALUE rb_git_index_clear(VALUE self)
 	git_index *index;
 	Data_Get_Struct(self, git_index, index);
 	git_index_clear(index);
+	rugged_file_monitor_sync(self, Qnil, Qnil);
 	return Qnil;
 }
 
@@ -107,6 +150,7 @@ static VALUE rb_git_index_read(VALUE self)
 	Data_Get_Struct(self, git_index, index);
 
 	error = git_index_read(index, 0);
+	rugged_file_monitor_sync(self, Qnil, Qnil);
 	rugged_exception_check(error);
 
 	return Qnil;
@@ -117,6 +161,11 @@ static VALUE rb_git_index_read(VALUE self)
  *    index.write -> nil
  *
  *  Writes the index object from memory back to the disk, persisting all changes.
+ *
+ *  The untracked cache of the repository (see Repository#status) is
+ *  written along with it. Failing to write the cache doesn't fail the
+ *  write: the saved cache is removed instead, and written again the next
+ *  time.
  */
 static VALUE rb_git_index_write(VALUE self)
 {
@@ -128,6 +177,8 @@ static VALUE rb_git_index_write(VALUE self)
 	error = git_index_write(index);
 	rugged_exception_check(error);
 
+	rugged_untracked_cache_write(rugged_owner(self));
+
 	return Qnil;
 }
 
@@ -190,33 +241,42 @@ static VALUE rb_git_index_get(int argc, VALUE *argv, VALUE self)
 			"Invalid type for `entry`: expected String or Fixnum");
 	}
 
-	return entry ? rb_git_indexentry_fromC(entry) : Qnil;
+	return entry ? rb_git_indexentry_fromC(entry, 0) : Qnil;
 }
 
 /*
  *  call-seq:
- *    index.each { |entry| } -> nil
- *    index.each -> Enumerator
+ *    index.each(options = {}) { |entry| } -> nil
+ *    index.each(options = {}) -> Enumerator
  *
  *  Passes each entry of the index to the given block.
  *
  *  If no block is given, an enumerator is returned instead.
+ *
+ *  If the +:oid_format+ option is set to +:raw+, the +:oid+ of each entry is
+ *  given as a raw Rugged::Oid instead of hex.
  */
-static VALUE rb_git_index_each(VALUE self)
+static VALUE rb_git_index_each(int argc, VALUE *argv, VALUE self)
 {
 	git_index *index;
 	unsigned int i, count;
+	int raw_oid;
+	VALUE rb_options;
 
 	Data_Get_Struct(self, git_index, index);
 
+	rb_scan_args(argc, argv, "01", &rb_options);
+
 	if (!rb_block_given_p())
-		return rb_funcall(self, rb_intern("to_enum"), 0);
+		return rb_funcall(self, rb_intern("to_enum"), 2, CSTR2SYM("each"), rb_options);
+
+	raw_oid = rugged_parse_oid_format(rb_options);
 
 	count = (unsigned int)git_index_entrycount(index);
 	for (i = 0; i < count; ++i) {
 		const git_index_entry *entry = git_index_get_byindex(index, i);
 		if (entry)
-			rb_yield(rb_git_indexentry_fromC(entry));
+			rb_yield(rb_git_indexentry_fromC(entry, raw_oid));
 	}
 
 	return Qnil;
@@ -295,7 +355,8 @@ static VALUE rb_git_index_remove_directory(int argc, VALUE *argv, VALUE self)
  *  creates a new index entry based on this file.
  *
  *  Alternatively, a new index entry can be created by passing a Hash containing
- *  all key/value pairs of an index entry.
+ *  all key/value pairs of an index entry, or a Rugged::Index::Entry as yielded
+ *  by Index#each_entry.
  *
  *  Any gitignore rules that might match +path+ (or the +:path+ value of the
  *  entry hash) are ignored.
@@ -311,7 +372,7 @@ static VALUE rb_git_index_add(VALUE self, VALUE rb_entry)
 
 	Data_Get_Struct(self, git_index, index);
 
-	if (TYPE(rb_entry) == T_HASH) {
+	if (TYPE(rb_entry) == T_HASH || rb_obj_is_kind_of(rb_entry, rb_cRuggedIndexEntry)) {
 		git_index_entry entry;
 
 		rb_git_indexentry_toC(&entry, rb_entry);
@@ -324,27 +385,554 @@ static VALUE rb_git_index_add(VALUE self, VALUE rb_entry)
 
 	else {
 		rb_raise(rb_eTypeError,
-			"Expecting a hash defining an Index Entry or a path to a file in the repository");
+			"Expecting a hash or Rugged::Index::Entry defining an Index Entry or a path to a file in the repository");
 	}
 
 	rugged_exception_check(error);
 	return Qnil;
 }
 
-int rugged__index_matched_path_cb(const char *path, const char *matched_pathspec, void *payload)
+/*
+ * A batch of changes for Index#apply_changes. The paths are copied into a
+ * single buffer, so that the batch can be sorted and applied without the GVL.
+ */
+struct rugged_index_change {
+	size_t offset;
+	const char *path;
+	size_t position;
+	git_oid oid;
+	unsigned int mode;
+};
+
+struct rugged_index_changes_args {
+	git_index *index;
+	VALUE rb_additions, rb_removals;
+	git_repository *repo;
+	const char *workdir;
+	int skip_stat;
+
+	char *paths;
+	size_t paths_len, paths_alloc;
+
+	struct rugged_index_change *additions, *removals;
+	size_t additions_count, removals_count;
+
+	int error;
+};
+
+/*
+ * Like git's verify_path: the path of a new entry must be relative, with
+ * no empty, "." or ".." component, and must not reach into ".git".
+ */
+static int rugged__index_change_path_valid(const char *path, size_t len)
+{
+	const char *component = path, *end = path + len, *slash;
+	size_t component_len;
+
+	for (;;) {
+		slash = memchr(component, '/', end - component);
+		component_len = (slash ? slash : end) - component;
+
+		if (component_len == 0 ||
+			(component_len == 1 && component[0] == '.') ||
+			(component_len == 2 && !memcmp(component, "..", 2)) ||
+			(component_len == 4 && !STRNCASECMP(component, ".git", 4)))
+			return 0;
+
+		if (!slash)
+			return 1;
+
+		component = slash + 1;
+	}
+}
+
+static size_t rugged__index_change_path(struct rugged_index_changes_args *args, VALUE rb_path, int addition)
+{
+	size_t offset = args->paths_len, len;
+
+	Check_Type(rb_path, T_STRING);
+	len = RSTRING_LEN(rb_path);
+
+	if (len == 0 || memchr(RSTRING_PTR(rb_path), '\0', len) ||
+		(addition && !rugged__index_change_path_valid(RSTRING_PTR(rb_path), len)))
+		rb_raise(rb_eArgError, "Invalid path for an index entry: %s",
+			RSTRING_PTR(rb_inspect(rb_path)));
+
+	if (offset + len + 1 > args->paths_alloc) {
+		while (offset + len + 1 > args->paths_alloc)
+			args->paths_alloc = args->paths_alloc ? args->paths_alloc * 2 : 4096;
+		REALLOC_N(args->paths, char, args->paths_alloc);
+	}
+
+	memcpy(args->paths + offset, RSTRING_PTR(rb_path), len);
+	args->paths[offset + len] = '\0';
+	args->paths_len = offset + len + 1;
+
+	return offset;
+}
+
+static int rugged__index_change_cmp(const void *a, const void *b)
 {
-	int *exception = (int *)payload;
+	const struct rugged_index_change *change_a = a, *change_b = b;
+	int cmp = strcmp(change_a->path, change_b->path);
+
+	if (cmp)
+		return cmp;
+
+	return (change_a->position > change_b->position) - (change_a->position < change_b->position);
+}
+
+/* Whether the first +len+ bytes of +path+ are the path of one of the sorted +changes+ */
+static int rugged__index_changes_contain(
+	const struct rugged_index_change *changes, size_t count, const char *path, size_t len)
+{
+	size_t lo = 0, hi = count;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		int cmp = strncmp(changes[mid].path, path, len);
+
+		if (!cmp && changes[mid].path[len])
+			cmp = 1;
+
+		if (cmp < 0)
+			lo = mid + 1;
+		else if (cmp > 0)
+			hi = mid;
+		else
+			return 1;
+	}
+
+	return 0;
+}
+
+/* The position of the first entry of the index not sorted before the first +len+ bytes of +path+ */
+static size_t rugged__index_lower_bound(git_index *index, int icase, const char *path, size_t len)
+{
+	size_t lo = 0, hi = git_index_entrycount(index);
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		const char *entry_path = git_index_get_byindex(index, mid)->path;
+
+		if ((icase ? STRNCASECMP(entry_path, path, len) : strncmp(entry_path, path, len)) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+static int rugged__index_change_conflict(const char *path, const char *other)
+{
+	char message[512];
+
+	snprintf(message, sizeof(message), "Cannot add '%s': it conflicts with '%s'", path, other);
+	giterr_set_str(GITERR_INDEX, message);
+
+	return -1;
+}
+
+/*
+ * Make sure that no addition turns a file into a directory or the other
+ * way around, against the other additions or against the entries of the
+ * index that are not removed, so that nothing is changed unless every
+ * change can be applied. Both lists of changes must be sorted.
+ */
+static int rugged__index_changes_check(struct rugged_index_changes_args *args)
+{
+	git_index *index = args->index;
+	int icase = (git_index_caps(index) & GIT_INDEXCAP_IGNORE_CASE) != 0;
+	size_t i, pos, len, entry_count = git_index_entrycount(index);
+	const git_index_entry *entry;
+	const char *slash;
+	char *dir;
+	int error = 0;
+
+	if ((dir = malloc(args->paths_len + 2)) == NULL) {
+		giterr_set_oom();
+		return -1;
+	}
+
+	for (i = 0; i < args->additions_count && !error; ++i) {
+		const char *path = args->additions[i].path;
+
+		/* each leading directory must neither be added nor be a file in the index */
+		for (slash = strchr(path, '/'); slash && !error; slash = strchr(slash + 1, '/')) {
+			len = slash - path;
+
+			if (rugged__index_changes_contain(args->additions, args->additions_count, path, len)) {
+				memcpy(dir, path, len);
+				dir[len] = '\0';
+				error = rugged__index_change_conflict(path, dir);
+				break;
+			}
+
+			pos = rugged__index_lower_bound(index, icase, path, len);
+			for (; pos < entry_count && !error; ++pos) {
+				entry = git_index_get_byindex(index, pos);
+				if (strlen(entry->path) != len ||
+					(icase ? STRNCASECMP(entry->path, path, len) : strncmp(entry->path, path, len)))
+					break;
+
+				if (!rugged__index_changes_contain(args->removals, args->removals_count, entry->path, len))
+					error = rugged__index_change_conflict(path, entry->path);
+			}
+		}
+
+		/* and the entry must not be a directory in the index */
+		len = strlen(path);
+		memcpy(dir, path, len);
+		dir[len] = '/';
+		dir[len + 1] = '\0';
+
+		pos = rugged__index_lower_bound(index, icase, dir, len + 1);
+		for (; pos < entry_count && !error; ++pos) {
+			entry = git_index_get_byindex(index, pos);
+			if (icase ? STRNCASECMP(entry->path, dir, len + 1) : strncmp(entry->path, dir, len + 1))
+				break;
+
+			if (!rugged__index_changes_contain(args->removals, args->removals_count, entry->path, strlen(entry->path)))
+				error = rugged__index_change_conflict(path, entry->path);
+		}
+	}
+
+	free(dir);
+	return error;
+}
+
+static void *rugged__index_apply_changes_nogvl(void *data)
+{
+	struct rugged_index_changes_args *args = data;
+	git_index_entry entry;
+	char *full_path = NULL;
+	size_t i, workdir_len = 0;
+	int stage, error = 0;
+
+	qsort(args->removals, args->removals_count, sizeof(struct rugged_index_change), rugged__index_change_cmp);
+	qsort(args->additions, args->additions_count, sizeof(struct rugged_index_change), rugged__index_change_cmp);
+
+	error = rugged__index_changes_check(args);
+
+	/* Removals go from the end of the index, to move as little as possible */
+	for (i = args->removals_count; i > 0 && !error; --i) {
+		for (stage = 0; stage <= 3 && !error; ++stage) {
+			error = git_index_remove(args->index, args->removals[i - 1].path, stage);
+			if (error == GIT_ENOTFOUND) {
+				giterr_clear();
+				error = 0;
+			}
+		}
+	}
+
+	/*
+	 * Additions go in path order: into an empty index, or past its last
+	 * entry, each one is appended instead of shifting the entries after
+	 * it. When a path is given more than once, the last addition wins.
+	 */
+#ifndef _WIN32
+	if (!error && !args->skip_stat) {
+		workdir_len = strlen(args->workdir);
+		if ((full_path = malloc(workdir_len + args->paths_len + 1)) == NULL) {
+			giterr_set_oom();
+			error = -1;
+		} else {
+			memcpy(full_path, args->workdir, workdir_len);
+		}
+	}
+#endif
+
+	for (i = 0; i < args->additions_count && !error; ++i) {
+		const struct rugged_index_change *change = &args->additions[i];
+
+		if (i + 1 < args->additions_count && !strcmp(change->path, args->additions[i + 1].path))
+			continue;
+
+		memset(&entry, 0x0, sizeof(entry));
+		entry.path = change->path;
+		entry.mode = change->mode;
+		git_oid_cpy(&entry.id, &change->oid);
+
+#ifndef _WIN32
+		/*
+		 * Stat data claims that the file on disk matches the entry, so
+		 * it's only recorded for files whose contents hash to its OID.
+		 */
+		if (full_path && (change->mode == GIT_FILEMODE_BLOB || change->mode == GIT_FILEMODE_BLOB_EXECUTABLE)) {
+			struct stat st;
+			git_oid oid;
+
+			strcpy(full_path + workdir_len, change->path);
+			if (lstat(full_path, &st) == 0 && S_ISREG(st.st_mode) &&
+				git_repository_hashfile(&oid, args->repo, full_path, GIT_OBJ_BLOB, change->path) == 0 &&
+				git_oid_equal(&oid, &change->oid)) {
+				entry.ctime.seconds = (git_time_t)st.st_ctime;
+				entry.mtime.seconds = (git_time_t)st.st_mtime;
+				entry.dev = (unsigned int)st.st_dev;
+				entry.ino = (unsigned int)st.st_ino;
+				entry.uid = st.st_uid;
+				entry.gid = st.st_gid;
+				entry.file_size = st.st_size;
+			}
+
+			/* an unreadable file just leaves the stat data empty */
+			giterr_clear();
+		}
+#endif
+
+		error = git_index_add(args->index, &entry);
+	}
+
+	free(full_path);
+	args->error = error;
+	return NULL;
+}
+
+static VALUE rugged__index_apply_changes_body(VALUE data)
+{
+	struct rugged_index_changes_args *args = (struct rugged_index_changes_args *)data;
+	long i;
+
+	args->additions = ALLOC_N(struct rugged_index_change, RARRAY_LEN(args->rb_additions));
+	for (i = 0; i < RARRAY_LEN(args->rb_additions); ++i) {
+		VALUE rb_change = rb_ary_entry(args->rb_additions, i), rb_oid, rb_mode;
+		struct rugged_index_change *change = &args->additions[args->additions_count];
+
+		Check_Type(rb_change, T_ARRAY);
+		if (RARRAY_LEN(rb_change) != 3)
+			rb_raise(rb_eArgError, "Expected an Array of [path, oid, mode] for each index entry");
+
+		rb_oid = rb_ary_entry(rb_change, 1);
+		Check_Type(rb_oid, T_STRING);
+		rugged_exception_check(rugged_oid_fromstr(&change->oid, rb_oid));
+
+		rb_mode = rb_ary_entry(rb_change, 2);
+		Check_Type(rb_mode, T_FIXNUM);
+		change->mode = FIX2UINT(rb_mode);
+
+		if (change->mode != GIT_FILEMODE_BLOB &&
+			change->mode != GIT_FILEMODE_BLOB_EXECUTABLE &&
+			change->mode != GIT_FILEMODE_LINK &&
+			change->mode != GIT_FILEMODE_COMMIT)
+			rb_raise(rb_eArgError, "Invalid mode for an index entry: 0%o", change->mode);
+
+		change->offset = rugged__index_change_path(args, rb_ary_entry(rb_change, 0), 1);
+		change->position = args->additions_count++;
+	}
+
+	if (!NIL_P(args->rb_removals)) {
+		args->removals = ALLOC_N(struct rugged_index_change, RARRAY_LEN(args->rb_removals));
+		for (i = 0; i < RARRAY_LEN(args->rb_removals); ++i) {
+			struct rugged_index_change *change = &args->removals[args->removals_count];
+
+			change->offset = rugged__index_change_path(args, rb_ary_entry(args->rb_removals, i), 0);
+			change->position = args->removals_count++;
+		}
+	}
+
+	/* The path buffer does not move anymore */
+	for (i = 0; i < (long)args->additions_count; ++i)
+		args->additions[i].path = args->paths + args->additions[i].offset;
+	for (i = 0; i < (long)args->removals_count; ++i)
+		args->removals[i].path = args->paths + args->removals[i].offset;
+
+	rugged_without_gvl(rugged__index_apply_changes_nogvl, args);
+	rugged_exception_check(args->error);
+
+	return Qnil;
+}
+
+static VALUE rugged__index_apply_changes_cleanup(VALUE data)
+{
+	struct rugged_index_changes_args *args = (struct rugged_index_changes_args *)data;
+
+	xfree(args->paths);
+	xfree(args->additions);
+	xfree(args->removals);
+
+	return Qnil;
+}
+
+static VALUE rugged__index_apply_changes(VALUE self, VALUE rb_additions, VALUE rb_removals, VALUE rb_options)
+{
+	struct rugged_index_changes_args args;
+	VALUE rb_value;
+
+	memset(&args, 0x0, sizeof(args));
+	Data_Get_Struct(self, git_index, args.index);
+
+	Check_Type(rb_additions, T_ARRAY);
+	if (!NIL_P(rb_removals))
+		Check_Type(rb_removals, T_ARRAY);
+
+	args.rb_additions = rb_additions;
+	args.rb_removals = rb_removals;
+
+	args.skip_stat = 1;
+	if (!NIL_P(rb_options)) {
+		rb_value = rb_hash_aref(rb_options, CSTR2SYM("skip_stat"));
+		if (!NIL_P(rb_value))
+			args.skip_stat = RTEST(rb_value);
+	}
+
+	args.repo = git_index_owner(args.index);
+	args.workdir = args.repo ? git_repository_workdir(args.repo) : NULL;
+	if (!args.workdir)
+		args.skip_stat = 1;
+
+	rb_ensure(rugged__index_apply_changes_body, (VALUE)&args, rugged__index_apply_changes_cleanup, (VALUE)&args);
+
+	/* The entries were changed behind the back of any file monitor */
+	rugged_file_monitor_sync(self, Qnil, Qnil);
+
+	return Qnil;
+}
+
+/*
+ *  call-seq:
+ *    index.apply_changes(additions, removals = [], options = {}) -> nil
+ *
+ *  Adds and removes many entries of the index in one call.
+ *
+ *  +additions+ is an Array of <tt>[path, oid, mode]</tt> Arrays, where +oid+
+ *  is given in hex or raw form and +mode+ is one of the blob, symlink or
+ *  gitlink file modes. Each addition replaces the stage 0 entry at +path+.
+ *  When a path is given more than once, the last addition wins.
+ *
+ *  +removals+ is an Array of paths whose entries are removed, at all stages.
+ *  Paths that are not in the index are skipped. Removals are applied before
+ *  additions.
+ *
+ *  All changes are checked before the index is touched: paths must be
+ *  relative, with no empty, "." or ".." component and no ".git" one
+ *  (ArgumentError), and no addition may turn a file of the index into a
+ *  directory or the other way around, unless the entries in the way are
+ *  removed too (Rugged::IndexError). Only running out of memory can leave
+ *  part of the changes applied.
+ *
+ *  The changes are then sorted by path and applied at once without the
+ *  GVL, instead of converting a Hash for each entry as Index#add does.
+ *  Each addition is still a binary search plus, unless it lands past the
+ *  last entry of the index, a move of the entries after it; building an
+ *  index from scratch only ever appends. <tt>script/bench-index-add</tt>
+ *  compares both on a given number of entries.
+ *
+ *  The following options can be passed in the +options+ Hash:
+ *
+ *  :skip_stat ::
+ *    If +true+ (the default), the new entries get empty stat data, like
+ *    entries added with Index#add. If +false+, each added file is looked
+ *    up in the working directory and hashed, and its stat data is stored
+ *    in the entry when its contents match the given OID, so that it is
+ *    considered unchanged until it is touched. Indexes that don't belong
+ *    to a repository with a working directory always skip the stat data.
+ *
+ *    index.apply_changes(
+ *      [["README", readme_oid, 0100644], ["bin/run", run_oid, 0100755]],
+ *      ["old_file"]
+ *    )
+ */
+static VALUE rb_git_index_apply_changes(int argc, VALUE *argv, VALUE self)
+{
+	VALUE rb_additions, rb_removals, rb_options;
+
+	rb_scan_args(argc, argv, "11:", &rb_additions, &rb_removals, &rb_options);
+
+	return rugged__index_apply_changes(self, rb_additions, rb_removals, rb_options);
+}
+
+/*
+ *  call-seq:
+ *    index.add_entries(entries, options = {}) -> nil
+ *
+ *  Adds many entries to the index in one call. +entries+ is an Array of
+ *  <tt>[path, oid, mode]</tt> Arrays.
+ *
+ *  This is the same as <tt>index.apply_changes(entries, [], options)</tt>;
+ *  see Index#apply_changes for the details and the available +options+.
+ */
+static VALUE rb_git_index_add_entries(int argc, VALUE *argv, VALUE self)
+{
+	VALUE rb_entries, rb_options;
+
+	rb_scan_args(argc, argv, "10:", &rb_entries, &rb_options);
+
+	return rugged__index_apply_changes(self, rb_entries, Qnil, rb_options);
+}
+
+struct rugged_index_matched_path_args {
+	const char *path;
+	const char *matched_pathspec;
+	int *exception;
+	int result;
+};
+
+static void *rugged__index_matched_path_gvl(void *data)
+{
+	struct rugged_index_matched_path_args *args = data;
 
 	VALUE rb_result, rb_args = rb_ary_new2(2);
-	rb_ary_push(rb_args, rb_str_new2(path));
-	rb_ary_push(rb_args, matched_pathspec == NULL ? Qnil : rb_str_new2(matched_pathspec));
+	rb_ary_push(rb_args, rb_str_new2(args->path));
+	rb_ary_push(rb_args, args->matched_pathspec == NULL ? Qnil : rb_str_new2(args->matched_pathspec));
+
+	rb_result = rb_protect(rb_yield_splat, rb_args, args->exception);
+
+	if (*args->exception)
+		args->result = GIT_ERROR;
+	else
+		args->result = RTEST(rb_result) ? 0 : 1;
+
+	return NULL;
+}
+
+int rugged__index_matched_path_cb(const char *path, const char *matched_pathspec, void *payload)
+{
+	struct rugged_index_matched_path_args args = { path, matched_pathspec, (int *)payload, 0 };
+
+	rugged_with_gvl(rugged__index_matched_path_gvl, &args);
+
+	return args.result;
+}
+
+struct rugged_index_pathspec_args {
+	git_index *index;
+	const git_strarray *pathspecs;
+	unsigned int flags;
+	git_index_matched_path_cb callback;
+	int *exception;
+	int error;
+};
+
+static void *rugged__index_add_all_nogvl(void *data)
+{
+	struct rugged_index_pathspec_args *args = data;
+	args->error = git_index_add_all(args->index, args->pathspecs, args->flags, args->callback, args->exception);
+	return NULL;
+}
 
-	rb_result = rb_protect(rb_yield_splat, rb_args, exception);
+static void *rugged__index_update_all_nogvl(void *data)
+{
+	struct rugged_index_pathspec_args *args = data;
+	args->error = git_index_update_all(args->index, args->pathspecs, args->callback, args->exception);
+	return NULL;
+}
 
-	if (*exception)
-		return GIT_ERROR;
+static void *rugged__index_remove_all_nogvl(void *data)
+{
+	struct rugged_index_pathspec_args *args = data;
+	args->error = git_index_remove_all(args->index, args->pathspecs, args->callback, args->exception);
+	return NULL;
+}
 
-	return RTEST(rb_result) ? 0 : 1;
+/*
+ * Without a pathspec, #add_all and #update_all only look at the paths the
+ * repository's file monitor saw change since the index last synced.
+ */
+static int rugged__index_pathspec_empty(VALUE rb_pathspecs)
+{
+	return NIL_P(rb_pathspecs) ||
+		(TYPE(rb_pathspecs) == T_ARRAY && RARRAY_LEN(rb_pathspecs) == 0);
 }
 
 /*
@@ -385,10 +973,15 @@ int rugged__index_matched_path_cb(const char *path, const char *matched_pathspec
  *    If +true+, and the +:force+ options is +false+ or not given, exact matches
  *    of ignored files or files that are not already in +index+ will raise a
  *    Rugged::InvalidError. This emulates <code>git add -A</code>.
+ *
+ *  If +pathspec+ is empty and the repository has a file monitor (see
+ *  Repository#file_monitor=), only the files changed since the previous
+ *  call are looked at.
  */
 static VALUE rb_git_index_add_all(int argc, VALUE *argv, VALUE self)
 {
 	VALUE rb_pathspecs, rb_options;
+	VALUE rb_monitor = Qnil, rb_changed = Qnil, rb_token = Qnil;
 
 	git_index *index;
 	git_strarray pathspecs;
@@ -410,17 +1003,61 @@ static VALUE rb_git_index_add_all(int argc, VALUE *argv, VALUE self)
 			flags |= GIT_INDEX_ADD_CHECK_PATHSPEC;
 	}
 
-	rugged_rb_ary_to_strarray(rb_pathspecs, &pathspecs);
+	if (rugged__index_pathspec_empty(rb_pathspecs)) {
+		rb_monitor = rugged_file_monitor_get(rugged_owner(self));
+		rb_changed = rugged_file_monitor_changes(rb_monitor, self, 0, &rb_token);
+
+		if (!NIL_P(rb_changed)) {
+			if (RARRAY_LEN(rb_changed) == 0) {
+				rugged_file_monitor_sync(self, rb_monitor, rb_token);
+				return Qnil;
+			}
 
-	error = git_index_add_all(index, &pathspecs, flags,
-		rb_block_given_p() ? rugged__index_matched_path_cb : NULL, &exception);
+			/* changed paths are literal, and may well be ignored */
+			flags |= GIT_INDEX_ADD_DISABLE_PATHSPEC_MATCH;
+			flags &= ~GIT_INDEX_ADD_CHECK_PATHSPEC;
+		}
+	}
 
-	xfree(pathspecs.strings);
+	{
+		struct rugged_index_pathspec_args args = {
+			index, &pathspecs, flags,
+			rb_block_given_p() ? rugged__index_matched_path_cb : NULL,
+			&exception, 0
+		};
+
+		if (NIL_P(rb_changed)) {
+			rugged_rb_ary_to_strarray(rb_pathspecs, &pathspecs);
+			rugged_without_gvl(rugged__index_add_all_nogvl, &args);
+			xfree(pathspecs.strings);
+		} else {
+			char *path;
+			long i;
+
+			/* one add per path, each only walking the workdir below that path */
+			rb_changed = rugged_file_monitor_outermost(rb_changed);
+			pathspecs.strings = &path;
+			pathspecs.count = 1;
+
+			for (i = 0; !args.error && i < RARRAY_LEN(rb_changed); ++i) {
+				VALUE rb_path = rb_ary_entry(rb_changed, i);
+
+				path = StringValueCStr(rb_path);
+				rugged_without_gvl(rugged__index_add_all_nogvl, &args);
+			}
+		}
+
+		error = args.error;
+	}
 
 	if (exception)
 		rb_jump_tag(exception);
 
 	rugged_exception_check(error);
+
+	if (!NIL_P(rb_monitor))
+		rugged_file_monitor_sync(self, rb_monitor, rb_token);
+
 	return Qnil;
 }
 
@@ -446,11 +1083,16 @@ static VALUE rb_git_index_add_all(int argc, VALUE *argv, VALUE self)
  *  it will be passed to the block. If the return value of +block+ is
  *  falsy, the matching item will not be updated in the index.
  *
+ *  If +pathspec+ is empty and the repository has a file monitor (see
+ *  Repository#file_monitor=), only the entries of the files changed since
+ *  the previous call are looked at.
+ *
  *  This method will fail in bare index instances.
  */
 static VALUE rb_git_index_update_all(int argc, VALUE *argv, VALUE self)
 {
 	VALUE rb_pathspecs = rb_ary_new();
+	VALUE rb_monitor = Qnil, rb_changed, rb_token = Qnil;
 
 	git_index *index;
 	git_strarray pathspecs;
@@ -460,10 +1102,32 @@ static VALUE rb_git_index_update_all(int argc, VALUE *argv, VALUE self)
 
 	rb_scan_args(argc, argv, "01", &rb_pathspecs);
 
+	if (rugged__index_pathspec_empty(rb_pathspecs)) {
+		rb_monitor = rugged_file_monitor_get(rugged_owner(self));
+		rb_changed = rugged_file_monitor_changes(rb_monitor, self, 0, &rb_token);
+
+		if (!NIL_P(rb_changed)) {
+			if (RARRAY_LEN(rb_changed) == 0) {
+				rugged_file_monitor_sync(self, rb_monitor, rb_token);
+				return Qnil;
+			}
+
+			rb_pathspecs = rb_changed;
+		}
+	}
+
 	rugged_rb_ary_to_strarray(rb_pathspecs, &pathspecs);
 
-	error = git_index_update_all(index, &pathspecs,
-		rb_block_given_p() ? rugged__index_matched_path_cb : NULL, &exception);
+	{
+		struct rugged_index_pathspec_args args = {
+			index, &pathspecs, 0,
+			rb_block_given_p() ? rugged__index_matched_path_cb : NULL,
+			&exception, 0
+		};
+
+		rugged_without_gvl(rugged__index_update_all_nogvl, &args);
+		error = args.error;
+	}
 
 	xfree(pathspecs.strings);
 
@@ -471,6 +1135,9 @@ static VALUE rb_git_index_update_all(int argc, VALUE *argv, VALUE self)
 		rb_jump_tag(exception);
 	rugged_exception_check(error);
 
+	if (!NIL_P(rb_monitor))
+		rugged_file_monitor_sync(self, rb_monitor, rb_token);
+
 	return Qnil;
 }
 
@@ -508,8 +1175,16 @@ static VALUE rb_git_index_remove_all(int argc, VALUE *argv, VALUE self)
 
 	rugged_rb_ary_to_strarray(rb_ary_to_ary(rb_pathspecs), &pathspecs);
 
-	error = git_index_remove_all(index, &pathspecs,
-		rb_block_given_p() ? rugged__index_matched_path_cb : NULL, &exception);
+	{
+		struct rugged_index_pathspec_args args = {
+			index, &pathspecs, 0,
+			rb_block_given_p() ? rugged__index_matched_path_cb : NULL,
+			&exception, 0
+		};
+
+		rugged_without_gvl(rugged__index_remove_all_nogvl, &args);
+		error = args.error;
+	}
 
 	xfree(pathspecs.strings);
 
@@ -520,7 +1195,7 @@ static VALUE rb_git_index_remove_all(int argc, VALUE *argv, VALUE self)
 	return Qnil;
 }
 
-static VALUE rb_git_indexentry_fromC(const git_index_entry *entry)
+static VALUE rb_git_indexentry_fromC(const git_index_entry *entry, int raw_oid)
 {
 	VALUE rb_entry, rb_mtime, rb_ctime;
 	unsigned int valid, stage;
@@ -530,35 +1205,35 @@ static VALUE rb_git_indexentry_fromC(const git_index_entry *entry)
 
 	rb_entry = rb_hash_new();
 
-	rb_hash_aset(rb_entry, CSTR2SYM("path"), rb_str_new_utf8(entry->path));
-	rb_hash_aset(rb_entry, CSTR2SYM("oid"), rugged_create_oid(&entry->id));
+	rb_hash_aset(rb_entry, id_entry_path, rb_str_new_utf8(entry->path));
+	rb_hash_aset(rb_entry, id_entry_oid, rugged_create_oid_as(&entry->id, raw_oid));
 
-	rb_hash_aset(rb_entry, CSTR2SYM("dev"), INT2FIX(entry->dev));
-	rb_hash_aset(rb_entry, CSTR2SYM("ino"), INT2FIX(entry->ino));
-	rb_hash_aset(rb_entry, CSTR2SYM("mode"), INT2FIX(entry->mode));
-	rb_hash_aset(rb_entry, CSTR2SYM("gid"), INT2FIX(entry->gid));
-	rb_hash_aset(rb_entry, CSTR2SYM("uid"), INT2FIX(entry->uid));
-	rb_hash_aset(rb_entry, CSTR2SYM("file_size"), INT2FIX(entry->file_size));
+	rb_hash_aset(rb_entry, id_entry_dev, INT2FIX(entry->dev));
+	rb_hash_aset(rb_entry, id_entry_ino, INT2FIX(entry->ino));
+	rb_hash_aset(rb_entry, id_entry_mode, INT2FIX(entry->mode));
+	rb_hash_aset(rb_entry, id_entry_gid, INT2FIX(entry->gid));
+	rb_hash_aset(rb_entry, id_entry_uid, INT2FIX(entry->uid));
+	rb_hash_aset(rb_entry, id_entry_file_size, INT2FIX(entry->file_size));
 
 	valid = (entry->flags & GIT_IDXENTRY_VALID);
-	rb_hash_aset(rb_entry, CSTR2SYM("valid"), valid ? Qtrue : Qfalse);
+	rb_hash_aset(rb_entry, id_entry_valid, valid ? Qtrue : Qfalse);
 
 	stage = (entry->flags & GIT_IDXENTRY_STAGEMASK) >> GIT_IDXENTRY_STAGESHIFT;
-	rb_hash_aset(rb_entry, CSTR2SYM("stage"), INT2FIX(stage));
+	rb_hash_aset(rb_entry, id_entry_stage, INT2FIX(stage));
 
 	rb_mtime = rb_time_new(entry->mtime.seconds, entry->mtime.nanoseconds / 1000);
 	rb_ctime = rb_time_new(entry->ctime.seconds, entry->ctime.nanoseconds / 1000);
 
-	rb_hash_aset(rb_entry, CSTR2SYM("ctime"), rb_ctime);
-	rb_hash_aset(rb_entry, CSTR2SYM("mtime"), rb_mtime);
+	rb_hash_aset(rb_entry, id_entry_ctime, rb_ctime);
+	rb_hash_aset(rb_entry, id_entry_mtime, rb_mtime);
 
 	return rb_entry;
 }
 
 static inline unsigned int
-default_entry_value(VALUE rb_entry, const char *key)
+default_entry_value(VALUE rb_entry, VALUE key)
 {
-	VALUE val = rb_hash_aref(rb_entry, CSTR2SYM(key));
+	VALUE val = rb_hash_aref(rb_entry, key);
 	if (NIL_P(val))
 		return 0;
 
@@ -570,26 +1245,35 @@ static void rb_git_indexentry_toC(git_index_entry *entry, VALUE rb_entry)
 {
 	VALUE val;
 
+	if (rb_obj_is_kind_of(rb_entry, rb_cRuggedIndexEntry)) {
+		struct rugged_index_entry *rugged_entry;
+		Data_Get_Struct(rb_entry, struct rugged_index_entry, rugged_entry);
+
+		*entry = rugged_entry->entry;
+		entry->path = StringValueCStr(rugged_entry->rb_path);
+		return;
+	}
+
 	Check_Type(rb_entry, T_HASH);
 
-	val = rb_hash_aref(rb_entry, CSTR2SYM("path"));
+	val = rb_hash_aref(rb_entry, id_entry_path);
 	Check_Type(val, T_STRING);
 	entry->path = StringValueCStr(val);
 
-	val = rb_hash_aref(rb_entry, CSTR2SYM("oid"));
+	val = rb_hash_aref(rb_entry, id_entry_oid);
 	Check_Type(val, T_STRING);
 	rugged_exception_check(
-		git_oid_fromstr(&entry->id, StringValueCStr(val))
+		rugged_oid_fromstr(&entry->id, val)
 	);
 
-	entry->dev = default_entry_value(rb_entry, "dev");
-	entry->ino = default_entry_value(rb_entry, "ino");
-	entry->mode = default_entry_value(rb_entry, "mode");
-	entry->gid = default_entry_value(rb_entry, "gid");
-	entry->uid = default_entry_value(rb_entry, "uid");
-	entry->file_size = (git_off_t)default_entry_value(rb_entry, "file_size");
+	entry->dev = default_entry_value(rb_entry, id_entry_dev);
+	entry->ino = default_entry_value(rb_entry, id_entry_ino);
+	entry->mode = default_entry_value(rb_entry, id_entry_mode);
+	entry->gid = default_entry_value(rb_entry, id_entry_gid);
+	entry->uid = default_entry_value(rb_entry, id_entry_uid);
+	entry->file_size = (git_off_t)default_entry_value(rb_entry, id_entry_file_size);
 
-	if ((val = rb_hash_aref(rb_entry, CSTR2SYM("mtime"))) != Qnil) {
+	if ((val = rb_hash_aref(rb_entry, id_entry_mtime)) != Qnil) {
 		if (!rb_obj_is_kind_of(val, rb_cTime))
 			rb_raise(rb_eTypeError, ":mtime must be a Time instance");
 
@@ -599,7 +1283,7 @@ static void rb_git_indexentry_toC(git_index_entry *entry, VALUE rb_entry)
 		entry->mtime.seconds = entry->mtime.nanoseconds = 0;
 	}
 
-	if ((val = rb_hash_aref(rb_entry, CSTR2SYM("ctime"))) != Qnil) {
+	if ((val = rb_hash_aref(rb_entry, id_entry_ctime)) != Qnil) {
 		if (!rb_obj_is_kind_of(val, rb_cTime))
 			rb_raise(rb_eTypeError, ":ctime must be a Time instance");
 
@@ -612,14 +1296,14 @@ static void rb_git_indexentry_toC(git_index_entry *entry, VALUE rb_entry)
 	entry->flags = 0x0;
 	entry->flags_extended = 0x0;
 
-	val = rb_hash_aref(rb_entry, CSTR2SYM("stage"));
+	val = rb_hash_aref(rb_entry, id_entry_stage);
 	if (!NIL_P(val)) {
 		unsigned int stage = NUM2INT(val);
 		entry->flags &= ~GIT_IDXENTRY_STAGEMASK;
 		entry->flags |= (stage << GIT_IDXENTRY_STAGESHIFT) & GIT_IDXENTRY_STAGEMASK;
 	}
 
-	val = rb_hash_aref(rb_entry, CSTR2SYM("valid"));
+	val = rb_hash_aref(rb_entry, id_entry_valid);
 	if (!NIL_P(val)) {
 		entry->flags &= ~GIT_IDXENTRY_VALID;
 		if (rugged_parse_bool(val))
@@ -629,6 +1313,238 @@ static void rb_git_indexentry_toC(git_index_entry *entry, VALUE rb_entry)
 	}
 }
 
+static VALUE rugged_index_entry_path(const char *path)
+{
+#ifdef HAVE_RB_ENC_INTERNED_STR
+	return rb_enc_interned_str(path, strlen(path), rb_utf8_encoding());
+#else
+	return rb_obj_freeze(rb_str_new_utf8(path));
+#endif
+}
+
+static VALUE rugged_index_entry_field(const git_index_entry *entry, int field, int raw_oid)
+{
+	switch (field) {
+	case RUGGED_ENTRY_PATH:
+		return rugged_index_entry_path(entry->path);
+	case RUGGED_ENTRY_OID:
+		return rugged_create_oid_as(&entry->id, raw_oid);
+	case RUGGED_ENTRY_DEV:
+		return INT2FIX(entry->dev);
+	case RUGGED_ENTRY_INO:
+		return INT2FIX(entry->ino);
+	case RUGGED_ENTRY_MODE:
+		return INT2FIX(entry->mode);
+	case RUGGED_ENTRY_GID:
+		return INT2FIX(entry->gid);
+	case RUGGED_ENTRY_UID:
+		return INT2FIX(entry->uid);
+	case RUGGED_ENTRY_FILE_SIZE:
+		return INT2FIX(entry->file_size);
+	case RUGGED_ENTRY_VALID:
+		return (entry->flags & GIT_IDXENTRY_VALID) ? Qtrue : Qfalse;
+	case RUGGED_ENTRY_STAGE:
+		return INT2FIX((entry->flags & GIT_IDXENTRY_STAGEMASK) >> GIT_IDXENTRY_STAGESHIFT);
+	case RUGGED_ENTRY_CTIME:
+		return rb_time_new(entry->ctime.seconds, entry->ctime.nanoseconds / 1000);
+	case RUGGED_ENTRY_MTIME:
+		return rb_time_new(entry->mtime.seconds, entry->mtime.nanoseconds / 1000);
+	default:
+		return Qnil;
+	}
+}
+
+static int rugged_index_entry_parse_field(VALUE rb_field)
+{
+	int i;
+
+	for (i = 0; i < RUGGED_ENTRY_FIELDS; ++i) {
+		if (rb_field == *rugged_index_entry_keys[i])
+			return i;
+	}
+
+	rb_raise(rb_eArgError, "Invalid index entry field: %s",
+		RSTRING_PTR(rb_inspect(rb_field)));
+}
+
+static void rb_git_indexentry__mark(struct rugged_index_entry *entry)
+{
+	rb_gc_mark(entry->rb_path);
+}
+
+static VALUE rugged_index_entry_new(const git_index_entry *entry, int raw_oid)
+{
+	struct rugged_index_entry *rb_entry;
+	VALUE rb_path, self;
+
+	rb_path = rugged_index_entry_path(entry->path);
+
+	self = Data_Make_Struct(rb_cRuggedIndexEntry, struct rugged_index_entry,
+		rb_git_indexentry__mark, xfree, rb_entry);
+
+	rb_entry->entry = *entry;
+	rb_entry->entry.path = NULL;
+	rb_entry->rb_path = rb_path;
+	rb_entry->raw_oid = raw_oid;
+
+	return self;
+}
+
+static VALUE rugged_index_entry_get(VALUE self, int field)
+{
+	struct rugged_index_entry *entry;
+	Data_Get_Struct(self, struct rugged_index_entry, entry);
+
+	if (field == RUGGED_ENTRY_PATH)
+		return entry->rb_path;
+
+	return rugged_index_entry_field(&entry->entry, field, entry->raw_oid);
+}
+
+#define RUGGED_INDEX_ENTRY_READER(name, field) \
+	static VALUE rb_git_indexentry_##name(VALUE self) \
+	{ \
+		return rugged_index_entry_get(self, field); \
+	}
+
+RUGGED_INDEX_ENTRY_READER(path, RUGGED_ENTRY_PATH)
+RUGGED_INDEX_ENTRY_READER(oid, RUGGED_ENTRY_OID)
+RUGGED_INDEX_ENTRY_READER(dev, RUGGED_ENTRY_DEV)
+RUGGED_INDEX_ENTRY_READER(ino, RUGGED_ENTRY_INO)
+RUGGED_INDEX_ENTRY_READER(mode, RUGGED_ENTRY_MODE)
+RUGGED_INDEX_ENTRY_READER(gid, RUGGED_ENTRY_GID)
+RUGGED_INDEX_ENTRY_READER(uid, RUGGED_ENTRY_UID)
+RUGGED_INDEX_ENTRY_READER(file_size, RUGGED_ENTRY_FILE_SIZE)
+RUGGED_INDEX_ENTRY_READER(valid, RUGGED_ENTRY_VALID)
+RUGGED_INDEX_ENTRY_READER(stage, RUGGED_ENTRY_STAGE)
+RUGGED_INDEX_ENTRY_READER(ctime, RUGGED_ENTRY_CTIME)
+RUGGED_INDEX_ENTRY_READER(mtime, RUGGED_ENTRY_MTIME)
+
+/*
+ *  call-seq:
+ *    entry[key] -> value
+ *
+ *  Returns the value of the field +key+ (e.g. +:path+ or +:mtime+), so
+ *  that entries can be read like the entry hashes of Index#each.
+ */
+static VALUE rb_git_indexentry_aref(VALUE self, VALUE rb_key)
+{
+	int i;
+
+	for (i = 0; i < RUGGED_ENTRY_FIELDS; ++i) {
+		if (rb_key == *rugged_index_entry_keys[i])
+			return rugged_index_entry_get(self, i);
+	}
+
+	return Qnil;
+}
+
+/*
+ *  call-seq:
+ *    entry.to_h -> hash
+ *
+ *  Returns the entry as a Hash in the format used by Index#each and
+ *  Index#add.
+ */
+static VALUE rb_git_indexentry_to_h(VALUE self)
+{
+	VALUE rb_hash = rb_hash_new();
+	int i;
+
+	for (i = 0; i < RUGGED_ENTRY_FIELDS; ++i)
+		rb_hash_aset(rb_hash, *rugged_index_entry_keys[i], rugged_index_entry_get(self, i));
+
+	return rb_hash;
+}
+
+/*
+ *  call-seq:
+ *    index.each_entry(options = {}) { |entry| } -> nil
+ *    index.each_entry(fields: [field, ...]) { |value, ...| } -> nil
+ *    index.each_entry(options = {}) -> Enumerator
+ *
+ *  Passes each entry of the index to the given block as a
+ *  Rugged::Index::Entry.
+ *
+ *  Unlike Index#each, no Hash is built per entry: an entry holds a copy of
+ *  the native index entry, its path is a frozen (and, where the Ruby
+ *  supports it, deduplicated) String, and the other fields, including the
+ *  +ctime+ and +mtime+ Time objects, are only created when read.
+ *
+ *  If no block is given, an enumerator is returned instead.
+ *
+ *  The following options can be passed in the +options+ Hash:
+ *
+ *  :fields ::
+ *    An Array of field names (+:path+, +:oid+, +:dev+, +:ino+, +:mode+,
+ *    +:gid+, +:uid+, +:file_size+, +:valid+, +:stage+, +:ctime+ or +:mtime+).
+ *    If given, no entry objects are created at all: the values of these
+ *    fields are passed to the block as separate arguments instead.
+ *
+ *  :oid_format ::
+ *    If set to +:raw+, +oid+ values are raw Rugged::Oid instances instead of hex.
+ *
+ *    index.each_entry(fields: [:path, :oid]) do |path, oid|
+ *      # ...
+ *    end
+ */
+static VALUE rb_git_index_each_entry(int argc, VALUE *argv, VALUE self)
+{
+	git_index *index;
+	unsigned int i, count;
+	int raw_oid, nfields = 0, fields[RUGGED_ENTRY_FIELDS];
+	VALUE rb_options, rb_fields = Qnil, rb_values[RUGGED_ENTRY_FIELDS];
+
+	Data_Get_Struct(self, git_index, index);
+
+	rb_scan_args(argc, argv, "01", &rb_options);
+
+	if (!rb_block_given_p())
+		return rb_funcall(self, rb_intern("to_enum"), 2, CSTR2SYM("each_entry"), rb_options);
+
+	raw_oid = rugged_parse_oid_format(rb_options);
+
+	if (!NIL_P(rb_options)) {
+		Check_Type(rb_options, T_HASH);
+		rb_fields = rb_hash_aref(rb_options, CSTR2SYM("fields"));
+	}
+
+	if (!NIL_P(rb_fields)) {
+		Check_Type(rb_fields, T_ARRAY);
+
+		if (RARRAY_LEN(rb_fields) == 0 || RARRAY_LEN(rb_fields) > RUGGED_ENTRY_FIELDS)
+			rb_raise(rb_eArgError, "Expected between 1 and %d fields", RUGGED_ENTRY_FIELDS);
+
+		nfields = (int)RARRAY_LEN(rb_fields);
+		for (i = 0; i < (unsigned int)nfields; ++i)
+			fields[i] = rugged_index_entry_parse_field(rb_ary_entry(rb_fields, i));
+	}
+
+	count = (unsigned int)git_index_entrycount(index);
+	for (i = 0; i < count; ++i) {
+		const git_index_entry *entry = git_index_get_byindex(index, i);
+		int f;
+
+		if (!entry)
+			continue;
+
+		if (!nfields) {
+			rb_yield(rugged_index_entry_new(entry, raw_oid));
+			continue;
+		}
+
+		for (f = 0; f < nfields; ++f)
+			rb_values[f] = rugged_index_entry_field(entry, fields[f], raw_oid);
+
+		if (nfields == 1)
+			rb_yield(rb_values[0]);
+		else
+			rb_yield_values2(nfields, rb_values);
+	}
+
+	return Qnil;
+}
+
 /*
  *  call-seq:
  *    index.write_tree([repo]) -> oid
@@ -686,6 +1602,7 @@ static VALUE rb_git_index_readtree(VALUE self, VALUE rb_tree)
 	}
 
 	error = git_index_read_tree(index, tree);
+	rugged_file_monitor_sync(self, Qnil, Qnil);
 	rugged_exception_check(error);
 
 	return Qnil;
@@ -715,6 +1632,9 @@ static VALUE rb_git_index_readtree(VALUE self, VALUE rb_tree)
  *    An integer specifying the maximum byte size of a file before a it will
  *    be treated as binary. The default value is 512MB.
  *
+ *  :max_file_bytes, :max_files, :timeout_ms, :max_total_lines ::
+ *    Size guardrails for the diff, see Rugged::Tree.diff.
+ *
  *  :context_lines ::
  *    The number of unchanged lines that define the boundary of a hunk (and
  *    to display before and after the actual changes). The default is 3.
@@ -797,10 +1717,12 @@ static VALUE rb_git_index_diff(int argc, VALUE *argv, VALUE self)
 	git_diff_options opts = GIT_DIFF_OPTIONS_INIT;
 	git_repository *repo;
 	git_diff *diff = NULL;
-	VALUE owner, rb_other, rb_options;
+	struct rugged_diff_budget budget;
+	VALUE owner, rb_other, rb_options, rb_diff;
 	int error;
 
 	rb_scan_args(argc, argv, "01:", &rb_other, &rb_options);
+	rugged_parse_diff_budget(&budget, &opts, rb_options);
 	rugged_parse_diff_options(&opts, rb_options);
 
 	Data_Get_Struct(self, git_index, index);
@@ -833,9 +1755,16 @@ static VALUE rb_git_index_diff(int argc, VALUE *argv, VALUE self)
 	}
 
 	xfree(opts.pathspec.strings);
+
+	if (error)
+		rugged_diff_budget_free(&budget);
 	rugged_exception_check(error);
 
-	return rugged_diff_new(rb_cRuggedDiff, owner, diff);
+	rb_diff = rugged_diff_new(rb_cRuggedDiff, owner, diff);
+	rugged_diff_set_budget(rb_diff, &budget);
+	rugged_diff_set_options(rb_diff, rb_options);
+
+	return rb_diff;
 }
 
 /*
@@ -945,9 +1874,9 @@ static VALUE rb_git_conflict_get(VALUE self, VALUE rb_path)
 	else
 		rugged_exception_check(error);
 
-	rb_hash_aset(rb_result, CSTR2SYM("ancestor"), rb_git_indexentry_fromC(ancestor));
-	rb_hash_aset(rb_result, CSTR2SYM("ours"),     rb_git_indexentry_fromC(ours));
-	rb_hash_aset(rb_result, CSTR2SYM("theirs"),   rb_git_indexentry_fromC(theirs));
+	rb_hash_aset(rb_result, CSTR2SYM("ancestor"), rb_git_indexentry_fromC(ancestor, 0));
+	rb_hash_aset(rb_result, CSTR2SYM("ours"),     rb_git_indexentry_fromC(ours, 0));
+	rb_hash_aset(rb_result, CSTR2SYM("theirs"),   rb_git_indexentry_fromC(theirs, 0));
 
 	return rb_result;
 }
@@ -1150,9 +2079,9 @@ static VALUE rb_git_index_conflicts(VALUE self)
 	while ((error = git_index_conflict_next(&ancestor, &ours, &theirs, iter)) == GIT_OK) {
 		VALUE rb_conflict = rb_hash_new();
 
-		rb_hash_aset(rb_conflict, CSTR2SYM("ancestor"), rb_git_indexentry_fromC(ancestor));
-		rb_hash_aset(rb_conflict, CSTR2SYM("ours"),     rb_git_indexentry_fromC(ours));
-		rb_hash_aset(rb_conflict, CSTR2SYM("theirs"),   rb_git_indexentry_fromC(theirs));
+		rb_hash_aset(rb_conflict, CSTR2SYM("ancestor"), rb_git_indexentry_fromC(ancestor, 0));
+		rb_hash_aset(rb_conflict, CSTR2SYM("ours"),     rb_git_indexentry_fromC(ours, 0));
+		rb_hash_aset(rb_conflict, CSTR2SYM("theirs"),   rb_git_indexentry_fromC(theirs, 0));
 
 		rb_ary_push(rb_conflicts, rb_conflict);
 	}
@@ -1211,6 +2140,19 @@ static VALUE rb_git_index_conflicts(VALUE self)
  */
 void Init_rugged_index(void)
 {
+	id_entry_path      = CSTR2SYM("path");
+	id_entry_oid       = CSTR2SYM("oid");
+	id_entry_dev       = CSTR2SYM("dev");
+	id_entry_ino       = CSTR2SYM("ino");
+	id_entry_mode      = CSTR2SYM("mode");
+	id_entry_gid       = CSTR2SYM("gid");
+	id_entry_uid       = CSTR2SYM("uid");
+	id_entry_file_size = CSTR2SYM("file_size");
+	id_entry_valid     = CSTR2SYM("valid");
+	id_entry_stage     = CSTR2SYM("stage");
+	id_entry_ctime     = CSTR2SYM("ctime");
+	id_entry_mtime     = CSTR2SYM("mtime");
+
 	/*
 	 * Index
 	 */
@@ -1223,7 +2165,8 @@ void Init_rugged_index(void)
 	rb_define_method(rb_cRuggedIndex, "write", rb_git_index_write, 0);
 	rb_define_method(rb_cRuggedIndex, "get", rb_git_index_get, -1);
 	rb_define_method(rb_cRuggedIndex, "[]", rb_git_index_get, -1);
-	rb_define_method(rb_cRuggedIndex, "each", rb_git_index_each, 0);
+	rb_define_method(rb_cRuggedIndex, "each", rb_git_index_each, -1);
+	rb_define_method(rb_cRuggedIndex, "each_entry", rb_git_index_each_entry, -1);
 	rb_define_method(rb_cRuggedIndex, "diff", rb_git_index_diff, -1);
 
 	rb_define_method(rb_cRuggedIndex, "conflicts?", rb_git_index_conflicts_p, 0);
@@ -1238,6 +2181,8 @@ void Init_rugged_index(void)
 	rb_define_method(rb_cRuggedIndex, "add", rb_git_index_add, 1);
 	rb_define_method(rb_cRuggedIndex, "update", rb_git_index_add, 1);
 	rb_define_method(rb_cRuggedIndex, "<<", rb_git_index_add, 1);
+	rb_define_method(rb_cRuggedIndex, "add_entries", rb_git_index_add_entries, -1);
+	rb_define_method(rb_cRuggedIndex, "apply_changes", rb_git_index_apply_changes, -1);
 
 	rb_define_method(rb_cRuggedIndex, "remove", rb_git_index_remove, -1);
 	rb_define_method(rb_cRuggedIndex, "remove_dir", rb_git_index_remove_directory, -1);
@@ -1252,4 +2197,22 @@ void Init_rugged_index(void)
 	rb_const_set(rb_cRuggedIndex, rb_intern("ENTRY_FLAGS_STAGE"), INT2FIX(GIT_IDXENTRY_STAGEMASK));
 	rb_const_set(rb_cRuggedIndex, rb_intern("ENTRY_FLAGS_STAGE_SHIFT"), INT2FIX(GIT_IDXENTRY_STAGESHIFT));
 	rb_const_set(rb_cRuggedIndex, rb_intern("ENTRY_FLAGS_VALID"), INT2FIX(GIT_IDXENTRY_VALID));
+
+	rb_cRuggedIndexEntry = rb_define_class_under(rb_cRuggedIndex, "Entry", rb_cObject);
+	rb_undef_alloc_func(rb_cRuggedIndexEntry);
+
+	rb_define_method(rb_cRuggedIndexEntry, "path", rb_git_indexentry_path, 0);
+	rb_define_method(rb_cRuggedIndexEntry, "oid", rb_git_indexentry_oid, 0);
+	rb_define_method(rb_cRuggedIndexEntry, "dev", rb_git_indexentry_dev, 0);
+	rb_define_method(rb_cRuggedIndexEntry, "ino", rb_git_indexentry_ino, 0);
+	rb_define_method(rb_cRuggedIndexEntry, "mode", rb_git_indexentry_mode, 0);
+	rb_define_method(rb_cRuggedIndexEntry, "gid", rb_git_indexentry_gid, 0);
+	rb_define_method(rb_cRuggedIndexEntry, "uid", rb_git_indexentry_uid, 0);
+	rb_define_method(rb_cRuggedIndexEntry, "file_size", rb_git_indexentry_file_size, 0);
+	rb_define_method(rb_cRuggedIndexEntry, "valid?", rb_git_indexentry_valid, 0);
+	rb_define_method(rb_cRuggedIndexEntry, "stage", rb_git_indexentry_stage, 0);
+	rb_define_method(rb_cRuggedIndexEntry, "ctime", rb_git_indexentry_ctime, 0);
+	rb_define_method(rb_cRuggedIndexEntry, "mtime", rb_git_indexentry_mtime, 0);
+	rb_define_method(rb_cRuggedIndexEntry, "[]", rb_git_indexentry_aref, 1);
+	rb_define_method(rb_cRuggedIndexEntry, "to_h", rb_git_indexentry_to_h, 0);
 }
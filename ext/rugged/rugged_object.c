@@ -93,6 +93,8 @@ int rugged_oid_get(git_oid *oid, git_repository *repo, VALUE p)
 	if (rb_obj_is_kind_of(p, rb_cRuggedObject)) {
 		Data_Get_Struct(p, git_object, object);
 		git_oid_cpy(oid, git_object_id(object));
+	} else if (rugged_oid_is_raw(p)) {
+		git_oid_fromraw(oid, (const unsigned char *)RSTRING_PTR(p));
 	} else {
 		Check_Type(p, T_STRING);
 
@@ -120,20 +122,17 @@ git_object *rugged_object_get(git_repository *repo, VALUE object_value, git_otyp
 		Data_Get_Struct(object_value, git_object, owned_obj);
 		git_object_dup(&object, owned_obj);
 	} else {
+		git_oid oid;
 		int error;
 
 		Check_Type(object_value, T_STRING);
 
-		/* Fast path: if we have a 40-char string, just perform the lookup directly */
-		if (RSTRING_LEN(object_value) == 40) {
-			git_oid oid;
-
-			/* If it's not an OID, we can still try the revparse */
-			if (git_oid_fromstr(&oid, RSTRING_PTR(object_value)) == 0) {
-				error = git_object_lookup(&object, repo, &oid, type);
-				rugged_exception_check(error);
-				return object;
-			}
+		/* Fast path: if we have a full OID, just perform the lookup directly */
+		if ((rugged_oid_is_raw(object_value) || RSTRING_LEN(object_value) == 40) &&
+			rugged_oid_fromstr(&oid, object_value) == 0) {
+			error = git_object_lookup(&object, repo, &oid, type);
+			rugged_exception_check(error);
+			return object;
 		}
 
 		/* Otherwise, assume the string is a revlist and try to parse it */
@@ -181,8 +180,14 @@ VALUE rugged_object_new(VALUE owner, git_object *object)
 			return Qnil; /* never reached */
 	}
 
-	rb_object = Data_Wrap_Struct(klass, NULL, &rb_git_object__free, object);
+	/*
+	 * The object is only handed over once nothing can raise anymore, so
+	 * the caller still owns it if this function raises.
+	 */
+	rb_object = Data_Wrap_Struct(klass, NULL, &rb_git_object__free, NULL);
 	rugged_set_owner(rb_object, owner);
+	DATA_PTR(rb_object) = object;
+
 	return rb_object;
 }
 
@@ -220,7 +225,7 @@ VALUE rb_git_object_lookup(VALUE klass, VALUE rb_repo, VALUE rb_hex)
 	git_otype type;
 	git_oid oid;
 	int error;
-	int oid_length;
+	size_t oid_length;
 
 	git_repository *repo;
 
@@ -230,16 +235,15 @@ VALUE rb_git_object_lookup(VALUE klass, VALUE rb_repo, VALUE rb_hex)
 		type = GIT_OBJ_ANY;
 
 	Check_Type(rb_hex, T_STRING);
-	oid_length = (int)RSTRING_LEN(rb_hex);
 
 	rugged_check_repo(rb_repo);
 
-	if (oid_length > GIT_OID_HEXSZ)
+	if (RSTRING_LEN(rb_hex) > GIT_OID_HEXSZ)
 		rb_raise(rb_eTypeError, "The given OID is too long");
 
 	Data_Get_Struct(rb_repo, git_repository, repo);
 
-	error = git_oid_fromstrn(&oid, RSTRING_PTR(rb_hex), oid_length);
+	error = rugged_oid_fromstrn(&oid, &oid_length, rb_hex);
 	rugged_exception_check(error);
 
 	if (oid_length < GIT_OID_HEXSZ)
@@ -105,9 +105,7 @@ VALUE rugged_patch_new(VALUE owner, git_patch *patch)
 static VALUE rb_git_diff_patch_each_hunk(VALUE self)
 {
 	git_patch *patch;
-	const git_diff_hunk *hunk;
-	size_t lines_in_hunk;
-	int error = 0;
+	int lines_in_hunk, error = 0;
 	size_t hunks_count, h;
 
 	if (!rb_block_given_p()) {
@@ -118,10 +116,13 @@ static VALUE rb_git_diff_patch_each_hunk(VALUE self)
 
 	hunks_count = git_patch_num_hunks(patch);
 	for (h = 0; h < hunks_count; ++h) {
-		error = git_patch_get_hunk(&hunk, &lines_in_hunk, patch, h);
-		if (error) break;
+		lines_in_hunk = git_patch_num_lines_in_hunk(patch, h);
+		if (lines_in_hunk < 0) {
+			error = lines_in_hunk;
+			break;
+		}
 
-		rb_yield(rugged_diff_hunk_new(self, h, hunk, lines_in_hunk));
+		rb_yield(rugged_diff_hunk_new(self, h, (size_t)lines_in_hunk));
 	}
 	rugged_exception_check(error);
 
@@ -190,6 +191,25 @@ static VALUE rb_git_diff_patch_lines(VALUE self)
 	return INT2FIX(context + adds + dels);
 }
 
+/*
+ *  call-seq:
+ *    patch.lines_columnar -> line_table
+ *
+ *  Returns a Rugged::Diff::LineTable with all the lines of all the hunks
+ *  in the patch.
+ *
+ *  Unlike iterating the hunks with #each_hunk and Hunk#each_line, no
+ *  Rugged::Diff::Line object is created for each line. Instead, the line
+ *  origins, line numbers and contents are packed into a handful of strings.
+ */
+static VALUE rb_git_diff_patch_lines_columnar(VALUE self)
+{
+	git_patch *patch;
+	Data_Get_Struct(self, git_patch, patch);
+
+	return rugged_diff_line_table_new(patch, 0, git_patch_num_hunks(patch));
+}
+
 static int patch_print_cb(
 	const git_diff_delta *delta,
 	const git_diff_hunk *hunk,
@@ -235,6 +255,7 @@ void Init_rugged_patch(void)
 
 	rb_define_method(rb_cRuggedPatch, "stat", rb_git_diff_patch_stat, 0);
 	rb_define_method(rb_cRuggedPatch, "lines", rb_git_diff_patch_lines, 0);
+	rb_define_method(rb_cRuggedPatch, "lines_columnar", rb_git_diff_patch_lines_columnar, 0);
 
 	rb_define_method(rb_cRuggedPatch, "delta", rb_git_diff_patch_delta, 0);
 
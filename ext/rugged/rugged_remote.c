@@ -31,30 +31,53 @@ VALUE rb_cRuggedRemote;
 
 #define RUGGED_REMOTE_CALLBACKS_INIT {1, progress_cb, NULL, credentials_cb, NULL, transfer_progress_cb, update_tips_cb, NULL}
 
-static int progress_cb(const char *str, int len, void *data)
+struct progress_cb_args
 {
-	struct rugged_remote_cb_payload *payload = data;
-	VALUE args = rb_ary_new2(2);
+	struct rugged_remote_cb_payload *payload;
+	const char *str;
+	int len;
+};
 
-	if (NIL_P(payload->progress))
-		return 0;
+static void *progress_cb_gvl(void *data)
+{
+	struct progress_cb_args *cb_args = data;
+	struct rugged_remote_cb_payload *payload = cb_args->payload;
+	VALUE args = rb_ary_new2(2);
 
 	rb_ary_push(args, payload->progress);
-	rb_ary_push(args, rb_str_new(str, len));
+	rb_ary_push(args, rb_str_new(cb_args->str, cb_args->len));
 
 	rb_protect(rugged__block_yield_splat, args, &payload->exception);
 
-	return payload->exception ? GIT_ERROR : GIT_OK;
+	return NULL;
 }
 
-static int transfer_progress_cb(const git_transfer_progress *stats, void *data)
+static int progress_cb(const char *str, int len, void *data)
 {
 	struct rugged_remote_cb_payload *payload = data;
-	VALUE args = rb_ary_new2(5);
+	struct progress_cb_args cb_args = { payload, str, len };
 
-	if (NIL_P(payload->transfer_progress))
+	if (NIL_P(payload->progress))
 		return 0;
 
+	rugged_with_gvl(progress_cb_gvl, &cb_args);
+
+	return payload->exception ? GIT_ERROR : GIT_OK;
+}
+
+struct transfer_progress_cb_args
+{
+	struct rugged_remote_cb_payload *payload;
+	const git_transfer_progress *stats;
+};
+
+static void *transfer_progress_cb_gvl(void *data)
+{
+	struct transfer_progress_cb_args *cb_args = data;
+	struct rugged_remote_cb_payload *payload = cb_args->payload;
+	const git_transfer_progress *stats = cb_args->stats;
+	VALUE args = rb_ary_new2(5);
+
 	rb_ary_push(args, payload->transfer_progress);
 	rb_ary_push(args, UINT2NUM(stats->total_objects));
 	rb_ary_push(args, UINT2NUM(stats->indexed_objects));
@@ -66,24 +89,56 @@ static int transfer_progress_cb(const git_transfer_progress *stats, void *data)
 
 	rb_protect(rugged__block_yield_splat, args, &payload->exception);
 
-	return payload->exception ? GIT_ERROR : GIT_OK;
+	return NULL;
 }
 
-static int update_tips_cb(const char *refname, const git_oid *src, const git_oid *dest, void *data)
+static int transfer_progress_cb(const git_transfer_progress *stats, void *data)
 {
 	struct rugged_remote_cb_payload *payload = data;
-	VALUE args = rb_ary_new2(4);
+	struct transfer_progress_cb_args cb_args = { payload, stats };
 
-	if (NIL_P(payload->update_tips))
+	if (NIL_P(payload->transfer_progress))
 		return 0;
 
+	rugged_with_gvl(transfer_progress_cb_gvl, &cb_args);
+
+	return payload->exception ? GIT_ERROR : GIT_OK;
+}
+
+struct update_tips_cb_args
+{
+	struct rugged_remote_cb_payload *payload;
+	const char *refname;
+	const git_oid *src;
+	const git_oid *dest;
+};
+
+static void *update_tips_cb_gvl(void *data)
+{
+	struct update_tips_cb_args *cb_args = data;
+	struct rugged_remote_cb_payload *payload = cb_args->payload;
+	VALUE args = rb_ary_new2(4);
+
 	rb_ary_push(args, payload->update_tips);
-	rb_ary_push(args, rb_str_new_utf8(refname));
-	rb_ary_push(args, git_oid_iszero(src) ? Qnil : rugged_create_oid(src));
-	rb_ary_push(args, git_oid_iszero(dest) ? Qnil : rugged_create_oid(dest));
+	rb_ary_push(args, rb_str_new_utf8(cb_args->refname));
+	rb_ary_push(args, git_oid_iszero(cb_args->src) ? Qnil : rugged_create_oid(cb_args->src));
+	rb_ary_push(args, git_oid_iszero(cb_args->dest) ? Qnil : rugged_create_oid(cb_args->dest));
 
 	rb_protect(rugged__block_yield_splat, args, &payload->exception);
 
+	return NULL;
+}
+
+static int update_tips_cb(const char *refname, const git_oid *src, const git_oid *dest, void *data)
+{
+	struct rugged_remote_cb_payload *payload = data;
+	struct update_tips_cb_args cb_args = { payload, refname, src, dest };
+
+	if (NIL_P(payload->update_tips))
+		return 0;
+
+	rugged_with_gvl(update_tips_cb_gvl, &cb_args);
+
 	return payload->exception ? GIT_ERROR : GIT_OK;
 }
 
@@ -94,6 +149,7 @@ struct extract_cred_args
 	const char *url;
 	const char *username_from_url;
 	unsigned int allowed_types;
+	int *exception;
 };
 
 static VALUE allowed_types_to_rb_ary(int allowed_types) {
@@ -126,6 +182,14 @@ static VALUE extract_cred(VALUE data) {
 	return Qnil;
 }
 
+static void *extract_cred_gvl(void *data) {
+	struct extract_cred_args *args = data;
+
+	rb_protect(extract_cred, (VALUE)args, args->exception);
+
+	return NULL;
+}
+
 static int credentials_cb(
 	git_cred **cred,
 	const char *url,
@@ -135,13 +199,14 @@ static int credentials_cb(
 {
 	struct rugged_remote_cb_payload *payload = data;
 	struct extract_cred_args args = {
-		payload->credentials, cred, url, username_from_url, allowed_types
+		payload->credentials, cred, url, username_from_url, allowed_types,
+		&payload->exception
 	};
 
 	if (NIL_P(payload->credentials))
 		return GIT_PASSTHROUGH;
 
-	rb_protect(extract_cred, (VALUE)&args, &payload->exception);
+	rugged_with_gvl(extract_cred_gvl, &args);
 
 	return payload->exception ? GIT_ERROR : GIT_OK;
 }
@@ -564,6 +629,21 @@ cleanup:
 	return Qfalse;
 }
 
+struct rugged_remote_fetch_args {
+	git_remote *remote;
+	const git_strarray *refspecs;
+	const git_signature *signature;
+	const char *log_message;
+	int error;
+};
+
+static void *rugged__remote_fetch_nogvl(void *data)
+{
+	struct rugged_remote_fetch_args *args = data;
+	args->error = git_remote_fetch(args->remote, args->refspecs, args->signature, args->log_message);
+	return NULL;
+}
+
 /*
  *  call-seq:
  *    remote.fetch(refspecs = nil, options = {}) -> hash
@@ -619,9 +699,10 @@ static VALUE rb_git_remote_fetch(int argc, VALUE *argv, VALUE self)
 	git_strarray refspecs;
 	git_remote_callbacks callbacks = GIT_REMOTE_CALLBACKS_INIT;
 	struct rugged_remote_cb_payload payload = { Qnil, Qnil, Qnil, Qnil, Qnil, 0 };
+	struct rugged_remote_fetch_args args;
 
 	char *log_message = NULL;
-	int error;
+	int error, interrupt = 0;
 
 	VALUE rb_options, rb_refspecs, rb_result = Qnil, rb_repo = rugged_owner(self);
 
@@ -648,7 +729,15 @@ static VALUE rb_git_remote_fetch(int argc, VALUE *argv, VALUE self)
 	if ((error = git_remote_set_callbacks(remote, &callbacks)))
 		goto cleanup;
 
-	if ((error = git_remote_fetch(remote, &refspecs, signature, log_message)) == GIT_OK) {
+	args.remote = remote;
+	args.refspecs = &refspecs;
+	args.signature = signature;
+	args.log_message = log_message;
+
+	args.error = GIT_OK;
+	interrupt = rugged_without_gvl_io(rugged__remote_fetch_nogvl, &args, 0);
+
+	if ((error = args.error) == GIT_OK && !interrupt) {
 		const git_transfer_progress *stats = git_remote_stats(remote);
 
 		rb_result = rb_hash_new();
@@ -666,6 +755,9 @@ static VALUE rb_git_remote_fetch(int argc, VALUE *argv, VALUE self)
 	xfree(refspecs.strings);
 	git_signature_free(signature);
 
+	if (interrupt)
+		rb_jump_tag(interrupt);
+
 	if (payload.exception)
 		rb_jump_tag(payload.exception);
 
@@ -674,6 +766,18 @@ static VALUE rb_git_remote_fetch(int argc, VALUE *argv, VALUE self)
 	return rb_result;
 }
 
+struct rugged_push_finish_args {
+	git_push *push;
+	int error;
+};
+
+static void *rugged__push_finish_nogvl(void *data)
+{
+	struct rugged_push_finish_args *args = data;
+	args->error = git_push_finish(args->push);
+	return NULL;
+}
+
 static int push_status_cb(const char *ref, const char *msg, void *payload)
 {
 	VALUE rb_result_hash = (VALUE)payload;
@@ -729,10 +833,11 @@ static VALUE rb_git_remote_push(int argc, VALUE *argv, VALUE self)
 	git_push *push = NULL;
 	git_signature *signature = NULL;
 
-	int error = 0, i = 0;
+	int error = 0, i = 0, interrupt = 0;
 	char *log_message = NULL;
 
 	struct rugged_remote_cb_payload payload = { Qnil, Qnil, Qnil, Qnil, 0 };
+	struct rugged_push_finish_args finish_args;
 
 	rb_scan_args(argc, argv, "01:", &rb_refspecs, &rb_options);
 
@@ -800,7 +905,13 @@ static VALUE rb_git_remote_push(int argc, VALUE *argv, VALUE self)
 		if (error) goto cleanup;
 	}
 
-	if ((error = git_push_finish(push)))
+	finish_args.push = push;
+	finish_args.error = GIT_OK;
+
+	if ((interrupt = rugged_without_gvl_io(rugged__push_finish_nogvl, &finish_args, 0)))
+		goto cleanup;
+
+	if ((error = finish_args.error))
 		goto cleanup;
 
 	if ((error = git_push_status_foreach(push, &push_status_cb, (void *)rb_result)) ||
@@ -812,6 +923,9 @@ cleanup:
 	git_remote_free(tmp_remote);
 	git_signature_free(signature);
 
+	if (interrupt)
+		rb_jump_tag(interrupt);
+
 	if (!NIL_P(rb_exception))
 		rb_exc_raise(rb_exception);
 
@@ -154,6 +154,47 @@ VALUE rugged_repo_new(VALUE klass, git_repository *repo)
 	return rb_repo;
 }
 
+/*
+ * Open another handle on +repo+, for a native thread of its own: a
+ * git_repository can't be used by several threads at once. Returns
+ * GIT_PASSTHROUGH when the new handle wouldn't read the same objects,
+ * because +repo+ has no path on disk or its object database was given
+ * backends or alternates at runtime (see the +:alternates+ option of
+ * Repository.new). Never raises, so it can run without the GVL.
+ */
+int rugged_repository_reopen(git_repository **out, git_repository *repo)
+{
+	const char *path = git_repository_path(repo);
+	const char *workdir = git_repository_workdir(repo);
+	git_odb *odb = NULL, *other_odb = NULL;
+	int error;
+
+	*out = NULL;
+
+	if (!path)
+		return GIT_PASSTHROUGH;
+
+	if ((error = git_repository_open_bare(out, path)) < 0 ||
+		(workdir && (error = git_repository_set_workdir(*out, workdir, 0)) < 0) ||
+		(error = git_repository_odb(&odb, repo)) < 0 ||
+		(error = git_repository_odb(&other_odb, *out)) < 0)
+		goto done;
+
+	if (git_odb_num_backends(odb) != git_odb_num_backends(other_odb))
+		error = GIT_PASSTHROUGH;
+
+done:
+	git_odb_free(odb);
+	git_odb_free(other_odb);
+
+	if (error < 0) {
+		git_repository_free(*out);
+		*out = NULL;
+	}
+
+	return error;
+}
+
 static void load_alternates(git_repository *repo, VALUE rb_alternates)
 {
 	git_odb *odb = NULL;
@@ -312,6 +353,21 @@ static void parse_clone_options(git_clone_options *ret, VALUE rb_options, struct
 	ret->remote_callbacks = remote_callbacks;
 }
 
+struct rugged_clone_args {
+	git_repository *repo;
+	const char *url;
+	const char *local_path;
+	const git_clone_options *options;
+	int error;
+};
+
+static void *rugged__clone_nogvl(void *data)
+{
+	struct rugged_clone_args *args = data;
+	args->error = git_clone(&args->repo, args->url, args->local_path, args->options);
+	return NULL;
+}
+
 /*
  *  call-seq:
  *    Repository.clone_at(url, local_path[, options]) -> repository
@@ -365,8 +421,8 @@ static VALUE rb_git_repo_clone_at(int argc, VALUE *argv, VALUE klass)
 	VALUE url, local_path, rb_options_hash;
 	git_clone_options options = GIT_CLONE_OPTIONS_INIT;
 	struct rugged_remote_cb_payload remote_payload = { Qnil, Qnil, Qnil, Qnil, 0 };
-	git_repository *repo;
-	int error;
+	struct rugged_clone_args args;
+	int interrupt;
 
 	rb_scan_args(argc, argv, "21", &url, &local_path, &rb_options_hash);
 	Check_Type(url, T_STRING);
@@ -374,13 +430,22 @@ static VALUE rb_git_repo_clone_at(int argc, VALUE *argv, VALUE klass)
 
 	parse_clone_options(&options, rb_options_hash, &remote_payload);
 
-	error = git_clone(&repo, StringValueCStr(url), StringValueCStr(local_path), &options);
+	args.url = StringValueCStr(url);
+	args.local_path = StringValueCStr(local_path);
+	args.options = &options;
+	args.repo = NULL;
+	args.error = GIT_OK;
+
+	if ((interrupt = rugged_without_gvl_io(rugged__clone_nogvl, &args, 0))) {
+		git_repository_free(args.repo);
+		rb_jump_tag(interrupt);
+	}
 
 	if (RTEST(remote_payload.exception))
 		rb_jump_tag(remote_payload.exception);
-	rugged_exception_check(error);
+	rugged_exception_check(args.error);
 
-	return rugged_repo_new(klass, repo);
+	return rugged_repo_new(klass, args.repo);
 }
 
 #define RB_GIT_REPO_OWNED_GET(_klass, _object) \
@@ -474,6 +539,138 @@ static VALUE rb_git_repo_get_config(VALUE self)
 	RB_GIT_REPO_OWNED_GET(rb_cRuggedConfig, config);
 }
 
+struct rugged_graph_args {
+	git_repository *repo;
+	const git_oid *oids;
+	size_t count;
+	git_oid base;
+	git_oidarray bases;
+	size_t ahead, behind;
+	int error;
+	const rugged_commit_graph *graph;
+	uint32_t positions[2];
+	int bases_from_graph;
+};
+
+/*
+ * The commit-graph can answer a query when it covers both commits;
+ * its history is closed under parents, so it covers their ancestors too.
+ */
+static int rugged__graph_covers(struct rugged_graph_args *args)
+{
+	size_t i;
+
+	if (!args->graph || args->count != 2)
+		return 0;
+
+	for (i = 0; i < 2; ++i) {
+		if (rugged_commit_graph_lookup(&args->positions[i], args->graph, &args->oids[i]) < 0)
+			return 0;
+	}
+
+	return 1;
+}
+
+static void *rugged__merge_base_nogvl(void *data)
+{
+	struct rugged_graph_args *args = data;
+
+	if (rugged__graph_covers(args)) {
+		git_oid *bases;
+		size_t count;
+
+		args->error = rugged_commit_graph_merge_bases(&bases, &count,
+			args->graph, args->positions[0], args->positions[1]);
+
+		if (!args->error && count == 0)
+			args->error = GIT_ENOTFOUND;
+		else if (!args->error)
+			git_oid_cpy(&args->base, &bases[0]);
+
+		free(bases);
+		return NULL;
+	}
+
+	args->error = git_merge_base_many(&args->base, args->repo, args->count, args->oids);
+	return NULL;
+}
+
+static void *rugged__merge_bases_nogvl(void *data)
+{
+	struct rugged_graph_args *args = data;
+
+	if (rugged__graph_covers(args)) {
+		args->bases_from_graph = 1;
+		args->error = rugged_commit_graph_merge_bases(&args->bases.ids, &args->bases.count,
+			args->graph, args->positions[0], args->positions[1]);
+		return NULL;
+	}
+
+	args->error = git_merge_bases_many(&args->bases, args->repo, args->count, args->oids);
+	return NULL;
+}
+
+static void *rugged__descendant_of_nogvl(void *data)
+{
+	struct rugged_graph_args *args = data;
+
+	if (rugged__graph_covers(args)) {
+		args->error = rugged_commit_graph_descendant_of(args->graph, args->positions[0], args->positions[1]);
+		return NULL;
+	}
+
+	args->error = git_graph_descendant_of(args->repo, &args->oids[0], &args->oids[1]);
+	return NULL;
+}
+
+static void *rugged__ahead_behind_nogvl(void *data)
+{
+	struct rugged_graph_args *args = data;
+
+	if (rugged__graph_covers(args)) {
+		args->error = rugged_commit_graph_ahead_behind(&args->ahead, &args->behind,
+			args->graph, args->positions[0], args->positions[1]);
+		return NULL;
+	}
+
+	args->error = git_graph_ahead_behind(
+		&args->ahead, &args->behind, args->repo, &args->oids[0], &args->oids[1]);
+	return NULL;
+}
+
+/*
+ *  call-seq:
+ *    repo.commit_graph -> graph or nil
+ *
+ *  Return the Rugged::CommitGraph stored in the repository's
+ *  <tt>objects/info/commit-graph</tt> file, or +nil+ if there is no
+ *  usable one. Shallow repositories never use a commit-graph.
+ *
+ *  When present, the graph is used by #merge_base, #merge_bases,
+ *  #descendant_of? and #ahead_behind for the commits it covers.
+ *  The graph is loaded once; see #write_commit_graph.
+ */
+static VALUE rb_git_repo_commit_graph(VALUE self)
+{
+	git_repository *repo;
+	ID id_commit_graph = rb_intern("@commit_graph");
+	VALUE rb_graph = Qnil;
+
+	if (RTEST(rb_ivar_defined(self, id_commit_graph)))
+		return rb_ivar_get(self, id_commit_graph);
+
+	Data_Get_Struct(self, git_repository, repo);
+
+	if (!git_repository_is_shallow(repo)) {
+		VALUE rb_path = rb_str_new_utf8(git_repository_path(repo));
+		rb_str_cat2(rb_path, "objects/info/commit-graph");
+		rb_graph = rugged_commit_graph_open(self, StringValueCStr(rb_path));
+	}
+
+	rb_ivar_set(self, id_commit_graph, rb_graph);
+	return rb_graph;
+}
+
 /*
  *  call-seq:
  *    repo.merge_base(oid1, oid2, ...)
@@ -487,8 +684,10 @@ static VALUE rb_git_repo_merge_base(VALUE self, VALUE rb_args)
 {
 	int error = GIT_OK, i;
 	git_repository *repo;
-	git_oid base, *input_array = xmalloc(sizeof(git_oid) * RARRAY_LEN(rb_args));
+	git_oid *input_array = xmalloc(sizeof(git_oid) * RARRAY_LEN(rb_args));
 	int len = (int)RARRAY_LEN(rb_args);
+	struct rugged_graph_args args = { NULL };
+	VALUE rb_graph = rb_git_repo_commit_graph(self);
 
 	if (len < 2)
 		rb_raise(rb_eArgError, "wrong number of arguments (%d for 2+)", len);
@@ -504,15 +703,21 @@ static VALUE rb_git_repo_merge_base(VALUE self, VALUE rb_args)
 		rugged_exception_check(error);
 	}
 
-	error = git_merge_base_many(&base, repo, len, input_array);
+	args.repo = repo;
+	args.oids = input_array;
+	args.count = len;
+	args.graph = rugged_commit_graph_get(rb_graph);
+
+	rugged_without_gvl(rugged__merge_base_nogvl, &args);
+	RB_GC_GUARD(rb_graph);
 	xfree(input_array);
 
-	if (error == GIT_ENOTFOUND)
+	if (args.error == GIT_ENOTFOUND)
 		return Qnil;
 
-	rugged_exception_check(error);
+	rugged_exception_check(args.error);
 
-	return rugged_create_oid(&base);
+	return rugged_create_oid(&args.base);
 }
 
 /*
@@ -528,11 +733,11 @@ static VALUE rb_git_repo_merge_bases(VALUE self, VALUE rb_args)
 {
 	int error = GIT_OK, i;
 	git_repository *repo;
-	git_oidarray bases = {NULL, 0};
 	git_oid *input_array = xmalloc(sizeof(git_oid) * RARRAY_LEN(rb_args));
 	int len = (int)RARRAY_LEN(rb_args);
+	struct rugged_graph_args args = { NULL, NULL, 0, {{0}}, {NULL, 0} };
 
-	VALUE rb_bases;
+	VALUE rb_bases, rb_graph = rb_git_repo_commit_graph(self);
 
 	if (len < 2)
 		rb_raise(rb_eArgError, "wrong number of arguments (%d for 2+)", len);
@@ -548,19 +753,28 @@ static VALUE rb_git_repo_merge_bases(VALUE self, VALUE rb_args)
 		rugged_exception_check(error);
 	}
 
-	error = git_merge_bases_many(&bases, repo, len, input_array);
+	args.repo = repo;
+	args.oids = input_array;
+	args.count = len;
+	args.graph = rugged_commit_graph_get(rb_graph);
+
+	rugged_without_gvl(rugged__merge_bases_nogvl, &args);
+	RB_GC_GUARD(rb_graph);
 	xfree(input_array);
 
-	if (error != GIT_ENOTFOUND)
-		rugged_exception_check(error);
+	if (args.error != GIT_ENOTFOUND)
+		rugged_exception_check(args.error);
 
-	rb_bases = rb_ary_new2(bases.count);
+	rb_bases = rb_ary_new2(args.bases.count);
 
-	for (i = 0; i < bases.count; ++i) {
-		rb_ary_push(rb_bases, rugged_create_oid(&bases.ids[i]));
+	for (i = 0; i < args.bases.count; ++i) {
+		rb_ary_push(rb_bases, rugged_create_oid(&args.bases.ids[i]));
 	}
 
-	git_oidarray_free(&bases);
+	if (args.bases_from_graph)
+		free(args.bases.ids);
+	else
+		git_oidarray_free(&args.bases);
 
 	return rb_bases;
 }
@@ -637,6 +851,22 @@ static VALUE rb_git_repo_merge_analysis(int argc, VALUE *argv, VALUE self)
 	return result;
 }
 
+struct rugged_merge_commits_args {
+	git_index *index;
+	git_repository *repo;
+	const git_commit *our_commit;
+	const git_commit *their_commit;
+	const git_merge_options *opts;
+	int error;
+};
+
+static void *rugged__merge_commits_nogvl(void *data)
+{
+	struct rugged_merge_commits_args *args = data;
+	args->error = git_merge_commits(&args->index, args->repo, args->our_commit, args->their_commit, args->opts);
+	return NULL;
+}
+
 /*
  *  call-seq:
  *    repo.merge_commits(our_commit, their_commit, options = {}) -> index
@@ -651,9 +881,9 @@ static VALUE rb_git_repo_merge_commits(int argc, VALUE *argv, VALUE self)
 {
 	VALUE rb_our_commit, rb_their_commit, rb_options;
 	git_commit *our_commit, *their_commit;
-	git_index *index;
 	git_repository *repo;
 	git_merge_options opts = GIT_MERGE_OPTIONS_INIT;
+	struct rugged_merge_commits_args args;
 
 	rb_scan_args(argc, argv, "20:", &rb_our_commit, &rb_their_commit, &rb_options);
 
@@ -682,9 +912,15 @@ static VALUE rb_git_repo_merge_commits(int argc, VALUE *argv, VALUE self)
 	Data_Get_Struct(rb_our_commit, git_commit, our_commit);
 	Data_Get_Struct(rb_their_commit, git_commit, their_commit);
 
-	rugged_exception_check(git_merge_commits(&index, repo, our_commit, their_commit, &opts));
+	args.repo = repo;
+	args.our_commit = our_commit;
+	args.their_commit = their_commit;
+	args.opts = &opts;
+
+	rugged_without_gvl(rugged__merge_commits_nogvl, &args);
+	rugged_exception_check(args.error);
 
-	return rugged_index_new(rb_cRuggedIndex, self, index);
+	return rugged_index_new(rb_cRuggedIndex, self, args.index);
 }
 
 /*
@@ -703,18 +939,19 @@ static VALUE rb_git_repo_exists(VALUE self, VALUE hex)
 	git_repository *repo;
 	git_odb *odb;
 	git_oid oid;
+	size_t len;
 	int error;
 
 	Data_Get_Struct(self, git_repository, repo);
 	Check_Type(hex, T_STRING);
 
-	error = git_oid_fromstrn(&oid, RSTRING_PTR(hex), RSTRING_LEN(hex));
+	error = rugged_oid_fromstrn(&oid, &len, hex);
 	rugged_exception_check(error);
 
 	error = git_repository_odb(&odb, repo);
 	rugged_exception_check(error);
 
-	error = git_odb_exists_prefix(NULL, odb, &oid, RSTRING_LEN(hex));
+	error = git_odb_exists_prefix(NULL, odb, &oid, len);
 	git_odb_free(odb);
 
 	if (error == 0 || error == GIT_EAMBIGUOUS)
@@ -738,12 +975,231 @@ static VALUE rb_git_repo_read(VALUE self, VALUE hex)
 	Data_Get_Struct(self, git_repository, repo);
 	Check_Type(hex, T_STRING);
 
-	error = git_oid_fromstr(&oid, StringValueCStr(hex));
+	error = rugged_oid_fromstr(&oid, hex);
 	rugged_exception_check(error);
 
 	return rugged_raw_read(repo, &oid);
 }
 
+struct rugged_read_many_args {
+	VALUE owner;
+	git_repository *repo;
+	git_oid *oids;
+	size_t *lengths;
+	void **results;
+	size_t count;
+	int error;
+};
+
+/*
+ * Validate and parse an Array of (possibly abbreviated) hex OIDs. Raises
+ * before allocating anything, so the caller only needs to free the
+ * returned buffers once this function has returned.
+ */
+static void rugged__parse_oid_array(VALUE rb_oids, struct rugged_read_many_args *args)
+{
+	size_t i;
+	int error = 0;
+
+	Check_Type(rb_oids, T_ARRAY);
+	args->count = RARRAY_LEN(rb_oids);
+
+	for (i = 0; i < args->count; ++i) {
+		VALUE rb_oid = rb_ary_entry(rb_oids, i);
+
+		Check_Type(rb_oid, T_STRING);
+		if (RSTRING_LEN(rb_oid) > GIT_OID_HEXSZ)
+			rb_raise(rb_eTypeError, "The given OID is too long");
+	}
+
+	args->oids = xcalloc(args->count, sizeof(git_oid));
+	args->lengths = xcalloc(args->count, sizeof(size_t));
+	args->results = xcalloc(args->count, sizeof(void *));
+
+	for (i = 0; !error && i < args->count; ++i) {
+		VALUE rb_oid = rb_ary_entry(rb_oids, i);
+
+		error = rugged_oid_fromstrn(&args->oids[i], &args->lengths[i], rb_oid);
+	}
+
+	if (error) {
+		xfree(args->oids);
+		xfree(args->lengths);
+		xfree(args->results);
+		rugged_exception_check(error);
+	}
+}
+
+static void *rugged__read_many_nogvl(void *data)
+{
+	struct rugged_read_many_args *args = data;
+	git_odb *odb;
+	size_t i;
+
+	if ((args->error = git_repository_odb(&odb, args->repo)) < 0)
+		return NULL;
+
+	for (i = 0; !args->error && i < args->count; ++i) {
+		git_odb_object **obj = (git_odb_object **)&args->results[i];
+
+		if (args->lengths[i] < GIT_OID_HEXSZ)
+			args->error = git_odb_read_prefix(obj, odb, &args->oids[i], args->lengths[i]);
+		else
+			args->error = git_odb_read(obj, odb, &args->oids[i]);
+	}
+
+	git_odb_free(odb);
+	return NULL;
+}
+
+static void *rugged__lookup_many_nogvl(void *data)
+{
+	struct rugged_read_many_args *args = data;
+	size_t i;
+
+	for (i = 0; !args->error && i < args->count; ++i) {
+		git_object **obj = (git_object **)&args->results[i];
+
+		if (args->lengths[i] < GIT_OID_HEXSZ)
+			args->error = git_object_lookup_prefix(obj, args->repo, &args->oids[i], args->lengths[i], GIT_OBJ_ANY);
+		else
+			args->error = git_object_lookup(obj, args->repo, &args->oids[i], GIT_OBJ_ANY);
+	}
+
+	return NULL;
+}
+
+/*
+ * The objects still in +results+ are owned by the args; each one is taken
+ * out as soon as a Ruby object owns it, so that the cleanup can free the
+ * others if building the result raises.
+ */
+static VALUE rugged__read_many_body(VALUE data)
+{
+	struct rugged_read_many_args *args = (struct rugged_read_many_args *)data;
+	VALUE rb_result, rb_object;
+	size_t i;
+
+	rugged_without_gvl(rugged__read_many_nogvl, args);
+
+	if (args->error)
+		return Qnil;
+
+	rb_result = rb_ary_new2(args->count);
+	for (i = 0; i < args->count; ++i) {
+		rb_object = Data_Wrap_Struct(rb_cRuggedOdbObject, NULL, rb_git__odbobj_free, args->results[i]);
+		args->results[i] = NULL;
+		rb_ary_push(rb_result, rb_object);
+	}
+
+	return rb_result;
+}
+
+static VALUE rugged__read_many_cleanup(VALUE data)
+{
+	struct rugged_read_many_args *args = (struct rugged_read_many_args *)data;
+	size_t i;
+
+	for (i = 0; i < args->count; ++i)
+		git_odb_object_free(args->results[i]);
+
+	xfree(args->oids);
+	xfree(args->lengths);
+	xfree(args->results);
+
+	return Qnil;
+}
+
+static VALUE rugged__lookup_many_body(VALUE data)
+{
+	struct rugged_read_many_args *args = (struct rugged_read_many_args *)data;
+	VALUE rb_result, rb_object;
+	size_t i;
+
+	rugged_without_gvl(rugged__lookup_many_nogvl, args);
+
+	if (args->error)
+		return Qnil;
+
+	rb_result = rb_ary_new2(args->count);
+	for (i = 0; i < args->count; ++i) {
+		rb_object = rugged_object_new(args->owner, args->results[i]);
+		args->results[i] = NULL;
+		rb_ary_push(rb_result, rb_object);
+	}
+
+	return rb_result;
+}
+
+static VALUE rugged__lookup_many_cleanup(VALUE data)
+{
+	struct rugged_read_many_args *args = (struct rugged_read_many_args *)data;
+	size_t i;
+
+	for (i = 0; i < args->count; ++i)
+		git_object_free(args->results[i]);
+
+	xfree(args->oids);
+	xfree(args->lengths);
+	xfree(args->results);
+
+	return Qnil;
+}
+
+/*
+ *  call-seq:
+ *    repo.read_many(oids) -> Array
+ *
+ *  Read the raw data of all the objects identified by the Array of +oids+,
+ *  returning an Array of Rugged::OdbObject instances in the same order.
+ *
+ *  All objects are read through a single object database handle, which is
+ *  much cheaper than calling #read once per object. Abbreviated OIDs are
+ *  supported. Raises if any of the objects cannot be read.
+ */
+static VALUE rb_git_repo_read_many(VALUE self, VALUE rb_oids)
+{
+	struct rugged_read_many_args args = { Qnil };
+	VALUE rb_result;
+
+	Data_Get_Struct(self, git_repository, args.repo);
+	rugged__parse_oid_array(rb_oids, &args);
+
+	rb_result = rb_ensure(rugged__read_many_body, (VALUE)&args,
+		rugged__read_many_cleanup, (VALUE)&args);
+	rugged_exception_check(args.error);
+
+	return rb_result;
+}
+
+/*
+ *  call-seq:
+ *    repo.lookup_many(oids) -> Array
+ *
+ *  Look up all the objects identified by the Array of +oids+, returning an
+ *  Array with one of the four classes that inherit from Rugged::Object for
+ *  each of them, in the same order.
+ *
+ *  This resolves every object in a single call, and is much cheaper than
+ *  calling #lookup once per object. Abbreviated OIDs are supported.
+ *  Raises if any of the objects cannot be found.
+ */
+static VALUE rb_git_repo_lookup_many(VALUE self, VALUE rb_oids)
+{
+	struct rugged_read_many_args args = { Qnil };
+	VALUE rb_result;
+
+	args.owner = self;
+	Data_Get_Struct(self, git_repository, args.repo);
+	rugged__parse_oid_array(rb_oids, &args);
+
+	rb_result = rb_ensure(rugged__lookup_many_body, (VALUE)&args,
+		rugged__lookup_many_cleanup, (VALUE)&args);
+	rugged_exception_check(args.error);
+
+	return rb_result;
+}
+
 /*
  *  call-seq:
  *    repo.read_header(oid) -> hash
@@ -772,7 +1228,7 @@ static VALUE rb_git_repo_read_header(VALUE self, VALUE hex)
 	Data_Get_Struct(self, git_repository, repo);
 	Check_Type(hex, T_STRING);
 
-	error = git_oid_fromstr(&oid, StringValueCStr(hex));
+	error = rugged_oid_fromstr(&oid, hex);
 	rugged_exception_check(error);
 
 	error = git_repository_odb(&odb, repo);
@@ -810,6 +1266,7 @@ static VALUE rb_git_repo_expand_oids(int argc, VALUE *argv, VALUE self)
 	git_repository *repo;
 	git_oid oid;
 	git_odb *odb;
+	size_t len;
 	int i, error;
 
 	Data_Get_Struct(self, git_repository, repo);
@@ -833,13 +1290,13 @@ static VALUE rb_git_repo_expand_oids(int argc, VALUE *argv, VALUE self)
 			rb_raise(rb_eTypeError, "Expected a SHA1 OID");
 		}
 
-		error = git_oid_fromstrn(&oid, RSTRING_PTR(hex_oid), RSTRING_LEN(hex_oid));
+		error = rugged_oid_fromstrn(&oid, &len, hex_oid);
 		if (error < 0) {
 			git_odb_free(odb);
 			rugged_exception_check(error);
 		}
 
-		error = git_odb_exists_prefix(&found_oid, odb, &oid, RSTRING_LEN(hex_oid));
+		error = git_odb_exists_prefix(&found_oid, odb, &oid, len);
 
 		if (!error) {
 			if (expected_type != GIT_OBJ_ANY) {
@@ -871,23 +1328,30 @@ static VALUE rb_git_repo_expand_oids(int argc, VALUE *argv, VALUE self)
  */
 static VALUE rb_git_repo_descendant_of(VALUE self, VALUE rb_commit, VALUE rb_ancestor)
 {
-	int result;
 	int error;
 	git_repository *repo;
-	git_oid commit, ancestor;
+	git_oid oids[2];
+	struct rugged_graph_args args = { NULL };
+	VALUE rb_graph = rb_git_repo_commit_graph(self);
 
 	Data_Get_Struct(self, git_repository, repo);
 
-	error = rugged_oid_get(&commit, repo, rb_commit);
+	error = rugged_oid_get(&oids[0], repo, rb_commit);
 	rugged_exception_check(error);
 
-	error = rugged_oid_get(&ancestor, repo, rb_ancestor);
+	error = rugged_oid_get(&oids[1], repo, rb_ancestor);
 	rugged_exception_check(error);
 
-	result = git_graph_descendant_of(repo, &commit, &ancestor);
-	rugged_exception_check(result);
+	args.repo = repo;
+	args.oids = oids;
+	args.count = 2;
+	args.graph = rugged_commit_graph_get(rb_graph);
+
+	rugged_without_gvl(rugged__descendant_of_nogvl, &args);
+	RB_GC_GUARD(rb_graph);
+	rugged_exception_check(args.error);
 
-	return result ? Qtrue : Qfalse;
+	return args.error ? Qtrue : Qfalse;
 }
 
 /*
@@ -1263,6 +1727,168 @@ static int rugged__status_cb(const char *path, unsigned int flags, void *payload
 	return GIT_OK;
 }
 
+static int rugged__status_cache_cb(const char *path, unsigned int flags, void *payload)
+{
+	rb_hash_aset((VALUE)payload, rb_str_new_utf8(path), UINT2NUM(flags));
+	return GIT_OK;
+}
+
+/*
+ * Drop the cached status of every changed path and of everything below
+ * it. Ignored or untracked directories reported as a whole are dropped
+ * as soon as anything inside them changes, and looked at again entirely.
+ */
+static int rugged__status_forget_i(VALUE rb_cached, VALUE rb_flags, VALUE rb_args)
+{
+	VALUE rb_changed = rb_ary_entry(rb_args, 0);
+	const char *cached = RSTRING_PTR(rb_cached);
+	long i, cached_len = RSTRING_LEN(rb_cached);
+
+	for (i = 0; i < RARRAY_LEN(rb_changed); ++i) {
+		VALUE rb_path = rb_ary_entry(rb_changed, i);
+		const char *path = RSTRING_PTR(rb_path);
+		long len = RSTRING_LEN(rb_path);
+
+		if (cached_len >= len && !memcmp(cached, path, len) &&
+			(cached_len == len || cached[len] == '/'))
+			return ST_DELETE;
+
+		if (cached_len > 0 && cached[cached_len - 1] == '/' &&
+			len > cached_len && !memcmp(path, cached, cached_len)) {
+			rb_ary_push(rb_ary_entry(rb_args, 1), rb_str_new(cached, cached_len - 1));
+			return ST_DELETE;
+		}
+	}
+
+	return ST_CONTINUE;
+}
+
+/*
+ * Status through the repository's file monitor: the status of the dirty
+ * files is kept between calls, and only the paths changed since the
+ * previous call are looked at again.
+ */
+static VALUE rugged__status_monitored(VALUE self, git_repository *repo, VALUE rb_monitor)
+{
+	ID id_status_cache = rb_intern("file_monitor_status");
+	VALUE rb_token, rb_changed, rb_cache, rb_paths;
+	int error;
+	long i;
+
+	rb_changed = rugged_file_monitor_changes(rb_monitor, self, RUGGED_FILE_MONITOR_GITDIR, &rb_token);
+	rb_cache = rb_attr_get(self, id_status_cache);
+
+	if (NIL_P(rb_changed) || NIL_P(rb_cache)) {
+		rb_cache = rb_hash_new();
+		error = git_status_foreach(repo, &rugged__status_cache_cb, (void *)rb_cache);
+	} else {
+		VALUE rb_args = rb_ary_new3(2, rb_changed, rb_ary_dup(rb_changed));
+		git_status_options opts = GIT_STATUS_OPTIONS_INIT;
+		char *path;
+
+		rb_cache = rb_hash_dup(rb_cache);
+		rb_hash_foreach(rb_cache, rugged__status_forget_i, rb_args);
+
+		opts.show = GIT_STATUS_SHOW_INDEX_AND_WORKDIR;
+		opts.flags = GIT_STATUS_OPT_DEFAULTS | GIT_STATUS_OPT_DISABLE_PATHSPEC_MATCH;
+		opts.pathspec.strings = &path;
+		opts.pathspec.count = 1;
+
+		/* one status per path, each only walking the trees down to that path */
+		rb_paths = rugged_file_monitor_outermost(rb_ary_entry(rb_args, 1));
+		error = 0;
+
+		for (i = 0; !error && i < RARRAY_LEN(rb_paths); ++i) {
+			VALUE rb_path = rb_ary_entry(rb_paths, i);
+
+			path = StringValueCStr(rb_path);
+			error = git_status_foreach_ext(repo, &opts, &rugged__status_cache_cb, (void *)rb_cache);
+		}
+	}
+
+	rugged_exception_check(error);
+
+	rb_ivar_set(self, id_status_cache, rb_cache);
+	rugged_file_monitor_sync(self, rb_monitor, rb_token);
+
+	rb_paths = rb_funcall(rb_funcall(rb_cache, rb_intern("keys"), 0), rb_intern("sort"), 0);
+
+	for (i = 0; i < RARRAY_LEN(rb_paths); ++i) {
+		VALUE rb_path = rb_ary_entry(rb_paths, i);
+		rb_yield_values(2, rb_str_dup(rb_path), flags_to_rb(NUM2UINT(rb_hash_aref(rb_cache, rb_path))));
+	}
+
+	return Qnil;
+}
+
+struct rugged_untracked_scan_args {
+	struct rugged_untracked_list *list;
+	struct rugged_untracked_cache *cache;
+	git_repository *repo;
+	int error;
+};
+
+static void *rugged__untracked_scan_nogvl(void *data)
+{
+	struct rugged_untracked_scan_args *args = data;
+	args->error = rugged_untracked_cache_scan(args->list, args->cache, args->repo);
+	return NULL;
+}
+
+/*
+ * Status through the untracked cache: libgit2 only compares the tracked
+ * files, and the untracked and ignored ones come from the cached walk.
+ * The comparison of the tracked files is as costly as without the cache.
+ */
+static VALUE rugged__status_untracked_cached(VALUE self, git_repository *repo, struct rugged_untracked_cache *cache)
+{
+	git_status_options opts = GIT_STATUS_OPTIONS_INIT;
+	struct rugged_untracked_list list;
+	struct rugged_untracked_scan_args args;
+	VALUE rb_statuses = rb_hash_new(), rb_paths;
+	size_t i;
+	int error;
+
+	memset(&list, 0, sizeof(list));
+
+	opts.show = GIT_STATUS_SHOW_INDEX_AND_WORKDIR;
+	opts.flags = GIT_STATUS_OPT_DEFAULTS & ~(GIT_STATUS_OPT_INCLUDE_UNTRACKED |
+		GIT_STATUS_OPT_RECURSE_UNTRACKED_DIRS | GIT_STATUS_OPT_INCLUDE_IGNORED);
+
+	error = git_status_foreach_ext(repo, &opts, &rugged__status_cache_cb, (void *)rb_statuses);
+
+	if (!error) {
+		args.list = &list;
+		args.cache = cache;
+		args.repo = repo;
+
+		rugged_without_gvl(rugged__untracked_scan_nogvl, &args);
+		error = args.error;
+	}
+
+	rugged_untracked_cache_release(cache);
+
+	for (i = 0; !error && i < list.count; ++i) {
+		VALUE rb_path = rb_str_new_utf8(list.paths + list.offsets[i]);
+		VALUE rb_flags = rb_hash_aref(rb_statuses, rb_path);
+
+		rb_hash_aset(rb_statuses, rb_path,
+			UINT2NUM(list.flags[i] | (NIL_P(rb_flags) ? 0 : NUM2UINT(rb_flags))));
+	}
+
+	rugged_untracked_list_free(&list);
+	rugged_exception_check(error);
+
+	rb_paths = rb_funcall(rb_funcall(rb_statuses, rb_intern("keys"), 0), rb_intern("sort"), 0);
+
+	for (i = 0; i < (size_t)RARRAY_LEN(rb_paths); ++i) {
+		VALUE rb_path = rb_ary_entry(rb_paths, i);
+		rb_yield_values(2, rb_path, flags_to_rb(NUM2UINT(rb_hash_aref(rb_statuses, rb_path))));
+	}
+
+	return Qnil;
+}
+
 /*
  *  call-seq:
  *    repo.status { |file, status_data| block }
@@ -1298,12 +1924,24 @@ static int rugged__status_cb(const char *path, unsigned int flags, void *payload
  *  +path+ must be relative to the repository's working directory.
  *
  *    repo.status('src/diff.c') #=> [:index_new, :worktree_new]
+ *
+ *  When a #file_monitor is set, iterating through the status only looks
+ *  at the files changed since the previous call.
+ *
+ *  Otherwise, when the +core.untrackedCache+ option is set, the listings
+ *  of the directories of the working directory are cached along with
+ *  their mtimes, and directories that didn't change since the previous
+ *  call are not read again to find untracked files. Tracked files are
+ *  still compared to the index one by one, so this only pays off when
+ *  untracked and ignored files make up much of the working directory.
+ *  The cache is saved next to the index by Index#write.
  */
 static VALUE rb_git_repo_status(int argc, VALUE *argv, VALUE self)
 {
 	int error;
-	VALUE rb_path;
+	VALUE rb_path, rb_monitor;
 	git_repository *repo;
+	struct rugged_untracked_cache *untracked_cache;
 
 	Data_Get_Struct(self, git_repository, repo);
 
@@ -1321,6 +1959,13 @@ static VALUE rb_git_repo_status(int argc, VALUE *argv, VALUE self)
 			"A block was expected for iterating through "
 			"the repository contents.");
 
+	rb_monitor = rugged_file_monitor_get(self);
+	if (!NIL_P(rb_monitor))
+		return rugged__status_monitored(self, repo, rb_monitor);
+
+	if ((untracked_cache = rugged_untracked_cache_acquire(self, repo)) != NULL)
+		return rugged__status_untracked_cached(self, repo, untracked_cache);
+
 	error = git_status_foreach(
 		repo,
 		&rugged__status_cb,
@@ -1331,41 +1976,59 @@ static VALUE rb_git_repo_status(int argc, VALUE *argv, VALUE self)
 	return Qnil;
 }
 
-static int rugged__each_id_cb(const git_oid *id, void *payload)
+struct rugged_each_id_payload {
+	int raw_oid;
+	int exception;
+};
+
+static int rugged__each_id_cb(const git_oid *id, void *data)
 {
-	int *exception = (int *)payload;
-	rb_protect(rb_yield, rugged_create_oid(id), exception);
-	return *exception ? GIT_ERROR : GIT_OK;
+	struct rugged_each_id_payload *payload = data;
+	rb_protect(rb_yield, rugged_create_oid_as(id, payload->raw_oid), &payload->exception);
+	return payload->exception ? GIT_ERROR : GIT_OK;
 }
 
 /*
  *  call-seq:
- *    repo.each_id { |id| block }
- *    repo.each_id -> Iterator
+ *    repo.each_id(options = {}) { |id| block }
+ *    repo.each_id(options = {}) -> Iterator
  *
  *  Call the given +block+ once with every object ID found in +repo+
  *  and all its alternates. Object IDs are passed as 40-character
  *  strings.
+ *
+ *  The following options can be passed in the +options+ Hash:
+ *
+ *  :oid_format ::
+ *    If set to +:raw+, object IDs are passed as raw Rugged::Oid instances
+ *    instead, which avoids formatting them as hex. Raw OIDs are accepted
+ *    anywhere an OID is expected.
  */
-static VALUE rb_git_repo_each_id(VALUE self)
+static VALUE rb_git_repo_each_id(int argc, VALUE *argv, VALUE self)
 {
 	git_repository *repo;
 	git_odb *odb;
-	int error, exception = 0;
+	struct rugged_each_id_payload payload = { 0, 0 };
+	int error;
+	VALUE rb_options;
+
+	rb_scan_args(argc, argv, "01", &rb_options);
 
 	if (!rb_block_given_p())
-		return rb_funcall(self, rb_intern("to_enum"), 1, CSTR2SYM("each_id"));
+		return rb_funcall(self, rb_intern("to_enum"), 2, CSTR2SYM("each_id"), rb_options);
+
+	payload.raw_oid = rugged_parse_oid_format(rb_options);
 
 	Data_Get_Struct(self, git_repository, repo);
 
 	error = git_repository_odb(&odb, repo);
 	rugged_exception_check(error);
 
-	error = git_odb_foreach(odb, &rugged__each_id_cb, &exception);
+	error = git_odb_foreach(odb, &rugged__each_id_cb, &payload);
 	git_odb_free(odb);
 
-	if (exception)
-		rb_jump_tag(exception);
+	if (payload.exception)
+		rb_jump_tag(payload.exception);
 	rugged_exception_check(error);
 
 	return Qnil;
@@ -1581,27 +2244,350 @@ static VALUE rb_git_repo_get_namespace(VALUE self)
 static VALUE rb_git_repo_ahead_behind(VALUE self, VALUE rb_local, VALUE rb_upstream) {
 	git_repository *repo;
 	int error;
-	git_oid local, upstream;
-	size_t ahead, behind;
-	VALUE rb_result;
+	git_oid oids[2];
+	struct rugged_graph_args args = { NULL };
+	VALUE rb_result, rb_graph = rb_git_repo_commit_graph(self);
 
 	Data_Get_Struct(self, git_repository, repo);
 
-	error = rugged_oid_get(&local, repo, rb_local);
+	error = rugged_oid_get(&oids[0], repo, rb_local);
 	rugged_exception_check(error);
 
-	error = rugged_oid_get(&upstream, repo, rb_upstream);
+	error = rugged_oid_get(&oids[1], repo, rb_upstream);
 	rugged_exception_check(error);
 
-	error = git_graph_ahead_behind(&ahead, &behind, repo, &local, &upstream);
-	rugged_exception_check(error);
+	args.repo = repo;
+	args.oids = oids;
+	args.count = 2;
+	args.graph = rugged_commit_graph_get(rb_graph);
+
+	rugged_without_gvl(rugged__ahead_behind_nogvl, &args);
+	RB_GC_GUARD(rb_graph);
+	rugged_exception_check(args.error);
 
 	rb_result = rb_ary_new2(2);
-	rb_ary_push(rb_result, INT2FIX((int) ahead));
-	rb_ary_push(rb_result, INT2FIX((int) behind));
+	rb_ary_push(rb_result, INT2FIX((int) args.ahead));
+	rb_ary_push(rb_result, INT2FIX((int) args.behind));
+	return rb_result;
+}
+
+struct rugged_ahead_behind_many_args {
+	git_repository *repo;
+	const rugged_commit_graph *graph;
+	VALUE rb_targets;
+	git_oid base;
+	git_oid *oids;
+	size_t count;
+	size_t *ahead, *behind;
+	int error;
+};
+
+static void *rugged__ahead_behind_many_nogvl(void *data)
+{
+	struct rugged_ahead_behind_many_args *args = data;
+	uint32_t base, *positions = NULL, *covered = NULL;
+	git_oid *uncovered = NULL;
+	size_t *ahead = NULL, *behind = NULL, covered_count = 0, uncovered_count = 0, i, j;
+
+	if (!args->count)
+		return NULL;
+
+	positions = malloc(args->count * sizeof(uint32_t));
+	covered = malloc(args->count * sizeof(uint32_t));
+	uncovered = malloc(args->count * sizeof(git_oid));
+	ahead = malloc(args->count * sizeof(size_t));
+	behind = malloc(args->count * sizeof(size_t));
+
+	if (!positions || !covered || !uncovered || !ahead || !behind) {
+		giterr_set_oom();
+		args->error = -1;
+		goto done;
+	}
+
+	/* The commits the commit-graph covers are all counted in one shared walk */
+	if (args->graph && rugged_commit_graph_lookup(&base, args->graph, &args->base) == 0) {
+		for (i = 0; i < args->count; ++i) {
+			if (rugged_commit_graph_lookup(&positions[i], args->graph, &args->oids[i]) == 0)
+				covered[covered_count++] = positions[i];
+			else
+				positions[i] = UINT32_MAX;
+		}
+
+		args->error = rugged_commit_graph_ahead_behind_many(
+			ahead, behind, args->graph, base, covered, covered_count);
+
+		if (args->error < 0)
+			goto done;
+
+		for (i = 0, j = 0; i < args->count; ++i) {
+			if (positions[i] == UINT32_MAX)
+				continue;
+
+			args->ahead[i] = ahead[j];
+			args->behind[i] = behind[j];
+			j++;
+		}
+	} else {
+		for (i = 0; i < args->count; ++i)
+			positions[i] = UINT32_MAX;
+	}
+
+	/* ...and the others in another one, over the object database */
+	for (i = 0; i < args->count; ++i) {
+		if (positions[i] == UINT32_MAX)
+			git_oid_cpy(&uncovered[uncovered_count++], &args->oids[i]);
+	}
+
+	if (!uncovered_count)
+		goto done;
+
+	args->error = rugged_commit_walk_ahead_behind_many(
+		ahead, behind, args->repo, &args->base, uncovered, uncovered_count);
+
+	if (args->error < 0)
+		goto done;
+
+	for (i = 0, j = 0; i < args->count; ++i) {
+		if (positions[i] != UINT32_MAX)
+			continue;
+
+		args->ahead[i] = ahead[j];
+		args->behind[i] = behind[j];
+		j++;
+	}
+
+done:
+	free(positions);
+	free(covered);
+	free(uncovered);
+	free(ahead);
+	free(behind);
+	return NULL;
+}
+
+static VALUE rugged__ahead_behind_many_body(VALUE data)
+{
+	struct rugged_ahead_behind_many_args *args = (struct rugged_ahead_behind_many_args *)data;
+	VALUE rb_result;
+	size_t i;
+
+	args->oids = xcalloc(args->count ? args->count : 1, sizeof(git_oid));
+	args->ahead = xcalloc(args->count ? args->count : 1, sizeof(size_t));
+	args->behind = xcalloc(args->count ? args->count : 1, sizeof(size_t));
+
+	/* rugged_oid_get may raise; the arrays are freed by the ensure */
+	for (i = 0; i < args->count; ++i) {
+		int error = rugged_oid_get(&args->oids[i], args->repo, rb_ary_entry(args->rb_targets, i));
+		rugged_exception_check(error);
+	}
+
+	rugged_without_gvl(rugged__ahead_behind_many_nogvl, args);
+	rugged_exception_check(args->error);
+
+	rb_result = rb_hash_new();
+
+	for (i = 0; i < args->count; ++i) {
+		VALUE rb_counts = rb_ary_new2(2);
+		rb_ary_push(rb_counts, INT2FIX((int) args->ahead[i]));
+		rb_ary_push(rb_counts, INT2FIX((int) args->behind[i]));
+		rb_hash_aset(rb_result, rb_ary_entry(args->rb_targets, i), rb_counts);
+	}
+
 	return rb_result;
 }
 
+static VALUE rugged__ahead_behind_many_cleanup(VALUE data)
+{
+	struct rugged_ahead_behind_many_args *args = (struct rugged_ahead_behind_many_args *)data;
+
+	xfree(args->oids);
+	xfree(args->ahead);
+	xfree(args->behind);
+
+	return Qnil;
+}
+
+/*
+ *  call-seq:
+ *    repo.ahead_behind_many(base, targets) -> Hash
+ *
+ *  Compare each one of the +targets+ against +base+, returning a Hash with
+ *  each target as key and a 2 element Array as value, with the number of
+ *  commits the target is ahead and behind +base+, like #ahead_behind.
+ *
+ *  +base+ and +targets+ can either be strings containing SHA1 OIDs,
+ *  revisions like branch names, or Rugged::Object instances.
+ *
+ *  All the targets are counted in a single walk over the shared history,
+ *  instead of one walk per target: over the commit-graph (see
+ *  #commit_graph) for the commits it covers, and over commits read from
+ *  the object database, in date order, for the others.
+ *
+ *    repo.ahead_behind_many("master", ["feature", "bugfix"])
+ *    # => {"feature" => [3, 1], "bugfix" => [1, 0]}
+ */
+static VALUE rb_git_repo_ahead_behind_many(VALUE self, VALUE rb_base, VALUE rb_targets)
+{
+	struct rugged_ahead_behind_many_args args = { NULL };
+	VALUE rb_result, rb_graph = rb_git_repo_commit_graph(self);
+	int error;
+
+	Check_Type(rb_targets, T_ARRAY);
+	Data_Get_Struct(self, git_repository, args.repo);
+
+	error = rugged_oid_get(&args.base, args.repo, rb_base);
+	rugged_exception_check(error);
+
+	args.rb_targets = rb_targets;
+	args.count = RARRAY_LEN(rb_targets);
+	args.graph = rugged_commit_graph_get(rb_graph);
+
+	rb_result = rb_ensure(rugged__ahead_behind_many_body, (VALUE)&args,
+		rugged__ahead_behind_many_cleanup, (VALUE)&args);
+	RB_GC_GUARD(rb_graph);
+
+	return rb_result;
+}
+
+struct rugged_commit_stats_args {
+	git_repository *repo;
+	const git_diff_options *opts;
+	VALUE rb_commits;
+	git_oid *oids;
+	size_t count;
+	struct rugged_diff_numstat *stats;
+	int error;
+};
+
+static int rugged__commit_stats(
+	struct rugged_diff_numstat *stats,
+	git_repository *repo,
+	const git_oid *oid,
+	const git_diff_options *opts)
+{
+	git_commit *commit = NULL, *parent = NULL;
+	git_tree *tree = NULL, *parent_tree = NULL;
+	git_diff *diff = NULL;
+	int error;
+
+	if ((error = git_commit_lookup(&commit, repo, oid)) < 0 ||
+		(error = git_commit_tree(&tree, commit)) < 0)
+		goto cleanup;
+
+	if (git_commit_parentcount(commit) > 0 &&
+		((error = git_commit_parent(&parent, commit, 0)) < 0 ||
+		(error = git_commit_tree(&parent_tree, parent)) < 0))
+		goto cleanup;
+
+	if ((error = git_diff_tree_to_tree(&diff, repo, parent_tree, tree, opts)) < 0)
+		goto cleanup;
+
+	error = rugged_diff_numstat(NULL, stats, diff,
+		(opts->flags & (GIT_DIFF_FORCE_TEXT | GIT_DIFF_FORCE_BINARY)) ? NULL : repo,
+		opts->max_size);
+
+cleanup:
+	git_diff_free(diff);
+	git_tree_free(parent_tree);
+	git_tree_free(tree);
+	git_commit_free(parent);
+	git_commit_free(commit);
+	return error;
+}
+
+static void *rugged__commit_stats_nogvl(void *data)
+{
+	struct rugged_commit_stats_args *args = data;
+	size_t i;
+
+	for (i = 0; !args->error && i < args->count; ++i)
+		args->error = rugged__commit_stats(&args->stats[i], args->repo, &args->oids[i], args->opts);
+
+	return NULL;
+}
+
+static VALUE rugged__commit_stats_body(VALUE data)
+{
+	struct rugged_commit_stats_args *args = (struct rugged_commit_stats_args *)data;
+	VALUE rb_result;
+	size_t i;
+
+	args->oids = xcalloc(args->count ? args->count : 1, sizeof(git_oid));
+	args->stats = xcalloc(args->count ? args->count : 1, sizeof(struct rugged_diff_numstat));
+
+	/* rugged_oid_get may raise; the arrays are freed by the ensure */
+	for (i = 0; i < args->count; ++i) {
+		int error = rugged_oid_get(&args->oids[i], args->repo, rb_ary_entry(args->rb_commits, i));
+		rugged_exception_check(error);
+	}
+
+	rugged_without_gvl(rugged__commit_stats_nogvl, args);
+	rugged_exception_check(args->error);
+
+	rb_result = rb_hash_new();
+
+	for (i = 0; i < args->count; ++i) {
+		rb_hash_aset(rb_result, rb_ary_entry(args->rb_commits, i), rb_ary_new3(3,
+			INT2FIX(args->stats[i].counted),
+			INT2FIX(args->stats[i].adds),
+			INT2FIX(args->stats[i].dels)));
+	}
+
+	return rb_result;
+}
+
+static VALUE rugged__commit_stats_cleanup(VALUE data)
+{
+	struct rugged_commit_stats_args *args = (struct rugged_commit_stats_args *)data;
+
+	xfree(args->opts->pathspec.strings);
+	xfree(args->oids);
+	xfree(args->stats);
+
+	return Qnil;
+}
+
+/*
+ *  call-seq:
+ *    repo.commit_stats(commits, options = {}) -> Hash
+ *
+ *  Compute the changes made by each one of the +commits+ against its first
+ *  parent, or against an empty tree for root commits. Returns a Hash with
+ *  each commit as key and a 3 element Array as value, with the number of
+ *  files changed, additions and deletions, like Rugged::Diff#stat.
+ *
+ *  +commits+ can either be strings containing SHA1 OIDs, revisions like
+ *  branch names, or Rugged::Object instances.
+ *
+ *  All the diffs are computed natively and, if enabled, without holding
+ *  the GVL. Files that were added or deleted are counted straight from
+ *  their blobs without being diffed.
+ *
+ *  See Rugged::Tree#diff for a list of options that can be passed.
+ *
+ *    repo.commit_stats(["master", "feature"])
+ *    # => {"master" => [1, 2, 1], "feature" => [3, 10, 0]}
+ */
+static VALUE rb_git_repo_commit_stats(int argc, VALUE *argv, VALUE self)
+{
+	git_diff_options opts = GIT_DIFF_OPTIONS_INIT;
+	struct rugged_commit_stats_args args = { NULL };
+	VALUE rb_commits, rb_options;
+
+	rb_scan_args(argc, argv, "10:", &rb_commits, &rb_options);
+	Check_Type(rb_commits, T_ARRAY);
+	Data_Get_Struct(self, git_repository, args.repo);
+
+	rugged_parse_diff_options(&opts, rb_options);
+
+	args.opts = &opts;
+	args.rb_commits = rb_commits;
+	args.count = RARRAY_LEN(rb_commits);
+
+	return rb_ensure(rugged__commit_stats_body, (VALUE)&args,
+		rugged__commit_stats_cleanup, (VALUE)&args);
+}
+
 /*
  *  call-seq:
  *    repo.default_signature -> signature or nil
@@ -2273,9 +3259,11 @@ void Init_rugged_repo(void)
 	rb_define_method(rb_cRuggedRepo, "descendant_of?", rb_git_repo_descendant_of, 2);
 
 	rb_define_method(rb_cRuggedRepo, "read",   rb_git_repo_read,   1);
+	rb_define_method(rb_cRuggedRepo, "read_many",   rb_git_repo_read_many,   1);
+	rb_define_method(rb_cRuggedRepo, "lookup_many",   rb_git_repo_lookup_many,   1);
 	rb_define_method(rb_cRuggedRepo, "read_header",   rb_git_repo_read_header,   1);
 	rb_define_method(rb_cRuggedRepo, "write",  rb_git_repo_write,  2);
-	rb_define_method(rb_cRuggedRepo, "each_id",  rb_git_repo_each_id,  0);
+	rb_define_method(rb_cRuggedRepo, "each_id",  rb_git_repo_each_id,  -1);
 
 	rb_define_method(rb_cRuggedRepo, "path",  rb_git_repo_path, 0);
 	rb_define_method(rb_cRuggedRepo, "workdir",  rb_git_repo_workdir, 0);
@@ -2311,6 +3299,9 @@ void Init_rugged_repo(void)
 	rb_define_method(rb_cRuggedRepo, "namespace", rb_git_repo_get_namespace, 0);
 
 	rb_define_method(rb_cRuggedRepo, "ahead_behind", rb_git_repo_ahead_behind, 2);
+	rb_define_method(rb_cRuggedRepo, "ahead_behind_many", rb_git_repo_ahead_behind_many, 2);
+	rb_define_method(rb_cRuggedRepo, "commit_stats", rb_git_repo_commit_stats, -1);
+	rb_define_method(rb_cRuggedRepo, "commit_graph", rb_git_repo_commit_graph, 0);
 
 	rb_define_method(rb_cRuggedRepo, "default_signature", rb_git_repo_default_signature, 0);
 
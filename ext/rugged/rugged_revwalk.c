@@ -67,7 +67,7 @@ static VALUE rb_git_walker_each_with_opts(int argc, VALUE *argv, VALUE self, int
 	git_repository *repo;
 	git_oid commit_oid;
 
-	int error, exception = 0;
+	int error, exception = 0, raw_oid = 0;
 	uint64_t offset = 0, limit = UINT64_MAX;
 
 	VALUE rb_options;
@@ -91,6 +91,9 @@ static VALUE rb_git_walker_each_with_opts(int argc, VALUE *argv, VALUE self, int
 			Check_Type(rb_value, T_FIXNUM);
 			limit = FIX2ULONG(rb_value);
 		}
+
+		if (oid_only)
+			raw_oid = rugged_parse_oid_format(rb_options);
 	}
 
 	Data_Get_Struct(self, git_revwalk, walk);
@@ -104,7 +107,7 @@ static VALUE rb_git_walker_each_with_opts(int argc, VALUE *argv, VALUE self, int
 
 		if (oid_only) {
 			rb_protect(rb_yield,
-				rugged_create_oid(&commit_oid),
+				rugged_create_oid_as(&commit_oid, raw_oid),
 				&exception);
 		} else {
 			error = git_commit_lookup(&commit, repo, &commit_oid);
@@ -160,13 +163,17 @@ static VALUE rb_git_walker_each(int argc, VALUE *argv, VALUE self)
 
 /*
  *  call-seq:
- *    walker.each_oid { |commit| block }
- *    walker.each_oid -> Iterator
+ *    walker.each_oid(options = {}) { |commit| block }
+ *    walker.each_oid(options = {}) -> Iterator
  *
  *  Perform the walk through the repository, yielding each
  *  one of the commit oids found as a <tt>String</tt>
  *  to +block+.
  *
+ *  Accepts the same +:offset+ and +:limit+ options as #each. If
+ *  +:oid_format+ is set to +:raw+, the oids are yielded as raw
+ *  Rugged::Oid instances instead of hex.
+ *
  *  If no +block+ is given, an +Iterator+ will be returned.
  *
  *  The walker must have been previously set-up before a walk can be performed
@@ -188,6 +195,243 @@ static VALUE rb_git_walker_each_oid(int argc, VALUE *argv, VALUE self)
 	return rb_git_walker_each_with_opts(argc, argv, self, 1);
 }
 
+enum rugged_commit_field {
+	COMMIT_FIELD_OID,
+	COMMIT_FIELD_MESSAGE,
+	COMMIT_FIELD_SUMMARY,
+	COMMIT_FIELD_AUTHOR,
+	COMMIT_FIELD_AUTHOR_NAME,
+	COMMIT_FIELD_AUTHOR_EMAIL,
+	COMMIT_FIELD_AUTHOR_TIME,
+	COMMIT_FIELD_COMMITTER,
+	COMMIT_FIELD_COMMITTER_NAME,
+	COMMIT_FIELD_COMMITTER_EMAIL,
+	COMMIT_FIELD_EPOCH_TIME,
+	COMMIT_FIELD_PARENT_IDS,
+	COMMIT_FIELD_TREE_ID,
+	COMMIT_FIELD__MAX
+};
+
+static const char *rugged_commit_field_names[COMMIT_FIELD__MAX] = {
+	"oid", "message", "summary",
+	"author", "author_name", "author_email", "author_time",
+	"committer", "committer_name", "committer_email",
+	"epoch_time", "parent_ids", "tree_id"
+};
+
+static int rugged_commit_field_get(VALUE rb_field)
+{
+	int i;
+	ID id_field;
+
+	Check_Type(rb_field, T_SYMBOL);
+	id_field = SYM2ID(rb_field);
+
+	for (i = 0; i < COMMIT_FIELD__MAX; ++i) {
+		if (id_field == rb_intern(rugged_commit_field_names[i]))
+			return i;
+	}
+
+	rb_raise(rb_eArgError, "Unknown commit field :%s", rb_id2name(id_field));
+	return -1; /* never reached */
+}
+
+static VALUE rugged_commit_field_new(git_commit *commit, int field, rb_encoding *encoding, int raw_oid)
+{
+	const char *str;
+
+	switch (field) {
+	case COMMIT_FIELD_OID:
+		return rugged_create_oid_as(git_commit_id(commit), raw_oid);
+
+	case COMMIT_FIELD_MESSAGE:
+		str = git_commit_message(commit);
+		return rb_enc_str_new(str, strlen(str), encoding);
+
+	case COMMIT_FIELD_SUMMARY:
+		str = git_commit_summary(commit);
+		return str ? rb_enc_str_new(str, strlen(str), encoding) : Qnil;
+
+	case COMMIT_FIELD_AUTHOR:
+		return rugged_signature_new_enc(git_commit_author(commit), encoding);
+
+	case COMMIT_FIELD_AUTHOR_NAME:
+		str = git_commit_author(commit)->name;
+		return rb_enc_str_new(str, strlen(str), encoding);
+
+	case COMMIT_FIELD_AUTHOR_EMAIL:
+		str = git_commit_author(commit)->email;
+		return rb_enc_str_new(str, strlen(str), encoding);
+
+	case COMMIT_FIELD_AUTHOR_TIME:
+		return LL2NUM(git_commit_author(commit)->when.time);
+
+	case COMMIT_FIELD_COMMITTER:
+		return rugged_signature_new_enc(git_commit_committer(commit), encoding);
+
+	case COMMIT_FIELD_COMMITTER_NAME:
+		str = git_commit_committer(commit)->name;
+		return rb_enc_str_new(str, strlen(str), encoding);
+
+	case COMMIT_FIELD_COMMITTER_EMAIL:
+		str = git_commit_committer(commit)->email;
+		return rb_enc_str_new(str, strlen(str), encoding);
+
+	case COMMIT_FIELD_EPOCH_TIME:
+		return ULONG2NUM(git_commit_time(commit));
+
+	case COMMIT_FIELD_PARENT_IDS: {
+		unsigned int n, parent_count = git_commit_parentcount(commit);
+		VALUE rb_parents = rb_ary_new2((long)parent_count);
+
+		for (n = 0; n < parent_count; ++n)
+			rb_ary_push(rb_parents, rugged_create_oid_as(git_commit_parent_id(commit, n), raw_oid));
+
+		return rb_parents;
+	}
+
+	case COMMIT_FIELD_TREE_ID:
+		return rugged_create_oid_as(git_commit_tree_id(commit), raw_oid);
+	}
+
+	return Qnil;
+}
+
+struct rugged_commit_info_args {
+	git_commit *commit;
+	int *fields;
+	long field_count;
+	int raw_oid;
+};
+
+static VALUE rugged__yield_commit_info(VALUE data)
+{
+	struct rugged_commit_info_args *args = (struct rugged_commit_info_args *)data;
+	const char *encoding_name = git_commit_message_encoding(args->commit);
+	rb_encoding *encoding = encoding_name ? rb_enc_find(encoding_name) : rb_utf8_encoding();
+	VALUE rb_info = rb_ary_new2(args->field_count);
+	long i;
+
+	for (i = 0; i < args->field_count; ++i)
+		rb_ary_push(rb_info, rugged_commit_field_new(args->commit, args->fields[i], encoding, args->raw_oid));
+
+	return rb_yield(rb_info);
+}
+
+/*
+ *  call-seq:
+ *    walker.each_commit_info(:fields => [...]) { |info| block }
+ *    walker.each_commit_info(:fields => [...]) -> Iterator
+ *
+ *  Perform the walk through the repository, yielding an +Array+ with the
+ *  requested +:fields+ of each commit, in the same order as they were given.
+ *
+ *  This parses every commit natively and only builds the values that were
+ *  asked for, without allocating a <tt>Rugged::Commit</tt> per step, which
+ *  makes it much cheaper than #each when only a few attributes are needed.
+ *
+ *  The following fields are available:
+ *
+ *  :oid, :tree_id ::
+ *    The oid of the commit or of its tree.
+ *
+ *  :parent_ids ::
+ *    An +Array+ with the oids of the parents of the commit.
+ *
+ *  :message, :summary ::
+ *    The full message of the commit, or only its first paragraph.
+ *
+ *  :author, :committer ::
+ *    The signature +Hash+, as returned by <tt>Rugged::Commit#author</tt>.
+ *
+ *  :author_name, :author_email, :committer_name, :committer_email ::
+ *    Single attributes of the signatures, which avoids building a +Hash+
+ *    and a +Time+ for each of them.
+ *
+ *  :author_time, :epoch_time ::
+ *    The author and committer times, in seconds since the Epoch.
+ *
+ *  Also accepts the +:offset+ and +:limit+ options of #each, and the
+ *  +:oid_format+ option of #each_oid.
+ *
+ *    walker.push("92b22bbcb37caf4f6f53d30292169e84f5e4283b")
+ *    walker.each_commit_info(:fields => [:oid, :author_name, :summary]) do |oid, name, summary|
+ *      puts "#{oid[0, 7]} #{name}: #{summary}"
+ *    end
+ */
+static VALUE rb_git_walker_each_commit_info(int argc, VALUE *argv, VALUE self)
+{
+	git_revwalk *walk;
+	git_repository *repo;
+	git_oid commit_oid;
+	struct rugged_commit_info_args args;
+
+	int error, exception = 0;
+	long i;
+	uint64_t offset = 0, limit = UINT64_MAX;
+
+	VALUE rb_options, rb_fields, rb_value;
+
+	rb_scan_args(argc, argv, "10", &rb_options);
+	Check_Type(rb_options, T_HASH);
+
+	if (!rb_block_given_p())
+		return rb_funcall(self, rb_intern("to_enum"), 2, CSTR2SYM("each_commit_info"), rb_options);
+
+	rb_fields = rb_hash_aref(rb_options, CSTR2SYM("fields"));
+	Check_Type(rb_fields, T_ARRAY);
+
+	if (RARRAY_LEN(rb_fields) > 4 * COMMIT_FIELD__MAX)
+		rb_raise(rb_eArgError, "Too many commit fields");
+
+	args.field_count = RARRAY_LEN(rb_fields);
+	args.fields = ALLOCA_N(int, args.field_count);
+
+	for (i = 0; i < args.field_count; ++i)
+		args.fields[i] = rugged_commit_field_get(rb_ary_entry(rb_fields, i));
+
+	args.raw_oid = rugged_parse_oid_format(rb_options);
+
+	rb_value = rb_hash_aref(rb_options, CSTR2SYM("offset"));
+	if (!NIL_P(rb_value)) {
+		Check_Type(rb_value, T_FIXNUM);
+		offset = FIX2ULONG(rb_value);
+	}
+
+	rb_value = rb_hash_aref(rb_options, CSTR2SYM("limit"));
+	if (!NIL_P(rb_value)) {
+		Check_Type(rb_value, T_FIXNUM);
+		limit = FIX2ULONG(rb_value);
+	}
+
+	Data_Get_Struct(self, git_revwalk, walk);
+	repo = git_revwalk_repository(walk);
+
+	while ((error = git_revwalk_next(&commit_oid, walk)) == 0) {
+		if (offset > 0) {
+			offset--;
+			continue;
+		}
+
+		error = git_commit_lookup(&args.commit, repo, &commit_oid);
+		rugged_exception_check(error);
+
+		rb_protect(rugged__yield_commit_info, (VALUE)&args, &exception);
+		git_commit_free(args.commit);
+
+		if (exception || --limit == 0)
+			break;
+	}
+
+	if (exception)
+		rb_jump_tag(exception);
+
+	if (error != GIT_ITEROVER)
+		rugged_exception_check(error);
+
+	return Qnil;
+}
+
 /*
  *  call-seq:
  *    walker.push(commit) -> nil
@@ -312,6 +556,7 @@ void Init_rugged_revwalk(void)
 	rb_define_method(rb_cRuggedWalker, "push_range", rb_git_walker_push_range, 1);
 	rb_define_method(rb_cRuggedWalker, "each", rb_git_walker_each, -1);
 	rb_define_method(rb_cRuggedWalker, "each_oid", rb_git_walker_each_oid, -1);
+	rb_define_method(rb_cRuggedWalker, "each_commit_info", rb_git_walker_each_commit_info, -1);
 	rb_define_method(rb_cRuggedWalker, "walk", rb_git_walker_each, -1);
 	rb_define_method(rb_cRuggedWalker, "hide", rb_git_walker_hide, 1);
 	rb_define_method(rb_cRuggedWalker, "reset", rb_git_walker_reset, 0);
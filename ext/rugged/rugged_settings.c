@@ -64,6 +64,13 @@ static VALUE get_search_path(int level)
  *    Settings[option] = value
  *
  *  Sets a libgit2 library option.
+ *
+ *  Besides the libgit2 options, the Rugged-specific +release_gvl+ option
+ *  can be set to +true+ to let long-running operations (diffing, blaming,
+ *  fetching, cloning, merging, ...) run without holding the Global VM Lock,
+ *  so other Ruby threads can make progress meanwhile. This requires a
+ *  thread-safe libgit2, and a single Repository instance should still not
+ *  be used from several threads at once.
  */
 static VALUE rb_git_set_option(VALUE self, VALUE option, VALUE value)
 {
@@ -98,6 +105,15 @@ static VALUE rb_git_set_option(VALUE self, VALUE option, VALUE value)
 		set_search_path(GIT_CONFIG_LEVEL_SYSTEM, value);
 	}
 
+	else if (strcmp(opt, "release_gvl") == 0) {
+		int release = rugged_parse_bool(value);
+
+		if (release && !(git_libgit2_features() & GIT_FEATURE_THREADS))
+			rb_raise(rb_eRuntimeError, "libgit2 was built without thread support");
+
+		rugged_release_gvl = release;
+	}
+
 	else {
 		rb_raise(rb_eArgError, "Unknown option specified");
 	}
@@ -142,6 +158,10 @@ static VALUE rb_git_get_option(VALUE self, VALUE option)
 		return get_search_path(GIT_CONFIG_LEVEL_SYSTEM);
 	}
 
+	else if (strcmp(opt, "release_gvl") == 0) {
+		return rugged_release_gvl ? Qtrue : Qfalse;
+	}
+
 	else {
 		rb_raise(rb_eArgError, "Unknown option specified");
 	}
@@ -26,12 +26,19 @@
 
 VALUE rugged_signature_new(const git_signature *sig, const char *encoding_name)
 {
-	VALUE rb_sig, rb_time;
 	rb_encoding *encoding = rb_utf8_encoding();
 
 	if (encoding_name != NULL)
 		encoding = rb_enc_find(encoding_name);
 
+	return rugged_signature_new_enc(sig, encoding);
+}
+
+/* Like rugged_signature_new, for callers that already looked the encoding up */
+VALUE rugged_signature_new_enc(const git_signature *sig, rb_encoding *encoding)
+{
+	VALUE rb_sig, rb_time;
+
 	rb_sig = rb_hash_new();
 
 	/* Allocate the time with a the given timezone */
@@ -0,0 +1,788 @@
+/*
+ * The MIT License
+ *
+ * Copyright (c) 2014 GitHub, Inc
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "rugged.h"
+#include <errno.h>
+#include <stdio.h>
+
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
+extern VALUE rb_cRuggedBlob;
+VALUE rb_cRuggedBlobSignatureIndex;
+
+/*
+ * The index keeps a MinHash sketch (see rugged_diff_similarity.c) for
+ * every blob. To answer queries without scanning every sketch, the bins
+ * of each sketch are grouped into SIGNATURE_INDEX_BANDS bands, and a
+ * sorted table maps the hash of every band to the blobs having it: only
+ * blobs sharing at least one whole band with the query are scored.
+ *
+ * A blob whose sketch has a Jaccard index J with the query shares a band
+ * with probability 1 - (1 - J^4)^16. Scores are Dice coefficients, and
+ * a Dice coefficient D is a Jaccard index of D / (2 - D): blobs scoring
+ * 90 against the query are found almost always, blobs scoring 80 about
+ * 97% of the time, but blobs scoring 70 (J = 0.54) only about 75% of the
+ * time, and blobs scoring 33 (J = 0.2) about 2.5% of the time. Use
+ * Rugged::Diff#find_similar! when every pair above a low score matters.
+ */
+#define SIGNATURE_INDEX_BANDS 16
+#define SIGNATURE_INDEX_ROWS (RUGGED_SIMILARITY_BINS / SIGNATURE_INDEX_BANDS)
+
+#define SIGNATURE_INDEX_MAGIC "RSIGIDX1"
+#define SIGNATURE_INDEX_VERSION 1
+
+struct signature_index_band {
+	uint32_t key;
+	uint32_t entry;
+};
+
+struct rugged_signature_index {
+	git_oid *oids;
+	struct rugged_similarity_sig *sigs;
+	size_t count, capacity;
+
+	/* oid -> entry + 1, open addressing */
+	uint32_t *slots;
+	size_t slot_count;
+
+	struct signature_index_band *bands;
+	size_t band_count;
+	int bands_dirty;
+
+	/* marks the entries already scored by the current query */
+	uint32_t *seen;
+	uint32_t query;
+};
+
+static void signature_index_free(struct rugged_signature_index *index)
+{
+	xfree(index->oids);
+	xfree(index->sigs);
+	xfree(index->slots);
+	xfree(index->bands);
+	xfree(index->seen);
+	xfree(index);
+}
+
+static VALUE rb_git_signature_index_allocate(VALUE klass)
+{
+	struct rugged_signature_index *index;
+	return Data_Make_Struct(klass, struct rugged_signature_index, NULL, signature_index_free, index);
+}
+
+static size_t signature_index_slot(const git_oid *oid, size_t slot_count)
+{
+	uint32_t h;
+	memcpy(&h, oid->id, sizeof(h));
+	return h & (slot_count - 1);
+}
+
+static size_t signature_index_find(struct rugged_signature_index *index, const git_oid *oid)
+{
+	size_t i;
+
+	if (!index->slot_count)
+		return (size_t)-1;
+
+	for (i = signature_index_slot(oid, index->slot_count);
+		index->slots[i];
+		i = (i + 1) & (index->slot_count - 1)) {
+		if (git_oid_equal(&index->oids[index->slots[i] - 1], oid))
+			return index->slots[i] - 1;
+	}
+
+	return (size_t)-1;
+}
+
+static void signature_index_link(struct rugged_signature_index *index, size_t entry)
+{
+	size_t i = signature_index_slot(&index->oids[entry], index->slot_count);
+
+	while (index->slots[i])
+		i = (i + 1) & (index->slot_count - 1);
+
+	index->slots[i] = (uint32_t)(entry + 1);
+}
+
+static void signature_index_reserve(struct rugged_signature_index *index, size_t count)
+{
+	size_t i;
+
+	if (count > UINT32_MAX - 1)
+		rb_raise(rb_eArgError, "Too many blobs for a signature index");
+
+	if (count > index->capacity) {
+		size_t capacity = index->capacity ? index->capacity : 64;
+
+		while (capacity < count)
+			capacity *= 2;
+
+		REALLOC_N(index->oids, git_oid, capacity);
+		REALLOC_N(index->sigs, struct rugged_similarity_sig, capacity);
+		index->capacity = capacity;
+	}
+
+	if (count * 2 > index->slot_count) {
+		size_t slot_count = index->slot_count ? index->slot_count : 128;
+
+		while (slot_count < count * 2)
+			slot_count *= 2;
+
+		xfree(index->slots);
+		index->slots = xcalloc(slot_count, sizeof(uint32_t));
+		index->slot_count = slot_count;
+
+		for (i = 0; i < index->count; ++i)
+			signature_index_link(index, i);
+	}
+}
+
+static int signature_index_push(struct rugged_signature_index *index, const git_oid *oid, const struct rugged_similarity_sig *sig)
+{
+	if (signature_index_find(index, oid) != (size_t)-1)
+		return 0;
+
+	signature_index_reserve(index, index->count + 1);
+
+	git_oid_cpy(&index->oids[index->count], oid);
+	index->sigs[index->count] = *sig;
+	signature_index_link(index, index->count);
+
+	index->count++;
+	index->bands_dirty = 1;
+
+	return 1;
+}
+
+/* Returns 0 for bands with no line at all, which would match every small file */
+static uint32_t signature_index_band_key(const struct rugged_similarity_sig *sig, size_t band)
+{
+	const uint32_t *bins = &sig->bins[band * SIGNATURE_INDEX_ROWS];
+	uint64_t h = 0x9e3779b97f4a7c15ULL * (band + 1);
+	int empty = 1;
+	size_t i;
+
+	for (i = 0; i < SIGNATURE_INDEX_ROWS; ++i) {
+		if (bins[i] != UINT32_MAX)
+			empty = 0;
+
+		h = (h ^ bins[i]) * 0x100000001b3ULL;
+		h ^= h >> 29;
+	}
+
+	if (empty)
+		return 0;
+
+	return (uint32_t)(h >> 32) | 1;
+}
+
+static int signature_index_band_cmp(const void *a, const void *b)
+{
+	const struct signature_index_band *band_a = a, *band_b = b;
+
+	if (band_a->key != band_b->key)
+		return band_a->key < band_b->key ? -1 : 1;
+
+	return band_a->entry < band_b->entry ? -1 : (band_a->entry > band_b->entry);
+}
+
+static void signature_index_build_bands(struct rugged_signature_index *index)
+{
+	size_t i, b;
+
+	if (!index->bands_dirty)
+		return;
+
+	xfree(index->bands);
+	index->bands = xcalloc(index->count * SIGNATURE_INDEX_BANDS + 1, sizeof(struct signature_index_band));
+	index->band_count = 0;
+
+	for (i = 0; i < index->count; ++i) {
+		for (b = 0; b < SIGNATURE_INDEX_BANDS; ++b) {
+			uint32_t key = signature_index_band_key(&index->sigs[i], b);
+
+			if (!key)
+				continue;
+
+			index->bands[index->band_count].key = key;
+			index->bands[index->band_count].entry = (uint32_t)i;
+			index->band_count++;
+		}
+	}
+
+	qsort(index->bands, index->band_count, sizeof(struct signature_index_band), signature_index_band_cmp);
+
+	xfree(index->seen);
+	index->seen = xcalloc(index->count + 1, sizeof(uint32_t));
+	index->query = 0;
+	index->bands_dirty = 0;
+}
+
+struct signature_index_build {
+	git_repository *repo;
+	const git_oid *oids;
+	struct rugged_similarity_sig *sigs;
+	size_t count;
+	size_t threads;
+};
+
+struct signature_index_worker {
+	struct signature_index_build *build;
+	git_repository *repo;
+	size_t offset;
+
+	size_t failed;
+	int error;
+	int error_class;
+	char *error_message;
+};
+
+static void signature_index_work_failed(struct signature_index_worker *worker, size_t i)
+{
+	const git_error *last_error;
+
+	/* libgit2 errors are thread-local, so keep a copy for the caller */
+	if ((last_error = giterr_last()) != NULL) {
+		worker->error_class = last_error->klass;
+		worker->error_message = strdup(last_error->message);
+	}
+
+	worker->failed = i;
+}
+
+static void *signature_index_work(void *data)
+{
+	struct signature_index_worker *worker = data;
+	struct signature_index_build *build = worker->build;
+	git_repository *repo = worker->repo ? worker->repo : build->repo;
+	size_t i;
+
+	for (i = worker->offset; i < build->count; i += build->threads) {
+		git_blob *blob;
+
+		if ((worker->error = git_blob_lookup(&blob, repo, &build->oids[i])) < 0) {
+			signature_index_work_failed(worker, i);
+			break;
+		}
+
+		rugged_similarity_sig_init(&build->sigs[i],
+			git_blob_rawcontent(blob), (size_t)git_blob_rawsize(blob),
+			RUGGED_SIMILARITY_SMART_WHITESPACE);
+
+		git_blob_free(blob);
+	}
+
+	git_repository_free(worker->repo);
+	worker->repo = NULL;
+
+	return NULL;
+}
+
+struct signature_index_build_args {
+	struct signature_index_build *build;
+	struct signature_index_worker *workers;
+};
+
+#ifdef HAVE_PTHREAD_H
+/*
+ * A repository can't be shared between threads, so each worker gets a
+ * handle of its own. Returns 0, with no handle opened, when the handles
+ * wouldn't see the objects of the repository (see rugged_repository_reopen).
+ */
+static int signature_index_open_workers(struct signature_index_build_args *args)
+{
+	size_t t;
+
+	for (t = 0; t < args->build->threads; ++t) {
+		if (rugged_repository_reopen(&args->workers[t].repo, args->build->repo) < 0) {
+			giterr_clear();
+
+			while (t--) {
+				git_repository_free(args->workers[t].repo);
+				args->workers[t].repo = NULL;
+			}
+
+			return 0;
+		}
+	}
+
+	return 1;
+}
+#endif
+
+static void *signature_index_build_nogvl(void *data)
+{
+	struct signature_index_build_args *args = data;
+	size_t t;
+
+#ifdef HAVE_PTHREAD_H
+	/* without handles that see the same objects, everything is hashed here */
+	if (args->build->threads > 1 && !signature_index_open_workers(args))
+		args->build->threads = 1;
+
+	if (args->build->threads > 1) {
+		pthread_t *threads = calloc(args->build->threads, sizeof(pthread_t));
+		int *started = calloc(args->build->threads, sizeof(int));
+
+		if (threads && started) {
+			for (t = 0; t < args->build->threads; ++t)
+				started[t] = pthread_create(&threads[t], NULL, signature_index_work, &args->workers[t]) == 0;
+
+			/* whatever couldn't get a thread of its own is handled here */
+			for (t = 0; t < args->build->threads; ++t) {
+				if (started[t])
+					pthread_join(threads[t], NULL);
+				else
+					signature_index_work(&args->workers[t]);
+			}
+
+			free(threads);
+			free(started);
+			return NULL;
+		}
+
+		free(threads);
+		free(started);
+	}
+#endif
+
+	for (t = 0; t < args->build->threads; ++t)
+		signature_index_work(&args->workers[t]);
+
+	return NULL;
+}
+
+/*
+ *  call-seq:
+ *    index.add(repository, oids, options = {}) -> int
+ *
+ *  Read the blobs identified by the Array of +oids+ from +repository+ and
+ *  add their signatures to the index. Blobs already in the index are
+ *  skipped. Returns the number of blobs added.
+ *
+ *  The blobs are read and hashed without creating any Rugged::Blob objects
+ *  and, if enabled, without holding the GVL.
+ *
+ *  The following options can be passed in the +options+ Hash:
+ *
+ *  :threads ::
+ *    The number of native threads hashing blobs in parallel, each with a
+ *    repository handle of its own. Defaults to 1. Ignored when libgit2
+ *    was built without thread support, and for repositories that another
+ *    handle wouldn't read the same objects from: repositories with no path
+ *    on disk, or with alternates or backends added at runtime.
+ */
+static VALUE rb_git_signature_index_add(int argc, VALUE *argv, VALUE self)
+{
+	struct rugged_signature_index *index;
+	struct signature_index_build build = { NULL };
+	struct signature_index_build_args args;
+	struct signature_index_worker *failed = NULL;
+	VALUE rb_repo, rb_oids, rb_options, rb_value;
+	size_t i, t, added = 0;
+	git_oid *oids;
+	int error = 0;
+
+	rb_scan_args(argc, argv, "20:", &rb_repo, &rb_oids, &rb_options);
+
+	rugged_check_repo(rb_repo);
+	Check_Type(rb_oids, T_ARRAY);
+	Data_Get_Struct(self, struct rugged_signature_index, index);
+	Data_Get_Struct(rb_repo, git_repository, build.repo);
+
+	build.threads = 1;
+
+	if (!NIL_P(rb_options)) {
+		rb_value = rb_hash_aref(rb_options, CSTR2SYM("threads"));
+		if (!NIL_P(rb_value)) {
+			Check_Type(rb_value, T_FIXNUM);
+			if (FIX2INT(rb_value) < 1)
+				rb_raise(rb_eArgError, "The number of threads must be positive");
+			build.threads = FIX2INT(rb_value);
+		}
+	}
+
+	if (!(git_libgit2_features() & GIT_FEATURE_THREADS))
+		build.threads = 1;
+
+	/* Parse every OID before allocating anything, since parsing may raise */
+	for (i = 0; i < (size_t)RARRAY_LEN(rb_oids); ++i) {
+		VALUE rb_oid = rb_ary_entry(rb_oids, i);
+		git_oid oid;
+
+		Check_Type(rb_oid, T_STRING);
+		rugged_exception_check(rugged_oid_fromstr(&oid, rb_oid));
+	}
+
+	oids = xcalloc(RARRAY_LEN(rb_oids) ? RARRAY_LEN(rb_oids) : 1, sizeof(git_oid));
+
+	/* only blobs missing from the index need to be read */
+	for (i = 0; i < (size_t)RARRAY_LEN(rb_oids); ++i) {
+		rugged_oid_fromstr(&oids[build.count], rb_ary_entry(rb_oids, i));
+
+		if (signature_index_find(index, &oids[build.count]) == (size_t)-1)
+			build.count++;
+	}
+
+	if (build.threads > build.count)
+		build.threads = build.count ? build.count : 1;
+
+	build.oids = oids;
+	build.sigs = xcalloc(build.count ? build.count : 1, sizeof(struct rugged_similarity_sig));
+
+	args.build = &build;
+	args.workers = xcalloc(build.threads, sizeof(struct signature_index_worker));
+
+	for (t = 0; t < build.threads; ++t) {
+		args.workers[t].build = &build;
+		args.workers[t].offset = t;
+	}
+
+	rugged_without_gvl(signature_index_build_nogvl, &args);
+
+	for (t = 0; t < build.threads; ++t) {
+		if (args.workers[t].error < 0 && (!failed || args.workers[t].failed < failed->failed))
+			failed = &args.workers[t];
+	}
+
+	if (failed) {
+		error = failed->error;
+
+		if (failed->error_message)
+			giterr_set_str(failed->error_class, failed->error_message);
+	} else {
+		for (i = 0; i < build.count; ++i)
+			added += signature_index_push(index, &oids[i], &build.sigs[i]);
+	}
+
+	for (t = 0; t < build.threads; ++t)
+		free(args.workers[t].error_message);
+
+	xfree(args.workers);
+	xfree(build.sigs);
+	xfree(oids);
+
+	rugged_exception_check(error);
+
+	return ULONG2NUM(added);
+}
+
+/*
+ *  call-seq:
+ *    index.query(blob, limit = 10, options = {}) -> Array
+ *
+ *  Return up to +limit+ of the blobs in the index that are most similar
+ *  to +blob+, a Rugged::Blob or a String, as an Array of
+ *  <tt>[oid, score]</tt> pairs ordered by descending score. Scores go
+ *  from 0 to 100 and estimate the share of lines both blobs have in
+ *  common; a blob that is in the index scores 100 against itself.
+ *
+ *  Only blobs sharing a band with +blob+ are scored, so similar blobs can
+ *  be missed: about one in four scoring 70, and a few in a hundred
+ *  scoring 80.
+ *
+ *  The following options can be passed in the +options+ Hash:
+ *
+ *  :min_score ::
+ *    Leave out blobs scoring below this. Defaults to 1.
+ *
+ *    index.query(repo.lookup(oid), 5, :min_score => 80)
+ *    #=> [["a8233120f6ad708f843d861ce2b7228ec4e3dec6", 96], ...]
+ */
+static VALUE rb_git_signature_index_query(int argc, VALUE *argv, VALUE self)
+{
+	struct rugged_signature_index *index;
+	struct rugged_similarity_sig sig;
+	VALUE rb_blob, rb_limit, rb_options, rb_value, rb_result;
+	size_t limit = 10, found = 0, i, b;
+	int min_score = 1;
+	uint32_t *top_entries;
+	int *top_scores;
+
+	rb_scan_args(argc, argv, "11:", &rb_blob, &rb_limit, &rb_options);
+	Data_Get_Struct(self, struct rugged_signature_index, index);
+
+	if (!NIL_P(rb_limit)) {
+		Check_Type(rb_limit, T_FIXNUM);
+		if (FIX2INT(rb_limit) < 1)
+			rb_raise(rb_eArgError, "The limit must be positive");
+		limit = FIX2INT(rb_limit);
+	}
+
+	if (!NIL_P(rb_options)) {
+		rb_value = rb_hash_aref(rb_options, CSTR2SYM("min_score"));
+		if (!NIL_P(rb_value)) {
+			Check_Type(rb_value, T_FIXNUM);
+			min_score = FIX2INT(rb_value);
+		}
+	}
+
+	if (rb_obj_is_kind_of(rb_blob, rb_cRuggedBlob)) {
+		git_blob *blob;
+		Data_Get_Struct(rb_blob, git_blob, blob);
+
+		rugged_similarity_sig_init(&sig,
+			git_blob_rawcontent(blob), (size_t)git_blob_rawsize(blob),
+			RUGGED_SIMILARITY_SMART_WHITESPACE);
+	} else {
+		Check_Type(rb_blob, T_STRING);
+		rugged_similarity_sig_init(&sig, RSTRING_PTR(rb_blob), RSTRING_LEN(rb_blob),
+			RUGGED_SIMILARITY_SMART_WHITESPACE);
+	}
+
+	signature_index_build_bands(index);
+
+	if (++index->query == 0 && index->seen) {
+		memset(index->seen, 0, (index->count + 1) * sizeof(uint32_t));
+		index->query = 1;
+	}
+
+	if (limit > index->count)
+		limit = index->count;
+
+	top_entries = xcalloc(limit + 1, sizeof(uint32_t));
+	top_scores = xcalloc(limit + 1, sizeof(int));
+
+	for (b = 0; b < SIGNATURE_INDEX_BANDS; ++b) {
+		struct signature_index_band *band;
+		size_t lo = 0, hi = index->band_count;
+		uint32_t key = signature_index_band_key(&sig, b);
+
+		if (!key)
+			continue;
+
+		while (lo < hi) {
+			size_t mid = lo + (hi - lo) / 2;
+
+			if (index->bands[mid].key < key)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+
+		for (band = &index->bands[lo]; band < index->bands + index->band_count && band->key == key; ++band) {
+			size_t pos;
+			int score;
+
+			if (index->seen[band->entry] == index->query)
+				continue;
+
+			index->seen[band->entry] = index->query;
+
+			score = rugged_similarity_sig_compare(&sig, &index->sigs[band->entry]);
+			if (score < min_score || (found == limit && score <= top_scores[found - 1]))
+				continue;
+
+			/* keep the best `limit` entries sorted by descending score */
+			pos = found < limit ? found++ : found - 1;
+			while (pos > 0 && top_scores[pos - 1] < score) {
+				top_scores[pos] = top_scores[pos - 1];
+				top_entries[pos] = top_entries[pos - 1];
+				pos--;
+			}
+
+			top_scores[pos] = score;
+			top_entries[pos] = band->entry;
+		}
+	}
+
+	rb_result = rb_ary_new2(found);
+	for (i = 0; i < found; ++i) {
+		rb_ary_push(rb_result, rb_ary_new3(2,
+			rugged_create_oid(&index->oids[top_entries[i]]), INT2FIX(top_scores[i])));
+	}
+
+	xfree(top_entries);
+	xfree(top_scores);
+
+	return rb_result;
+}
+
+/*
+ *  call-seq:
+ *    index.size -> int
+ *
+ *  Returns the number of blobs in the index.
+ */
+static VALUE rb_git_signature_index_size(VALUE self)
+{
+	struct rugged_signature_index *index;
+	Data_Get_Struct(self, struct rugged_signature_index, index);
+	return ULONG2NUM(index->count);
+}
+
+/*
+ *  call-seq:
+ *    index.include?(oid) -> true or false
+ *
+ *  Returns +true+ if the blob identified by +oid+ is in the index.
+ */
+static VALUE rb_git_signature_index_include_p(VALUE self, VALUE rb_oid)
+{
+	struct rugged_signature_index *index;
+	git_oid oid;
+
+	Data_Get_Struct(self, struct rugged_signature_index, index);
+
+	Check_Type(rb_oid, T_STRING);
+	rugged_exception_check(rugged_oid_fromstr(&oid, rb_oid));
+
+	return signature_index_find(index, &oid) != (size_t)-1 ? Qtrue : Qfalse;
+}
+
+/*
+ *  call-seq:
+ *    index.save(path) -> self
+ *
+ *  Writes the index to the file at +path+, so it can be read back with
+ *  Rugged::Blob::SignatureIndex.load. Each blob takes 276 bytes; the file
+ *  uses the byte order of the machine it was written on.
+ */
+static VALUE rb_git_signature_index_save(VALUE self, VALUE rb_path)
+{
+	struct rugged_signature_index *index;
+	uint32_t version = SIGNATURE_INDEX_VERSION, bins = RUGGED_SIMILARITY_BINS;
+	uint64_t count;
+	const char *path;
+	FILE *fp;
+	size_t i;
+	int ok, error = 0;
+
+	Data_Get_Struct(self, struct rugged_signature_index, index);
+	FilePathValue(rb_path);
+	path = StringValueCStr(rb_path);
+
+	if ((fp = fopen(path, "wb")) == NULL)
+		rb_sys_fail(path);
+
+	count = index->count;
+	ok = fwrite(SIGNATURE_INDEX_MAGIC, 8, 1, fp) == 1 &&
+		fwrite(&version, sizeof(version), 1, fp) == 1 &&
+		fwrite(&bins, sizeof(bins), 1, fp) == 1 &&
+		fwrite(&count, sizeof(count), 1, fp) == 1;
+
+	for (i = 0; ok && i < index->count; ++i) {
+		ok = fwrite(index->oids[i].id, GIT_OID_RAWSZ, 1, fp) == 1 &&
+			fwrite(index->sigs[i].bins, sizeof(index->sigs[i].bins), 1, fp) == 1;
+	}
+
+	/* fclose may overwrite errno, report the failure that came first */
+	if (!ok)
+		error = errno;
+
+	if (fclose(fp) != 0 && ok) {
+		ok = 0;
+		error = errno;
+	}
+
+	if (!ok) {
+		errno = error;
+		rb_sys_fail(path);
+	}
+
+	return self;
+}
+
+struct signature_index_load_args {
+	struct rugged_signature_index *index;
+	FILE *fp;
+};
+
+static VALUE signature_index_load_body(VALUE data)
+{
+	struct signature_index_load_args *args = (struct signature_index_load_args *)data;
+	char magic[8];
+	uint32_t version, bins;
+	uint64_t count, i;
+	int ok;
+
+	ok = fread(magic, sizeof(magic), 1, args->fp) == 1 &&
+		fread(&version, sizeof(version), 1, args->fp) == 1 &&
+		fread(&bins, sizeof(bins), 1, args->fp) == 1 &&
+		fread(&count, sizeof(count), 1, args->fp) == 1 &&
+		memcmp(magic, SIGNATURE_INDEX_MAGIC, sizeof(magic)) == 0 &&
+		version == SIGNATURE_INDEX_VERSION &&
+		bins == RUGGED_SIMILARITY_BINS &&
+		count < UINT32_MAX;
+
+	for (i = 0; ok && i < count; ++i) {
+		struct rugged_similarity_sig sig;
+		git_oid oid;
+
+		ok = fread(oid.id, GIT_OID_RAWSZ, 1, args->fp) == 1 &&
+			fread(sig.bins, sizeof(sig.bins), 1, args->fp) == 1;
+
+		/* may raise when growing the index; the file is closed by the ensure */
+		if (ok)
+			signature_index_push(args->index, &oid, &sig);
+	}
+
+	return ok ? Qtrue : Qfalse;
+}
+
+static VALUE signature_index_load_cleanup(VALUE data)
+{
+	struct signature_index_load_args *args = (struct signature_index_load_args *)data;
+	fclose(args->fp);
+	return Qnil;
+}
+
+/*
+ *  call-seq:
+ *    SignatureIndex.load(path) -> index
+ *
+ *  Returns the index saved to +path+ with Rugged::Blob::SignatureIndex#save.
+ */
+static VALUE rb_git_signature_index_load(VALUE klass, VALUE rb_path)
+{
+	VALUE rb_index = rb_class_new_instance(0, NULL, klass);
+	struct signature_index_load_args args;
+
+	Data_Get_Struct(rb_index, struct rugged_signature_index, args.index);
+	FilePathValue(rb_path);
+
+	if ((args.fp = fopen(StringValueCStr(rb_path), "rb")) == NULL)
+		rb_sys_fail(StringValueCStr(rb_path));
+
+	if (!RTEST(rb_ensure(signature_index_load_body, (VALUE)&args, signature_index_load_cleanup, (VALUE)&args)))
+		rb_raise(rb_eIOError, "Invalid signature index file '%s'", StringValueCStr(rb_path));
+
+	return rb_index;
+}
+
+void Init_rugged_signature_index(void)
+{
+	rb_cRuggedBlobSignatureIndex = rb_define_class_under(rb_cRuggedBlob, "SignatureIndex", rb_cObject);
+	rb_define_alloc_func(rb_cRuggedBlobSignatureIndex, rb_git_signature_index_allocate);
+
+	rb_define_singleton_method(rb_cRuggedBlobSignatureIndex, "load", rb_git_signature_index_load, 1);
+
+	rb_define_method(rb_cRuggedBlobSignatureIndex, "add", rb_git_signature_index_add, -1);
+	rb_define_method(rb_cRuggedBlobSignatureIndex, "query", rb_git_signature_index_query, -1);
+	rb_define_method(rb_cRuggedBlobSignatureIndex, "size", rb_git_signature_index_size, 0);
+	rb_define_method(rb_cRuggedBlobSignatureIndex, "include?", rb_git_signature_index_include_p, 1);
+	rb_define_method(rb_cRuggedBlobSignatureIndex, "save", rb_git_signature_index_save, 1);
+}
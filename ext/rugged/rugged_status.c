@@ -0,0 +1,612 @@
+/*
+ * The MIT License
+ *
+ * Copyright (c) 2014 GitHub, Inc
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "rugged.h"
+
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#include <dirent.h>
+#endif
+
+extern VALUE rb_mRugged;
+extern VALUE rb_cRuggedRepo;
+VALUE rb_cRuggedStatusTable;
+
+/*
+ * Repository#status_table gathers the status of the whole working
+ * directory into a few packed strings instead of calling a block for
+ * every file.
+ *
+ * To spread the work over several threads, the sorted top-level names
+ * of the working directory, the index and HEAD are cut into contiguous
+ * ranges, one per worker. Each worker opens its own handle on the
+ * repository and runs one status per name in its range: libgit2 bounds
+ * its tree, index and directory iterators by the prefix of a literal
+ * pathspec, so every worker only walks its own part of the tree. The
+ * results are merged and sorted by path at the end.
+ */
+struct rugged_status_scan;
+
+struct rugged_status_worker {
+	struct rugged_status_scan *scan;
+	git_repository *repo;
+	char **names;
+	size_t names_count;
+
+	char *paths;
+	size_t paths_len, paths_alloc;
+
+	size_t *offsets;
+	uint16_t *flags;
+	size_t count, alloc;
+
+	int error;
+	int error_class;
+	char *error_message;
+};
+
+struct rugged_status_scan {
+	git_repository *repo;
+	unsigned int options;
+	size_t threads;
+
+	char **names;
+	size_t names_count, names_alloc;
+
+	struct rugged_status_worker *workers;
+	int error;
+};
+
+static int rugged__status_push(struct rugged_status_worker *worker, const char *path, unsigned int flags)
+{
+	size_t len = strlen(path) + 1;
+
+	if (worker->count == worker->alloc) {
+		size_t alloc = worker->alloc ? worker->alloc * 2 : 256;
+		size_t *offsets;
+		uint16_t *new_flags;
+
+		if (!(offsets = realloc(worker->offsets, alloc * sizeof(size_t))))
+			goto oom;
+		worker->offsets = offsets;
+
+		if (!(new_flags = realloc(worker->flags, alloc * sizeof(uint16_t))))
+			goto oom;
+		worker->flags = new_flags;
+
+		worker->alloc = alloc;
+	}
+
+	if (worker->paths_len + len > worker->paths_alloc) {
+		size_t alloc = worker->paths_alloc ? worker->paths_alloc * 2 : 4096;
+		char *paths;
+
+		while (alloc < worker->paths_len + len)
+			alloc *= 2;
+
+		if (!(paths = realloc(worker->paths, alloc)))
+			goto oom;
+
+		worker->paths = paths;
+		worker->paths_alloc = alloc;
+	}
+
+	memcpy(worker->paths + worker->paths_len, path, len);
+	worker->offsets[worker->count] = worker->paths_len;
+	worker->flags[worker->count] = (uint16_t)flags;
+	worker->paths_len += len;
+	worker->count++;
+
+	return 0;
+
+oom:
+	giterr_set_oom();
+	return -1;
+}
+
+static int rugged__status_list(struct rugged_status_worker *worker, const git_status_options *opts)
+{
+	git_status_list *list;
+	size_t i, count;
+	int error;
+
+	if ((error = git_status_list_new(&list, worker->repo, opts)) < 0)
+		return error;
+
+	count = git_status_list_entrycount(list);
+
+	for (i = 0; i < count; ++i) {
+		const git_status_entry *entry = git_status_byindex(list, i);
+		const char *path = entry->index_to_workdir ?
+			entry->index_to_workdir->old_file.path :
+			entry->head_to_index->old_file.path;
+
+		if ((error = rugged__status_push(worker, path, entry->status)) < 0)
+			break;
+	}
+
+	git_status_list_free(list);
+	return error;
+}
+
+static void *rugged__status_work(void *data)
+{
+	struct rugged_status_worker *worker = data;
+	struct rugged_status_scan *scan = worker->scan;
+	git_status_options opts = GIT_STATUS_OPTIONS_INIT;
+	const git_error *last_error;
+	size_t i;
+
+	opts.show = GIT_STATUS_SHOW_INDEX_AND_WORKDIR;
+	opts.flags = scan->options;
+
+	/* repository handles can't be shared between threads */
+	if (!worker->repo) {
+		const char *workdir = git_repository_workdir(scan->repo);
+
+		if ((worker->error = git_repository_open(&worker->repo, git_repository_path(scan->repo))) < 0)
+			goto done;
+
+		if (workdir && (worker->error = git_repository_set_workdir(worker->repo, workdir, 0)) < 0)
+			goto done;
+	}
+
+	if (!worker->names_count) {
+		worker->error = rugged__status_list(worker, &opts);
+		goto done;
+	}
+
+	/*
+	 * One literal name per status: its prefix becomes the start and end
+	 * of the iterators, so only that entry of the tree is walked.
+	 */
+	opts.flags |= GIT_STATUS_OPT_DISABLE_PATHSPEC_MATCH;
+	opts.pathspec.count = 1;
+
+	for (i = 0; !worker->error && i < worker->names_count; ++i) {
+		opts.pathspec.strings = &worker->names[i];
+		worker->error = rugged__status_list(worker, &opts);
+	}
+
+done:
+	/* libgit2 errors are thread-local, so keep a copy for the caller */
+	if (worker->error < 0 && (last_error = giterr_last()) != NULL) {
+		worker->error_class = last_error->klass;
+		worker->error_message = strdup(last_error->message);
+	}
+
+	return NULL;
+}
+
+#ifdef HAVE_PTHREAD_H
+static int rugged__status_add_name(struct rugged_status_scan *scan, const char *name, size_t len)
+{
+	char *copy;
+
+	if (scan->names_count == scan->names_alloc) {
+		size_t alloc = scan->names_alloc ? scan->names_alloc * 2 : 64;
+		char **names = realloc(scan->names, alloc * sizeof(char *));
+
+		if (!names)
+			goto oom;
+
+		scan->names = names;
+		scan->names_alloc = alloc;
+	}
+
+	if (!(copy = malloc(len + 1)))
+		goto oom;
+
+	memcpy(copy, name, len);
+	copy[len] = '\0';
+	scan->names[scan->names_count++] = copy;
+
+	return 0;
+
+oom:
+	giterr_set_oom();
+	return -1;
+}
+
+static int rugged__status_name_cmp(const void *a, const void *b)
+{
+	return strcmp(*(const char * const *)a, *(const char * const *)b);
+}
+
+/*
+ * Gather the top-level names of the working directory, the index and
+ * the tree of HEAD: together they cover every path a status can report,
+ * including files only deleted from the index.
+ */
+static int rugged__status_collect_names(struct rugged_status_scan *scan)
+{
+	const char *workdir = git_repository_workdir(scan->repo);
+	git_index *index = NULL;
+	git_object *tree = NULL;
+	struct dirent *de;
+	const char *last = NULL;
+	size_t i, count, last_len = 0;
+	DIR *dir;
+	int error = 0;
+
+	if (!(dir = opendir(workdir))) {
+		giterr_set_str(GITERR_OS, "Failed to open the working directory");
+		return -1;
+	}
+
+	while (!error && (de = readdir(dir)) != NULL) {
+		if (!strcmp(de->d_name, ".") || !strcmp(de->d_name, "..") || !strcmp(de->d_name, ".git"))
+			continue;
+
+		error = rugged__status_add_name(scan, de->d_name, strlen(de->d_name));
+	}
+
+	closedir(dir);
+
+	if (error < 0 || (error = git_repository_index(&index, scan->repo)) < 0)
+		return error;
+
+	/* the entries of a directory are contiguous in the sorted index */
+	count = git_index_entrycount(index);
+	for (i = 0; !error && i < count; ++i) {
+		const char *path = git_index_get_byindex(index, i)->path;
+		const char *slash = strchr(path, '/');
+		size_t len = slash ? (size_t)(slash - path) : strlen(path);
+
+		if (last && len == last_len && !memcmp(path, last, len))
+			continue;
+
+		last = path;
+		last_len = len;
+		error = rugged__status_add_name(scan, path, len);
+	}
+
+	git_index_free(index);
+
+	if (error < 0)
+		return error;
+
+	error = git_revparse_single(&tree, scan->repo, "HEAD^{tree}");
+
+	if (error == GIT_ENOTFOUND || error == GIT_EUNBORNBRANCH) {
+		giterr_clear();
+		error = 0;
+	} else if (!error) {
+		count = git_tree_entrycount((git_tree *)tree);
+
+		for (i = 0; !error && i < count; ++i) {
+			const char *name = git_tree_entry_name(git_tree_entry_byindex((git_tree *)tree, i));
+			error = rugged__status_add_name(scan, name, strlen(name));
+		}
+
+		git_object_free(tree);
+	}
+
+	if (error < 0)
+		return error;
+
+	qsort(scan->names, scan->names_count, sizeof(char *), rugged__status_name_cmp);
+
+	for (i = 0, count = 0; i < scan->names_count; ++i) {
+		if (count && !strcmp(scan->names[count - 1], scan->names[i]))
+			free(scan->names[i]);
+		else
+			scan->names[count++] = scan->names[i];
+	}
+	scan->names_count = count;
+
+	return 0;
+}
+
+static int rugged__status_partition(struct rugged_status_scan *scan)
+{
+	size_t t, share;
+	int error;
+
+	if ((error = rugged__status_collect_names(scan)) < 0)
+		return error;
+
+	if (scan->threads > scan->names_count)
+		scan->threads = scan->names_count;
+
+	if (scan->threads < 2)
+		return 0;
+
+	/* contiguous ranges keep each worker's iterators bounded */
+	share = (scan->names_count + scan->threads - 1) / scan->threads;
+	scan->threads = (scan->names_count + share - 1) / share;
+
+	for (t = 0; t < scan->threads; ++t) {
+		struct rugged_status_worker *worker = &scan->workers[t];
+
+		worker->repo = NULL;
+		worker->names = scan->names + t * share;
+		worker->names_count = t == scan->threads - 1 ?
+			scan->names_count - t * share : share;
+	}
+
+	return 0;
+}
+#endif
+
+static void *rugged__status_scan_nogvl(void *data)
+{
+	struct rugged_status_scan *scan = data;
+	size_t t;
+
+#ifdef HAVE_PTHREAD_H
+	if (scan->threads > 1) {
+		pthread_t *threads;
+		int *started;
+
+		if ((scan->error = rugged__status_partition(scan)) < 0)
+			return NULL;
+
+		threads = calloc(scan->threads + 1, sizeof(pthread_t));
+		started = calloc(scan->threads + 1, sizeof(int));
+
+		if (threads && started && scan->threads > 1) {
+			for (t = 0; t < scan->threads; ++t)
+				started[t] = pthread_create(&threads[t], NULL, rugged__status_work, &scan->workers[t]) == 0;
+
+			/* whatever couldn't get a thread of its own is handled here */
+			for (t = 0; t < scan->threads; ++t) {
+				if (started[t])
+					pthread_join(threads[t], NULL);
+				else
+					rugged__status_work(&scan->workers[t]);
+			}
+
+			free(threads);
+			free(started);
+			return NULL;
+		}
+
+		free(threads);
+		free(started);
+	}
+#endif
+
+	scan->threads = 1;
+	scan->workers[0].repo = scan->repo;
+	scan->workers[0].names_count = 0;
+	rugged__status_work(&scan->workers[0]);
+
+	return NULL;
+}
+
+struct rugged_status_entry {
+	const char *path;
+	uint16_t flags;
+};
+
+static int rugged__status_entry_cmp(const void *a, const void *b)
+{
+	return strcmp(
+		((const struct rugged_status_entry *)a)->path,
+		((const struct rugged_status_entry *)b)->path);
+}
+
+static VALUE rugged__status_table_new(struct rugged_status_scan *scan)
+{
+	VALUE rb_table, rb_paths, rb_path_offsets, rb_flags;
+	struct rugged_status_entry *entries;
+	size_t i, t, count = 0, paths_len = 0;
+	uint32_t offset;
+
+	for (t = 0; t < scan->threads; ++t) {
+		count += scan->workers[t].count;
+		paths_len += scan->workers[t].paths_len;
+	}
+
+	if (paths_len > UINT32_MAX)
+		return Qnil;
+
+	entries = xcalloc(count ? count : 1, sizeof(struct rugged_status_entry));
+
+	for (t = 0, count = 0; t < scan->threads; ++t) {
+		struct rugged_status_worker *worker = &scan->workers[t];
+
+		for (i = 0; i < worker->count; ++i, ++count) {
+			entries[count].path = worker->paths + worker->offsets[i];
+			entries[count].flags = worker->flags[i];
+		}
+	}
+
+	if (scan->threads > 1)
+		qsort(entries, count, sizeof(struct rugged_status_entry), rugged__status_entry_cmp);
+
+	rb_paths = rb_str_buf_new(paths_len);
+	rb_enc_associate(rb_paths, rb_utf8_encoding());
+	rb_path_offsets = rb_str_buf_new((count + 1) * sizeof(uint32_t));
+	rb_flags = rb_str_buf_new(count * sizeof(uint16_t));
+
+	for (i = 0; i < count; ++i) {
+		offset = (uint32_t)RSTRING_LEN(rb_paths);
+		rb_str_cat(rb_path_offsets, (const char *)&offset, sizeof(offset));
+		rb_str_cat(rb_paths, entries[i].path, strlen(entries[i].path));
+		rb_str_cat(rb_flags, (const char *)&entries[i].flags, sizeof(uint16_t));
+	}
+
+	offset = (uint32_t)RSTRING_LEN(rb_paths);
+	rb_str_cat(rb_path_offsets, (const char *)&offset, sizeof(offset));
+
+	xfree(entries);
+
+	rb_table = rb_class_new_instance(0, NULL, rb_cRuggedStatusTable);
+	rb_iv_set(rb_table, "@paths", rb_paths);
+	rb_iv_set(rb_table, "@path_offsets", rb_path_offsets);
+	rb_iv_set(rb_table, "@flags", rb_flags);
+
+	return rb_table;
+}
+
+static void rugged__status_scan_free(struct rugged_status_scan *scan, size_t workers)
+{
+	size_t t;
+
+	for (t = 0; t < workers; ++t) {
+		struct rugged_status_worker *worker = &scan->workers[t];
+
+		if (worker->repo && worker->repo != scan->repo)
+			git_repository_free(worker->repo);
+
+		free(worker->paths);
+		free(worker->offsets);
+		free(worker->flags);
+		free(worker->error_message);
+	}
+
+	for (t = 0; t < scan->names_count; ++t)
+		free(scan->names[t]);
+
+	free(scan->names);
+	xfree(scan->workers);
+}
+
+/*
+ *  call-seq:
+ *    repo.status_table(options = {}) -> status_table
+ *
+ *  Returns the status of every file in the working directory, like
+ *  #status, as a Rugged::StatusTable: the paths and their status flags
+ *  are packed into a few strings instead of yielding each file to a
+ *  block, and the whole scan runs without holding the GVL.
+ *
+ *  Unlike #status, ignored files are only reported when asked for.
+ *
+ *  The following options can be passed in the +options+ Hash:
+ *
+ *  :threads ::
+ *    The number of native threads scanning the working directory in
+ *    parallel. The sorted top-level entries of the repository are split
+ *    into one contiguous range per thread, so a single huge directory
+ *    doesn't benefit.
+ *    Defaults to 1. Ignored when libgit2 was built without thread support.
+ *
+ *  :untracked ::
+ *    +:no+ to leave untracked files out, +:normal+ (the default) to
+ *    report untracked directories as a whole, or +:all+ to report every
+ *    untracked file they contain.
+ *
+ *  :ignored ::
+ *    If true, ignored files are reported too. Defaults to false.
+ *
+ *    Hash[repo.status_table(threads: 8).to_a]
+ *    #=> {"README" => [:worktree_modified], "src/diff.c" => [:index_new, :worktree_new]}
+ */
+static VALUE rb_git_repo_status_table(int argc, VALUE *argv, VALUE self)
+{
+	struct rugged_status_scan scan;
+	struct rugged_status_worker *failed = NULL;
+	VALUE rb_options, rb_value, rb_table = Qnil;
+	size_t t, workers;
+	int error;
+
+	rb_scan_args(argc, argv, "00:", &rb_options);
+
+	memset(&scan, 0, sizeof(scan));
+	Data_Get_Struct(self, git_repository, scan.repo);
+
+	scan.threads = 1;
+	scan.options = GIT_STATUS_OPT_INCLUDE_UNTRACKED;
+
+	if (!NIL_P(rb_options)) {
+		rb_value = rb_hash_aref(rb_options, CSTR2SYM("threads"));
+		if (!NIL_P(rb_value)) {
+			Check_Type(rb_value, T_FIXNUM);
+			if (FIX2INT(rb_value) < 1)
+				rb_raise(rb_eArgError, "The number of threads must be positive");
+			scan.threads = FIX2INT(rb_value);
+		}
+
+		rb_value = rb_hash_aref(rb_options, CSTR2SYM("untracked"));
+		if (!NIL_P(rb_value)) {
+			ID id_untracked;
+
+			Check_Type(rb_value, T_SYMBOL);
+			id_untracked = SYM2ID(rb_value);
+
+			if (id_untracked == rb_intern("no"))
+				scan.options = 0;
+			else if (id_untracked == rb_intern("all"))
+				scan.options = GIT_STATUS_OPT_INCLUDE_UNTRACKED | GIT_STATUS_OPT_RECURSE_UNTRACKED_DIRS;
+			else if (id_untracked != rb_intern("normal"))
+				rb_raise(rb_eArgError, "Invalid untracked mode. Expected `:no`, `:normal` or `:all`");
+		}
+
+		if (RTEST(rb_hash_aref(rb_options, CSTR2SYM("ignored"))))
+			scan.options |= GIT_STATUS_OPT_INCLUDE_IGNORED;
+	}
+
+	/* let libgit2 report the error for bare repositories */
+	if (!(git_libgit2_features() & GIT_FEATURE_THREADS) || git_repository_is_bare(scan.repo))
+		scan.threads = 1;
+
+	workers = scan.threads;
+	scan.workers = xcalloc(workers, sizeof(struct rugged_status_worker));
+
+	for (t = 0; t < workers; ++t)
+		scan.workers[t].scan = &scan;
+
+	rugged_without_gvl(rugged__status_scan_nogvl, &scan);
+
+	if ((error = scan.error) == 0) {
+		for (t = 0; t < scan.threads; ++t) {
+			if (scan.workers[t].error < 0) {
+				failed = &scan.workers[t];
+				break;
+			}
+		}
+
+		if (failed) {
+			error = failed->error;
+
+			if (failed->error_message)
+				giterr_set_str(failed->error_class, failed->error_message);
+		}
+	}
+
+	if (!error)
+		rb_table = rugged__status_table_new(&scan);
+
+	rugged__status_scan_free(&scan, workers);
+	rugged_exception_check(error);
+
+	if (NIL_P(rb_table))
+		rb_raise(rb_eRangeError, "status is too large for a status table");
+
+	return rb_table;
+}
+
+void Init_rugged_status(void)
+{
+	rb_cRuggedStatusTable = rb_define_class_under(rb_mRugged, "StatusTable", rb_cObject);
+
+	rb_define_attr(rb_cRuggedStatusTable, "paths", 1, 0);
+	rb_define_attr(rb_cRuggedStatusTable, "path_offsets", 1, 0);
+	rb_define_attr(rb_cRuggedStatusTable, "flags", 1, 0);
+
+	rb_define_method(rb_cRuggedRepo, "status_table", rb_git_repo_status_table, -1);
+}
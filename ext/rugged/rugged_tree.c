@@ -32,45 +32,225 @@ extern VALUE rb_cRuggedIndex;
 extern VALUE rb_cRuggedCommit;
 
 VALUE rb_cRuggedTree;
+VALUE rb_cRuggedTreeEntry;
 VALUE rb_cRuggedTreeBuilder;
 
-static VALUE rb_git_treeentry_fromC(const git_tree_entry *entry)
+/* Keys and values of the entry hashes, interned once in Init_rugged_tree */
+static VALUE sym_entry_name, sym_entry_oid, sym_entry_filemode, sym_entry_type;
+static VALUE sym_type_tree, sym_type_blob, sym_type_commit;
+
+static VALUE rugged__treeentry_type(git_otype type)
+{
+	switch (type) {
+		case GIT_OBJ_TREE:
+			return sym_type_tree;
+
+		case GIT_OBJ_BLOB:
+			return sym_type_blob;
+
+		case GIT_OBJ_COMMIT:
+			return sym_type_commit;
+
+		default:
+			return Qnil;
+	}
+}
+
+static VALUE rb_git_treeentry_fromC(const git_tree_entry *entry, int raw_oid)
 {
 	VALUE rb_entry;
-	VALUE type;
 
 	if (!entry)
 		return Qnil;
 
 	rb_entry = rb_hash_new();
 
-	rb_hash_aset(rb_entry, CSTR2SYM("name"), rb_str_new_utf8(git_tree_entry_name(entry)));
-	rb_hash_aset(rb_entry, CSTR2SYM("oid"), rugged_create_oid(git_tree_entry_id(entry)));
+	rb_hash_aset(rb_entry, sym_entry_name, rb_str_new_utf8(git_tree_entry_name(entry)));
+	rb_hash_aset(rb_entry, sym_entry_oid, rugged_create_oid_as(git_tree_entry_id(entry), raw_oid));
 
-	rb_hash_aset(rb_entry, CSTR2SYM("filemode"), INT2FIX(git_tree_entry_filemode(entry)));
+	rb_hash_aset(rb_entry, sym_entry_filemode, INT2FIX(git_tree_entry_filemode(entry)));
+	rb_hash_aset(rb_entry, sym_entry_type, rugged__treeentry_type(git_tree_entry_type(entry)));
 
-	switch(git_tree_entry_type(entry)) {
-		case GIT_OBJ_TREE:
-			type = CSTR2SYM("tree");
-			break;
+	return rb_entry;
+}
 
-		case GIT_OBJ_BLOB:
-			type = CSTR2SYM("blob");
-			break;
+/*
+ * An entry yielded by Tree#each and Tree#walk: the OID, filemode and type are
+ * copied from the libgit2 entry and only converted when read, and the
+ * name is a frozen Ruby string.
+ */
+struct rugged_tree_entry {
+	git_oid oid;
+	git_filemode_t filemode;
+	git_otype type;
+	VALUE rb_name;
+	int raw_oid;
+};
 
-		case GIT_OBJ_COMMIT:
-			type = CSTR2SYM("commit");
-			break;
+static VALUE rugged__treeentry_name(const char *name)
+{
+#ifdef HAVE_RB_ENC_INTERNED_STR
+	return rb_enc_interned_str(name, strlen(name), rb_utf8_encoding());
+#else
+	return rb_obj_freeze(rb_str_new_utf8(name));
+#endif
+}
 
-		default:
-			type = Qnil;
-			break;
-	}
-	rb_hash_aset(rb_entry, CSTR2SYM("type"), type);
+static void rb_git_treeentry__mark(struct rugged_tree_entry *entry)
+{
+	rb_gc_mark(entry->rb_name);
+}
+
+static VALUE rugged_tree_entry_new(const git_tree_entry *entry, int raw_oid)
+{
+	struct rugged_tree_entry *rb_entry;
+	VALUE rb_name, self;
+
+	rb_name = rugged__treeentry_name(git_tree_entry_name(entry));
+
+	self = Data_Make_Struct(rb_cRuggedTreeEntry, struct rugged_tree_entry,
+		rb_git_treeentry__mark, xfree, rb_entry);
+
+	git_oid_cpy(&rb_entry->oid, git_tree_entry_id(entry));
+	rb_entry->filemode = git_tree_entry_filemode(entry);
+	rb_entry->type = git_tree_entry_type(entry);
+	rb_entry->rb_name = rb_name;
+	rb_entry->raw_oid = raw_oid;
+
+	return self;
+}
+
+static VALUE rb_git_treeentry_name(VALUE self)
+{
+	struct rugged_tree_entry *entry;
+	Data_Get_Struct(self, struct rugged_tree_entry, entry);
+
+	return entry->rb_name;
+}
+
+static VALUE rb_git_treeentry_oid(VALUE self)
+{
+	struct rugged_tree_entry *entry;
+	Data_Get_Struct(self, struct rugged_tree_entry, entry);
+
+	return rugged_create_oid_as(&entry->oid, entry->raw_oid);
+}
+
+static VALUE rb_git_treeentry_filemode(VALUE self)
+{
+	struct rugged_tree_entry *entry;
+	Data_Get_Struct(self, struct rugged_tree_entry, entry);
+
+	return INT2FIX(entry->filemode);
+}
+
+static VALUE rb_git_treeentry_type(VALUE self)
+{
+	struct rugged_tree_entry *entry;
+	Data_Get_Struct(self, struct rugged_tree_entry, entry);
+
+	return rugged__treeentry_type(entry->type);
+}
+
+/*
+ *  call-seq:
+ *    entry[key] -> value
+ *
+ *  Returns the value of +key+ (+:name+, +:oid+, +:filemode+ or +:type+),
+ *  so that entries can be read like the entry hashes of Tree#[].
+ */
+static VALUE rb_git_treeentry_aref(VALUE self, VALUE rb_key)
+{
+	if (rb_key == sym_entry_name)
+		return rb_git_treeentry_name(self);
+	if (rb_key == sym_entry_oid)
+		return rb_git_treeentry_oid(self);
+	if (rb_key == sym_entry_filemode)
+		return rb_git_treeentry_filemode(self);
+	if (rb_key == sym_entry_type)
+		return rb_git_treeentry_type(self);
+
+	return Qnil;
+}
+
+/*
+ *  call-seq:
+ *    entry.to_h -> hash
+ *
+ *  Returns the entry as a Hash in the format used by Tree#[].
+ */
+static VALUE rb_git_treeentry_to_h(VALUE self)
+{
+	VALUE rb_entry = rb_hash_new();
+
+	rb_hash_aset(rb_entry, sym_entry_name, rb_git_treeentry_name(self));
+	rb_hash_aset(rb_entry, sym_entry_oid, rb_git_treeentry_oid(self));
+	rb_hash_aset(rb_entry, sym_entry_filemode, rb_git_treeentry_filemode(self));
+	rb_hash_aset(rb_entry, sym_entry_type, rb_git_treeentry_type(self));
 
 	return rb_entry;
 }
 
+/*
+ *  call-seq:
+ *    entry.eql?(other) -> true or false
+ *
+ *  Returns +true+ if +other+ is a Rugged::Tree::Entry with the same
+ *  name, OID, filemode and type as +entry+.
+ */
+static VALUE rb_git_treeentry_eql(VALUE self, VALUE rb_other)
+{
+	struct rugged_tree_entry *entry, *other;
+
+	if (!rb_obj_is_kind_of(rb_other, rb_cRuggedTreeEntry))
+		return Qfalse;
+
+	Data_Get_Struct(self, struct rugged_tree_entry, entry);
+	Data_Get_Struct(rb_other, struct rugged_tree_entry, other);
+
+	if (entry->filemode != other->filemode || entry->type != other->type ||
+		!git_oid_equal(&entry->oid, &other->oid))
+		return Qfalse;
+
+	return rb_str_equal(entry->rb_name, other->rb_name);
+}
+
+/*
+ *  call-seq:
+ *    entry == other -> true or false
+ *
+ *  Returns +true+ if +other+ is an equal Rugged::Tree::Entry (see #eql?),
+ *  or a Hash equal to <tt>entry.to_h</tt>.
+ */
+static VALUE rb_git_treeentry_equal(VALUE self, VALUE rb_other)
+{
+	if (TYPE(rb_other) == T_HASH)
+		return rb_equal(rb_git_treeentry_to_h(self), rb_other);
+
+	return rb_git_treeentry_eql(self, rb_other);
+}
+
+/*
+ *  call-seq:
+ *    entry.hash -> integer
+ *
+ *  Returns a hash code consistent with #eql?, so that entries can be
+ *  used as Hash keys.
+ */
+static VALUE rb_git_treeentry_hash(VALUE self)
+{
+	struct rugged_tree_entry *entry;
+	st_index_t hash;
+	Data_Get_Struct(self, struct rugged_tree_entry, entry);
+
+	hash = rb_hash_start(rb_str_hash(entry->rb_name));
+	hash = rb_hash_uint(hash, rb_memhash(entry->oid.id, GIT_OID_RAWSZ));
+	hash = rb_hash_uint(hash, entry->filemode);
+	hash = rb_hash_end(hash);
+
+	return LONG2FIX((long)hash);
+}
+
 /*
  * Rugged Tree
  */
@@ -114,10 +294,10 @@ static VALUE rb_git_tree_get_entry(VALUE self, VALUE entry_id)
 	Data_Get_Struct(self, git_tree, tree);
 
 	if (TYPE(entry_id) == T_FIXNUM)
-		return rb_git_treeentry_fromC(git_tree_entry_byindex(tree, FIX2INT(entry_id)));
+		return rb_git_treeentry_fromC(git_tree_entry_byindex(tree, FIX2INT(entry_id)), 0);
 
 	else if (TYPE(entry_id) == T_STRING)
-		return rb_git_treeentry_fromC(git_tree_entry_byname(tree, StringValueCStr(entry_id)));
+		return rb_git_treeentry_fromC(git_tree_entry_byname(tree, StringValueCStr(entry_id)), 0);
 
 	else
 		rb_raise(rb_eTypeError, "entry_id must be either an index or a filename");
@@ -145,18 +325,29 @@ static VALUE rb_git_tree_get_entry_by_oid(VALUE self, VALUE rb_oid)
 	Data_Get_Struct(self, git_tree, tree);
 
 	Check_Type(rb_oid, T_STRING);
-	rugged_exception_check(git_oid_fromstr(&oid, StringValueCStr(rb_oid)));
+	rugged_exception_check(rugged_oid_fromstr(&oid, rb_oid));
 
-	return rb_git_treeentry_fromC(git_tree_entry_byid(tree, &oid));
+	return rb_git_treeentry_fromC(git_tree_entry_byid(tree, &oid), 0);
 }
 
 /*
  *  call-seq:
- *    tree.each { |entry| block }
- *    tree.each -> enumerator
+ *    tree.each(options = {}) { |entry| block }
+ *    tree.each(options = {}) -> enumerator
+ *    tree.each_entry(options = {}) { |entry| block }
+ *    tree.each_entry(options = {}) -> enumerator
+ *
+ *  Call +block+ with each of the entries of the tree as a
+ *  Rugged::Tree::Entry. If no +block+ is given, an +enumerator+ is
+ *  returned instead.
  *
- *  Call +block+ with each of the entries of the subtree as a +Hash+. If no +block+
- *  is given, an +enumerator+ is returned instead.
+ *  No Hash is built per entry: the name of an entry is a frozen (and, where
+ *  the Ruby supports it, deduplicated) String, and its +oid+ is only created
+ *  when read. Entries respond to +[]+ like the Hash entries of Tree#[], and
+ *  +to_h+ returns such a Hash.
+ *
+ *  If the +:oid_format+ option is set to +:raw+, the +oid+ of each entry is
+ *  given as a raw Rugged::Oid instead of hex.
  *
  *  Note that only the entries in the root of the tree are yielded; if you need to
  *  list also entries in subfolders, use +tree.walk+ instead.
@@ -165,39 +356,52 @@ static VALUE rb_git_tree_get_entry_by_oid(VALUE self, VALUE rb_oid)
  *
  *  generates:
  *
- *    {:name => "foo.txt", :type => :blob, :oid => "d8786bfc97485e8d7b19b21fb88c8ef1f199fc3f", :filemode => 0}
- *    {:name => "bar.txt", :type => :blob, :oid => "de5ba987198bcf2518885f0fc1350e5172cded78", :filemode => 0}
+ *    #<Rugged::Tree::Entry blob "foo.txt" d8786bfc97485e8d7b19b21fb88c8ef1f199fc3f>
+ *    #<Rugged::Tree::Entry blob "bar.txt" de5ba987198bcf2518885f0fc1350e5172cded78>
  *    ...
  */
-static VALUE rb_git_tree_each(VALUE self)
+static VALUE rb_git_tree_each(int argc, VALUE *argv, VALUE self)
 {
 	git_tree *tree;
 	size_t i, count;
+	int raw_oid;
+	VALUE rb_options;
 	Data_Get_Struct(self, git_tree, tree);
 
+	rb_scan_args(argc, argv, "01", &rb_options);
+
 	if (!rb_block_given_p())
-		return rb_funcall(self, rb_intern("to_enum"), 0);
+		return rb_funcall(self, rb_intern("to_enum"), 2, CSTR2SYM("each"), rb_options);
 
+	raw_oid = rugged_parse_oid_format(rb_options);
 	count = git_tree_entrycount(tree);
 
-	for (i = 0; i < count; ++i) {
-		const git_tree_entry *entry = git_tree_entry_byindex(tree, i);
-		rb_yield(rb_git_treeentry_fromC(entry));
-	}
+	for (i = 0; i < count; ++i)
+		rb_yield(rugged_tree_entry_new(git_tree_entry_byindex(tree, i), raw_oid));
 
 	return Qnil;
 }
 
-static int rugged__treewalk_cb(const char *root, const git_tree_entry *entry, void *payload)
+struct rugged_treewalk_yield_args {
+	const char *root;
+	const git_tree_entry *entry;
+};
+
+static VALUE rugged__treewalk_yield(VALUE data)
 {
-	int *exception = (int *)payload;
+	struct rugged_treewalk_yield_args *args = (struct rugged_treewalk_yield_args *)data;
 
-	VALUE rb_result, rb_args = rb_ary_new2(2);
+	return rb_yield_values(2, rb_str_new_utf8(args->root),
+		rugged_tree_entry_new(args->entry, 0));
+}
 
-	rb_ary_push(rb_args, rb_str_new_utf8(root));
-	rb_ary_push(rb_args, rb_git_treeentry_fromC(entry));
+static int rugged__treewalk_cb(const char *root, const git_tree_entry *entry, void *payload)
+{
+	int *exception = (int *)payload;
+	struct rugged_treewalk_yield_args args = { root, entry };
+	VALUE rb_result;
 
-	rb_result = rb_protect(rb_yield_splat, rb_args, exception);
+	rb_result = rb_protect(rugged__treewalk_yield, (VALUE)&args, exception);
 
 	if (*exception)
 		return -1;
@@ -216,9 +420,9 @@ static int rugged__treewalk_cb(const char *root, const git_tree_entry *entry, vo
  *    tree.walk(mode) -> Iterator
  *
  *  Walk +tree+ with the given mode (either +:preorder+ or +:postorder+) and yield
- *  to +block+ every entry in +tree+ and all its subtrees, as a +Hash+. The +block+
- *  also takes a +root+, the relative path in the traversal, starting from the root
- *  of the original tree.
+ *  to +block+ every entry in +tree+ and all its subtrees, as a Rugged::Tree::Entry
+ *  (see #each). The +block+ also takes a +root+, the relative path in the traversal,
+ *  starting from the root of the original tree.
  *
  *  If the +block+ returns a falsy value, that entry and its sub-entries (in the case
  *  of a folder) will be skipped for the iteration.
@@ -267,6 +471,177 @@ static VALUE rb_git_tree_walk(VALUE self, VALUE rb_mode)
 	return Qnil;
 }
 
+struct rugged_treepath_payload {
+	git_repository *repo;
+	char *path;
+	size_t path_len;
+	size_t path_alloc;
+	const char *prefix;
+	size_t prefix_len;
+	int max_depth;
+	int raw_oid;
+	int exception;
+};
+
+struct rugged_treepath_yield_args {
+	struct rugged_treepath_payload *payload;
+	const git_tree_entry *entry;
+};
+
+static void rugged__treepath_append(struct rugged_treepath_payload *payload, const char *str, size_t len)
+{
+	if (payload->path_len + len > payload->path_alloc) {
+		payload->path_alloc = (payload->path_len + len) * 2;
+		payload->path = xrealloc(payload->path, payload->path_alloc);
+	}
+
+	memcpy(payload->path + payload->path_len, str, len);
+	payload->path_len += len;
+}
+
+static VALUE rugged__treepath_yield(VALUE data)
+{
+	struct rugged_treepath_yield_args *args = (struct rugged_treepath_yield_args *)data;
+	struct rugged_treepath_payload *payload = args->payload;
+	VALUE rb_path;
+
+	rb_path = rb_enc_str_new(payload->path, payload->path_len, rb_utf8_encoding());
+	rb_obj_freeze(rb_path);
+
+	return rb_yield_values(4, rb_path,
+		rugged_create_oid_as(git_tree_entry_id(args->entry), payload->raw_oid),
+		INT2FIX(git_tree_entry_filemode(args->entry)),
+		rugged__treeentry_type(git_tree_entry_type(args->entry)));
+}
+
+static int rugged__tree_each_path(struct rugged_treepath_payload *payload, const git_tree *tree, int depth)
+{
+	size_t i, count = git_tree_entrycount(tree);
+	size_t root_len = payload->path_len;
+	int error = 0;
+
+	for (i = 0; !error && i < count; ++i) {
+		const git_tree_entry *entry = git_tree_entry_byindex(tree, i);
+		const char *name = git_tree_entry_name(entry);
+		size_t common;
+
+		payload->path_len = root_len;
+		rugged__treepath_append(payload, name, strlen(name));
+
+		/* Skip whole subtrees that cannot contain the prefix */
+		common = payload->path_len < payload->prefix_len ? payload->path_len : payload->prefix_len;
+		if (memcmp(payload->path, payload->prefix, common) != 0)
+			continue;
+
+		if (payload->path_len >= payload->prefix_len) {
+			struct rugged_treepath_yield_args args = { payload, entry };
+
+			rb_protect(rugged__treepath_yield, (VALUE)&args, &payload->exception);
+			if (payload->exception) {
+				error = -1;
+				break;
+			}
+		}
+
+		if (git_tree_entry_type(entry) == GIT_OBJ_TREE &&
+			(payload->max_depth < 0 || depth < payload->max_depth) &&
+			(payload->path_len >= payload->prefix_len || payload->prefix[payload->path_len] == '/')) {
+			git_tree *subtree;
+
+			if ((error = git_tree_lookup(&subtree, payload->repo, git_tree_entry_id(entry))) < 0)
+				break;
+
+			rugged__treepath_append(payload, "/", 1);
+			error = rugged__tree_each_path(payload, subtree, depth + 1);
+			git_tree_free(subtree);
+		}
+	}
+
+	payload->path_len = root_len;
+	return error;
+}
+
+/*
+ *  call-seq:
+ *    tree.each_path(options = {}) { |path, oid, filemode, type| block }
+ *    tree.each_path(options = {}) -> Iterator
+ *
+ *  Recursively list every entry in +tree+ and all its subtrees in a single
+ *  native pass, yielding the full (frozen) +path+ of each entry together
+ *  with its +oid+, +filemode+ and +type+. Entries are yielded in preorder,
+ *  so a tree is always yielded before its contents.
+ *
+ *  Unlike #walk, no entry object is built at all, which makes this the
+ *  cheapest way to list large trees.
+ *
+ *  The following options can be passed in the +options+ Hash:
+ *
+ *  :prefix ::
+ *    Only yield entries whose path starts with the given String. Subtrees
+ *    that cannot contain such paths are not loaded at all.
+ *
+ *  :max_depth ::
+ *    Do not descend deeper than the given number of subtree levels; +0+
+ *    only lists the root of +tree+. Defaults to no limit.
+ *
+ *  :oid_format ::
+ *    If set to +:raw+, oids are yielded as raw Rugged::Oid instances.
+ *
+ *    tree.each_path(:prefix => "lib/") { |path, oid, filemode, type| puts path }
+ *
+ *  generates:
+ *
+ *    lib/rugged.rb
+ *    lib/rugged
+ *    lib/rugged/blob.rb
+ *    ...
+ */
+static VALUE rb_git_tree_each_path(int argc, VALUE *argv, VALUE self)
+{
+	git_tree *tree;
+	struct rugged_treepath_payload payload = { NULL, NULL, 0, 0, "", 0, -1, 0, 0 };
+	VALUE rb_options;
+	int error;
+
+	rb_scan_args(argc, argv, "01", &rb_options);
+
+	if (!rb_block_given_p())
+		return rb_funcall(self, rb_intern("to_enum"), 2, CSTR2SYM("each_path"), rb_options);
+
+	Data_Get_Struct(self, git_tree, tree);
+
+	if (!NIL_P(rb_options)) {
+		VALUE rb_value;
+
+		payload.raw_oid = rugged_parse_oid_format(rb_options);
+
+		rb_value = rb_hash_aref(rb_options, CSTR2SYM("prefix"));
+		if (!NIL_P(rb_value)) {
+			Check_Type(rb_value, T_STRING);
+			payload.prefix = RSTRING_PTR(rb_value);
+			payload.prefix_len = RSTRING_LEN(rb_value);
+		}
+
+		rb_value = rb_hash_aref(rb_options, CSTR2SYM("max_depth"));
+		if (!NIL_P(rb_value)) {
+			Check_Type(rb_value, T_FIXNUM);
+			payload.max_depth = FIX2INT(rb_value);
+		}
+	}
+
+	payload.repo = git_tree_owner(tree);
+
+	error = rugged__tree_each_path(&payload, tree, 0);
+	xfree(payload.path);
+
+	if (payload.exception)
+		rb_jump_tag(payload.exception);
+
+	rugged_exception_check(error);
+
+	return Qnil;
+}
+
 /*
  *  call-seq:
  *    tree.path(path) -> entry
@@ -285,12 +660,34 @@ static VALUE rb_git_tree_path(VALUE self, VALUE rb_path)
 	error = git_tree_entry_bypath(&entry, tree, StringValueCStr(rb_path));
 	rugged_exception_check(error);
 
-	rb_entry = rb_git_treeentry_fromC(entry);
+	rb_entry = rb_git_treeentry_fromC(entry, 0);
 	git_tree_entry_free(entry);
 
 	return rb_entry;
 }
 
+struct rugged_tree_diff_args {
+	git_diff *diff;
+	git_repository *repo;
+	git_tree *old_tree;
+	git_tree *new_tree;
+	git_index *index;
+	const git_diff_options *opts;
+	int error;
+};
+
+static void *rugged__tree_diff_nogvl(void *data)
+{
+	struct rugged_tree_diff_args *args = data;
+
+	if (args->index)
+		args->error = git_diff_tree_to_index(&args->diff, args->repo, args->old_tree, args->index, args->opts);
+	else
+		args->error = git_diff_tree_to_tree(&args->diff, args->repo, args->old_tree, args->new_tree, args->opts);
+
+	return NULL;
+}
+
 /*
  *  call-seq:
  *    Tree.diff(repo, tree, diffable[, options]) -> diff
@@ -315,6 +712,30 @@ static VALUE rb_git_tree_path(VALUE self, VALUE rb_path)
  *    An integer specifying the maximum byte size of a file before a it will
  *    be treated as binary. The default value is 512MB.
  *
+ *  :max_file_bytes ::
+ *    Same as +:max_size+, but accepts sizes over 2GB. Files over this size
+ *    are never loaded and are reported as binary. Can't be combined with
+ *    +:max_size+.
+ *
+ *  :max_files ::
+ *    The maximum number of deltas in the diff. Further deltas are left out,
+ *    the diff is marked as Rugged::Diff#truncated?, and they're listed by
+ *    Rugged::Diff#skipped_deltas.
+ *
+ *  :timeout_ms ::
+ *    The time in milliseconds after which no further deltas are added to
+ *    the diff. The diff is then marked as Rugged::Diff#truncated?, and the
+ *    deltas left out are listed by Rugged::Diff#skipped_deltas. Each later
+ *    call to Rugged::Diff#each_patch, Rugged::Diff#patch and
+ *    Rugged::Diff#write_patch gets the same time to itself.
+ *
+ *  :max_total_lines ::
+ *    The maximum number of added and deleted lines loaded by
+ *    Rugged::Diff#each_patch, Rugged::Diff#patch and
+ *    Rugged::Diff#write_patch. Once it's spent, they stop, the diff is
+ *    marked as Rugged::Diff#truncated?, and the deltas left out are listed
+ *    by Rugged::Diff#truncated_deltas.
+ *
  *  :context_lines ::
  *    The number of unchanged lines that define the boundary of a hunk (and
  *    to display before and after the actual changes). The default is 3.
@@ -413,14 +834,17 @@ static VALUE rb_git_tree_path(VALUE self, VALUE rb_path)
  */
 static VALUE rb_git_tree_diff_(int argc, VALUE *argv, VALUE self)
 {
-	git_tree *tree = NULL;
+	git_tree *tree = NULL, *other_tree = NULL;
 	git_diff_options opts = GIT_DIFF_OPTIONS_INIT;
 	git_repository *repo = NULL;
-	git_diff *diff = NULL;
 	VALUE rb_self, rb_repo, rb_other, rb_options;
+	struct rugged_tree_diff_args args = { NULL };
+	struct rugged_diff_budget budget;
+	VALUE rb_diff;
 	int error;
 
 	rb_scan_args(argc, argv, "22", &rb_repo, &rb_self, &rb_other, &rb_options);
+	rugged_parse_diff_budget(&budget, &opts, rb_options);
 	rugged_parse_diff_options(&opts, rb_options);
 
 	Data_Get_Struct(rb_repo, git_repository, repo);
@@ -439,41 +863,59 @@ static VALUE rb_git_tree_diff_(int argc, VALUE *argv, VALUE self)
 			rb_raise(rb_eTypeError, "Need 'old' or 'new' for diffing");
 		}
 
-		error = git_diff_tree_to_tree(&diff, repo, tree, NULL, &opts);
+		args.old_tree = tree;
 	} else {
 		if (TYPE(rb_other) == T_STRING)
 			rb_other = rugged_object_rev_parse(rb_repo, rb_other, 1);
 
 		if (rb_obj_is_kind_of(rb_other, rb_cRuggedCommit)) {
-			git_tree *other_tree;
 			git_commit *commit;
 
 			Data_Get_Struct(rb_other, git_commit, commit);
 			error = git_commit_tree(&other_tree, commit);
 
-			if (!error) {
-				error = git_diff_tree_to_tree(&diff, repo, tree, other_tree, &opts);
-				git_tree_free(other_tree);
+			if (error) {
+				xfree(opts.pathspec.strings);
+				rugged_exception_check(error);
 			}
-		} else if (rb_obj_is_kind_of(rb_other, rb_cRuggedTree)) {
-			git_tree *other_tree;
 
-			Data_Get_Struct(rb_other, git_tree, other_tree);
-			error = git_diff_tree_to_tree(&diff, repo, tree, other_tree, &opts);
+			args.old_tree = tree;
+			args.new_tree = other_tree;
+		} else if (rb_obj_is_kind_of(rb_other, rb_cRuggedTree)) {
+			args.old_tree = tree;
+			Data_Get_Struct(rb_other, git_tree, args.new_tree);
 		} else if (rb_obj_is_kind_of(rb_other, rb_cRuggedIndex)) {
-			git_index *index;
-			Data_Get_Struct(rb_other, git_index, index);
-			error = git_diff_tree_to_index(&diff, repo, tree, index, &opts);
+			args.old_tree = tree;
+			Data_Get_Struct(rb_other, git_index, args.index);
 		} else {
 			xfree(opts.pathspec.strings);
 			rb_raise(rb_eTypeError, "A Rugged::Commit, Rugged::Tree or Rugged::Index instance is required");
 		}
 	}
 
+	args.repo = repo;
+	args.opts = &opts;
+	rugged_without_gvl(rugged__tree_diff_nogvl, &args);
+
+	git_tree_free(other_tree);
 	xfree(opts.pathspec.strings);
-	rugged_exception_check(error);
 
-	return rugged_diff_new(rb_cRuggedDiff, rb_repo, diff);
+	if (args.error)
+		rugged_diff_budget_free(&budget);
+	rugged_exception_check(args.error);
+
+	rb_diff = rugged_diff_new(rb_cRuggedDiff, rb_repo, args.diff);
+	rugged_diff_set_budget(rb_diff, &budget);
+	rugged_diff_set_options(rb_diff, rb_options);
+
+	return rb_diff;
+}
+
+static void *rugged__tree_diff_workdir_nogvl(void *data)
+{
+	struct rugged_tree_diff_args *args = data;
+	args->error = git_diff_tree_to_workdir(&args->diff, args->repo, args->old_tree, args->opts);
+	return NULL;
 }
 
 /*
@@ -489,26 +931,33 @@ static VALUE rb_git_tree_diff_(int argc, VALUE *argv, VALUE self)
  */
 static VALUE rb_git_tree_diff_workdir(int argc, VALUE *argv, VALUE self)
 {
-	git_tree *tree;
 	git_diff_options opts = GIT_DIFF_OPTIONS_INIT;
-	git_repository *repo;
-	git_diff *diff;
-	VALUE owner, rb_options;
-	int error;
+	struct rugged_tree_diff_args args = { NULL };
+	struct rugged_diff_budget budget;
+	VALUE owner, rb_options, rb_diff;
 
 	rb_scan_args(argc, argv, "00:", &rb_options);
+	rugged_parse_diff_budget(&budget, &opts, rb_options);
 	rugged_parse_diff_options(&opts, rb_options);
 
-	Data_Get_Struct(self, git_tree, tree);
+	Data_Get_Struct(self, git_tree, args.old_tree);
 	owner = rugged_owner(self);
-	Data_Get_Struct(owner, git_repository, repo);
+	Data_Get_Struct(owner, git_repository, args.repo);
 
-	error = git_diff_tree_to_workdir(&diff, repo, tree, &opts);
+	args.opts = &opts;
+	rugged_without_gvl(rugged__tree_diff_workdir_nogvl, &args);
 
 	xfree(opts.pathspec.strings);
-	rugged_exception_check(error);
 
-	return rugged_diff_new(rb_cRuggedDiff, owner, diff);
+	if (args.error)
+		rugged_diff_budget_free(&budget);
+	rugged_exception_check(args.error);
+
+	rb_diff = rugged_diff_new(rb_cRuggedDiff, owner, args.diff);
+	rugged_diff_set_budget(rb_diff, &budget);
+	rugged_diff_set_options(rb_diff, rb_options);
+
+	return rb_diff;
 }
 
 void rugged_parse_merge_options(git_merge_options *opts, VALUE rb_options)
@@ -694,7 +1143,7 @@ static VALUE rb_git_treebuilder_get(VALUE self, VALUE path)
 
 	Check_Type(path, T_STRING);
 
-	return rb_git_treeentry_fromC(git_treebuilder_get(builder, StringValueCStr(path)));
+	return rb_git_treeentry_fromC(git_treebuilder_get(builder, StringValueCStr(path)), 0);
 }
 
 /*
@@ -702,7 +1151,8 @@ static VALUE rb_git_treebuilder_get(VALUE self, VALUE path)
  *    builder << entry      -> nil
  *    builder.insert(entry) -> nil
  *
- *  Inser a new entry into +builder+.
+ *  Inser a new entry into +builder+. +entry+ is either a Hash with the
+ *  +:name+, +:oid+ and +:filemode+ of the entry, or a Rugged::Tree::Entry.
  */
 static VALUE rb_git_treebuilder_insert(VALUE self, VALUE rb_entry)
 {
@@ -712,6 +1162,18 @@ static VALUE rb_git_treebuilder_insert(VALUE self, VALUE rb_entry)
 	int error;
 
 	Data_Get_Struct(self, git_treebuilder, builder);
+
+	if (rb_obj_is_kind_of(rb_entry, rb_cRuggedTreeEntry)) {
+		struct rugged_tree_entry *entry;
+		Data_Get_Struct(rb_entry, struct rugged_tree_entry, entry);
+
+		error = git_treebuilder_insert(NULL, builder,
+			StringValueCStr(entry->rb_name), &entry->oid, entry->filemode);
+
+		rugged_exception_check(error);
+		return Qnil;
+	}
+
 	Check_Type(rb_entry, T_HASH);
 
 	rb_path = rb_hash_aref(rb_entry, CSTR2SYM("name"));
@@ -719,7 +1181,7 @@ static VALUE rb_git_treebuilder_insert(VALUE self, VALUE rb_entry)
 
 	rb_oid = rb_hash_aref(rb_entry, CSTR2SYM("oid"));
 	Check_Type(rb_oid, T_STRING);
-	rugged_exception_check(git_oid_fromstr(&oid, StringValueCStr(rb_oid)));
+	rugged_exception_check(rugged_oid_fromstr(&oid, rb_oid));
 
 	rb_attr = rb_hash_aref(rb_entry, CSTR2SYM("filemode"));
 	Check_Type(rb_attr, T_FIXNUM);
@@ -784,7 +1246,7 @@ static VALUE rb_git_treebuilder_write(VALUE self)
 static int treebuilder_cb(const git_tree_entry *entry, void *opaque)
 {
 	VALUE proc = (VALUE)opaque;
-	VALUE ret = rb_funcall(proc, rb_intern("call"), 1, rb_git_treeentry_fromC(entry));
+	VALUE ret = rb_funcall(proc, rb_intern("call"), 1, rb_git_treeentry_fromC(entry, 0));
 	return rugged_parse_bool(ret);
 }
 
@@ -808,6 +1270,14 @@ static VALUE rb_git_treebuilder_filter(VALUE self)
 
 void Init_rugged_tree(void)
 {
+	sym_entry_name     = CSTR2SYM("name");
+	sym_entry_oid      = CSTR2SYM("oid");
+	sym_entry_filemode = CSTR2SYM("filemode");
+	sym_entry_type     = CSTR2SYM("type");
+	sym_type_tree      = CSTR2SYM("tree");
+	sym_type_blob      = CSTR2SYM("blob");
+	sym_type_commit    = CSTR2SYM("commit");
+
 	/*
 	 * Tree
 	 */
@@ -819,12 +1289,27 @@ void Init_rugged_tree(void)
 	rb_define_method(rb_cRuggedTree, "path", rb_git_tree_path, 1);
 	rb_define_method(rb_cRuggedTree, "diff_workdir", rb_git_tree_diff_workdir, -1);
 	rb_define_method(rb_cRuggedTree, "[]", rb_git_tree_get_entry, 1);
-	rb_define_method(rb_cRuggedTree, "each", rb_git_tree_each, 0);
+	rb_define_method(rb_cRuggedTree, "each", rb_git_tree_each, -1);
+	rb_define_method(rb_cRuggedTree, "each_entry", rb_git_tree_each, -1);
 	rb_define_method(rb_cRuggedTree, "walk", rb_git_tree_walk, 1);
+	rb_define_method(rb_cRuggedTree, "each_path", rb_git_tree_each_path, -1);
 	rb_define_method(rb_cRuggedTree, "merge", rb_git_tree_merge, -1);
 
 	rb_define_singleton_method(rb_cRuggedTree, "diff", rb_git_tree_diff_, -1);
 
+	rb_cRuggedTreeEntry = rb_define_class_under(rb_cRuggedTree, "Entry", rb_cObject);
+	rb_undef_alloc_func(rb_cRuggedTreeEntry);
+
+	rb_define_method(rb_cRuggedTreeEntry, "name", rb_git_treeentry_name, 0);
+	rb_define_method(rb_cRuggedTreeEntry, "oid", rb_git_treeentry_oid, 0);
+	rb_define_method(rb_cRuggedTreeEntry, "filemode", rb_git_treeentry_filemode, 0);
+	rb_define_method(rb_cRuggedTreeEntry, "type", rb_git_treeentry_type, 0);
+	rb_define_method(rb_cRuggedTreeEntry, "[]", rb_git_treeentry_aref, 1);
+	rb_define_method(rb_cRuggedTreeEntry, "to_h", rb_git_treeentry_to_h, 0);
+	rb_define_method(rb_cRuggedTreeEntry, "==", rb_git_treeentry_equal, 1);
+	rb_define_method(rb_cRuggedTreeEntry, "eql?", rb_git_treeentry_eql, 1);
+	rb_define_method(rb_cRuggedTreeEntry, "hash", rb_git_treeentry_hash, 0);
+
 	rb_cRuggedTreeBuilder = rb_define_class_under(rb_cRuggedTree, "Builder", rb_cObject);
 	rb_define_singleton_method(rb_cRuggedTreeBuilder, "new", rb_git_treebuilder_new, -1);
 	rb_define_method(rb_cRuggedTreeBuilder, "clear", rb_git_treebuilder_clear, 0);
@@ -0,0 +1,855 @@
+/*
+ * The MIT License
+ *
+ * Copyright (c) 2014 GitHub, Inc
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "rugged.h"
+#include <stdio.h>
+#include <time.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#ifndef _WIN32
+#include <dirent.h>
+#endif
+
+/*
+ * The untracked cache remembers the listing of every directory of the
+ * working directory, along with its mtime: as long as the mtime of a
+ * directory doesn't change, neither do the names in it, and the cached
+ * listing is used instead of reading the directory again.
+ *
+ * libgit2 has no hook into its own walk of the working directory, so
+ * untracked and ignored files are found by a walk of our own over the
+ * cached listings, while libgit2 only looks at the tracked files. That
+ * only saves reading the directories that didn't change: libgit2 still
+ * compares HEAD to the index and stats every tracked file, so a status
+ * stays linear in the number of tracked files. It is
+ * enabled by `core.untrackedCache` and kept next to the index by
+ * Index#write, since libgit2 doesn't write unknown index extensions.
+ *
+ * Listings younger than the mtime granularity of the filesystem could
+ * still change without their mtime moving, so they're never trusted.
+ * The cache isn't available on Windows.
+ */
+#define UNTRACKED_CACHE_MAGIC "RUNTRAC1"
+#define UNTRACKED_CACHE_VERSION 1
+#define UNTRACKED_CACHE_FILE "rugged-untracked-cache"
+
+#define UNTRACKED_CACHE_FILE_ENTRY 'f'
+#define UNTRACKED_CACHE_DIR_ENTRY 'd'
+
+struct untracked_cache_dir {
+	char *path;
+	int64_t mtime_sec;
+	uint32_t mtime_nsec;
+	uint32_t count;
+
+	/* every name is preceded by its type and followed by a NUL */
+	char *names;
+	size_t names_len;
+
+	uint32_t seen;
+};
+
+struct rugged_untracked_cache {
+	struct untracked_cache_dir *dirs;
+	size_t capacity, count;
+
+	uint32_t generation;
+	int dirty;
+	int busy;
+};
+
+static ID id_untracked_cache;
+
+static uint32_t untracked_cache_hash(const char *path)
+{
+	uint32_t hash = 2166136261u;
+
+	while (*path) {
+		hash ^= (unsigned char)*path++;
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+static struct untracked_cache_dir *untracked_cache_find(struct rugged_untracked_cache *cache, const char *path)
+{
+	size_t i, mask = cache->capacity - 1;
+
+	if (!cache->capacity)
+		return NULL;
+
+	for (i = untracked_cache_hash(path) & mask; cache->dirs[i].path; i = (i + 1) & mask) {
+		if (!strcmp(cache->dirs[i].path, path))
+			return &cache->dirs[i];
+	}
+
+	return NULL;
+}
+
+static int untracked_cache_grow(struct rugged_untracked_cache *cache)
+{
+	size_t i, capacity = cache->capacity ? cache->capacity * 2 : 256;
+	struct untracked_cache_dir *dirs = calloc(capacity, sizeof(struct untracked_cache_dir));
+
+	if (!dirs) {
+		giterr_set_oom();
+		return -1;
+	}
+
+	for (i = 0; i < cache->capacity; ++i) {
+		size_t slot;
+
+		if (!cache->dirs[i].path)
+			continue;
+
+		slot = untracked_cache_hash(cache->dirs[i].path) & (capacity - 1);
+		while (dirs[slot].path)
+			slot = (slot + 1) & (capacity - 1);
+
+		dirs[slot] = cache->dirs[i];
+	}
+
+	free(cache->dirs);
+	cache->dirs = dirs;
+	cache->capacity = capacity;
+
+	return 0;
+}
+
+/*
+ * Store a listing, taking ownership of +path+ and +names+ (which are
+ * freed on failure).
+ */
+static struct untracked_cache_dir *untracked_cache_store(
+	struct rugged_untracked_cache *cache, char *path,
+	int64_t mtime_sec, uint32_t mtime_nsec,
+	char *names, size_t names_len, uint32_t count)
+{
+	struct untracked_cache_dir *dir = untracked_cache_find(cache, path);
+
+	if (dir) {
+		free(path);
+		free(dir->names);
+	} else {
+		size_t slot;
+
+		if ((cache->count + 1) * 4 > cache->capacity * 3 && untracked_cache_grow(cache) < 0) {
+			free(path);
+			free(names);
+			return NULL;
+		}
+
+		slot = untracked_cache_hash(path) & (cache->capacity - 1);
+		while (cache->dirs[slot].path)
+			slot = (slot + 1) & (cache->capacity - 1);
+
+		dir = &cache->dirs[slot];
+		dir->path = path;
+		cache->count++;
+	}
+
+	dir->mtime_sec = mtime_sec;
+	dir->mtime_nsec = mtime_nsec;
+	dir->names = names;
+	dir->names_len = names_len;
+	dir->count = count;
+	dir->seen = cache->generation;
+
+	return dir;
+}
+
+static void untracked_cache_clear(struct rugged_untracked_cache *cache)
+{
+	size_t i;
+
+	for (i = 0; i < cache->capacity; ++i) {
+		free(cache->dirs[i].path);
+		free(cache->dirs[i].names);
+	}
+
+	free(cache->dirs);
+	cache->dirs = NULL;
+	cache->capacity = cache->count = 0;
+}
+
+static void rb_git_untracked_cache__free(struct rugged_untracked_cache *cache)
+{
+	untracked_cache_clear(cache);
+	free(cache);
+}
+
+static char *untracked_cache_file(git_repository *repo)
+{
+	const char *gitdir = git_repository_path(repo);
+	char *path = malloc(strlen(gitdir) + strlen(UNTRACKED_CACHE_FILE) + 1);
+
+	if (path) {
+		strcpy(path, gitdir);
+		strcat(path, UNTRACKED_CACHE_FILE);
+	}
+
+	return path;
+}
+
+/*
+ * Load the listings saved by untracked_cache_save. A missing or damaged
+ * file only means starting from an empty cache.
+ */
+static void untracked_cache_load(struct rugged_untracked_cache *cache, git_repository *repo)
+{
+	char magic[8], *file = untracked_cache_file(repo);
+	uint32_t version, count, i;
+	FILE *fp;
+	int ok;
+
+	if (!file || (fp = fopen(file, "rb")) == NULL) {
+		free(file);
+		return;
+	}
+
+	ok = fread(magic, sizeof(magic), 1, fp) == 1 &&
+		fread(&version, sizeof(version), 1, fp) == 1 &&
+		fread(&count, sizeof(count), 1, fp) == 1 &&
+		memcmp(magic, UNTRACKED_CACHE_MAGIC, sizeof(magic)) == 0 &&
+		version == UNTRACKED_CACHE_VERSION;
+
+	for (i = 0; ok && i < count; ++i) {
+		uint32_t path_len, names_len, entries;
+		int64_t mtime_sec;
+		uint32_t mtime_nsec;
+		char *path = NULL, *names = NULL;
+
+		ok = fread(&path_len, sizeof(path_len), 1, fp) == 1 &&
+			fread(&names_len, sizeof(names_len), 1, fp) == 1 &&
+			fread(&entries, sizeof(entries), 1, fp) == 1 &&
+			fread(&mtime_sec, sizeof(mtime_sec), 1, fp) == 1 &&
+			fread(&mtime_nsec, sizeof(mtime_nsec), 1, fp) == 1 &&
+			path_len < 4096 && names_len < (1u << 28) &&
+			(path = malloc(path_len + 1)) != NULL &&
+			(names = malloc(names_len ? names_len : 1)) != NULL &&
+			fread(path, 1, path_len, fp) == path_len &&
+			fread(names, 1, names_len, fp) == names_len &&
+			(names_len == 0 || names[names_len - 1] == '\0');
+
+		if (!ok) {
+			free(path);
+			free(names);
+			break;
+		}
+
+		path[path_len] = '\0';
+		ok = untracked_cache_store(cache, path, mtime_sec, mtime_nsec, names, names_len, entries) != NULL;
+	}
+
+	if (!ok)
+		untracked_cache_clear(cache);
+
+	fclose(fp);
+	free(file);
+}
+
+static int untracked_cache_save(struct rugged_untracked_cache *cache, git_repository *repo)
+{
+	uint32_t version = UNTRACKED_CACHE_VERSION, count = 0;
+	char *file, *tmpfile;
+	size_t i;
+	FILE *fp;
+	int ok;
+
+	for (i = 0; i < cache->capacity; ++i) {
+		if (cache->dirs[i].path && cache->dirs[i].seen == cache->generation)
+			count++;
+	}
+
+	if ((file = untracked_cache_file(repo)) == NULL || (tmpfile = malloc(strlen(file) + 6)) == NULL) {
+		free(file);
+		giterr_set_oom();
+		return -1;
+	}
+
+	sprintf(tmpfile, "%s.lock", file);
+
+	if ((fp = fopen(tmpfile, "wb")) == NULL) {
+		giterr_set_str(GITERR_OS, "Failed to write the untracked cache");
+		free(tmpfile);
+		free(file);
+		return -1;
+	}
+
+	ok = fwrite(UNTRACKED_CACHE_MAGIC, 8, 1, fp) == 1 &&
+		fwrite(&version, sizeof(version), 1, fp) == 1 &&
+		fwrite(&count, sizeof(count), 1, fp) == 1;
+
+	/* directories that weren't seen by the last walk are gone */
+	for (i = 0; ok && i < cache->capacity; ++i) {
+		struct untracked_cache_dir *dir = &cache->dirs[i];
+		uint32_t path_len, names_len;
+
+		if (!dir->path || dir->seen != cache->generation)
+			continue;
+
+		path_len = (uint32_t)strlen(dir->path);
+		names_len = (uint32_t)dir->names_len;
+
+		ok = fwrite(&path_len, sizeof(path_len), 1, fp) == 1 &&
+			fwrite(&names_len, sizeof(names_len), 1, fp) == 1 &&
+			fwrite(&dir->count, sizeof(dir->count), 1, fp) == 1 &&
+			fwrite(&dir->mtime_sec, sizeof(dir->mtime_sec), 1, fp) == 1 &&
+			fwrite(&dir->mtime_nsec, sizeof(dir->mtime_nsec), 1, fp) == 1 &&
+			fwrite(dir->path, 1, path_len, fp) == path_len &&
+			fwrite(dir->names, 1, names_len, fp) == names_len;
+	}
+
+	if (fclose(fp) != 0)
+		ok = 0;
+
+	if (ok && rename(tmpfile, file) == 0) {
+		cache->dirty = 0;
+	} else {
+		remove(tmpfile);
+		giterr_set_str(GITERR_OS, "Failed to write the untracked cache");
+		ok = 0;
+	}
+
+	free(tmpfile);
+	free(file);
+
+	return ok ? 0 : -1;
+}
+
+void rugged_untracked_list_free(struct rugged_untracked_list *list)
+{
+	free(list->paths);
+	free(list->offsets);
+	free(list->flags);
+	memset(list, 0, sizeof(*list));
+}
+
+#ifndef _WIN32
+/*
+ * Walking the working directory
+ */
+struct untracked_walk {
+	struct rugged_untracked_cache *cache;
+	git_repository *repo;
+	git_index *index;
+	const char *workdir;
+	time_t now;
+
+	char *path;
+	size_t path_alloc;
+
+	struct rugged_untracked_list *list;
+};
+
+static int untracked_list_push(struct rugged_untracked_list *list, const char *path, size_t len, unsigned int flags)
+{
+	if (list->count == list->alloc) {
+		size_t alloc = list->alloc ? list->alloc * 2 : 64;
+		size_t *offsets;
+		unsigned int *new_flags;
+
+		if (!(offsets = realloc(list->offsets, alloc * sizeof(size_t))))
+			goto oom;
+		list->offsets = offsets;
+
+		if (!(new_flags = realloc(list->flags, alloc * sizeof(unsigned int))))
+			goto oom;
+		list->flags = new_flags;
+
+		list->alloc = alloc;
+	}
+
+	if (list->paths_len + len + 1 > list->paths_alloc) {
+		size_t alloc = list->paths_alloc ? list->paths_alloc * 2 : 1024;
+		char *paths;
+
+		while (alloc < list->paths_len + len + 1)
+			alloc *= 2;
+
+		if (!(paths = realloc(list->paths, alloc)))
+			goto oom;
+
+		list->paths = paths;
+		list->paths_alloc = alloc;
+	}
+
+	memcpy(list->paths + list->paths_len, path, len);
+	list->paths[list->paths_len + len] = '\0';
+
+	list->offsets[list->count] = list->paths_len;
+	list->flags[list->count] = flags;
+	list->paths_len += len + 1;
+	list->count++;
+
+	return 0;
+
+oom:
+	giterr_set_oom();
+	return -1;
+}
+
+/*
+ * Find the first index entry sorting at or after +path+. The index is
+ * sorted by path, as long as it isn't case-insensitive.
+ */
+static size_t untracked_index_lower_bound(git_index *index, const char *path)
+{
+	size_t lo = 0, hi = git_index_entrycount(index);
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+
+		if (strcmp(git_index_get_byindex(index, mid)->path, path) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+static int untracked_index_has(git_index *index, const char *path)
+{
+	size_t pos = untracked_index_lower_bound(index, path);
+
+	return pos < git_index_entrycount(index) &&
+		!strcmp(git_index_get_byindex(index, pos)->path, path);
+}
+
+/* +dir+ ends with a slash */
+static int untracked_index_has_below(git_index *index, const char *dir, size_t len)
+{
+	size_t pos = untracked_index_lower_bound(index, dir);
+
+	return pos < git_index_entrycount(index) &&
+		!strncmp(git_index_get_byindex(index, pos)->path, dir, len);
+}
+
+static int untracked_name_cmp(const void *a, const void *b)
+{
+	return strcmp(*(const char * const *)a + 1, *(const char * const *)b + 1);
+}
+
+static int untracked_walk_set_path(struct untracked_walk *walk, size_t len, const char *name)
+{
+	size_t name_len = strlen(name);
+
+	if (len + name_len + 2 > walk->path_alloc) {
+		size_t alloc = walk->path_alloc * 2;
+		char *path;
+
+		while (alloc < len + name_len + 2)
+			alloc *= 2;
+
+		if (!(path = realloc(walk->path, alloc))) {
+			giterr_set_oom();
+			return -1;
+		}
+
+		walk->path = path;
+		walk->path_alloc = alloc;
+	}
+
+	memcpy(walk->path + len, name, name_len + 1);
+	return 0;
+}
+
+/*
+ * Read the directory at walk->path (of length +len+) and store its
+ * sorted listing in the cache.
+ */
+static struct untracked_cache_dir *untracked_walk_read(struct untracked_walk *walk, size_t len, const struct stat *st)
+{
+	char *fullpath, **entries = NULL, *names = NULL, *path;
+	size_t count = 0, alloc = 0, names_len = 0, i;
+	struct dirent *de;
+	DIR *dir;
+	int64_t mtime_sec = (int64_t)st->st_mtime;
+
+	if (!(fullpath = malloc(strlen(walk->workdir) + len + 1)))
+		goto oom;
+
+	strcpy(fullpath, walk->workdir);
+	memcpy(fullpath + strlen(walk->workdir), walk->path, len + 1);
+
+	/* the directory went away: remember it as empty, but don't trust that */
+	if ((dir = opendir(fullpath)) == NULL) {
+		free(fullpath);
+
+		if (!(path = strdup(walk->path)))
+			goto oom_path;
+
+		return untracked_cache_store(walk->cache, path, -1, 0, NULL, 0, 0);
+	}
+
+	while ((de = readdir(dir)) != NULL) {
+		char type = UNTRACKED_CACHE_FILE_ENTRY, *entry;
+		size_t name_len = strlen(de->d_name);
+
+		if (!strcmp(de->d_name, ".") || !strcmp(de->d_name, ".."))
+			continue;
+
+#ifdef _DIRENT_HAVE_D_TYPE
+		if (de->d_type != DT_UNKNOWN) {
+			if (de->d_type == DT_DIR)
+				type = UNTRACKED_CACHE_DIR_ENTRY;
+		} else
+#endif
+		{
+			struct stat child;
+			char *childpath = malloc(strlen(fullpath) + name_len + 1);
+
+			if (!childpath)
+				goto oom_dir;
+
+			sprintf(childpath, "%s%s", fullpath, de->d_name);
+			if (!lstat(childpath, &child) && S_ISDIR(child.st_mode))
+				type = UNTRACKED_CACHE_DIR_ENTRY;
+			free(childpath);
+		}
+
+		if (count == alloc) {
+			char **grown;
+
+			alloc = alloc ? alloc * 2 : 32;
+			if (!(grown = realloc(entries, alloc * sizeof(char *))))
+				goto oom_dir;
+			entries = grown;
+		}
+
+		if (!(entry = malloc(name_len + 2)))
+			goto oom_dir;
+
+		entry[0] = type;
+		memcpy(entry + 1, de->d_name, name_len + 1);
+		entries[count++] = entry;
+		names_len += name_len + 2;
+	}
+
+	closedir(dir);
+	free(fullpath);
+
+	qsort(entries, count, sizeof(char *), untracked_name_cmp);
+
+	if (!(names = malloc(names_len ? names_len : 1)))
+		goto oom;
+
+	for (i = 0, names_len = 0; i < count; ++i) {
+		size_t entry_len = strlen(entries[i]) + 1;
+
+		memcpy(names + names_len, entries[i], entry_len);
+		names_len += entry_len;
+		free(entries[i]);
+	}
+	free(entries);
+
+	/* a listing read in the same second its directory changed can't be trusted */
+	if (mtime_sec >= (int64_t)walk->now - 1)
+		mtime_sec = -1;
+
+	if (!(path = strdup(walk->path))) {
+		free(names);
+		goto oom_path;
+	}
+
+	walk->cache->dirty = 1;
+
+	return untracked_cache_store(walk->cache, path, mtime_sec,
+#ifdef __APPLE__
+		(uint32_t)st->st_mtimespec.tv_nsec,
+#else
+		(uint32_t)st->st_mtim.tv_nsec,
+#endif
+		names, names_len, (uint32_t)count);
+
+oom_dir:
+	closedir(dir);
+	free(fullpath);
+oom:
+	for (i = 0; i < count; ++i)
+		free(entries[i]);
+	free(entries);
+oom_path:
+	giterr_set_oom();
+	return NULL;
+}
+
+static int untracked_walk_dir(struct untracked_walk *walk, size_t len, int tracked);
+
+/*
+ * Report the untracked or ignored entries of the directory at walk->path
+ * (of length +len+, empty or ending with a slash). Inside an untracked
+ * directory, nothing can be in the index.
+ */
+static int untracked_walk_dir(struct untracked_walk *walk, size_t len, int tracked)
+{
+	struct untracked_cache_dir *dir;
+	struct stat st;
+	const char *name;
+	char *fullpath, *names;
+	size_t i, names_len;
+	int error = 0;
+
+	if (!(fullpath = malloc(strlen(walk->workdir) + len + 1))) {
+		giterr_set_oom();
+		return -1;
+	}
+
+	strcpy(fullpath, walk->workdir);
+	memcpy(fullpath + strlen(walk->workdir), walk->path, len + 1);
+
+	error = lstat(fullpath, &st);
+	free(fullpath);
+
+	if (error < 0 || !S_ISDIR(st.st_mode))
+		return 0;
+
+	dir = untracked_cache_find(walk->cache, walk->path);
+
+	if (dir && dir->mtime_sec == (int64_t)st.st_mtime &&
+#ifdef __APPLE__
+		dir->mtime_nsec == (uint32_t)st.st_mtimespec.tv_nsec
+#else
+		dir->mtime_nsec == (uint32_t)st.st_mtim.tv_nsec
+#endif
+		) {
+		dir->seen = walk->cache->generation;
+	} else if ((dir = untracked_walk_read(walk, len, &st)) == NULL) {
+		return -1;
+	}
+
+	/* the listing can move while the cache grows below */
+	if (!(names = malloc(dir->names_len ? dir->names_len : 1))) {
+		giterr_set_oom();
+		return -1;
+	}
+
+	names_len = dir->names_len;
+	memcpy(names, dir->names, names_len);
+
+	/* nested repositories are reported as a whole */
+	if (!tracked && len) {
+		for (i = 0; i < names_len; i += strlen(names + i) + 1) {
+			if (!strcmp(names + i + 1, ".git")) {
+				free(names);
+				return untracked_list_push(walk->list, walk->path, len, GIT_STATUS_WT_NEW);
+			}
+		}
+	}
+
+	for (i = 0; !error && i < names_len; i += strlen(names + i) + 1) {
+		int is_dir = names[i] == UNTRACKED_CACHE_DIR_ENTRY, ignored = 0;
+		size_t child_len;
+
+		name = names + i + 1;
+
+		if (!len && !strcmp(name, ".git"))
+			continue;
+
+		if ((error = untracked_walk_set_path(walk, len, name)) < 0)
+			break;
+
+		child_len = len + strlen(name);
+
+		if (tracked && untracked_index_has(walk->index, walk->path))
+			continue;
+
+		if (is_dir) {
+			walk->path[child_len++] = '/';
+			walk->path[child_len] = '\0';
+
+			if (tracked && untracked_index_has_below(walk->index, walk->path, child_len)) {
+				error = untracked_walk_dir(walk, child_len, 1);
+				continue;
+			}
+		}
+
+		if ((error = git_ignore_path_is_ignored(&ignored, walk->repo, walk->path)) < 0)
+			break;
+
+		if (ignored)
+			error = untracked_list_push(walk->list, walk->path, child_len, GIT_STATUS_IGNORED);
+		else if (is_dir)
+			error = untracked_walk_dir(walk, child_len, 0);
+		else
+			error = untracked_list_push(walk->list, walk->path, child_len, GIT_STATUS_WT_NEW);
+	}
+
+	free(names);
+	walk->path[len] = '\0';
+
+	return error;
+}
+
+int rugged_untracked_cache_scan(
+	struct rugged_untracked_list *list,
+	struct rugged_untracked_cache *cache,
+	git_repository *repo)
+{
+	struct untracked_walk walk;
+	int error;
+
+	memset(&walk, 0, sizeof(walk));
+	walk.cache = cache;
+	walk.repo = repo;
+	walk.workdir = git_repository_workdir(repo);
+	walk.now = time(NULL);
+	walk.list = list;
+	walk.path_alloc = 256;
+
+	if (!(walk.path = malloc(walk.path_alloc))) {
+		giterr_set_oom();
+		return -1;
+	}
+	walk.path[0] = '\0';
+
+	if ((error = git_repository_index(&walk.index, repo)) < 0) {
+		free(walk.path);
+		return error;
+	}
+
+	cache->generation++;
+	error = untracked_walk_dir(&walk, 0, 1);
+
+	git_index_free(walk.index);
+	free(walk.path);
+
+	return error;
+}
+#else
+int rugged_untracked_cache_scan(
+	struct rugged_untracked_list *list,
+	struct rugged_untracked_cache *cache,
+	git_repository *repo)
+{
+	return 0;
+}
+#endif
+
+/*
+ * The cache of a repository is loaded on first use, and only used while
+ * `core.untrackedCache` is set and paths are case-sensitive.
+ */
+struct rugged_untracked_cache *rugged_untracked_cache_acquire(VALUE rb_repo, git_repository *repo)
+{
+	struct rugged_untracked_cache *cache;
+	VALUE rb_cache;
+	git_config *config;
+	int enabled = 0, ignorecase = 0;
+
+#ifdef _WIN32
+	return NULL;
+#endif
+
+	if (git_repository_is_bare(repo) || git_repository_config(&config, repo) < 0) {
+		giterr_clear();
+		return NULL;
+	}
+
+	if (git_config_get_bool(&enabled, config, "core.untrackedcache") < 0)
+		enabled = 0;
+
+	if (git_config_get_bool(&ignorecase, config, "core.ignorecase") < 0)
+		ignorecase = 0;
+
+	git_config_free(config);
+	giterr_clear();
+
+	if (!enabled || ignorecase)
+		return NULL;
+
+	rb_cache = rb_attr_get(rb_repo, id_untracked_cache);
+
+	if (NIL_P(rb_cache)) {
+		cache = calloc(1, sizeof(struct rugged_untracked_cache));
+		if (!cache)
+			rb_raise(rb_eNoMemError, "out of memory");
+
+		rb_cache = Data_Wrap_Struct(rb_cObject, NULL, rb_git_untracked_cache__free, cache);
+		untracked_cache_load(cache, repo);
+		rb_ivar_set(rb_repo, id_untracked_cache, rb_cache);
+	}
+
+	Data_Get_Struct(rb_cache, struct rugged_untracked_cache, cache);
+
+	/* only one walk at a time; the others go without the cache */
+	if (cache->busy)
+		return NULL;
+
+	cache->busy = 1;
+	return cache;
+}
+
+void rugged_untracked_cache_release(struct rugged_untracked_cache *cache)
+{
+	cache->busy = 0;
+}
+
+/*
+ * Save the untracked cache of +rb_repo+ if it changed. This runs once the
+ * index is written, so a failure isn't reported: the saved cache is
+ * removed instead, so that no outdated copy of it is loaded, and the next
+ * write tries again.
+ */
+void rugged_untracked_cache_write(VALUE rb_repo)
+{
+	struct rugged_untracked_cache *cache;
+	git_repository *repo;
+	VALUE rb_cache;
+	char *file;
+	int error;
+
+	if (!rb_obj_is_kind_of(rb_repo, rb_cRuggedRepo))
+		return;
+
+	rb_cache = rb_attr_get(rb_repo, id_untracked_cache);
+	if (NIL_P(rb_cache))
+		return;
+
+	Data_Get_Struct(rb_repo, git_repository, repo);
+	Data_Get_Struct(rb_cache, struct rugged_untracked_cache, cache);
+
+	if (!cache->dirty || cache->busy)
+		return;
+
+	cache->busy = 1;
+	error = untracked_cache_save(cache, repo);
+	cache->busy = 0;
+
+	if (error) {
+		if ((file = untracked_cache_file(repo)) != NULL)
+			remove(file);
+
+		free(file);
+		giterr_clear();
+	}
+}
+
+void Init_rugged_untracked_cache(void)
+{
+	id_untracked_cache = rb_intern("untracked_cache");
+}
@@ -5,19 +5,24 @@ rescue LoadError
   require "rugged/rugged"
 end
 require 'rugged/index'
+require 'rugged/oid'
 require 'rugged/object'
 require 'rugged/commit'
 require 'rugged/version'
 require 'rugged/repository'
 require 'rugged/reference'
 require 'rugged/walker'
+require 'rugged/commit_graph'
 require 'rugged/tree'
 require 'rugged/tag'
 require 'rugged/branch'
 require 'rugged/diff'
+require 'rugged/diff_cache'
 require 'rugged/patch'
 require 'rugged/remote'
 require 'rugged/credentials'
 require 'rugged/attributes'
 require 'rugged/blob'
 require 'rugged/submodule_collection'
+require 'rugged/status_table'
+require 'rugged/file_monitor'
@@ -0,0 +1,36 @@
+require 'digest/sha1'
+require 'fileutils'
+
+module Rugged
+  class CommitGraph
+    # Write the commit-graph of a repository to its objects/info directory,
+    # in the same format and location as `git commit-graph write`.
+    #
+    # The file is written to a lock file first and then renamed into place,
+    # so readers never see a partial graph.
+    #
+    # repo - The Rugged::Repository to write the graph for.
+    #
+    # Returns the String path of the written file.
+    def self.write(repo)
+      data = serialize(repo)
+      data << Digest::SHA1.digest(data)
+
+      path = File.join(repo.path, "objects", "info", "commit-graph")
+      lock = "#{path}.lock"
+      FileUtils.mkdir_p(File.dirname(path))
+
+      File.open(lock, File::WRONLY | File::CREAT | File::EXCL | File::BINARY, 0444) do |io|
+        begin
+          io.write(data)
+        rescue
+          File.unlink(lock)
+          raise
+        end
+      end
+
+      File.rename(lock, path)
+      path
+    end
+  end
+end
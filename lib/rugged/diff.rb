@@ -1,5 +1,6 @@
 require 'rugged/diff/hunk'
 require 'rugged/diff/line'
+require 'rugged/diff/line_table'
 require 'rugged/diff/delta'
 
 module Rugged
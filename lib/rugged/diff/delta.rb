@@ -4,13 +4,6 @@ module Rugged
       attr_reader :owner
       alias diff owner
 
-      attr_reader :old_file
-      attr_reader :new_file
-      attr_reader :similarity
-      attr_reader :status
-      attr_reader :status_char
-      attr_reader :binary
-
       alias binary? binary
 
       def added?
@@ -0,0 +1,102 @@
+module Rugged
+  class Diff
+    # A compact, columnar representation of the lines of a patch or hunk,
+    # as returned by Patch#lines_columnar and Hunk#line_table.
+    #
+    # Each column is a single String:
+    #
+    # origins         :: one byte per line, as in `git diff` (" ", "+", "-", ...)
+    # old_linenos     :: native-endian 32-bit signed integers, -1 if absent
+    # new_linenos     :: native-endian 32-bit signed integers, -1 if absent
+    # content         :: the content of all lines, concatenated
+    # content_offsets :: native-endian 32-bit unsigned offsets into +content+,
+    #                    one per line plus a final one for the end of the buffer
+    # file_offsets    :: native-endian 64-bit signed offsets of the lines in
+    #                    their files, as in Diff::Line#content_offset, -1 if absent
+    # hunk_offsets    :: native-endian 32-bit unsigned indexes of the first line
+    #                    of each hunk, plus a final one for the number of lines
+    #
+    # The columns can be unpacked in bulk with <tt>String#unpack("l*")</tt>,
+    # <tt>String#unpack("L*")</tt> and <tt>String#unpack("q*")</tt>, or read
+    # one line at a time with the accessors below.
+    class LineTable
+      include Enumerable
+
+      ORIGINS = {
+        " " => :context,
+        "+" => :addition,
+        "-" => :deletion,
+        "=" => :eof_no_newline,
+        ">" => :eof_newline_added,
+        "<" => :eof_newline_removed,
+        "F" => :file_header,
+        "H" => :hunk_header,
+        "B" => :binary
+      }.freeze
+
+      # Returns the number of lines in the table.
+      def size
+        @origins.bytesize
+      end
+      alias count size
+
+      # Returns the number of hunks in the table.
+      def hunk_count
+        @hunk_offsets.bytesize / 4 - 1
+      end
+
+      # Returns the origin of the line at +index+ as a Symbol, like
+      # Diff::Line#line_origin.
+      def line_origin(index)
+        ORIGINS.fetch(@origins[index], :unknown)
+      end
+
+      def old_lineno(index)
+        @old_linenos[index * 4, 4].unpack("l").first
+      end
+
+      def new_lineno(index)
+        @new_linenos[index * 4, 4].unpack("l").first
+      end
+
+      # Returns the offset of the line at +index+ in its file, like
+      # Diff::Line#content_offset, or +nil+ if it has none.
+      def content_offset(index)
+        offset = @file_offsets[index * 8, 8].unpack("q").first
+        offset unless offset == -1
+      end
+
+      # Returns the content of the line at +index+.
+      def line_content(index)
+        start, stop = @content_offsets[index * 4, 8].unpack("L2")
+        @content.byteslice(start, stop - start)
+      end
+
+      # Yields each line of the table as a Diff::Line.
+      def each
+        return to_enum(__method__) unless block_given?
+
+        size.times do |index|
+          yield line(index)
+        end
+
+        self
+      end
+
+      # Returns a Diff::Line for the line at +index+.
+      def line(index)
+        line = Line.allocate
+        line.instance_variable_set(:@line_origin, line_origin(index))
+        line.instance_variable_set(:@content, line_content(index))
+        line.instance_variable_set(:@old_lineno, old_lineno(index))
+        line.instance_variable_set(:@new_lineno, new_lineno(index))
+        line.instance_variable_set(:@content_offset, content_offset(index))
+        line
+      end
+
+      def inspect
+        "#<#{self.class.name}:#{object_id} {size: #{size}, hunk_count: #{hunk_count}}>"
+      end
+    end
+  end
+end
@@ -0,0 +1,126 @@
+module Rugged
+  # A size-bounded, file-backed cache for the results of tree-to-tree diffs.
+  #
+  # Results are keyed by the OIDs of the two trees and the canonical form of
+  # the diff options, so the same diff requested with the same options from
+  # different places is only computed once. A cache hit is served straight
+  # from the cache file; the only objects read from the repository are the
+  # commits or revisions that have to be resolved to their trees.
+  #
+  # Results are stored as plain text and parsed back, never as marshaled
+  # Ruby objects, so a cache file shared with other users can at worst
+  # produce wrong results, not run code.
+  #
+  #   cache = Rugged::DiffCache.new("/var/cache/diffs", 256 * 1024 * 1024)
+  #   cache.patch(repo, old_commit, new_commit, :context_lines => 5)
+  #   cache.stat(repo, old_commit, new_commit)
+  #
+  # Trees can be given as Rugged::Tree or Rugged::Commit objects, as SHA1 OID
+  # Strings or revisions that resolve to a tree or commit, or as +nil+ for an
+  # empty tree.
+  class DiffCache
+    DELTA_STATUSES = [
+      :unmodified, :added, :deleted, :modified, :renamed,
+      :copied, :ignored, :untracked, :typechange, :unknown
+    ].freeze
+
+    # Returns the patch of the diff between +old_tree+ and +new_tree+,
+    # like Rugged::Diff#patch.
+    def patch(repo, old_tree, new_tree, options = {})
+      fetch(:patch, repo, old_tree, new_tree, options) { |diff| diff.patch }
+    end
+
+    # Returns the number of files changed, additions and deletions of the
+    # diff between +old_tree+ and +new_tree+, like Rugged::Diff#stat.
+    def stat(repo, old_tree, new_tree, options = {})
+      data = fetch(:stat, repo, old_tree, new_tree, options) { |diff| diff.stat.join(" ") }
+      data.split(" ").map { |count| Integer(count) }
+    end
+
+    # Returns the per-file additions and deletions of the diff between
+    # +old_tree+ and +new_tree+, like Rugged::Diff#numstat.
+    def numstat(repo, old_tree, new_tree, options = {})
+      data = fetch(:numstat, repo, old_tree, new_tree, options) do |diff|
+        diff.numstat.map { |path, adds, dels| "#{adds || "-"}\t#{dels || "-"}\t#{path}\0" }.join
+      end
+
+      data.split("\0").map do |line|
+        adds, dels, path = line.split("\t", 3)
+        [path.force_encoding(Encoding::UTF_8), parse_count(adds), parse_count(dels)]
+      end
+    end
+
+    # Returns an Array with a Hash for each delta of the diff between
+    # +old_tree+ and +new_tree+, with its +:status+, +:old_path+, +:new_path+
+    # and +:similarity+.
+    def deltas(repo, old_tree, new_tree, options = {})
+      data = fetch(:deltas, repo, old_tree, new_tree, options) do |diff|
+        diff.each_delta.map do |delta|
+          [delta.status, delta.old_file[:path], delta.new_file[:path], delta.similarity].join("\0") + "\0"
+        end.join
+      end
+
+      data.split("\0").each_slice(4).map do |status, old_path, new_path, similarity|
+        {
+          :status => DELTA_STATUSES.find { |known| known.to_s == status } || raise(ArgumentError, "invalid delta status"),
+          :old_path => old_path.force_encoding(Encoding::UTF_8),
+          :new_path => new_path.force_encoding(Encoding::UTF_8),
+          :similarity => Integer(similarity)
+        }
+      end
+    end
+
+    # Returns the cached result of type +kind+ for the diff between +old_tree+
+    # and +new_tree+. On a miss, yields the Rugged::Diff between them and
+    # stores the result of the block, which must be a String. Results of a
+    # diff that went over one of its budgets (see Rugged::Diff#truncated?)
+    # are returned but never stored.
+    def fetch(kind, repo, old_tree, new_tree, options = {})
+      old_oid, new_oid = tree_oid(repo, old_tree), tree_oid(repo, new_tree)
+      raise TypeError, "Need 'old' or 'new' for diffing" if old_oid.nil? && new_oid.nil?
+
+      key = [kind.to_s, old_oid.to_s, new_oid.to_s].join("\0")
+      key << "\0" << DiffCache.options_key(options)
+
+      if data = self[key]
+        return data
+      end
+
+      old_tree = old_oid && Tree.lookup(repo, old_oid)
+      new_tree = new_oid && Tree.lookup(repo, new_oid)
+
+      # Tree.diff needs an old tree; diffing the other way around is the same
+      # diff in reverse.
+      diff = if old_tree
+        Tree.diff(repo, old_tree, new_tree, options)
+      else
+        Tree.diff(repo, new_tree, nil, options.merge(:reverse => !options[:reverse]))
+      end
+
+      value = yield diff
+      raise TypeError, "The cached value must be a String" unless value.is_a?(String)
+
+      self[key] = value unless diff.truncated?
+      value
+    end
+
+    private
+
+    # Every argument is resolved to the OID of its tree, so that a commit,
+    # its tree and any revision naming either share the same key.
+    def tree_oid(repo, tree)
+      case tree
+      when nil then nil
+      when Rugged::Commit then tree.tree_id
+      when Rugged::Tree then tree.oid
+      when String then repo.rev_parse_oid("#{tree}^{tree}")
+      else
+        raise TypeError, "A Rugged::Commit, Rugged::Tree or SHA1 OID is required"
+      end
+    end
+
+    def parse_count(count)
+      count == "-" ? nil : Integer(count)
+    end
+  end
+end
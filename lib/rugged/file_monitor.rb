@@ -0,0 +1,59 @@
+module Rugged
+  # Tracks the paths changed in a working directory, so that
+  # Repository#status, Index#add_all and Index#update_all only need to
+  # look at those. See Repository#file_monitor=.
+  #
+  # Subclasses implement #poll, returning the paths changed since the
+  # previous call, or +nil+ if that isn't known. This class turns those
+  # into the tokens handed out by #changed_paths, so that any number of
+  # consumers can share one monitor.
+  class FileMonitor
+    # The number of changed paths remembered for the consumers that are
+    # behind. A consumer that falls further behind than that gets +nil+
+    # from #changed_paths, and scans everything again.
+    MAX_CHANGES = 10_000
+
+    # Returns a token for the current state of the working directory, and
+    # the paths changed since +token+, or +nil+ instead of the paths if
+    # +token+ is +nil+ or older than the last time the monitor lost track.
+    def changed_paths(token)
+      @changes_generation ||= 0
+      @changed_at ||= {}
+      @changes_lost ||= 0
+
+      paths = poll
+      @changes_generation += 1
+
+      if paths.nil?
+        @changed_at.clear
+        @changes_lost = @changes_generation
+      else
+        record_changes(paths)
+      end
+
+      return [@changes_generation, nil] if token.nil? || token < @changes_lost || token > @changes_generation
+      [@changes_generation, @changed_at.select { |_, generation| generation > token }.keys]
+    end
+
+    def poll
+      raise NotImplementedError, "#{self.class.name}#poll is not implemented"
+    end
+
+    private
+
+    # Keeps @changed_at in the order the paths last changed in, and drops the
+    # oldest ones past MAX_CHANGES: the tokens from before them are lost.
+    def record_changes(paths)
+      paths.each do |path|
+        @changed_at.delete(path)
+        @changed_at[path] = @changes_generation
+      end
+
+      while @changed_at.size > MAX_CHANGES
+        path, generation = @changed_at.first
+        @changed_at.delete(path)
+        @changes_lost = generation
+      end
+    end
+  end
+end
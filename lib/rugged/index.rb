@@ -9,5 +9,11 @@ module Rugged
       end
       s + '>'
     end
+
+    class Entry
+      def inspect
+        "#<#{self.class.name} [#{stage}] '#{path}'>"
+      end
+    end
   end
 end
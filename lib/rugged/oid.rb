@@ -0,0 +1,22 @@
+module Rugged
+  class Oid
+    # Wrap the 20 bytes of a raw SHA1 OID, such as one read back from a
+    # database, so that Rugged takes it as an OID and not as a revspec.
+    def initialize(raw)
+      raw = raw.to_str
+      raise TypeError, "Invalid buffer size for an OID" unless raw.bytesize == 20
+
+      super(raw, :encoding => Encoding::BINARY)
+      freeze
+    end
+
+    # Returns the OID as a String of 40 hexadecimal characters.
+    def to_hex
+      Rugged.raw_to_hex(self)
+    end
+
+    def inspect
+      "#<Rugged::Oid #{to_hex}>"
+    end
+  end
+end
@@ -202,6 +202,20 @@ module Rugged
       (blob.type == :blob) ? blob : nil
     end
 
+    # Write a commit-graph file covering every commit reachable from the
+    # references of this repository, and start using it for #ahead_behind,
+    # #descendant_of?, #merge_base and #merge_bases.
+    #
+    # Commits created afterwards are handled without the graph until it is
+    # written again.
+    #
+    # Returns the String path of the written file.
+    def write_commit_graph
+      path = Rugged::CommitGraph.write(self)
+      remove_instance_variable(:@commit_graph) if instance_variable_defined?(:@commit_graph)
+      path
+    end
+
     def fetch(remote_or_url, *args)
       unless remote_or_url.kind_of? Remote
         remote_or_url = remotes[remote_or_url] || remotes.create_anonymous(remote_or_url)
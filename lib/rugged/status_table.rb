@@ -0,0 +1,68 @@
+module Rugged
+  # A compact, columnar representation of the status of a working
+  # directory, as returned by Repository#status_table.
+  #
+  # Each column is a single String:
+  #
+  # paths        :: the paths of all files, concatenated, sorted by path
+  # path_offsets :: native-endian 32-bit unsigned offsets into +paths+,
+  #                 one per file plus a final one for the end of the buffer
+  # flags        :: native-endian 16-bit unsigned status flags, one per file
+  #
+  # The columns can be unpacked in bulk with <tt>String#unpack("L*")</tt> and
+  # <tt>String#unpack("S*")</tt>, or read one file at a time with the
+  # accessors below.
+  class StatusTable
+    include Enumerable
+
+    # The status flags of libgit2 reported by Repository#status.
+    FLAGS = {
+      index_new: 1 << 0,
+      index_modified: 1 << 1,
+      index_deleted: 1 << 2,
+      worktree_new: 1 << 7,
+      worktree_modified: 1 << 8,
+      worktree_deleted: 1 << 9,
+      ignored: 1 << 14
+    }.freeze
+
+    # Returns the number of files in the table.
+    def size
+      @flags.bytesize / 2
+    end
+    alias count size
+
+    # Returns the path of the file at +index+.
+    def path(index)
+      start, stop = @path_offsets[index * 4, 8].unpack("L2")
+      @paths.byteslice(start, stop - start)
+    end
+
+    # Returns the raw libgit2 status flags of the file at +index+.
+    def raw_flags(index)
+      @flags[index * 2, 2].unpack("S").first
+    end
+
+    # Returns the status of the file at +index+ as an Array of Symbols,
+    # like Repository#status.
+    def status(index)
+      raw = raw_flags(index)
+      FLAGS.select { |_, bit| raw & bit != 0 }.keys
+    end
+
+    # Yields the path and status of each file, like Repository#status.
+    def each
+      return to_enum(__method__) unless block_given?
+
+      size.times do |index|
+        yield path(index), status(index)
+      end
+
+      self
+    end
+
+    def inspect
+      "#<#{self.class.name}:#{object_id} {size: #{size}}>"
+    end
+  end
+end
@@ -1,4 +1,6 @@
 require "test_helper"
+require "stringio"
+require "tempfile"
 
 class BlobTest < Rugged::TestCase
   include Rugged::RepositoryAccess
@@ -53,6 +55,20 @@ class BlobTest < Rugged::TestCase
     assert_equal 328, blob.sloc
   end
 
+  def test_blob_line_stats
+    oid = "7771329dfa3002caf8c61a0ceb62a31d09023f37"
+    blob = @repo.lookup(oid)
+    lines = blob.content.lines.map(&:chomp)
+
+    stats = blob.line_stats
+    assert_equal blob.sloc, stats[:sloc]
+    assert_equal lines.size, stats[:lines]
+    assert_equal lines.count { |line| line.strip.empty? }, stats[:blank]
+    assert_equal lines.map(&:bytesize).max, stats[:longest_line]
+    assert_equal 0, stats[:crlf]
+    assert_equal false, stats[:binary]
+  end
+
   def test_blob_content_with_size
     oid = "7771329dfa3002caf8c61a0ceb62a31d09023f37"
     blob = @repo.lookup(oid)
@@ -82,6 +98,51 @@ class BlobTest < Rugged::TestCase
     assert_equal blob.size, content.size
   end
 
+  def test_blob_read_range
+    blob = @repo.lookup("7771329dfa3002caf8c61a0ceb62a31d09023f37")
+
+    assert_equal "# Rugged\n*", blob.read(0, 10)
+    assert_equal blob.content[100, 50], blob.read(100, 50)
+    assert_equal blob.content[11000..-1], blob.read(11000)
+    assert_equal blob.content[11000..-1], blob.read(11000, 1000)
+    assert_equal Encoding::BINARY, blob.read(0, 10).encoding
+    assert_equal "", blob.read(blob.size)
+    assert_nil blob.read(blob.size + 1)
+    assert_raises(ArgumentError) { blob.read(-1) }
+  end
+
+  def test_blob_each_chunk
+    blob = @repo.lookup("7771329dfa3002caf8c61a0ceb62a31d09023f37")
+
+    chunks = blob.each_chunk(:chunk_size => 4096).to_a
+    assert_equal [4096, 4096, 3005], chunks.map(&:bytesize)
+    assert_equal blob.content, chunks.join
+
+    chunks = []
+    blob.each_chunk(:chunk_size => 100, :offset => 10, :length => 250) { |chunk| chunks << chunk }
+    assert_equal [100, 100, 50], chunks.map(&:bytesize)
+    assert_equal blob.content[10, 250], chunks.join
+
+    assert_equal [], blob.each_chunk(:offset => blob.size + 10).to_a
+    assert_raises(ArgumentError) { blob.each_chunk(:chunk_size => 0) {} }
+  end
+
+  def test_blob_write_to
+    blob = @repo.lookup("7771329dfa3002caf8c61a0ceb62a31d09023f37")
+
+    io = StringIO.new(String.new)
+    assert_equal blob.size, blob.write_to(io, :chunk_size => 1000)
+    assert_equal blob.content, io.string
+
+    Tempfile.open("rugged-blob") do |file|
+      file.binmode
+      file.write("header:")
+      assert_equal 20, blob.write_to(file, :offset => 2, :length => 20)
+      file.flush
+      assert_equal "header:" + blob.content[2, 20], File.binread(file.path)
+    end
+  end
+
   def test_blob_text_with_max_lines
     oid = "7771329dfa3002caf8c61a0ceb62a31d09023f37"
     blob = @repo.lookup(oid)
@@ -125,6 +186,30 @@ end
 class BlobWriteTest < Rugged::TestCase
   include Rugged::TempRepositoryAccess
 
+  def test_blob_write_to_file_descriptors
+    content = "rugged\n" * (256 * 1024)
+    blob = @repo.lookup(Rugged::Blob.from_buffer(@repo, content))
+
+    Dir.mktmpdir do |dir|
+      path = File.join(dir, "blob")
+      File.open(path, "wb") { |file| assert_equal content.bytesize, blob.write_to(file) }
+      assert_equal content, File.binread(path)
+    end
+
+    # Larger than the pipe buffer, so the write has to wait for the reader
+    reader, writer = IO.pipe
+    writer.binmode
+    thread = Thread.new { reader.binmode.read }
+
+    assert_equal content.bytesize, blob.write_to(writer)
+    writer.close
+
+    assert_equal content, thread.value
+  ensure
+    reader.close if reader && !reader.closed?
+    writer.close if writer && !writer.closed?
+  end
+
   def test_fetch_blob_content_with_nulls
     content = "100644 example_helper.rb\x00\xD3\xD5\xED\x9DA4_"+
                "\xE3\xC3\nK\xCD<!\xEA-_\x9E\xDC=40000 examples\x00"+
@@ -168,6 +253,82 @@ class BlobWriteTest < Rugged::TestCase
     text_blob = @repo.lookup(Rugged::Blob.from_disk(@repo, text_file_path))
     refute text_blob.binary?
   end
+
+  def test_blob_line_stats_with_crlf
+    oid = Rugged::Blob.from_buffer(@repo, "one\r\n\r\n  \n\tthree lines\r\nlast")
+    stats = @repo.lookup(oid).line_stats
+
+    assert_equal 5, stats[:lines]
+    assert_equal 3, stats[:sloc]
+    assert_equal 2, stats[:blank]
+    assert_equal 12, stats[:longest_line]
+    assert_equal 3, stats[:crlf]
+  end
+
+  def test_blob_line_stats_many
+    oids = [
+      Rugged::Blob.from_buffer(@repo, "a\nb\n"),
+      Rugged::Blob.from_buffer(@repo, ""),
+      Rugged::Blob.from_workdir(@repo, "README")
+    ]
+
+    stats = Rugged::Blob.line_stats(@repo, oids)
+    assert_equal oids.map { |oid| @repo.lookup(oid).line_stats }, stats
+    assert_equal 2, stats[0][:lines]
+    assert_equal 0, stats[1][:lines]
+
+    assert_raises Rugged::OdbError do
+      Rugged::Blob.line_stats(@repo, ["1" * 40])
+    end
+
+    assert_raises ArgumentError do
+      Rugged::Blob.line_stats(@repo, [oids[0], "a\0b"])
+    end
+  end
+
+  def test_signature_index
+    content = (1..40).map { |i| "line #{i}\n" }.join
+    original = Rugged::Blob.from_buffer(@repo, content)
+    edited = Rugged::Blob.from_buffer(@repo, content.sub("line 3\n", "line three\n"))
+    unrelated = Rugged::Blob.from_buffer(@repo, (1..40).map { |i| "other #{i}\n" }.join)
+
+    index = Rugged::Blob::SignatureIndex.new
+    assert_equal 3, index.add(@repo, [original, edited, unrelated], :threads => 2)
+    assert_equal 0, index.add(@repo, [original])
+    assert_equal 3, index.size
+    assert index.include?(edited)
+
+    results = index.query(@repo.lookup(original), 2)
+    assert_equal [original, edited], results.map(&:first)
+    assert_equal 100, results[0][1]
+    assert_operator results[1][1], :>=, 80
+
+    assert_equal [], index.query("nothing in common\n")
+
+    Tempfile.open("signatures") do |file|
+      index.save(file.path)
+      assert_equal results, Rugged::Blob::SignatureIndex.load(file.path).query(content, 2)
+    end
+
+    assert_raises Rugged::OdbError do
+      index.add(@repo, ["1" * 40])
+    end
+  end
+
+  def test_signature_index_threads_see_alternates
+    alt_path = File.dirname(__FILE__) + '/fixtures/alternate/objects'
+    repo = Rugged::Repository.new(@repo.path, :alternates => [alt_path])
+
+    begin
+      index = Rugged::Blob::SignatureIndex.new
+      oids = ["14fb3108588f9421bf764041e5e3ac305eb6277f", "7771329dfa3002caf8c61a0ceb62a31d09023f37"]
+
+      assert_equal 2, index.add(repo, oids, :threads => 2)
+      assert_equal oids.first, index.query(repo.lookup(oids.first), 1)[0][0]
+    ensure
+      repo.close
+    end
+  end
 end
 
 class BlobDiffTest < Rugged::SandboxedTestCase
@@ -0,0 +1,141 @@
+require "test_helper"
+
+class DiffCacheTest < Rugged::SandboxedTestCase
+  def setup
+    super
+    @repo = sandbox_init("diff")
+    @cache_path = File.join(@_sandbox_path, "diff-cache")
+    @cache = Rugged::DiffCache.new(@cache_path, 64 * 1024)
+
+    @a = @repo.lookup("d70d245ed97ed2aa596dd1af6536e4bfdb047b69")
+    @b = @repo.lookup("7a9e0b02e63179929fed24f0a3e0f19168114d10")
+  end
+
+  def teardown
+    @cache.close
+    super
+  end
+
+  def test_results_match_diff
+    diff = @a.tree.diff(@b.tree, :context_lines => 1)
+
+    assert_equal diff.patch, @cache.patch(@repo, @a, @b, :context_lines => 1)
+    assert_equal diff.stat, @cache.stat(@repo, @a.tree, @b.tree_id, :context_lines => 1)
+    assert_equal diff.numstat, @cache.numstat(@repo, @a.oid, @b)
+    assert_equal diff.each_delta.map(&:status), @cache.deltas(@repo, @a, @b).map { |delta| delta[:status] }
+  end
+
+  def test_hits_do_not_recompute
+    patch = @cache.patch(@repo, @a, @b)
+    assert_equal 1, @cache.size
+
+    result = @cache.fetch(:patch, @repo, @a.tree_id, @b.tree) { flunk "cache miss" }
+    assert_equal patch, result
+
+    # equivalent options share an entry, different ones don't
+    @cache.patch(@repo, @a, @b, :context_lines => 3)
+    assert_equal 1, @cache.size
+    @cache.patch(@repo, @a, @b, :context_lines => 0)
+    assert_equal 2, @cache.size
+  end
+
+  def test_keys_resolve_to_trees
+    @cache.stat(@repo, @a.oid, @b.oid)
+    @cache.stat(@repo, @a, @b.tree_id)
+    @cache.stat(@repo, @a.tree, @b.oid[0, 7])
+    assert_equal 1, @cache.size
+  end
+
+  def test_results_are_stored_as_text
+    stat = @cache.stat(@repo, @a, @b)
+    numstat = @cache.numstat(@repo, @a, @b)
+    deltas = @cache.deltas(@repo, @a, @b)
+
+    key = ["stat", @a.tree_id, @b.tree_id].join("\0") + "\0" + Rugged::DiffCache.options_key({})
+    assert_equal stat.join(" "), @cache[key]
+
+    assert_equal numstat, @cache.numstat(@repo, @a, @b)
+    assert_equal deltas, @cache.deltas(@repo, @a, @b)
+
+    @cache[key] = Marshal.dump(stat)
+    assert_raises(ArgumentError) { @cache.stat(@repo, @a, @b) }
+  end
+
+  def test_budgets_are_part_of_the_key
+    [:max_files, :max_file_bytes, :max_total_lines, :timeout_ms].each do |budget|
+      refute_equal Rugged::DiffCache.options_key({}), Rugged::DiffCache.options_key(budget => 100_000), budget.to_s
+    end
+  end
+
+  def test_truncated_diffs_are_not_stored
+    patch = @cache.patch(@repo, @a, @b, :max_total_lines => 5)
+    assert_equal @a.tree.diff(@b.tree, :max_total_lines => 5).patch, patch
+    assert_equal 0, @cache.size
+
+    @cache.stat(@repo, @a, @b, :max_files => 1)
+    assert_equal 0, @cache.size
+
+    @cache.patch(@repo, @a, @b, :max_total_lines => 100_000)
+    assert_equal 1, @cache.size
+  end
+
+  def test_empty_tree
+    diff = Rugged::Tree.diff(@repo, @a.tree, nil, :reverse => true)
+    assert_equal diff.stat, @cache.stat(@repo, nil, @a)
+  end
+
+  def test_persists_across_reopen
+    patch = @cache.patch(@repo, @a, @b)
+    @cache.close
+
+    @cache = Rugged::DiffCache.new(@cache_path, 64 * 1024)
+    assert_equal patch, @cache.fetch(:patch, @repo, @a, @b) { flunk "cache miss" }
+  end
+
+  def test_bounded_size
+    assert_equal 64 * 1024, @cache.max_size
+
+    100.times { |i| @cache["key #{i}"] = "x" * 1024 }
+    assert @cache.size < 64
+    assert_equal "x" * 1024, @cache["key 99"]
+    assert_nil @cache["key 0"]
+
+    @cache["too big"] = "x" * 65 * 1024
+    assert_nil @cache["too big"]
+
+    assert_equal 64 * 1024 + 64, File.size(@cache_path)
+  end
+
+  def test_shared_between_caches
+    other = Rugged::DiffCache.new(@cache_path, 64 * 1024)
+
+    patch = @cache.patch(@repo, @a, @b)
+    assert_equal patch, other.fetch(:patch, @repo, @a, @b) { flunk "cache miss" }
+
+    other["key"] = "value"
+    assert_equal "value", @cache["key"]
+    assert_equal 2, @cache.size
+
+    other.clear
+    assert_nil @cache["key"]
+    assert_equal 0, @cache.size
+  ensure
+    other.close if other
+  end
+
+  def test_resized_by_another_cache
+    Rugged::DiffCache.new(@cache_path, 128 * 1024).close
+    assert_raises(IOError) { @cache["key"] }
+
+    @cache.close
+    @cache = Rugged::DiffCache.new(@cache_path, 128 * 1024)
+    assert_equal 128 * 1024, @cache.max_size
+  end
+
+  def test_closed
+    @cache.close
+    assert_raises(IOError) { @cache["key"] }
+
+    @cache = Rugged::DiffCache.new(@cache_path, 64 * 1024)
+  end
+end
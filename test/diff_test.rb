@@ -1,4 +1,5 @@
 require "test_helper"
+require "stringio"
 
 class PatchFromStringsTest < Rugged::SandboxedTestCase
   def test_from_strings_no_args
@@ -390,6 +391,97 @@ class TreeToWorkdirDiffTest < Rugged::SandboxedTestCase
       assert_equal expected_lines, patch.lines
     end
   end
+
+  def test_each_patch_with_threads
+    repo = sandbox_init("status")
+    index = repo.index
+
+    a = Rugged::Commit.lookup(repo, "26a125ee1bf").tree
+
+    diff  = a.diff(index, :include_ignored => true, :include_untracked => true)
+    diff2 = index.diff(:include_ignored => true, :include_untracked => true)
+    diff.merge!(diff2)
+
+    expected = diff.each_patch.map(&:to_s)
+
+    assert_equal expected, diff.each_patch(:threads => 4).map(&:to_s)
+    assert_equal expected, diff.each_patch(:threads => 3, :window => 1).map(&:to_s)
+
+    yielded = []
+    diff.each_patch(:threads => 4, :window => 2) do |patch|
+      yielded << patch.to_s
+      break if yielded.size == 3
+    end
+    assert_equal expected.first(3), yielded
+
+    assert_raises(RuntimeError) { diff.each_patch(:threads => 2) { raise "stop" } }
+    assert_equal expected, diff.each_patch(:threads => 2).map(&:to_s)
+
+    assert_raises(ArgumentError) { diff.each_patch(:threads => 0) { } }
+  end
+
+  def test_each_patch_with_threads_between_trees
+    repo = sandbox_init("diff")
+    a = repo.lookup("d70d245ed97ed2aa596dd1af6536e4bfdb047b69").tree
+    b = repo.lookup("7a9e0b02e63179929fed24f0a3e0f19168114d10").tree
+
+    [a.diff(b, :context_lines => 1), b.diff(a, :reverse => true), a.diff(b, :paths => ["readme.txt"])].each do |diff|
+      expected = diff.each_patch.map(&:to_s)
+      assert_equal expected, diff.each_patch(:threads => 2).map(&:to_s)
+      assert_equal expected, diff.each_patch(:threads => 4, :window => 1).map(&:to_s)
+    end
+  end
+
+  def test_deltas_are_snapshots
+    repo = sandbox_init("status")
+    index = repo.index
+
+    a = Rugged::Commit.lookup(repo, "26a125ee1bf").tree
+    diff = a.diff(index, :include_ignored => true, :include_untracked => true)
+
+    deltas = diff.deltas
+    assert_nil deltas.first.instance_variable_get(:@old_file)
+    assert_equal diff.patches.map { |patch| patch.delta.new_file[:path] }, deltas.map { |delta| delta.new_file[:path] }
+    assert_same deltas.first.old_file, deltas.first.old_file
+
+    old = deltas.last
+    status, path = old.status, old.new_file[:path]
+    diff.merge!(index.diff(:include_ignored => true, :include_untracked => true))
+    diff.find_similar!
+    assert_equal [status, path], [old.status, old.new_file[:path]]
+    assert_same diff, old.diff
+  end
+
+  def test_delta_keeps_its_diff_alive
+    repo = sandbox_init("status")
+
+    delta = Rugged::Commit.lookup(repo, "26a125ee1bf").tree.diff(repo.index).deltas.first
+    GC.start
+    assert_kind_of String, delta.old_file[:path]
+    assert_kind_of Rugged::Diff, delta.diff
+  end
+
+  def test_numstat
+    repo = sandbox_init("status")
+    index = repo.index
+
+    a = Rugged::Commit.lookup(repo, "26a125ee1bf").tree
+
+    diff  = a.diff(index, :include_ignored => true, :include_untracked => true)
+    diff2 = index.diff(:include_ignored => true, :include_untracked => true)
+    diff.merge!(diff2)
+
+    expected = diff.each_patch.reject { |patch|
+      [:unmodified, :ignored, :untracked].include? patch.delta.status
+    }.map { |patch|
+      [patch.delta.new_file[:path], *patch.stat]
+    }
+
+    numstat = diff.numstat
+    assert_equal 11, numstat.size
+    assert_equal expected, numstat
+    assert_equal [8, 5], [numstat.map { |_, adds, _| adds }.inject(:+), numstat.map { |_, _, dels| dels }.inject(:+)]
+  end
 end
 
 class TreeToTreeDiffTest < Rugged::SandboxedTestCase
@@ -443,6 +535,33 @@ class TreeToTreeDiffTest < Rugged::SandboxedTestCase
     assert_equal((7 + 14), lines.select(&:deletion?).size)
   end
 
+  def test_diff_without_gvl
+    skip "libgit2 was built without thread support" unless Rugged.features.include?(:threads)
+
+    path = sandbox_init("attr").path
+
+    Rugged::Settings['release_gvl'] = true
+
+    # Repository handles must not be shared between threads
+    stats = 4.times.map do
+      Thread.new do
+        repo = Rugged::Repository.new(path)
+        a = Rugged::Commit.lookup(repo, "605812a").tree
+        b = Rugged::Commit.lookup(repo, "370fe9ec22").tree
+
+        begin
+          Rugged::Tree.diff(repo, a, b, :context_lines => 1, :interhunk_lines => 1).stat
+        ensure
+          repo.close
+        end
+      end
+    end.map(&:value)
+
+    assert_equal [[5, 35, 8]], stats.uniq
+  ensure
+    Rugged::Settings['release_gvl'] = false
+  end
+
   def test_diff_with_empty_tree
     repo = sandbox_init("attr")
     a = Rugged::Commit.lookup(repo, "605812a").tree
@@ -1122,6 +1241,203 @@ M\treadme.txt
 EOS
   end
 
+  def test_patch_max_bytes
+    repo = sandbox_init("diff")
+
+    a = repo.lookup("d70d245ed97ed2aa596dd1af6536e4bfdb047b69")
+    b = repo.lookup("7a9e0b02e63179929fed24f0a3e0f19168114d10")
+
+    diff = a.tree.diff(b.tree)
+    patch = diff.patch
+
+    preview = diff.patch(:max_bytes => 100)
+    assert_operator preview.bytesize, :<=, 100
+    assert preview.end_with?("\n")
+    assert patch.start_with?(preview)
+
+    assert_equal patch, diff.patch(:max_bytes => patch.bytesize)
+
+    assert_raises ArgumentError do
+      diff.patch(:max_bytes => 0)
+    end
+  end
+
+  def test_find_similar_with_signature_cache
+    repo = sandbox_init("diff")
+    content = (1..50).map { |i| "line #{i}\n" }.join
+
+    trees = [["old.txt", content], ["new.txt", content.sub("line 7\n", "line seven\n")]].map do |path, data|
+      index = Rugged::Index.new
+      index.add(:path => path, :oid => repo.write(data, :blob), :mode => 0100644)
+      repo.lookup(index.write_tree(repo))
+    end
+
+    cache = Rugged::Diff::SignatureCache.new
+
+    2.times do
+      diff = trees[0].diff(trees[1])
+      diff.find_similar!(:renames => true, :signature_cache => cache)
+
+      assert_equal 1, diff.size
+      delta = diff.each_delta.first
+      assert_equal :renamed, delta.status
+      assert_equal "old.txt", delta.old_file[:path]
+      assert_equal "new.txt", delta.new_file[:path]
+      assert_operator delta.similarity, :>=, 90
+    end
+
+    assert_equal 2, cache.size
+
+    Tempfile.open("signatures") do |file|
+      cache.save(file.path)
+      assert_equal 2, Rugged::Diff::SignatureCache.load(file.path).size
+    end
+  end
+
+  def test_find_similar_with_minhash_bands
+    repo = sandbox_init("diff")
+    content = (1..50).map { |i| "line #{i}\n" }.join
+
+    trees = [
+      { "old.txt" => content, "gone.txt" => (1..50).map { |i| "gone #{i}\n" }.join },
+      { "new.txt" => content.sub("line 7\n", "line seven\n"), "fresh.txt" => (1..50).map { |i| "fresh #{i}\n" }.join }
+    ].map do |files|
+      index = Rugged::Index.new
+      files.each { |path, data| index.add(:path => path, :oid => repo.write(data, :blob), :mode => 0100644) }
+      repo.lookup(index.write_tree(repo))
+    end
+
+    diff = trees[0].diff(trees[1])
+    diff.find_similar!(:renames => true, :minhash => true, :rename_threshold => 80,
+      :rename_from_rewrite_threshold => 80, :copy_threshold => 80, :break_rewrite_threshold => 80)
+
+    statuses = Hash[diff.each_delta.map { |delta| [delta.new_file[:path], delta.status] }]
+    assert_equal({ "fresh.txt" => :added, "gone.txt" => :deleted, "new.txt" => :renamed }, statuses)
+  end
+
+  def test_diff_budgets
+    repo = sandbox_init("diff")
+
+    a = repo.lookup("d70d245ed97ed2aa596dd1af6536e4bfdb047b69")
+    b = repo.lookup("7a9e0b02e63179929fed24f0a3e0f19168114d10")
+
+    full = a.tree.diff(b.tree)
+    paths = full.deltas.map { |delta| delta.new_file[:path] }
+    refute full.truncated?
+    assert_empty full.skipped_deltas
+
+    diff = a.tree.diff(b.tree, :max_files => 1)
+    assert diff.truncated?
+    assert_equal 1, diff.size
+    assert_equal paths.drop(1), diff.skipped_deltas.map { |delta| delta.new_file[:path] }
+
+    diff = a.tree.diff(b.tree, :max_total_lines => 5)
+    refute diff.truncated?
+    assert_equal ["another.txt"], diff.each_patch.map { |patch| patch.delta.new_file[:path] }
+    assert diff.truncated?
+    assert_empty diff.skipped_deltas
+    assert_equal paths.drop(1), diff.truncated_deltas.map { |delta| delta.new_file[:path] }
+
+    diff = a.tree.diff(b.tree, :max_total_lines => 5)
+    assert_equal ["another.txt"], diff.each_patch(:threads => 2).map { |patch| patch.delta.new_file[:path] }
+    assert diff.truncated?
+    assert_equal paths.drop(1), diff.truncated_deltas.map { |delta| delta.new_file[:path] }
+
+    diff = a.tree.diff(b.tree, :max_total_lines => 5)
+    assert_equal 5, diff.patch.lines.grep(/\A[+-][^+-]/).size
+    assert diff.truncated?
+    assert_equal paths, diff.truncated_deltas.map { |delta| delta.new_file[:path] }
+
+    diff = a.tree.diff(b.tree, :max_total_lines => 100_000)
+    diff.patch
+    assert_empty diff.truncated_deltas
+
+    assert_raises ArgumentError do
+      a.tree.diff(b.tree, :max_files => 0)
+    end
+
+    assert_raises ArgumentError do
+      a.tree.diff(b.tree, :max_size => 1024, :max_file_bytes => 1024)
+    end
+  end
+
+  def test_timeout_budget_applies_to_each_patch
+    repo = sandbox_init("diff")
+
+    a = repo.lookup("d70d245ed97ed2aa596dd1af6536e4bfdb047b69")
+    b = repo.lookup("7a9e0b02e63179929fed24f0a3e0f19168114d10")
+
+    diff = a.tree.diff(b.tree, :timeout_ms => 50)
+    refute diff.truncated?
+
+    assert_equal 1, diff.each_patch.map { sleep 0.1 }.size
+    assert diff.truncated?
+    assert_equal diff.size - 1, diff.truncated_deltas.size
+
+    assert_equal diff.size, diff.each_patch.count
+    assert_empty diff.truncated_deltas
+  end
+
+  def test_write_patch
+    repo = sandbox_init("diff")
+
+    a = repo.lookup("d70d245ed97ed2aa596dd1af6536e4bfdb047b69")
+    b = repo.lookup("7a9e0b02e63179929fed24f0a3e0f19168114d10")
+
+    diff = a.tree.diff(b.tree)
+    patch = diff.patch
+
+    io = StringIO.new("".force_encoding("binary"))
+    assert_equal patch.bytesize, diff.write_patch(io)
+    assert_equal patch, io.string
+
+    io = StringIO.new("".force_encoding("binary"))
+    written = diff.write_patch(io, :max_bytes => 100)
+    assert_equal diff.patch(:max_bytes => 100), io.string
+    assert_equal io.string.bytesize, written
+
+    Tempfile.open("patch") do |file|
+      file.binmode
+      diff.write_patch(file)
+      file.flush
+
+      assert_equal patch, File.binread(file.path)
+    end
+  end
+
+  def test_write_patch_to_file_descriptors
+    repo = sandbox_init("diff")
+
+    trees = ["old", "new"].map do |version|
+      builder = Rugged::Tree::Builder.new(repo)
+      content = (1..40_000).map { |i| "#{version} line #{i}\n" }.join
+      builder << { :type => :blob, :name => "big", :oid => repo.write(content, :blob), :filemode => 0100644 }
+      repo.lookup(builder.write)
+    end
+
+    diff = trees[0].diff(trees[1])
+    patch = diff.patch
+
+    Dir.mktmpdir do |dir|
+      path = File.join(dir, "patch")
+      File.open(path, "wb") { |file| assert_equal patch.bytesize, diff.write_patch(file) }
+      assert_equal patch, File.binread(path)
+    end
+
+    # Larger than the pipe buffer, so the write has to wait for the reader
+    reader, writer = IO.pipe
+    writer.binmode
+    thread = Thread.new { reader.binmode.read }
+
+    assert_equal patch.bytesize, diff.write_patch(writer)
+    writer.close
+
+    assert_equal patch, thread.value
+  ensure
+    reader.close if reader && !reader.closed?
+    writer.close if writer && !writer.closed?
+  end
+
   def test_stats
     repo = sandbox_init("diff")
 
@@ -85,6 +85,39 @@ class IndexTest < Rugged::TestCase
     assert_equal "README:new.txt", itr_test
   end
 
+  def test_iterate_entries_with_raw_oids
+    raw_oids = @index.each(:oid_format => :raw).map { |e| e[:oid] }
+    assert_equal @index.map { |e| e[:oid] }, raw_oids.map { |oid| Rugged.raw_to_hex(oid) }
+  end
+
+  def test_each_entry
+    entries = @index.each_entry.to_a
+    assert_equal @index.count, entries.size
+
+    @index.each.zip(entries) do |hash, entry|
+      assert_instance_of Rugged::Index::Entry, entry
+      assert_equal hash, entry.to_h
+      assert_equal hash[:path], entry.path
+      assert_equal hash[:oid], entry[:oid]
+      assert_equal hash[:mtime], entry.mtime
+      assert_equal hash[:valid], entry.valid?
+      assert entry.path.frozen?
+    end
+  end
+
+  def test_each_entry_with_fields
+    expected = @index.map { |e| [e[:path], e[:oid], e[:mode]] }
+    actual = []
+    @index.each_entry(fields: [:path, :oid, :mode]) { |*values| actual << values }
+    assert_equal expected, actual
+
+    assert_equal @index.map { |e| e[:path] }, @index.each_entry(fields: [:path]).to_a
+    assert_equal @index.map { |e| Rugged.hex_to_raw(e[:oid]) },
+      @index.each_entry(fields: [:oid], oid_format: :raw).to_a
+
+    assert_raises(ArgumentError) { @index.each_entry(fields: [:nope]) { } }
+  end
+
   def test_update_entries
     now = Time.at Time.now.to_i
     e = @index[0]
@@ -113,6 +146,49 @@ class IndexTest < Rugged::TestCase
     itr_test = @index.sort { |a, b| a[:oid] <=> b[:oid] }.map { |x| x[:path] }.join(':')
     assert_equal "README:new_path:new.txt", itr_test
   end
+
+  def test_add_entries
+    oid = "d385f264afb75a95ec3b6b2d3e5dd7b9c3d5e1a8"
+    @index.add_entries([
+      ["new_path", oid, 0100644],
+      ["bin/run", oid, 0100755],
+      ["new_path", "a8233120f6ad708f843d861ce2b7228ec4e3dec6", 0100644]
+    ])
+
+    assert_equal %w[README bin/run new.txt new_path], @index.map { |e| e[:path] }
+    assert_equal "a8233120f6ad708f843d861ce2b7228ec4e3dec6", @index["new_path"][:oid]
+    assert_equal 0100755, @index["bin/run"][:mode]
+    assert_equal 0, @index["bin/run"][:file_size]
+
+    assert_raises(ArgumentError) { @index.add_entries([["other", oid, 0100600]]) }
+    assert_raises(ArgumentError) { @index.add_entries([["other", oid]]) }
+    assert_nil @index["other"]
+  end
+
+  def test_add_entries_checks_every_entry_first
+    oid = "d385f264afb75a95ec3b6b2d3e5dd7b9c3d5e1a8"
+    paths = @index.map { |e| e[:path] }
+
+    [".git/config", "../other", "/other", "a//b", "a/./b", "a/"].each do |path|
+      assert_raises(ArgumentError, path) { @index.add_entries([["other", oid, 0100644], [path, oid, 0100644]]) }
+    end
+
+    assert_raises(Rugged::IndexError) { @index.add_entries([["other", oid, 0100644], ["README/file", oid, 0100644]]) }
+    assert_raises(Rugged::IndexError) { @index.add_entries([["other", oid, 0100644], ["dir", oid, 0100644], ["dir/file", oid, 0100644]]) }
+    assert_raises(Rugged::IndexError) { @index.apply_changes([["other", oid, 0100644], ["README/file", oid, 0100644]], ["new.txt"]) }
+    assert_equal paths, @index.map { |e| e[:path] }
+
+    @index.apply_changes([["README/file", oid, 0100644]], ["README"])
+    assert_equal %w[README/file new.txt new_path], @index.map { |e| e[:path] }
+  end
+
+  def test_apply_changes
+    oid = "d385f264afb75a95ec3b6b2d3e5dd7b9c3d5e1a8"
+    @index.apply_changes([["README", oid, 0100644], ["sub/file", oid, 0100644]], ["new.txt", "missing"], skip_stat: true)
+
+    assert_equal %w[README sub/file], @index.map { |e| e[:path] }
+    assert_equal oid, @index["README"][:oid]
+  end
 end
 
 class IndexWriteTest < Rugged::TestCase
@@ -197,6 +273,24 @@ class IndexWorkdirTest < Rugged::TestCase
     e = @index.get 'new_path', 3
     assert_equal e[:mode], 33188
   end
+
+  def test_add_entries_with_stat
+    File.open(File.join(@tmppath, 'test.txt'), 'w') { |f| f.write "test content" }
+    oid = Rugged::Repository.hash_data("test content", :blob)
+    other = Rugged::Repository.hash_data("other content", :blob)
+
+    @index.add_entries([["test.txt", oid, 0100644]])
+    assert_equal 0, @index["test.txt"][:file_size]
+
+    @index.add_entries([["test.txt", other, 0100644]], skip_stat: false)
+    assert_equal 0, @index["test.txt"][:file_size]
+    assert_equal other, @index["test.txt"][:oid]
+
+    @index.add_entries([["test.txt", oid, 0100644], ["missing.txt", oid, 0100644]], skip_stat: false)
+    assert_equal 12, @index["test.txt"][:file_size]
+    assert_equal File.stat(File.join(@tmppath, 'test.txt')).ino & 0xffffffff, @index["test.txt"][:ino]
+    assert_equal 0, @index["missing.txt"][:file_size]
+  end
 end
 
 class IndexConflictsTest < Rugged::SandboxedTestCase
@@ -386,6 +480,36 @@ class IndexAddAllTest < Rugged::SandboxedTestCase
     end
   end
 
+  def test_add_all_with_file_monitor
+    monitor = ScriptedMonitor.new
+    monitor.changes = []
+    @repo.file_monitor = monitor
+
+    index = @repo.index
+    index.add_all
+
+    assert index["file.bar"]
+    assert index["other.zzz"]
+
+    Dir.chdir(@repo.workdir) do
+      File.open("unseen.zzz", "w") { |f| f.write "not reported" }
+      File.open("seen.zzz", "w") { |f| f.write "reported" }
+      File.open("file.bar", "w") { |f| f.write "changed" }
+    end
+
+    monitor.changes = ["seen.zzz", "file.bar"]
+    index.add_all
+
+    assert index["seen.zzz"]
+    refute index["unseen.zzz"]
+    assert_equal Rugged::Repository.hash_data("changed", :blob), index["file.bar"][:oid]
+
+    @repo.file_monitor = nil
+    index.add_all
+
+    assert index["unseen.zzz"]
+  end
+
   def test_add_all_dry_run
     Dir.chdir(@repo.workdir) do
       yielded = []
@@ -39,6 +39,19 @@ class RuggedTest < Rugged::TestCase
     end
   end
 
+  def test_release_gvl_option
+    skip "libgit2 was built without thread support" unless Rugged.features.include?(:threads)
+
+    assert_equal false, Rugged::Settings['release_gvl']
+
+    Rugged::Settings['release_gvl'] = true
+    assert_equal true, Rugged::Settings['release_gvl']
+
+    assert_raises(TypeError) { Rugged::Settings['release_gvl'] = 'yes' }
+  ensure
+    Rugged::Settings['release_gvl'] = false
+  end
+
   def test_features
     features = Rugged.features
     assert features.is_a? Array
@@ -55,6 +68,19 @@ class RuggedTest < Rugged::TestCase
     assert_equal raw1, raw2
   end
 
+  def test_raw_oid
+    hex = "ce08fe4884650f067bd5703b6a59a8b3b3c99a09"
+    raw = Rugged::hex_to_raw(hex)
+
+    assert_instance_of Rugged::Oid, raw
+    assert raw.frozen?
+    assert_equal hex, raw.to_hex
+    assert_equal raw, Rugged::Oid.new([hex].pack("H*"))
+    assert Rugged::Oid.new(raw).frozen?
+
+    assert_raises(TypeError) { Rugged::Oid.new(hex) }
+  end
+
   def test_raw_to_hex
     raw = Base64.decode64("FqASNFZ4mrze9Ld1ITwjqL109eA=")
     hex = Rugged::raw_to_hex(raw)
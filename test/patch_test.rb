@@ -52,4 +52,57 @@ index 7b808f7..29ab705 100644
 \\ No newline at end of file
 EOS
   end
+
+  def test_lines_columnar
+    repo = sandbox_init("diff")
+
+    a = repo.lookup("d70d245ed97ed2aa596dd1af6536e4bfdb047b69")
+    b = repo.lookup("7a9e0b02e63179929fed24f0a3e0f19168114d10")
+
+    diff = a.tree.diff(b.tree, :context_lines => 0)
+    patch = diff.patches[1]
+    lines = patch.hunks.map(&:lines).flatten
+
+    table = patch.lines_columnar
+    assert_equal 12, table.size
+    assert_equal 4, table.hunk_count
+    assert_equal [0, 2, 6, 9, 12], table.hunk_offsets.unpack("L*")
+    assert_equal "-+--------+", table.origins[0, 11]
+
+    assert_equal lines.map(&:line_origin), table.map(&:line_origin)
+    assert_equal lines.map(&:content), table.size.times.map { |i| table.line_content(i) }
+    assert_equal lines.map(&:old_lineno), table.old_linenos.unpack("l*")
+    assert_equal lines.map(&:new_lineno), table.new_linenos.unpack("l*")
+    assert_equal lines.map(&:content_offset), table.map(&:content_offset)
+    assert_equal lines.map { |line| line.content_offset || -1 }, table.file_offsets.unpack("q*")
+
+    hunk_table = patch.hunks[3].line_table
+    assert_equal 1, hunk_table.hunk_count
+    assert_equal patch.hunks[3].lines.map(&:content), hunk_table.map(&:content)
+    assert_equal table.content.byteslice(table.content_offsets.unpack("L*")[9]..-1), hunk_table.content
+  end
+
+  def test_hunk_intraline_changes
+    repo = sandbox_init("diff")
+
+    a = repo.lookup("d70d245ed97ed2aa596dd1af6536e4bfdb047b69")
+    b = repo.lookup("7a9e0b02e63179929fed24f0a3e0f19168114d10")
+
+    diff = a.tree.diff(b.tree, :context_lines => 0)
+    hunks = diff.patches[0].hunks
+
+    assert_equal [{
+      :old_line => 0, :new_line => 1, :old_ranges => [3...4], :new_ranges => [3...5]
+    }], hunks[0].intraline_changes
+    assert_equal [], hunks[1].intraline_changes
+
+    patch = Rugged::Patch.from_strings("foo(bar, baz)\nx = 1\n", "foo(bar, qux)\ny = 1\nextra\n")
+    lines = patch.hunks[0].lines
+    changes = patch.hunks[0].intraline_changes
+
+    assert_equal 2, changes.size
+    assert_equal "baz", lines[changes[0][:old_line]].content.byteslice(changes[0][:old_ranges][0])
+    assert_equal "qux", lines[changes[0][:new_line]].content.byteslice(changes[0][:new_ranges][0])
+    assert_equal [[0...1], [0...1]], changes[1].values_at(:old_ranges, :new_ranges)
+  end
 end
@@ -61,6 +61,29 @@ class RepositoryTest < Rugged::SandboxedTestCase
     end
   end
 
+  def test_can_read_many_raw_objects
+    rawobjs = @repo.read_many(["8496071c1b46c854b31185ea97743be6a8774479", "1385f264af"])
+    assert_equal 2, rawobjs.size
+
+    assert_equal :commit, rawobjs[0].type
+    assert_equal 172, rawobjs[0].len
+
+    assert_equal :blob, rawobjs[1].type
+    assert_equal "1385f264afb75a56a5bec74243be9b367ba4ca08", rawobjs[1].oid
+
+    assert_equal [], @repo.read_many([])
+  end
+
+  def test_read_many_fails_on_missing_objects
+    assert_raises Rugged::OdbError do
+      @repo.read_many(["8496071c1b46c854b31185ea97743be6a8774479", "a496071c1b46c854b31185ea97743be6a8774471"])
+    end
+
+    assert_raises TypeError do
+      @repo.read_many([:foo])
+    end
+  end
+
   def test_walking_with_block
     oid = "a4a7dce85cf63874e984719f4fdd239f5145052f"
     list = []
@@ -80,6 +103,20 @@ class RepositoryTest < Rugged::SandboxedTestCase
     assert object.kind_of?(Rugged::Commit)
   end
 
+  def test_lookup_many_objects
+    objects = @repo.lookup_many(["8496071c1b46c854b31185ea97743be6a8774479", "1385f264af", "181037049a54"])
+
+    assert_equal [Rugged::Commit, Rugged::Blob, Rugged::Tree], objects.map(&:class)
+    assert_equal "1385f264afb75a56a5bec74243be9b367ba4ca08", objects[1].oid
+    assert_equal objects[2].oid, objects[0].tree_id
+  end
+
+  def test_lookup_many_fails_on_missing_objects
+    assert_raises Rugged::OdbError do
+      @repo.lookup_many(["a496071c1b46c854b31185ea97743be6a8774471"])
+    end
+  end
+
   def test_find_reference
     ref = @repo.ref('refs/heads/master')
 
@@ -152,6 +189,37 @@ class RepositoryTest < Rugged::SandboxedTestCase
     assert_equal 1687, @repo.each_id.count
   end
 
+  def test_enumerate_all_objects_as_raw_oids
+    raw_oids = @repo.each_id(:oid_format => :raw).to_a
+
+    assert_equal 1687, raw_oids.size
+    assert raw_oids.all? { |oid| oid.bytesize == 20 }
+    assert @repo.exists?(raw_oids.first)
+    assert_equal Rugged.raw_to_hex(raw_oids.first), @repo.read(raw_oids.first).oid
+  end
+
+  def test_accepts_raw_oids
+    raw = Rugged.hex_to_raw("8496071c1b46c854b31185ea97743be6a8774479")
+
+    assert_equal "8496071c1b46c854b31185ea97743be6a8774479", @repo.lookup(raw).oid
+    assert @repo.descendant_of?(
+      Rugged.hex_to_raw("a65fedf39aefe402d3bb6e24df4d4f5fe4547750"),
+      Rugged.hex_to_raw("be3563ae3f795b2b4353bcce3a527ad0a4f7f644"))
+  end
+
+  def test_binary_revspecs_are_not_raw_oids
+    revspec = "refs/heads/master^{}".b
+    assert_equal 20, revspec.bytesize
+
+    assert_equal @repo.lookup("refs/heads/master^{}").oid, @repo.lookup(revspec).oid
+    assert @repo.descendant_of?(revspec, "8496071c1b46c854b31185ea97743be6a8774479")
+
+    # only a Rugged::Oid is taken as a raw OID
+    raw = Rugged.hex_to_raw("8496071c1b46c854b31185ea97743be6a8774479")
+    assert_raises(Rugged::Error) { @repo.lookup(raw.b) }
+    assert_equal "8496071c1b46c854b31185ea97743be6a8774479", @repo.lookup(Rugged::Oid.new(raw.b)).oid
+  end
+
   def test_loading_alternates
     alt_path = File.dirname(__FILE__) + '/fixtures/alternate/objects'
     repo = Rugged::Repository.new(@repo.path, :alternates => [alt_path])
@@ -254,6 +322,120 @@ class RepositoryTest < Rugged::SandboxedTestCase
     assert_equal 2, behind
   end
 
+  def test_commit_graph
+    assert_nil @repo.commit_graph
+
+    path = @repo.write_commit_graph
+    assert_equal File.join(@repo.path, "objects", "info", "commit-graph"), path
+
+    graph = @repo.commit_graph
+    assert_kind_of Rugged::CommitGraph, graph
+    assert_operator graph.size, :>=, @repo.walk("a65fedf39aefe402d3bb6e24df4d4f5fe4547750").count
+
+    assert graph.include?("a65fedf39aefe402d3bb6e24df4d4f5fe4547750")
+    assert graph.include?(Rugged.hex_to_raw("a65fedf39aefe402d3bb6e24df4d4f5fe4547750"))
+    refute graph.include?("deadbeef" * 5)
+
+    assert_equal 1, graph.generation("8496071c1b46c854b31185ea97743be6a8774479")
+    assert_equal 2, graph.generation("5b5b025afb0b4c913b4c338a42934a3863bf3644")
+    assert_nil graph.generation("deadbeef" * 5)
+  end
+
+  def test_ancestry_with_commit_graph
+    one = 'a4a7dce85cf63874e984719f4fdd239f5145052f'
+    two = 'a65fedf39aefe402d3bb6e24df4d4f5fe4547750'
+    ancestor = 'be3563ae3f795b2b4353bcce3a527ad0a4f7f644'
+
+    # make sure both sides are reachable from a reference
+    @repo.references.create("refs/heads/graph-one", one)
+    @repo.references.create("refs/heads/graph-two", two)
+
+    expected = [
+      @repo.merge_base(one, two), @repo.merge_bases(one, two), @repo.ahead_behind(one, two),
+      @repo.descendant_of?(two, ancestor), @repo.descendant_of?(ancestor, two), @repo.descendant_of?(two, two)
+    ]
+
+    @repo.write_commit_graph
+    assert @repo.commit_graph.include?(one)
+
+    assert_equal expected, [
+      @repo.merge_base(one, two), @repo.merge_bases(one, two), @repo.ahead_behind(one, two),
+      @repo.descendant_of?(two, ancestor), @repo.descendant_of?(ancestor, two), @repo.descendant_of?(two, two)
+    ]
+
+    assert_equal "c47800c7266a2be04c571c04d5a6614691ea99bd", @repo.merge_base(one, two)
+    assert_equal [0, 0], @repo.ahead_behind(one, one)
+  end
+
+  def test_commit_graph_falls_back_for_new_commits
+    two = 'a65fedf39aefe402d3bb6e24df4d4f5fe4547750'
+    @repo.write_commit_graph
+
+    parent = @repo.lookup('a4a7dce85cf63874e984719f4fdd239f5145052f')
+    oid = Rugged::Commit.create(@repo,
+      :message => "not in the graph\n",
+      :author => { :email => "rugged@example.com", :time => Time.now, :name => "Rugged" },
+      :parents => [parent],
+      :tree => parent.tree)
+
+    refute @repo.commit_graph.include?(oid)
+    assert_equal [2, 2], @repo.ahead_behind(oid, two)
+    assert @repo.descendant_of?(oid, parent)
+  end
+
+  def test_ahead_behind_many
+    base = 'a65fedf39aefe402d3bb6e24df4d4f5fe4547750'
+    targets = [
+      'a4a7dce85cf63874e984719f4fdd239f5145052f', 'be3563ae3f795b2b4353bcce3a527ad0a4f7f644',
+      "refs/heads/master", @repo.lookup('c47800c7266a2be04c571c04d5a6614691ea99bd')
+    ]
+
+    expected = Hash[targets.map { |target| [target, @repo.ahead_behind(target, base)] }]
+    assert_equal [1, 2], expected['a4a7dce85cf63874e984719f4fdd239f5145052f']
+    assert_equal expected, @repo.ahead_behind_many(base, targets)
+
+    @repo.references.create("refs/heads/graph-one", targets.first)
+    @repo.write_commit_graph
+    assert_equal expected, @repo.ahead_behind_many(base, targets)
+
+    assert_equal({}, @repo.ahead_behind_many(base, []))
+    assert_raises(Rugged::ReferenceError) { @repo.ahead_behind_many(base, ["refs/heads/nope"]) }
+  end
+
+  def test_ahead_behind_many_against_every_commit
+    base = 'a65fedf39aefe402d3bb6e24df4d4f5fe4547750'
+    walker = Rugged::Walker.new(@repo)
+    @repo.branches.each { |branch| walker.push(branch.target_id) }
+    targets = walker.map(&:oid)
+
+    expected = Hash[targets.map { |target| [target, @repo.ahead_behind(target, base)] }]
+    assert_equal expected, @repo.ahead_behind_many(base, targets)
+  end
+
+  def test_commit_stats
+    commits = @repo.walk('a65fedf39aefe402d3bb6e24df4d4f5fe4547750').to_a
+    assert commits.last.parents.empty?
+
+    expected = Hash[commits.map { |commit|
+      [commit.oid, Rugged::Tree.diff(@repo, commit.parents.first && commit.parents.first.tree, commit.tree).stat]
+    }]
+
+    assert_equal expected, @repo.commit_stats(commits.map(&:oid))
+    assert_equal expected[commits.last.oid], @repo.commit_stats([commits.last.oid])[commits.last.oid]
+    assert_equal({ "master" => expected[commits.first.oid] }, @repo.commit_stats(["master"]))
+
+    assert_equal({}, @repo.commit_stats([]))
+    assert_raises(Rugged::ReferenceError) { @repo.commit_stats(["master", "refs/heads/nope"]) }
+  end
+
+  def test_commit_stats_with_max_size
+    root = @repo.walk('a65fedf39aefe402d3bb6e24df4d4f5fe4547750').to_a.last
+    expected = Rugged::Tree.diff(@repo, nil, root.tree, :max_size => 1).stat
+
+    assert_equal 0, expected[1]
+    assert_equal({ root.oid => expected }, @repo.commit_stats([root.oid], :max_size => 1))
+  end
+
   def test_expand_objects
     expected = {
       'a4a7dce8' => 'a4a7dce85cf63874e984719f4fdd239f5145052f',
@@ -51,6 +51,175 @@ class LibgitRepositoryStatusTest < Rugged::SandboxedTestCase
     end
   end
 
+  def test_status_table
+    [1, 4].each do |threads|
+      table = @repo.status_table(threads: threads, untracked: :all, ignored: true)
+
+      assert_equal STATUSES.size, table.size
+      assert_equal STATUSES, Hash[table.to_a]
+      assert_equal STATUSES.keys.sort, table.map(&:first)
+    end
+
+    expected = STATUSES.map { |file, status| [file, status - [:worktree_new, :ignored]] }
+    assert_equal Hash[expected.reject { |_, status| status.empty? }], Hash[@repo.status_table(untracked: :no).to_a]
+  end
+
+  def test_status_with_file_monitor
+    monitor = ScriptedMonitor.new
+    monitor.changes = []
+    @repo.file_monitor = monitor
+
+    statuses = {}
+    @repo.status { |file, status| statuses[file] = status }
+    assert_equal STATUSES, statuses
+
+    File.open(File.join(@repo.workdir, "another_new_file"), "w") { |f| f.write "new" }
+    File.open(File.join(@repo.workdir, "unreported_file"), "w") { |f| f.write "new" }
+    File.unlink(File.join(@repo.workdir, "subdir", "new_file"))
+    monitor.changes = ["another_new_file", "subdir/new_file"]
+
+    statuses = {}
+    @repo.status { |file, status| statuses[file] = status }
+
+    expected = STATUSES.merge("another_new_file" => [:worktree_new])
+    expected.delete("subdir/new_file")
+    assert_equal expected, statuses
+
+    monitor.changes = ["unreported_file", ".git/index"]
+    statuses = {}
+    @repo.status { |file, status| statuses[file] = status }
+    assert_equal expected.merge("unreported_file" => [:worktree_new]), statuses
+  end
+
+  def test_status_with_file_monitor_reporting_nested_paths
+    monitor = ScriptedMonitor.new
+    monitor.changes = []
+    @repo.file_monitor = monitor
+    @repo.status { }
+
+    File.unlink(File.join(@repo.workdir, "subdir", "new_file"))
+    File.write(File.join(@repo.workdir, "subdir", "current_file"), "changed")
+    monitor.changes = ["subdir/current_file", "subdir", "subdir/new_file", "subdir"]
+
+    statuses = {}
+    @repo.status { |file, status| statuses[file] = status }
+
+    expected = STATUSES.merge("subdir/current_file" => [:worktree_modified])
+    expected.delete("subdir/new_file")
+    assert_equal expected, statuses
+  end
+
+  def test_file_monitor_forgets_old_changes
+    monitor = ScriptedMonitor.new
+    monitor.changes = []
+    token, _ = monitor.changed_paths(nil)
+
+    monitor.changes = ["a", "b"]
+    newer, paths = monitor.changed_paths(token)
+    assert_equal ["a", "b"], paths.sort
+
+    monitor.changes = Array.new(Rugged::FileMonitor::MAX_CHANGES) { |i| "file#{i}" }
+    latest, paths = monitor.changed_paths(newer)
+    assert_equal Rugged::FileMonitor::MAX_CHANGES, paths.size
+
+    # the changes from before the last poll no longer fit
+    assert_nil monitor.changed_paths(token).last
+    assert_equal [], monitor.changed_paths(latest + 1).last
+  end
+
+  def test_status_and_add_all_with_inotify
+    skip "inotify is only available on Linux" unless defined?(Rugged::FileMonitor::Inotify)
+
+    monitor = Rugged::FileMonitor::Inotify.new(@repo.workdir)
+    @repo.file_monitor = monitor
+
+    statuses = {}
+    @repo.status { |file, status| statuses[file] = status }
+    assert_equal STATUSES, statuses
+
+    index = @repo.index
+    index.add_all
+
+    File.write(File.join(@repo.workdir, "another_new_file"), "new")
+    File.write(File.join(@repo.workdir, "subdir", "current_file"), "changed")
+
+    statuses = {}
+    @repo.status { |file, status| statuses[file] = status }
+    assert_equal STATUSES.merge(
+      "another_new_file" => [:worktree_new],
+      "subdir/current_file" => [:worktree_modified]
+    ), statuses
+
+    index.add_all
+
+    assert_equal Rugged::Repository.hash_data("new", :blob), index["another_new_file"][:oid]
+    assert_equal Rugged::Repository.hash_data("changed", :blob), index["subdir/current_file"][:oid]
+  ensure
+    monitor.close if monitor
+  end
+
+  def test_status_with_untracked_cache
+    @repo.config['core.untrackedCache'] = 'true'
+
+    # listings of directories changed in the last second aren't trusted
+    past = Time.now - 60
+    subdir = File.join(@repo.workdir, "subdir")
+    [@repo.workdir, subdir].each { |dir| File.utime(past, past, dir) }
+
+    statuses = {}
+    @repo.status { |file, status| statuses[file] = status }
+    assert_equal STATUSES, statuses
+
+    @repo.index.write
+    assert File.exist?(File.join(@repo.path, "rugged-untracked-cache"))
+
+    # a file added behind the cache's back stays hidden while the mtime holds
+    File.write(File.join(subdir, "hidden_file"), "new")
+    File.utime(past, past, subdir)
+
+    statuses = {}
+    @repo.status { |file, status| statuses[file] = status }
+    assert_equal STATUSES, statuses
+
+    reopened = Rugged::Repository.new(@repo.workdir)
+    statuses = {}
+    reopened.status { |file, status| statuses[file] = status }
+    assert_equal STATUSES, statuses
+
+    # once the mtime moves, the directory is read again
+    File.utime(past + 1, past + 1, subdir)
+
+    statuses = {}
+    @repo.status { |file, status| statuses[file] = status }
+    assert_equal STATUSES.merge("subdir/hidden_file" => [:worktree_new]), statuses
+  ensure
+    reopened.close if reopened
+  end
+
+  def test_untracked_cache_write_failures_are_not_fatal
+    @repo.config['core.untrackedCache'] = 'true'
+    file = File.join(@repo.path, "rugged-untracked-cache")
+    past = Time.now - 60
+
+    File.utime(past, past, @repo.workdir)
+    @repo.status { }
+    @repo.index.write
+    assert File.exist?(file)
+
+    # a directory in the way of the lock file makes the next save fail
+    Dir.mkdir("#{file}.lock")
+    File.write(File.join(@repo.workdir, "another_file"), "new")
+    File.utime(past + 1, past + 1, @repo.workdir)
+    @repo.status { }
+
+    @repo.index.write
+    refute File.exist?(file)
+
+    Dir.rmdir("#{file}.lock")
+    @repo.index.write
+    assert File.exist?(file)
+  end
+
   def teardown
     @repo.close
     super
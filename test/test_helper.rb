@@ -20,6 +20,15 @@ module Rugged
 
       Encoding.default_internal = old_encoding
     end
+
+    # A file monitor reporting whatever paths the test hands it.
+    class ScriptedMonitor < Rugged::FileMonitor
+      attr_accessor :changes
+
+      def poll
+        changes.tap { self.changes = [] }
+      end
+    end
   end
 
   class SandboxedTestCase < TestCase
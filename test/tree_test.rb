@@ -90,6 +90,81 @@ class TreeTest < Rugged::TestCase
     assert enum.kind_of? Enumerable
   end
 
+  def test_tree_iteration_with_raw_oids
+    entries = @tree.each(:oid_format => :raw).to_a
+
+    assert_equal @tree.map { |e| e[:oid] }, entries.map { |e| Rugged.raw_to_hex(e[:oid]) }
+    assert_equal @tree.get_entry_by_oid(entries.first[:oid]), @tree.first.to_h
+  end
+
+  def test_each_entry
+    entries = @tree.each_entry.to_a
+
+    assert_equal @tree.map { |e| e[:name] }, entries.map(&:name)
+    entries.each_with_index do |entry, i|
+      hash = @tree[i]
+      assert_instance_of Rugged::Tree::Entry, entry
+      assert_equal hash, entry.to_h
+      assert_equal hash[:oid], entry.oid
+      assert_equal hash[:type], entry[:type]
+      assert_equal hash[:filemode], entry.filemode
+      assert entry.name.frozen?
+    end
+
+    raw = @tree.each_entry(:oid_format => :raw).map(&:oid)
+    assert_equal entries.map(&:oid), raw.map { |oid| Rugged.raw_to_hex(oid) }
+
+    builder = Rugged::Tree::Builder.new(@repo)
+    entries.each { |entry| builder << entry }
+    assert_equal @oid, builder.write
+  end
+
+  def test_entry_equality
+    entries = @tree.each.to_a
+    again = @tree.each(:oid_format => :raw).to_a
+
+    assert_equal entries, again
+    assert entries.first.eql?(again.first)
+    assert_equal entries.first.hash, again.first.hash
+    refute_equal entries[0], entries[1]
+    assert_equal 1, { entries.first => true, again.first => true }.size
+
+    assert entries.first == @tree[0]
+    refute entries.first.eql?(@tree[0])
+
+    walked = []
+    @tree.walk(:preorder) { |root, entry| walked << entry if root.empty? }
+    assert_equal entries, walked
+    assert walked.all? { |entry| entry.instance_of?(Rugged::Tree::Entry) }
+  end
+
+  def test_each_path
+    paths = @tree.each_path.to_a
+
+    assert_equal [
+      ["README", "1385f264afb75a56a5bec74243be9b367ba4ca08", 0100644, :blob],
+      ["new.txt", "fa49b077972391ad58037050f2a75f74e3671e92", 0100644, :blob],
+      ["subdir", "619f9935957e010c419cb9d15621916ddfcc0b96", 040000, :tree],
+      ["subdir/README", "1385f264afb75a56a5bec74243be9b367ba4ca08", 0100644, :blob],
+      ["subdir/new.txt", "fa49b077972391ad58037050f2a75f74e3671e92", 0100644, :blob],
+      ["subdir/subdir2", "f60079018b664e4e79329a7ef9559c8d9e0378d1", 040000, :tree],
+      ["subdir/subdir2/README", "1385f264afb75a56a5bec74243be9b367ba4ca08", 0100644, :blob],
+      ["subdir/subdir2/new.txt", "fa49b077972391ad58037050f2a75f74e3671e92", 0100644, :blob],
+    ], paths
+    assert paths.all? { |path, _| path.frozen? }
+  end
+
+  def test_each_path_with_prefix_and_max_depth
+    assert_equal ["subdir/subdir2", "subdir/subdir2/README", "subdir/subdir2/new.txt"],
+      @tree.each_path(:prefix => "subdir/subdir2").map(&:first)
+
+    assert_equal ["subdir/README", "subdir/new.txt"],
+      @tree.each_path(:prefix => "subdir/", :max_depth => 1).select { |_, _, _, type| type == :blob }.map(&:first)
+
+    assert_equal ["README", "new.txt", "subdir"], @tree.each_path(:max_depth => 0).map(&:first)
+    assert_equal [], @tree.each_path(:prefix => "nope").to_a
+  end
+
   def test_tree_walk_only_trees
     @tree.walk_trees {|root, entry| assert_equal :tree, entry[:type]}
   end
@@ -62,6 +62,59 @@ class WalkerTest < Rugged::TestCase
     assert_equal ["5b5b025afb0b4c913b4c338a42934a3863bf3644"], oids
   end
 
+  def test_walk_revlist_as_raw_oids
+    @walker.push("9fd738e8f7967c078dceed8190330fc8648ee56a")
+    oids = @walker.each_oid(:limit => 2, :oid_format => :raw).to_a
+
+    assert_equal ["9fd738e8f7967c078dceed8190330fc8648ee56a", "4a202b346bb0fb0db7eff3cffeb3c70babbd2045"],
+      oids.map { |oid| Rugged.raw_to_hex(oid) }
+    assert_equal Encoding::BINARY, oids.first.encoding
+    assert_equal "9fd738e8f7967c078dceed8190330fc8648ee56a", @repo.lookup(oids.first).oid
+
+    assert_raises(ArgumentError) { @walker.each_oid(:oid_format => :base64).to_a }
+  end
+
+  def test_walk_commit_info
+    @walker.push("9fd738e8f7967c078dceed8190330fc8648ee56a")
+    infos = @walker.each_commit_info(:fields => [:oid, :summary, :author_name, :epoch_time, :parent_ids], :limit => 2).to_a
+
+    assert_equal [
+      ["9fd738e8f7967c078dceed8190330fc8648ee56a", "a fourth commit", "Scott Chacon", 1274721559, ["4a202b346bb0fb0db7eff3cffeb3c70babbd2045"]],
+      ["4a202b346bb0fb0db7eff3cffeb3c70babbd2045", "a third commit", "Scott Chacon", 1274721544, ["5b5b025afb0b4c913b4c338a42934a3863bf3644"]]
+    ], infos
+  end
+
+  def test_walk_commit_info_matches_commit
+    @walker.push("9fd738e8f7967c078dceed8190330fc8648ee56a")
+    fields = [:message, :author, :committer, :author_email, :committer_name, :author_time, :tree_id]
+
+    @walker.each_commit_info(:fields => fields, :offset => 3) do |message, author, committer, email, name, time, tree_id|
+      commit = @repo.lookup("8496071c1b46c854b31185ea97743be6a8774479")
+      assert_equal commit.message, message
+      assert_equal commit.author, author
+      assert_equal commit.committer, committer
+      assert_equal "schacon@gmail.com", email
+      assert_equal "Scott Chacon", name
+      assert_equal 1273360386, time
+      assert_equal "181037049a54a1eb5fab404658a3a250b44335d7", tree_id
+    end
+  end
+
+  def test_walk_commit_info_with_raw_oids
+    @walker.push("9fd738e8f7967c078dceed8190330fc8648ee56a")
+    oid, tree_id = @walker.each_commit_info(:fields => [:oid, :tree_id], :oid_format => :raw).first
+
+    assert_equal "9fd738e8f7967c078dceed8190330fc8648ee56a", Rugged.raw_to_hex(oid)
+    assert_equal "814889a078c031f61ed08ab5fa863aea9314344d", Rugged.raw_to_hex(tree_id)
+  end
+
+  def test_walk_commit_info_with_invalid_fields
+    @walker.push("9fd738e8f7967c078dceed8190330fc8648ee56a")
+    assert_raises(ArgumentError) { @walker.each_commit_info(:fields => [:oid, :nope]) {} }
+    assert_raises(TypeError) { @walker.each_commit_info(:fields => ["oid"]) {} }
+    assert_raises(TypeError) { @walker.each_commit_info({}) {} }
+  end
+
   def test_walk_push_range
     @walker.push_range("HEAD~2..HEAD")
     data = @walker.each.to_a